@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+
+#include <glib.h>
+
+#include "lcm_channel_filter.h"
+
+typedef struct {
+    char *pattern;
+    regex_t preg;
+    int exclude;
+} regex_rule_t;
+
+struct _lcm_channel_filter_t {
+    regex_rule_t *regexes;
+    int num_regexes;
+    GHashTable *included;  // channel name -> GINT_TO_POINTER(1), the named channels
+    GHashTable *excluded;
+    int have_includes;
+
+    GHashTable *matches;   // channel name -> GINT_TO_POINTER(picked + 1), the decisions so far
+};
+
+lcm_channel_filter_t *
+lcm_channel_filter_create(void)
+{
+    lcm_channel_filter_t *filter = calloc(1, sizeof(lcm_channel_filter_t));
+    filter->included = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    filter->excluded = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    filter->matches = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    return filter;
+}
+
+void
+lcm_channel_filter_destroy(lcm_channel_filter_t *filter)
+{
+    for (int i = 0; i < filter->num_regexes; i++) {
+        free(filter->regexes[i].pattern);
+        regfree(&filter->regexes[i].preg);
+    }
+    free(filter->regexes);
+    g_hash_table_destroy(filter->included);
+    g_hash_table_destroy(filter->excluded);
+    g_hash_table_destroy(filter->matches);
+    free(filter);
+}
+
+static void
+_copy_channel(gpointer key, gpointer value, gpointer user_data)
+{
+    g_hash_table_insert((GHashTable *) user_data, strdup((const char *) key), value);
+}
+
+lcm_channel_filter_t *
+lcm_channel_filter_copy(const lcm_channel_filter_t *filter)
+{
+    lcm_channel_filter_t *copy = lcm_channel_filter_create();
+    for (int i = 0; i < filter->num_regexes; i++)
+        lcm_channel_filter_add_regex(copy, filter->regexes[i].pattern, filter->regexes[i].exclude);
+    g_hash_table_foreach(filter->included, _copy_channel, copy->included);
+    g_hash_table_foreach(filter->excluded, _copy_channel, copy->excluded);
+    copy->have_includes = filter->have_includes;
+    return copy;
+}
+
+int
+lcm_channel_filter_add_regex(lcm_channel_filter_t *filter, const char *pattern, int exclude)
+{
+    regex_t preg;
+    if (regcomp(&preg, pattern, REG_NOSUB | REG_EXTENDED) != 0)
+        return -1;
+    filter->regexes = realloc(filter->regexes, (filter->num_regexes + 1) * sizeof(regex_rule_t));
+    regex_rule_t *rule = &filter->regexes[filter->num_regexes++];
+    rule->pattern = strdup(pattern);
+    rule->preg = preg;
+    rule->exclude = exclude;
+    if (!exclude)
+        filter->have_includes = 1;
+    g_hash_table_remove_all(filter->matches);
+    return 0;
+}
+
+void
+lcm_channel_filter_add_channels(lcm_channel_filter_t *filter, const char *list, int exclude)
+{
+    gchar **names = g_strsplit(list, ",", -1);
+    for (int i = 0; names[i]; i++) {
+        if (!strlen(names[i]))
+            continue;
+        g_hash_table_insert(exclude ? filter->excluded : filter->included, strdup(names[i]),
+                GINT_TO_POINTER(1));
+        if (!exclude)
+            filter->have_includes = 1;
+    }
+    g_strfreev(names);
+    g_hash_table_remove_all(filter->matches);
+}
+
+int
+lcm_channel_filter_add_rule(lcm_channel_filter_t *filter, int opt, const char *arg)
+{
+    switch (opt) {
+        case 'c':
+        case 'x':
+            if (lcm_channel_filter_add_regex(filter, arg, opt == 'x') != 0) {
+                fprintf(stderr, "bad regex\n");
+                return -1;
+            }
+            return 0;
+        case 'l':
+        case 'L':
+            lcm_channel_filter_add_channels(filter, arg, opt == 'L');
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+void
+lcm_channel_filter_finish_rules(lcm_channel_filter_t *filter, int invert)
+{
+    if (!invert)
+        return;
+    if (!filter->have_includes) {
+        // everything is included by default, so -i on its own picks nothing
+        lcm_channel_filter_add_regex(filter, ".*", 1);
+        return;
+    }
+    for (int i = 0; i < filter->num_regexes; i++)
+        filter->regexes[i].exclude = 1;
+    g_hash_table_foreach(filter->included, _copy_channel, filter->excluded);
+    g_hash_table_remove_all(filter->included);
+    filter->have_includes = 0;
+    g_hash_table_remove_all(filter->matches);
+}
+
+static int
+_decide(const lcm_channel_filter_t *filter, const char *channel)
+{
+    if (g_hash_table_lookup(filter->excluded, channel))
+        return 0;
+    int included = !filter->have_includes || g_hash_table_lookup(filter->included, channel) != NULL;
+    for (int i = 0; i < filter->num_regexes && !included; i++)
+        if (!filter->regexes[i].exclude && regexec(&filter->regexes[i].preg, channel, 0, NULL, 0) == 0)
+            included = 1;
+    if (!included)
+        return 0;
+    for (int i = 0; i < filter->num_regexes; i++)
+        if (filter->regexes[i].exclude && regexec(&filter->regexes[i].preg, channel, 0, NULL, 0) == 0)
+            return 0;
+    return 1;
+}
+
+int
+lcm_channel_filter_match(lcm_channel_filter_t *filter, const char *channel)
+{
+    int match = GPOINTER_TO_INT(g_hash_table_lookup(filter->matches, channel)) - 1;
+    if (match < 0) {
+        match = _decide(filter, channel);
+        g_hash_table_insert(filter->matches, strdup(channel), GINT_TO_POINTER(match + 1));
+    }
+    return match;
+}
@@ -0,0 +1,56 @@
+#ifndef __lcm_channel_filter_h__
+#define __lcm_channel_filter_h__
+
+// lcm_channel_filter decides which channels the log tools pick out, from
+// any number of regular expressions and lists of channel names, each of
+// which either includes or excludes the channels it matches.  A channel is
+// picked if it's matched by an include (or there aren't any includes), and
+// isn't matched by any exclude.  Regular expressions match anywhere in the
+// channel name, as regexec() does.
+//
+// A log only has a few dozen channels in it, so the decision is made once
+// for each channel name and remembered, instead of running the regular
+// expressions for every event.
+//
+// A filter isn't safe to share between threads, give each one a
+// lcm_channel_filter_copy() instead.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _lcm_channel_filter_t lcm_channel_filter_t;
+
+lcm_channel_filter_t *lcm_channel_filter_create(void);
+
+void lcm_channel_filter_destroy(lcm_channel_filter_t *filter);
+
+// a new filter with the same rules
+lcm_channel_filter_t *lcm_channel_filter_copy(const lcm_channel_filter_t *filter);
+
+// adds a POSIX extended regular expression.  Returns 0 on success, -1 if
+// pattern isn't a valid one.
+int lcm_channel_filter_add_regex(lcm_channel_filter_t *filter, const char *pattern, int exclude);
+
+// adds a comma separated list of channel names, which have to match exactly
+void lcm_channel_filter_add_channels(lcm_channel_filter_t *filter, const char *list, int exclude);
+
+// adds the rule for one of the log tools' channel options: -c and -x take a
+// regular expression of channels to include or exclude, -l and -L a list of
+// them.  Returns -1, after saying so on stderr, if arg is a bad regular
+// expression or opt isn't one of those.
+int lcm_channel_filter_add_rule(lcm_channel_filter_t *filter, int opt, const char *arg);
+
+// call once all the rules are in.  If invert (the tools' -i) is set, the
+// channels that the includes pick are excluded instead, and if there aren't
+// any includes, all of them are.
+void lcm_channel_filter_finish_rules(lcm_channel_filter_t *filter, int invert);
+
+// returns 1 if channel is picked, 0 if not
+int lcm_channel_filter_match(lcm_channel_filter_t *filter, const char *channel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
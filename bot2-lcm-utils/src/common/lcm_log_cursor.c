@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <lcm/lcm.h>
+
+#include "lcm_log_cursor.h"
+
+#define LOG_MAGIC 0xEDA1DA01
+#define LOG_EVENT_HEADER_SIZE 28 // magic, eventnum, timestamp, channellen and datalen
+#define LOG_MAX_CHANNEL_LEN 1000 // this long or longer and the event's corrupt, as in lcm's eventlog.c
+
+struct _lcm_log_cursor_t {
+    // the mapping, or NULL if the file couldn't be mapped
+    const uint8_t *map;
+    int64_t size;
+    int64_t pos;
+
+    lcm_eventlog_t *log;            // otherwise, what we read it with
+    lcm_eventlog_event_t *log_event; // and the last event it gave us
+
+    char *channel;                  // the current event's channel, nul terminated
+    int channel_sz;
+    lcm_log_event_t event;
+};
+
+static inline uint32_t
+_get_u32(const uint8_t *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline int64_t
+_get_i64(const uint8_t *p)
+{
+    return (int64_t) (((uint64_t) _get_u32(p) << 32) | _get_u32(p + 4));
+}
+
+lcm_log_cursor_t *
+lcm_log_cursor_create(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    lcm_log_cursor_t *cursor = calloc(1, sizeof(lcm_log_cursor_t));
+    cursor->size = -1;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t) st.st_size <= (size_t) -1) {
+        cursor->size = st.st_size;
+        if (cursor->size > 0) {
+            void *map = mmap(NULL, cursor->size, PROT_READ, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED) {
+                // the kernel reads ahead more, and drops pages behind us sooner
+                madvise(map, cursor->size, MADV_SEQUENTIAL);
+                cursor->map = map;
+            }
+            else {
+                cursor->size = -1;
+            }
+        }
+    }
+    close(fd);
+
+    if (cursor->size < 0) {
+        cursor->log = lcm_eventlog_create(path, "r");
+        if (!cursor->log) {
+            free(cursor);
+            return NULL;
+        }
+    }
+    return cursor;
+}
+
+void
+lcm_log_cursor_destroy(lcm_log_cursor_t *cursor)
+{
+    if (cursor->map)
+        munmap((void *) cursor->map, cursor->size);
+    if (cursor->log_event)
+        lcm_eventlog_free_event(cursor->log_event);
+    if (cursor->log)
+        lcm_eventlog_destroy(cursor->log);
+    free(cursor->channel);
+    free(cursor);
+}
+
+static void
+_set_channel(lcm_log_cursor_t *cursor, const char *channel, int32_t channellen)
+{
+    if (cursor->channel_sz < channellen + 1) {
+        free(cursor->channel);
+        cursor->channel_sz = channellen + 1;
+        cursor->channel = malloc(cursor->channel_sz);
+    }
+    memcpy(cursor->channel, channel, channellen);
+    cursor->channel[channellen] = 0;
+    cursor->event.channel = cursor->channel;
+}
+
+static const lcm_log_event_t *
+_next_from_eventlog(lcm_log_cursor_t *cursor)
+{
+    if (cursor->log_event)
+        lcm_eventlog_free_event(cursor->log_event);
+    cursor->log_event = lcm_eventlog_read_next_event(cursor->log);
+    lcm_eventlog_event_t *le = cursor->log_event;
+    if (!le)
+        return NULL;
+    cursor->event.offset = -1;
+    cursor->event.eventnum = le->eventnum;
+    cursor->event.timestamp = le->timestamp;
+    cursor->event.channellen = le->channellen;
+    cursor->event.datalen = le->datalen;
+    cursor->event.channel = le->channel;
+    cursor->event.data = le->data;
+    return &cursor->event;
+}
+
+const lcm_log_event_t *
+lcm_log_cursor_next(lcm_log_cursor_t *cursor)
+{
+    if (!cursor->map)
+        return cursor->log ? _next_from_eventlog(cursor) : NULL;
+
+    while (cursor->pos + LOG_EVENT_HEADER_SIZE <= cursor->size) {
+        const uint8_t *p = cursor->map + cursor->pos;
+        if (_get_u32(p) != LOG_MAGIC) {
+            // find the next sync word
+            cursor->pos++;
+            continue;
+        }
+        int32_t channellen = (int32_t) _get_u32(p + 20);
+        int32_t datalen = (int32_t) _get_u32(p + 24);
+        if (channellen <= 0 || channellen >= LOG_MAX_CHANNEL_LEN || datalen < 0) {
+            fprintf(stderr, "Skipping a corrupt log event at offset %lld\n", (long long) cursor->pos);
+            cursor->pos++;
+            continue;
+        }
+        int64_t end = cursor->pos + LOG_EVENT_HEADER_SIZE + channellen + datalen;
+        if (end > cursor->size)
+            break; // truncated, the log was cut off while it was being written
+
+        cursor->event.offset = cursor->pos;
+        cursor->event.eventnum = _get_i64(p + 4);
+        cursor->event.timestamp = _get_i64(p + 12);
+        cursor->event.channellen = channellen;
+        cursor->event.datalen = datalen;
+        _set_channel(cursor, (const char *) p + LOG_EVENT_HEADER_SIZE, channellen);
+        cursor->event.data = p + LOG_EVENT_HEADER_SIZE + channellen;
+        cursor->pos = end;
+        return &cursor->event;
+    }
+    cursor->pos = cursor->size;
+    return NULL;
+}
+
+int64_t
+lcm_log_cursor_size(const lcm_log_cursor_t *cursor)
+{
+    return cursor->log ? -1 : cursor->size;
+}
+
+int64_t
+lcm_log_cursor_tell(const lcm_log_cursor_t *cursor)
+{
+    return cursor->log ? -1 : cursor->pos;
+}
+
+int
+lcm_log_cursor_seek(lcm_log_cursor_t *cursor, int64_t offset)
+{
+    if (cursor->log || offset < 0 || offset > cursor->size)
+        return -1;
+    cursor->pos = offset;
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef __lcm_log_cursor_h__
+#define __lcm_log_cursor_h__
+
+// lcm_log_cursor reads LCM log files without copying them.  The file is
+// memory mapped, and each event comes back as a view into the mapping, so
+// there's no allocation or copy per event the way there is with
+// lcm_eventlog_read_next_event().
+//
+// Files that can't be mapped (pipes, or anything too big for a 32 bit
+// address space) are read with lcm_eventlog instead, behind the same
+// interface.
+//
+// e.g.
+//
+//     lcm_log_cursor_t *cursor = lcm_log_cursor_create("lcmlog-2010-01-01.00");
+//     const lcm_log_event_t *event;
+//     while ((event = lcm_log_cursor_next(cursor)) != NULL)
+//         printf("%s: %d bytes\n", event->channel, event->datalen);
+//     lcm_log_cursor_destroy(cursor);
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _lcm_log_cursor_t lcm_log_cursor_t;
+
+typedef struct {
+    int64_t offset;       // of the event in the file
+    int64_t eventnum;
+    int64_t timestamp;
+    int32_t channellen;
+    int32_t datalen;
+    const char *channel;  // nul terminated
+    const uint8_t *data;
+} lcm_log_event_t;
+
+// opens a log file for reading, returns NULL (with errno set) if it can't
+lcm_log_cursor_t *lcm_log_cursor_create(const char *path);
+
+void lcm_log_cursor_destroy(lcm_log_cursor_t *cursor);
+
+// returns the next event, or NULL at the end of the log.  The event, and
+// what it points to, stay valid until the next call.  Garbage between
+// events is skipped over, as lcm_eventlog does, and so are events with
+// impossible lengths, where lcm_eventlog would give up.
+const lcm_log_event_t *lcm_log_cursor_next(lcm_log_cursor_t *cursor);
+
+// the size of the file, -1 if it isn't mapped
+int64_t lcm_log_cursor_size(const lcm_log_cursor_t *cursor);
+
+// where the next event will be read from, -1 if the file isn't mapped
+int64_t lcm_log_cursor_tell(const lcm_log_cursor_t *cursor);
+
+// carries on reading from offset, which should be the start of an event
+// (otherwise the cursor skips ahead to the next one).  Returns 0 on
+// success, -1 if the file isn't mapped or offset is past its end.
+int lcm_log_cursor_seek(lcm_log_cursor_t *cursor, int64_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "lcm_log_index.h"
+
+// the file is big endian throughout, like the log:
+//
+//   u32 magic, i32 version
+//   i64 log_size, i64 log_mtime, i64 first_timestamp, i64 num_events
+//   i32 num_channels, then for each:
+//     i32 namelen, name, i64 num_events, i64 num_bytes, i64 first_offset, i64 last_offset
+//   i32 num_chunks, i32 channel_mask_size, then for each:
+//     i64 offset, i64 min_timestamp, i64 max_timestamp, i32 num_events, channel mask
+#define INDEX_MAGIC 0x4C434D49 // "LCMI"
+#define INDEX_VERSION 1
+#define INDEX_MAX_CHANNEL_LEN 1000 // as in the log
+
+char *
+lcm_log_index_path(const char *log_path)
+{
+    char *path = malloc(strlen(log_path) + strlen(LCM_LOG_INDEX_SUFFIX) + 1);
+    strcpy(path, log_path);
+    strcat(path, LCM_LOG_INDEX_SUFFIX);
+    return path;
+}
+
+void
+lcm_log_index_destroy(lcm_log_index_t *index)
+{
+    for (int i = 0; i < index->num_channels; i++)
+        free(index->channels[i].name);
+    free(index->channels);
+    for (int i = 0; i < index->num_chunks; i++)
+        free(index->chunks[i].channels);
+    free(index->chunks);
+    free(index);
+}
+
+static void
+_finish(lcm_log_index_t *index)
+{
+    for (int i = 0; i < index->num_chunks; i++) {
+        lcm_log_index_chunk_t *chunk = &index->chunks[i];
+        chunk->max_timestamp_so_far = chunk->max_timestamp;
+        if (i > 0 && index->chunks[i - 1].max_timestamp_so_far > chunk->max_timestamp)
+            chunk->max_timestamp_so_far = index->chunks[i - 1].max_timestamp_so_far;
+    }
+}
+
+lcm_log_index_t *
+lcm_log_index_build(lcm_log_cursor_t *cursor, int64_t chunk_usec, int64_t chunk_bytes)
+{
+    if (lcm_log_cursor_tell(cursor) < 0)
+        return NULL;
+
+    lcm_log_index_t *index = calloc(1, sizeof(lcm_log_index_t));
+    index->log_size = lcm_log_cursor_size(cursor);
+    int max_channels = 0;
+    int max_chunks = 0;
+    // channel name -> its number + 1
+    GHashTable *channel_nums = g_hash_table_new(g_str_hash, g_str_equal);
+
+    // the channels seen in the current chunk, and how big each chunk's mask
+    // was when it was done, since channels keep turning up
+    int mask_capacity = 64;
+    uint8_t *mask = calloc(mask_capacity, 1);
+    int *mask_sizes = NULL;
+    lcm_log_index_chunk_t *chunk = NULL;
+
+    for (const lcm_log_event_t *event = lcm_log_cursor_next(cursor);
+            event != NULL;
+            event = lcm_log_cursor_next(cursor)) {
+        if (index->num_events == 0)
+            index->first_timestamp = event->timestamp;
+        index->num_events++;
+
+        int ch = GPOINTER_TO_INT(g_hash_table_lookup(channel_nums, event->channel)) - 1;
+        if (ch < 0) {
+            if (index->num_channels == max_channels) {
+                max_channels = max_channels ? max_channels * 2 : 16;
+                index->channels = realloc(index->channels, max_channels * sizeof(lcm_log_index_channel_t));
+            }
+            ch = index->num_channels++;
+            lcm_log_index_channel_t *channel = &index->channels[ch];
+            memset(channel, 0, sizeof(lcm_log_index_channel_t));
+            channel->name = strdup(event->channel);
+            channel->first_offset = event->offset;
+            g_hash_table_insert(channel_nums, channel->name, GINT_TO_POINTER(ch + 1));
+            if (ch / 8 >= mask_capacity) {
+                mask = realloc(mask, mask_capacity * 2);
+                memset(mask + mask_capacity, 0, mask_capacity);
+                mask_capacity *= 2;
+            }
+        }
+        lcm_log_index_channel_t *channel = &index->channels[ch];
+        channel->num_events++;
+        channel->num_bytes += event->datalen;
+        channel->last_offset = event->offset;
+
+        if (chunk == NULL || event->offset - chunk->offset >= chunk_bytes
+                || event->timestamp - chunk->min_timestamp >= chunk_usec) {
+            if (chunk) {
+                int sz = (index->num_channels + 7) / 8;
+                chunk->channels = malloc(sz);
+                memcpy(chunk->channels, mask, sz);
+                mask_sizes[index->num_chunks - 1] = sz;
+                memset(mask, 0, mask_capacity);
+            }
+            if (index->num_chunks == max_chunks) {
+                max_chunks = max_chunks ? max_chunks * 2 : 256;
+                index->chunks = realloc(index->chunks, max_chunks * sizeof(lcm_log_index_chunk_t));
+                mask_sizes = realloc(mask_sizes, max_chunks * sizeof(int));
+            }
+            chunk = &index->chunks[index->num_chunks++];
+            memset(chunk, 0, sizeof(lcm_log_index_chunk_t));
+            chunk->offset = event->offset;
+            chunk->min_timestamp = event->timestamp;
+            chunk->max_timestamp = event->timestamp;
+        }
+        if (event->timestamp < chunk->min_timestamp)
+            chunk->min_timestamp = event->timestamp;
+        if (event->timestamp > chunk->max_timestamp)
+            chunk->max_timestamp = event->timestamp;
+        chunk->num_events++;
+        mask[ch / 8] |= 1 << (ch % 8);
+    }
+
+    // now that all the channels are known, make the masks the same size
+    index->channel_mask_size = (index->num_channels + 7) / 8;
+    for (int i = 0; i < index->num_chunks; i++) {
+        uint8_t *chunk_mask = calloc(index->channel_mask_size ? index->channel_mask_size : 1, 1);
+        if (i == index->num_chunks - 1)
+            memcpy(chunk_mask, mask, index->channel_mask_size);
+        else
+            memcpy(chunk_mask, index->chunks[i].channels, mask_sizes[i]);
+        free(index->chunks[i].channels);
+        index->chunks[i].channels = chunk_mask;
+    }
+    _finish(index);
+
+    free(mask_sizes);
+    free(mask);
+    g_hash_table_destroy(channel_nums);
+    return index;
+}
+
+static void
+_put_i32(FILE *f, int32_t v)
+{
+    uint8_t b[4] = { (uint8_t) (v >> 24), (uint8_t) (v >> 16), (uint8_t) (v >> 8), (uint8_t) v };
+    fwrite(b, 1, 4, f);
+}
+
+static void
+_put_i64(FILE *f, int64_t v)
+{
+    _put_i32(f, (int32_t) (v >> 32));
+    _put_i32(f, (int32_t) v);
+}
+
+int
+lcm_log_index_write(const lcm_log_index_t *index, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return -1;
+
+    _put_i32(f, INDEX_MAGIC);
+    _put_i32(f, INDEX_VERSION);
+    _put_i64(f, index->log_size);
+    _put_i64(f, index->log_mtime);
+    _put_i64(f, index->first_timestamp);
+    _put_i64(f, index->num_events);
+
+    _put_i32(f, index->num_channels);
+    for (int i = 0; i < index->num_channels; i++) {
+        const lcm_log_index_channel_t *channel = &index->channels[i];
+        int32_t namelen = strlen(channel->name);
+        _put_i32(f, namelen);
+        fwrite(channel->name, 1, namelen, f);
+        _put_i64(f, channel->num_events);
+        _put_i64(f, channel->num_bytes);
+        _put_i64(f, channel->first_offset);
+        _put_i64(f, channel->last_offset);
+    }
+
+    _put_i32(f, index->num_chunks);
+    _put_i32(f, index->channel_mask_size);
+    for (int i = 0; i < index->num_chunks; i++) {
+        const lcm_log_index_chunk_t *chunk = &index->chunks[i];
+        _put_i64(f, chunk->offset);
+        _put_i64(f, chunk->min_timestamp);
+        _put_i64(f, chunk->max_timestamp);
+        _put_i32(f, chunk->num_events);
+        fwrite(chunk->channels, 1, index->channel_mask_size, f);
+    }
+
+    int failed = ferror(f);
+    if (fclose(f) != 0 || failed)
+        return -1;
+    return 0;
+}
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    int failed;
+} _reader_t;
+
+static const uint8_t *
+_get(_reader_t *r, int64_t n)
+{
+    if (r->failed || n < 0 || n > r->end - r->p) {
+        r->failed = 1;
+        return NULL;
+    }
+    const uint8_t *p = r->p;
+    r->p += n;
+    return p;
+}
+
+static int32_t
+_get_i32(_reader_t *r)
+{
+    const uint8_t *b = _get(r, 4);
+    if (!b)
+        return 0;
+    return (int32_t) (((uint32_t) b[0] << 24) | ((uint32_t) b[1] << 16) | ((uint32_t) b[2] << 8) | b[3]);
+}
+
+static int64_t
+_get_i64(_reader_t *r)
+{
+    uint32_t hi = (uint32_t) _get_i32(r);
+    uint32_t lo = (uint32_t) _get_i32(r);
+    return (int64_t) (((uint64_t) hi << 32) | lo);
+}
+
+lcm_log_index_t *
+lcm_log_index_read(const char *path)
+{
+    gchar *contents;
+    gsize len;
+    if (!g_file_get_contents(path, &contents, &len, NULL))
+        return NULL;
+
+    _reader_t r = { (const uint8_t *) contents, (const uint8_t *) contents + len, 0 };
+    lcm_log_index_t *index = calloc(1, sizeof(lcm_log_index_t));
+    if ((uint32_t) _get_i32(&r) != INDEX_MAGIC || _get_i32(&r) != INDEX_VERSION)
+        goto fail;
+    index->log_size = _get_i64(&r);
+    index->log_mtime = _get_i64(&r);
+    index->first_timestamp = _get_i64(&r);
+    index->num_events = _get_i64(&r);
+
+    // check the counts against what's left before allocating anything for them
+    int32_t num_channels = _get_i32(&r);
+    if (num_channels < 0 || num_channels > (r.end - r.p) / 36)
+        goto fail;
+    index->channels = calloc(num_channels ? num_channels : 1, sizeof(lcm_log_index_channel_t));
+    for (; index->num_channels < num_channels; index->num_channels++) {
+        lcm_log_index_channel_t *channel = &index->channels[index->num_channels];
+        int32_t namelen = _get_i32(&r);
+        const uint8_t *name = (namelen > 0 && namelen < INDEX_MAX_CHANNEL_LEN) ? _get(&r, namelen) : NULL;
+        if (!name)
+            goto fail;
+        channel->name = g_strndup((const char *) name, namelen);
+        channel->num_events = _get_i64(&r);
+        channel->num_bytes = _get_i64(&r);
+        channel->first_offset = _get_i64(&r);
+        channel->last_offset = _get_i64(&r);
+    }
+
+    int32_t num_chunks = _get_i32(&r);
+    index->channel_mask_size = _get_i32(&r);
+    if (r.failed || num_chunks < 0 || index->channel_mask_size != (num_channels + 7) / 8
+            || num_chunks > (r.end - r.p) / (28 + index->channel_mask_size))
+        goto fail;
+    index->chunks = calloc(num_chunks ? num_chunks : 1, sizeof(lcm_log_index_chunk_t));
+    for (; index->num_chunks < num_chunks; index->num_chunks++) {
+        lcm_log_index_chunk_t *chunk = &index->chunks[index->num_chunks];
+        chunk->offset = _get_i64(&r);
+        chunk->min_timestamp = _get_i64(&r);
+        chunk->max_timestamp = _get_i64(&r);
+        chunk->num_events = _get_i32(&r);
+        const uint8_t *mask = _get(&r, index->channel_mask_size);
+        if (!mask || chunk->offset < 0 || chunk->offset >= index->log_size
+                || (index->num_chunks > 0 && chunk->offset <= chunk[-1].offset))
+            goto fail;
+        chunk->channels = calloc(index->channel_mask_size ? index->channel_mask_size : 1, 1);
+        memcpy(chunk->channels, mask, index->channel_mask_size);
+    }
+    if (r.failed || r.p != r.end)
+        goto fail;
+
+    _finish(index);
+    g_free(contents);
+    return index;
+
+fail:
+    lcm_log_index_destroy(index);
+    g_free(contents);
+    return NULL;
+}
+
+lcm_log_index_t *
+lcm_log_index_open(const char *log_path)
+{
+    struct stat st;
+    if (stat(log_path, &st) != 0 || !S_ISREG(st.st_mode))
+        return NULL;
+    char *path = lcm_log_index_path(log_path);
+    lcm_log_index_t *index = lcm_log_index_read(path);
+    if (index && (index->log_size != st.st_size || index->log_mtime != st.st_mtime)) {
+        fprintf(stderr, "%s is out of date, ignoring it\n", path);
+        lcm_log_index_destroy(index);
+        index = NULL;
+    }
+    free(path);
+    return index;
+}
+
+int
+lcm_log_index_find(const lcm_log_index_t *index, int64_t timestamp)
+{
+    // max_timestamp_so_far never goes down, even when the log's timestamps do
+    int lo = 0, hi = index->num_chunks;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (index->chunks[mid].max_timestamp_so_far < timestamp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int
+_has_wanted(const lcm_log_index_t *index, int chunk, const uint8_t *wanted)
+{
+    for (int i = 0; i < index->num_channels; i++)
+        if (wanted[i] && lcm_log_index_chunk_has_channel(index, chunk, i))
+            return 1;
+    return 0;
+}
+
+void
+lcm_log_index_skip(const lcm_log_index_t *index, lcm_log_cursor_t *cursor, int *next_chunk,
+        const uint8_t *wanted, int64_t start_timestamp, int64_t end_timestamp)
+{
+    int64_t pos = lcm_log_cursor_tell(cursor);
+    if (pos < 0)
+        return;
+    while (1) {
+        // the chunks the cursor has already gone into
+        while (*next_chunk < index->num_chunks && index->chunks[*next_chunk].offset < pos)
+            (*next_chunk)++;
+        int c = *next_chunk;
+        if (c == index->num_chunks)
+            return;
+        const lcm_log_index_chunk_t *chunk = &index->chunks[c];
+        // part way through the chunk before, unless this is the first one,
+        // since anything before that is garbage
+        if (pos != chunk->offset && c > 0)
+            return;
+
+        int skip_to = c;
+        if (chunk->max_timestamp_so_far < start_timestamp)
+            skip_to = lcm_log_index_find(index, start_timestamp);
+        else if (chunk->max_timestamp < start_timestamp
+                || (wanted && chunk->max_timestamp <= end_timestamp && !_has_wanted(index, c, wanted)))
+            skip_to = c + 1;
+        if (skip_to == c)
+            return;
+        pos = lcm_log_index_chunk_offset(index, skip_to);
+        lcm_log_cursor_seek(cursor, pos);
+        *next_chunk = skip_to;
+    }
+}
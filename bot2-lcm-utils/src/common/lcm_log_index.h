@@ -0,0 +1,118 @@
+#ifndef __lcm_log_index_h__
+#define __lcm_log_index_h__
+
+// lcm_log_index is a sidecar index for an LCM log file, written by
+// bot-lcm-logindex next to the log as <logfile>.idx.
+//
+// The log is cut into chunks, a new one starting every second or so of
+// log time.  For each chunk the index has its offset in the log, the
+// range of timestamps in it, and which channels it has events on.  For
+// each channel, it has how many events and bytes there are, and where the
+// first and last of them are.
+//
+// With that, the log tools can seek straight to the start of a time window
+// instead of reading up to it, and skip over chunks that don't have any of
+// the channels they're after, e.g.
+//
+//     lcm_log_index_t *index = lcm_log_index_open(log_path);
+//     if (index) {
+//         int chunk = lcm_log_index_find(index, index->first_timestamp + start_utime);
+//         ...
+//     }
+
+#include <stdint.h>
+
+#include "lcm_log_cursor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LCM_LOG_INDEX_SUFFIX ".idx"
+#define LCM_LOG_INDEX_CHUNK_USEC 1000000 // a new chunk starts after this much log time
+#define LCM_LOG_INDEX_CHUNK_BYTES (16*1024*1024) // or after this much of the log
+
+typedef struct {
+    char *name;
+    int64_t num_events;
+    int64_t num_bytes;    // of data, not counting the event headers
+    int64_t first_offset; // of the first event on the channel
+    int64_t last_offset;
+} lcm_log_index_channel_t;
+
+typedef struct {
+    int64_t offset;        // of the first event in the chunk
+    int64_t min_timestamp;
+    int64_t max_timestamp;
+    int64_t max_timestamp_so_far; // over this chunk and all the ones before it, not stored in the file
+    int32_t num_events;
+    uint8_t *channels;     // a bit per channel, set if the chunk has events on it
+} lcm_log_index_chunk_t;
+
+typedef struct {
+    int64_t log_size;       // of the log when it was indexed
+    int64_t log_mtime;
+    int64_t first_timestamp; // of the first event in the log
+    int64_t num_events;
+
+    int num_channels;
+    lcm_log_index_channel_t *channels;
+
+    int num_chunks;
+    int channel_mask_size;  // bytes in each chunk's channel bitmask
+    lcm_log_index_chunk_t *chunks;
+} lcm_log_index_t;
+
+// returns the path of log_path's index, free() it when done
+char *lcm_log_index_path(const char *log_path);
+
+// reads the whole log through cursor (which has to be mapped, see
+// lcm_log_cursor_tell) and indexes it.  Returns NULL if the cursor isn't
+// mapped.
+lcm_log_index_t *lcm_log_index_build(lcm_log_cursor_t *cursor, int64_t chunk_usec, int64_t chunk_bytes);
+
+// writes the index to path.  Returns 0 on success, -1 (with errno set) on
+// failure.
+int lcm_log_index_write(const lcm_log_index_t *index, const char *path);
+
+// reads an index from path, returns NULL if it can't or it isn't an index
+lcm_log_index_t *lcm_log_index_read(const char *path);
+
+// reads log_path's index, if it has one that's up to date with the log.
+// Returns NULL otherwise.
+lcm_log_index_t *lcm_log_index_open(const char *log_path);
+
+void lcm_log_index_destroy(lcm_log_index_t *index);
+
+// the first chunk that might have events at or after timestamp, everything
+// before it is earlier.  num_chunks if there isn't one.
+int lcm_log_index_find(const lcm_log_index_t *index, int64_t timestamp);
+
+static inline int
+lcm_log_index_chunk_has_channel(const lcm_log_index_t *index, int chunk, int channel)
+{
+    return (index->chunks[chunk].channels[channel / 8] >> (channel % 8)) & 1;
+}
+
+// where chunk starts in the log, or the end of the log for num_chunks
+static inline int64_t
+lcm_log_index_chunk_offset(const lcm_log_index_t *index, int chunk)
+{
+    return chunk < index->num_chunks ? index->chunks[chunk].offset : index->log_size;
+}
+
+// Moves cursor past the chunks that don't have anything the caller wants,
+// when it's at the start of one.  Call it before each lcm_log_cursor_next().
+// A chunk is skipped if it's all before start_timestamp, or if it has none
+// of the channels flagged in wanted (one per index channel, NULL for all of
+// them) and nothing after end_timestamp either, so that the caller still
+// sees the event that ends its window.  *next_chunk keeps track of where
+// the cursor is, start it at 0.
+void lcm_log_index_skip(const lcm_log_index_t *index, lcm_log_cursor_t *cursor, int *next_chunk,
+        const uint8_t *wanted, int64_t start_timestamp, int64_t end_timestamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
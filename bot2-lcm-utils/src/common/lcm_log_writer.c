@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "lcm_log_writer.h"
+
+#define LOG_MAGIC 0xEDA1DA01
+#define LOG_EVENT_HEADER_SIZE 28
+
+struct _lcm_log_writer_t {
+    int fd;
+    int64_t eventcount;
+    uint8_t *buf;
+    int buf_len;
+    int failed; // a write failed, so the log is incomplete
+};
+
+static inline void
+_put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static inline void
+_put_i64(uint8_t *p, int64_t v)
+{
+    _put_u32(p, (uint64_t) v >> 32);
+    _put_u32(p + 4, (uint32_t) v);
+}
+
+// writes all of iov, picking up after short writes
+static int
+_writev_fully(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+lcm_log_writer_t *
+lcm_log_writer_create(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+        return NULL;
+    lcm_log_writer_t *writer = calloc(1, sizeof(lcm_log_writer_t));
+    writer->fd = fd;
+    writer->buf = malloc(LCM_LOG_WRITER_BUFFER_SIZE);
+    return writer;
+}
+
+int
+lcm_log_writer_flush(lcm_log_writer_t *writer)
+{
+    struct iovec iov = { writer->buf, writer->buf_len };
+    if (writer->buf_len > 0 && _writev_fully(writer->fd, &iov, 1) != 0)
+        writer->failed = 1;
+    writer->buf_len = 0;
+    return writer->failed ? -1 : 0;
+}
+
+int
+lcm_log_writer_destroy(lcm_log_writer_t *writer)
+{
+    int ret = lcm_log_writer_flush(writer);
+    if (close(writer->fd) != 0)
+        ret = -1;
+    free(writer->buf);
+    free(writer);
+    return ret;
+}
+
+int
+lcm_log_writer_write(lcm_log_writer_t *writer, int64_t timestamp, const char *channel, int32_t channellen,
+        const void *data, int32_t datalen)
+{
+    int64_t size = LOG_EVENT_HEADER_SIZE + (int64_t) channellen + datalen;
+    if (writer->buf_len + size > LCM_LOG_WRITER_BUFFER_SIZE && lcm_log_writer_flush(writer) != 0)
+        return -1;
+
+    uint8_t header[LOG_EVENT_HEADER_SIZE];
+    uint8_t *p = size <= LCM_LOG_WRITER_BUFFER_SIZE ? writer->buf + writer->buf_len : header;
+    _put_u32(p, LOG_MAGIC);
+    _put_i64(p + 4, writer->eventcount);
+    _put_i64(p + 12, timestamp);
+    _put_u32(p + 20, channellen);
+    _put_u32(p + 24, datalen);
+    writer->eventcount++;
+
+    if (p != header) {
+        memcpy(p + LOG_EVENT_HEADER_SIZE, channel, channellen);
+        memcpy(p + LOG_EVENT_HEADER_SIZE + channellen, data, datalen);
+        writer->buf_len += size;
+        return 0;
+    }
+
+    // too big to buffer, so it goes straight out
+    struct iovec iov[3] = { { header, LOG_EVENT_HEADER_SIZE }, { (char *) channel, channellen },
+        { (void *) data, datalen } };
+    if (_writev_fully(writer->fd, iov, 3) != 0)
+        writer->failed = 1;
+    return writer->failed ? -1 : 0;
+}
@@ -0,0 +1,47 @@
+#ifndef __lcm_log_writer_h__
+#define __lcm_log_writer_h__
+
+// lcm_log_writer writes LCM log files in big chunks.  Events are gathered
+// in a buffer and written out when it fills up, and events too big for
+// the buffer go out with a single writev().  Events are numbered from 0
+// in the order they're written, as lcm_eventlog_write_event() does.
+
+#include <stdint.h>
+
+#include "lcm_log_cursor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LCM_LOG_WRITER_BUFFER_SIZE (4*1024*1024)
+
+typedef struct _lcm_log_writer_t lcm_log_writer_t;
+
+// creates (or truncates) a log file for writing, returns NULL (with errno
+// set) if it can't
+lcm_log_writer_t *lcm_log_writer_create(const char *path);
+
+// flushes and closes the log.  Returns 0 on success, -1 if anything
+// couldn't be written.
+int lcm_log_writer_destroy(lcm_log_writer_t *writer);
+
+// returns 0 on success, -1 on failure
+int lcm_log_writer_write(lcm_log_writer_t *writer, int64_t timestamp, const char *channel, int32_t channellen,
+        const void *data, int32_t datalen);
+
+static inline int
+lcm_log_writer_write_event(lcm_log_writer_t *writer, const lcm_log_event_t *event)
+{
+    return lcm_log_writer_write(writer, event->timestamp, event->channel, event->channellen, event->data,
+            event->datalen);
+}
+
+// writes out what's buffered, returns 0 on success, -1 on failure
+int lcm_log_writer_flush(lcm_log_writer_t *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
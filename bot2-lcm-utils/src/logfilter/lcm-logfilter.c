@@ -5,13 +5,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <regex.h>
 #include <getopt.h>
 
 #include <glib.h>
 
 #include <lcm/lcm.h>
 
+#include "lcm_log_cursor.h"
+#include "lcm_log_writer.h"
+#include "lcm_log_index.h"
+#include "lcm_channel_filter.h"
+
 static void 
 usage()
 {
@@ -24,9 +28,17 @@ usage()
            "  -h        prints this help text and exits\n"
            "  -c CHAN   POSIX regular expression.  Channels matching this expression\n"
            "            will be copied to the destination logfile.  Defaults to .* if\n"
-           "            left unspecified.\n"
-           "  -i        invert the regular expression CHAN, so that only channels not\n"
-           "            matching CHAN will be copied to the destination logfile.\n"
+           "            left unspecified.  Can be given more than once, to copy the\n"
+           "            channels matching any of them.\n"
+           "  -l LIST   comma separated list of channels to copy, as well as the\n"
+           "            ones matching CHAN.  Can be given more than once.\n"
+           "  -x CHAN   POSIX regular expression.  Channels matching this expression\n"
+           "            won't be copied, even if they match CHAN or are in LIST.  Can\n"
+           "            be given more than once.\n"
+           "  -L LIST   comma separated list of channels not to copy.  Can be given\n"
+           "            more than once.\n"
+           "  -i        invert CHAN and LIST, so that only channels not matching CHAN\n"
+           "            or in LIST will be copied to the destination logfile.\n"
            "  -s START  start time.  Messages logged less than START seconds\n"
            "            after the first message in the logfile will not be\n"
            "            extracted.\n"
@@ -34,6 +46,13 @@ usage()
            "            after the first message in the logfile will not be\n"
            "            extracted.\n"
            "  -v        verbose mode. Prints a summary of channels extracted\n"
+           "  -j N      filter with N threads.  The log is split into pieces at event\n"
+           "            boundaries, which are filtered in parallel and written out in\n"
+           "            order.  The output is the same as with one thread.\n"
+           "\n"
+           "If the source logfile has been indexed with bot-lcm-logindex, the index\n"
+           "is used to seek to START, and to skip the parts of the log that don't\n"
+           "have any of the channels being extracted.\n"
            );
     exit(1);
 }
@@ -44,18 +63,264 @@ _verbose_entry_summary(gpointer key, gpointer value, gpointer user_data)
     printf("%20s: %d\n", (char*)key, *((int*)value));
 }
 
+// writes an event that passed the filter, and counts it.  Returns 0 on
+// success, -1 if it couldn't be written.
+static int
+_copy_event(lcm_log_writer_t *dst_log, const lcm_log_event_t *event, int verbose,
+        GHashTable *counts, int *nwritten)
+{
+    if (lcm_log_writer_write_event(dst_log, event) != 0)
+        return -1;
+    (*nwritten)++;
+
+    if (verbose)  {
+        int *count = g_hash_table_lookup(counts, event->channel);
+        if (!count) {
+            count = (int*) malloc(sizeof(int));
+            *count = 1;
+            g_hash_table_insert(counts, strdup(event->channel), count);
+            printf("matched channel %s\n", event->channel);
+        } else {
+            *count += 1;
+        }
+    }
+    return 0;
+}
+
+// With -j, the log is split into pieces of about PIECE_SIZE, each starting
+// at the first event at or after its share of the log.  Worker threads
+// filter the pieces, each with its own cursor and channel filter, and make
+// a list of the events to copy.  The main thread copies them out, a piece
+// at a time and in order, and doesn't let the workers get more than a few
+// pieces ahead of it.
+//
+// A piece's start can turn out not to be an event boundary after all, when
+// the sync word turns up in the middle of an event's data.  The piece before
+// it then ends somewhere else, and the main thread filters the piece again
+// from there itself.
+#define PIECE_SIZE (16*1024*1024)
+
+typedef struct {
+    int64_t start;
+    int64_t limit;         // where the next piece starts
+    int done;
+
+    // what the worker found
+    int64_t *offsets;      // of the events to copy
+    int num_offsets;
+    int max_offsets;
+    int64_t next_offset;   // of the first event at or past limit, -1 if the log ended first
+    int ended;             // got to an event after the end time
+} piece_t;
+
+typedef struct {
+    const char *source_fname;
+    const lcm_channel_filter_t *channels;
+    int64_t first_event_timestamp;
+    int64_t start_utime;
+    int64_t end_utime;
+    int have_end_utime;
+    const lcm_log_index_t *index; // NULL if the log hasn't been indexed
+    const uint8_t *wanted;
+
+    GMutex *lock;          // protects everything below
+    GCond *cond;
+    piece_t *pieces;
+    int num_pieces;
+    int next_piece;        // the next one for a worker to take
+    int num_written;       // pieces the main thread is done with
+    int max_ahead;
+    int quit;
+} filter_t;
+
+typedef struct {
+    filter_t *filter;
+    lcm_log_cursor_t *cursor;
+    lcm_channel_filter_t *channels; // filters aren't thread safe, so each worker has its own
+    GThread *thread;
+} worker_t;
+
+static void
+_filter_piece(const filter_t *f, lcm_log_cursor_t *cursor, lcm_channel_filter_t *channels, piece_t *piece)
+{
+    piece->num_offsets = 0;
+    piece->next_offset = -1;
+    piece->ended = 0;
+
+    int next_chunk = 0;
+    int64_t end_timestamp = INT64_MAX;
+    if (f->have_end_utime)
+        end_timestamp = f->first_event_timestamp + f->end_utime;
+
+    lcm_log_cursor_seek(cursor, piece->start);
+    while (1) {
+        if (f->index)
+            lcm_log_index_skip(f->index, cursor, &next_chunk, f->wanted,
+                    f->first_event_timestamp + f->start_utime, end_timestamp);
+        const lcm_log_event_t *event = lcm_log_cursor_next(cursor);
+        if (!event)
+            break;
+        if (event->offset >= piece->limit) {
+            piece->next_offset = event->offset;
+            break;
+        }
+
+        int64_t elapsed = event->timestamp - f->first_event_timestamp;
+        if(elapsed < f->start_utime)
+            continue;
+        if(f->have_end_utime && elapsed > f->end_utime) {
+            piece->ended = 1;
+            break;
+        }
+
+        if (lcm_channel_filter_match(channels, event->channel)) {
+            if (piece->num_offsets == piece->max_offsets) {
+                piece->max_offsets = piece->max_offsets ? piece->max_offsets * 2 : 1024;
+                piece->offsets = realloc(piece->offsets, piece->max_offsets * sizeof(int64_t));
+            }
+            piece->offsets[piece->num_offsets++] = event->offset;
+        }
+    }
+}
+
+static gpointer
+_filter_thread(gpointer user_data)
+{
+    worker_t *worker = (worker_t *) user_data;
+    filter_t *f = worker->filter;
+
+    g_mutex_lock(f->lock);
+    while (1) {
+        while (!f->quit && f->next_piece < f->num_pieces
+                && f->next_piece - f->num_written >= f->max_ahead)
+            g_cond_wait(f->cond, f->lock);
+        if (f->quit || f->next_piece == f->num_pieces)
+            break;
+        piece_t *piece = &f->pieces[f->next_piece++];
+        g_mutex_unlock(f->lock);
+
+        _filter_piece(f, worker->cursor, worker->channels, piece);
+
+        g_mutex_lock(f->lock);
+        piece->done = 1;
+        g_cond_broadcast(f->cond);
+    }
+    g_mutex_unlock(f->lock);
+    return NULL;
+}
+
+// filters src_log, which has to be mapped, with num_threads workers.
+// Returns 0 on success, -1 if the output couldn't be written.
+static int
+_filter_parallel(filter_t *f, lcm_log_cursor_t *src_log, lcm_channel_filter_t *channels, int num_threads,
+        lcm_log_writer_t *dst_log, int verbose, GHashTable *counts, int *nwritten)
+{
+    int64_t size = lcm_log_cursor_size(src_log);
+    f->pieces = calloc(size / PIECE_SIZE + 1, sizeof(piece_t));
+    for (int64_t b = 0; b < size; b += PIECE_SIZE) {
+        lcm_log_cursor_seek(src_log, b);
+        const lcm_log_event_t *event = lcm_log_cursor_next(src_log);
+        if (!event)
+            break;
+        // an event can span more than one piece's share
+        if (f->num_pieces > 0 && event->offset <= f->pieces[f->num_pieces - 1].start)
+            continue;
+        f->pieces[f->num_pieces++].start = event->offset;
+    }
+    for (int i = 0; i < f->num_pieces; i++)
+        f->pieces[i].limit = i + 1 < f->num_pieces ? f->pieces[i + 1].start : INT64_MAX;
+
+    int status = 0;
+    // the main thread can filter pieces too, so it can make do with fewer
+    // workers if the log can't be opened again
+    worker_t workers[num_threads];
+    int num_workers = 0;
+    for (int i = 0; i < num_threads; i++) {
+        worker_t *worker = &workers[num_workers];
+        memset(worker, 0, sizeof(worker_t));
+        worker->filter = f;
+        worker->cursor = lcm_log_cursor_create(f->source_fname);
+        if (!worker->cursor) {
+            perror("Unable to open source logfile for a worker");
+            break;
+        }
+        worker->channels = lcm_channel_filter_copy(f->channels);
+        num_workers++;
+    }
+
+    f->lock = g_mutex_new();
+    f->cond = g_cond_new();
+    f->max_ahead = 4 * num_threads;
+    for (int i = 0; i < num_workers; i++)
+        workers[i].thread = g_thread_create(_filter_thread, &workers[i], 1, NULL);
+
+    // the first piece starts where reading the log from the beginning would
+    int64_t expected_start = f->num_pieces > 0 ? f->pieces[0].start : -1;
+    for (int i = 0; i < f->num_pieces; i++) {
+        piece_t *piece = &f->pieces[i];
+        int claimed = 0;
+        g_mutex_lock(f->lock);
+        if (f->next_piece == i) {
+            // no worker has got to it yet
+            f->next_piece++;
+            claimed = 1;
+        }
+        while (!claimed && !piece->done)
+            g_cond_wait(f->cond, f->lock);
+        g_mutex_unlock(f->lock);
+
+        if (claimed || piece->start != expected_start) {
+            piece->start = expected_start;
+            _filter_piece(f, src_log, channels, piece);
+        }
+
+        for (int j = 0; j < piece->num_offsets && status == 0; j++) {
+            lcm_log_cursor_seek(src_log, piece->offsets[j]);
+            status = _copy_event(dst_log, lcm_log_cursor_next(src_log), verbose, counts, nwritten);
+        }
+        free(piece->offsets);
+        piece->offsets = NULL;
+
+        g_mutex_lock(f->lock);
+        f->num_written = i + 1;
+        g_cond_broadcast(f->cond);
+        g_mutex_unlock(f->lock);
+
+        if (status != 0 || piece->ended || piece->next_offset < 0)
+            break;
+        expected_start = piece->next_offset;
+    }
+
+    g_mutex_lock(f->lock);
+    f->quit = 1;
+    g_cond_broadcast(f->cond);
+    g_mutex_unlock(f->lock);
+    for (int i = 0; i < num_workers; i++) {
+        g_thread_join(workers[i].thread);
+        lcm_log_cursor_destroy(workers[i].cursor);
+        lcm_channel_filter_destroy(workers[i].channels);
+    }
+    for (int i = 0; i < f->num_pieces; i++)
+        free(f->pieces[i].offsets);
+    free(f->pieces);
+    g_mutex_free(f->lock);
+    g_cond_free(f->cond);
+    return status;
+}
+
 int main(int argc, char **argv)
 {
     int verbose = 0;
-    char *pattern = strdup(".*");
     char *source_fname = NULL;
     char *dest_fname = NULL;
     int64_t start_utime = 0;
     int64_t end_utime = -1;
     int have_end_utime = 0;
     int invert_regex = 0;
+    int num_threads = 1;
+    lcm_channel_filter_t *channels = lcm_channel_filter_create();
 
-    char *optstring = "hc:vs:e:i";
+    char *optstring = "hc:vs:e:ij:l:x:L:";
     int c;
 
     while ((c = getopt_long (argc, argv, optstring, NULL, 0)) >= 0)
@@ -86,9 +351,20 @@ int main(int argc, char **argv)
             case 'i':
                 invert_regex = 1;
                 break;
+            case 'j':
+                {
+                    char *eptr = NULL;
+                    num_threads = strtol(optarg, &eptr, 10);
+                    if(*eptr != 0 || num_threads < 1)
+                        usage();
+                }
+                break;
             case 'c':
-                free(pattern);
-                pattern = strdup(optarg);
+            case 'l':
+            case 'x':
+            case 'L':
+                if (lcm_channel_filter_add_rule(channels, c, optarg) != 0)
+                    exit(1);
                 break;
             case 'v':
                 verbose = 1;
@@ -105,26 +381,27 @@ int main(int argc, char **argv)
     if (optind != argc - 2)
         usage();
 
-    regex_t preg;
-    if (0 != regcomp(&preg, pattern, REG_NOSUB | REG_EXTENDED)) {
-        fprintf(stderr, "bad regex\n");
-        exit(1);
-    }
+    if (num_threads > 1 && !g_thread_supported())
+        g_thread_init(NULL);
+
+    // the channels to copy are decided once for each channel name, not for
+    // every event
+    lcm_channel_filter_finish_rules(channels, invert_regex);
 
     source_fname = argv[argc - 2];
     dest_fname = argv[argc - 1];
 
-    lcm_eventlog_t *src_log = lcm_eventlog_create(source_fname, "r");
+    lcm_log_cursor_t *src_log = lcm_log_cursor_create(source_fname);
     if (!src_log) {
         perror("Unable to open source logfile");
-        regfree(&preg);
+        lcm_channel_filter_destroy(channels);
         return 1;
     }
-    lcm_eventlog_t *dst_log = lcm_eventlog_create(dest_fname, "w");
+    lcm_log_writer_t *dst_log = lcm_log_writer_create(dest_fname);
     if (!dst_log) {
         perror("Unable to open destination logfile");
-        lcm_eventlog_destroy(src_log);
-        regfree(&preg);
+        lcm_log_cursor_destroy(src_log);
+        lcm_channel_filter_destroy(channels);
         return 1;
     }
 
@@ -132,46 +409,81 @@ int main(int argc, char **argv)
             free, free);
     int nwritten = 0;
     int have_first_event_timestamp = 0;
-    int64_t first_event_timestamp;
+    int64_t first_event_timestamp = -1;
+
+    int write_failed = 0;
+
+    // with an index, the parts of the log outside the time window, or
+    // without any matching channels, aren't read at all
+    lcm_log_index_t *index = lcm_log_index_open(source_fname);
+    uint8_t *wanted = NULL;
+    int next_chunk = 0;
+    int64_t end_timestamp = INT64_MAX;
+    if (index) {
+        wanted = calloc(index->num_channels + 1, 1);
+        for (int i = 0; i < index->num_channels; i++) {
+            wanted[i] = lcm_channel_filter_match(channels, index->channels[i].name);
+        }
+        first_event_timestamp = index->first_timestamp;
+        have_first_event_timestamp = 1;
+        if (have_end_utime)
+            end_timestamp = first_event_timestamp + end_utime;
+        if (verbose)
+            printf("using the index of %s\n", source_fname);
+    }
+
+    if (num_threads > 1 && lcm_log_cursor_size(src_log) < 0) {
+        fprintf(stderr, "Can't split up %s, filtering it with one thread\n", source_fname);
+        num_threads = 1;
+    }
+    if (num_threads > 1 && !have_first_event_timestamp) {
+        const lcm_log_event_t *event = lcm_log_cursor_next(src_log);
+        if (event) {
+            first_event_timestamp = event->timestamp;
+            have_first_event_timestamp = 1;
+        }
+    }
+
+    if (num_threads > 1 && have_first_event_timestamp) {
+        filter_t f;
+        memset(&f, 0, sizeof(f));
+        f.source_fname = source_fname;
+        f.channels = channels;
+        f.first_event_timestamp = first_event_timestamp;
+        f.start_utime = start_utime;
+        f.end_utime = end_utime;
+        f.have_end_utime = have_end_utime;
+        f.index = index;
+        f.wanted = wanted;
+        write_failed = _filter_parallel(&f, src_log, channels, num_threads, dst_log, verbose, counts,
+                &nwritten) != 0;
+    }
+
+    // otherwise, the events point into the mapped source log, so nothing is
+    // copied until they go into the destination's write buffer
+    while (num_threads == 1) {
+        if (index)
+            lcm_log_index_skip(index, src_log, &next_chunk, wanted,
+                    first_event_timestamp + start_utime, end_timestamp);
+        const lcm_log_event_t *event = lcm_log_cursor_next(src_log);
+        if (!event)
+            break;
 
-    for (lcm_eventlog_event_t *event = lcm_eventlog_read_next_event(src_log);
-            event != NULL;
-            event = lcm_eventlog_read_next_event(src_log)) {
         if(!have_first_event_timestamp) {
             first_event_timestamp = event->timestamp;
             have_first_event_timestamp = 1;
         }
 
         int64_t elapsed = event->timestamp - first_event_timestamp;
-        if(elapsed < start_utime) {
-            lcm_eventlog_free_event(event);
+        if(elapsed < start_utime)
             continue;
-        }
-        if(have_end_utime && elapsed > end_utime) {
-            lcm_eventlog_free_event(event);
+        if(have_end_utime && elapsed > end_utime)
             break;
-        }
 
-        int regmatch = regexec(&preg, event->channel, 0, NULL, 0);
-        int copy_to_dest = (regmatch == 0 && !invert_regex) ||
-                           (regmatch != 0 && invert_regex);
-        if (copy_to_dest) {
-            lcm_eventlog_write_event(dst_log, event);
-            nwritten++;
-
-            if (verbose)  {
-                int *count = g_hash_table_lookup(counts, event->channel);
-                if (!count) {
-                    count = (int*) malloc(sizeof(int));
-                    *count = 1;
-                    g_hash_table_insert(counts, strdup(event->channel), count);
-                    printf("matched channel %s\n", event->channel);
-                } else {
-                    *count += 1;
-                }
-            }
+        if (lcm_channel_filter_match(channels, event->channel) && _copy_event(dst_log, event, verbose, counts, &nwritten) != 0) {
+            write_failed = 1;
+            break;
         }
-        lcm_eventlog_free_event(event);
     }
 
     if (verbose) {
@@ -180,9 +492,17 @@ int main(int argc, char **argv)
         printf("Events written: %d\n", nwritten);
     }
     
-    regfree(&preg);
-    lcm_eventlog_destroy(src_log);
-    lcm_eventlog_destroy(dst_log);
+    lcm_channel_filter_destroy(channels);
+    if (index)
+        lcm_log_index_destroy(index);
+    free(wanted);
+    lcm_log_cursor_destroy(src_log);
+    if (lcm_log_writer_destroy(dst_log) != 0)
+        write_failed = 1;
     g_hash_table_destroy(counts);
+    if (write_failed) {
+        perror("Unable to write destination logfile");
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,158 @@
+// file: bot-lcm-logindex.c
+// desc: utility to write a sidecar index for logfiles, which the other log
+//       tools use to seek through them
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include <lcm/lcm.h>
+
+#include "lcm_log_cursor.h"
+#include "lcm_log_index.h"
+
+static void
+usage()
+{
+    printf("usage: bot-lcm-logindex [OPTIONS] <logfile> [logfile...]\n"
+           "\n"
+           "Write an index for each logfile, to <logfile>%s.  The index has\n"
+           "where in the log each second or so starts, and which channels are\n"
+           "in it, along with how many events each channel has.\n"
+           "\n"
+           "bot-lcm-logfilter and bot-lcm-logsplice use the index when it's there,\n"
+           "to seek straight to the start time instead of reading up to it, and\n"
+           "to skip the parts of the log without any of the channels they want.\n"
+           "\n"
+           "Options:\n"
+           "  -h        prints this help text and exits\n"
+           "  -i SECS   start a new chunk of the index every SECS seconds of log\n"
+           "            time.  Defaults to %g.\n"
+           "  -p        print the logfiles' existing indexes instead of writing them\n"
+           "  -v        verbose mode.  Prints a summary of each index written\n",
+           LCM_LOG_INDEX_SUFFIX, LCM_LOG_INDEX_CHUNK_USEC * 1e-6);
+    exit(1);
+}
+
+static void
+print_index(const char *path, const lcm_log_index_t *index)
+{
+    printf("%s: %lld events in %d chunks, %.1f MB\n", path, (long long) index->num_events,
+            index->num_chunks, index->log_size / (1024.0 * 1024.0));
+    if (index->num_chunks > 0) {
+        const lcm_log_index_chunk_t *last = &index->chunks[index->num_chunks - 1];
+        printf("  %.3f seconds\n", (last->max_timestamp_so_far - index->first_timestamp) * 1e-6);
+    }
+    printf("  %-32s %10s %12s %14s %14s\n", "channel", "events", "bytes", "first offset", "last offset");
+    for (int i = 0; i < index->num_channels; i++) {
+        const lcm_log_index_channel_t *channel = &index->channels[i];
+        printf("  %-32s %10lld %12lld %14lld %14lld\n", channel->name, (long long) channel->num_events,
+                (long long) channel->num_bytes, (long long) channel->first_offset,
+                (long long) channel->last_offset);
+    }
+}
+
+static int
+write_index(const char *log_path, int64_t chunk_usec, int verbose)
+{
+    struct stat st;
+    if (stat(log_path, &st) != 0) {
+        perror(log_path);
+        return -1;
+    }
+    lcm_log_cursor_t *cursor = lcm_log_cursor_create(log_path);
+    if (!cursor) {
+        perror(log_path);
+        return -1;
+    }
+    lcm_log_index_t *index = lcm_log_index_build(cursor, chunk_usec, LCM_LOG_INDEX_CHUNK_BYTES);
+    lcm_log_cursor_destroy(cursor);
+    if (!index) {
+        fprintf(stderr, "%s: can only index regular files\n", log_path);
+        return -1;
+    }
+    index->log_mtime = st.st_mtime;
+
+    // written alongside and moved into place, so that the other tools never
+    // see half an index
+    char *path = lcm_log_index_path(log_path);
+    char *tmp_path = g_strconcat(path, ".tmp", NULL);
+    int status = 0;
+    if (lcm_log_index_write(index, tmp_path) != 0 || rename(tmp_path, path) != 0) {
+        perror(path);
+        unlink(tmp_path);
+        status = -1;
+    }
+    else if (verbose) {
+        print_index(path, index);
+    }
+    g_free(tmp_path);
+    free(path);
+    lcm_log_index_destroy(index);
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    int verbose = 0;
+    int print = 0;
+    int64_t chunk_usec = LCM_LOG_INDEX_CHUNK_USEC;
+
+    char *optstring = "hi:pv";
+    int c;
+
+    while ((c = getopt_long (argc, argv, optstring, NULL, 0)) >= 0)
+    {
+        switch (c) {
+            case 'i':
+                {
+                    char *eptr = NULL;
+                    double interval = strtod(optarg, &eptr);
+                    if(*eptr != 0 || interval <= 0)
+                        usage();
+                    chunk_usec = (int64_t) (interval * 1000000);
+                }
+                break;
+            case 'p':
+                print = 1;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'h':
+            default:
+                usage();
+                break;
+        };
+    }
+
+    if (optind >= argc)
+        usage();
+
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        if (print) {
+            char *path = lcm_log_index_path(argv[i]);
+            lcm_log_index_t *index = lcm_log_index_read(path);
+            if (index) {
+                print_index(path, index);
+                lcm_log_index_destroy(index);
+            }
+            else {
+                fprintf(stderr, "%s: not a log index\n", path);
+                status = 1;
+            }
+            free(path);
+        }
+        else if (write_index(argv[i], chunk_usec, verbose) != 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
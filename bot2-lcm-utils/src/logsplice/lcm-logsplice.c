@@ -5,13 +5,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <regex.h>
 #include <getopt.h>
 
 #include <glib.h>
 
 #include <lcm/lcm.h>
 
+#include "lcm_log_cursor.h"
+#include "lcm_log_writer.h"
+#include "lcm_log_index.h"
+#include "lcm_channel_filter.h"
+
 static void
 usage()
 {
@@ -25,19 +29,304 @@ usage()
                 "  -h        prints this help text and exits\n"
                 "  -c CHAN   POSIX regular expression.  Channels matching this expression\n"
                 "            will be copied to the destination logfile.  Defaults to .* if\n"
-                "            left unspecified.\n"
-                "  -i        invert the regular expression CHAN, so that only channels not\n"
-                "            matching CHAN will be copied to the destination logfile.\n"
+                "            left unspecified.  Can be given more than once, to copy the\n"
+                "            channels matching any of them.\n"
+                "  -l LIST   comma separated list of channels to copy, as well as the\n"
+                "            ones matching CHAN.  Can be given more than once.\n"
+                "  -x CHAN   POSIX regular expression.  Channels matching this expression\n"
+                "            won't be copied, even if they match CHAN or are in LIST.  Can\n"
+                "            be given more than once.\n"
+                "  -L LIST   comma separated list of channels not to copy.  Can be given\n"
+                "            more than once.\n"
+                "  -i        invert CHAN and LIST, so that only channels not matching CHAN\n"
+                "            or in LIST will be copied to the destination logfile.\n"
                 "  -s START  start time.  Messages logged less than START seconds\n"
                 "            after the first message in the logfile will not be\n"
                 "            extracted.\n"
                 "  -e END    end time.  Messages logged more than END seconds\n"
                 "            after the first message in the logfile will not be\n"
                 "            extracted.\n"
-                "  -v        verbose mode. Prints a summary of channels extracted\n");
+                "  -v        verbose mode. Prints a summary of channels extracted\n"
+                "\n"
+                "Source logfiles that have been indexed with bot-lcm-logindex are\n"
+                "read through their indexes, skipping the parts that are before START\n"
+                "or that don't have any of the channels being extracted.\n");
     exit(1);
 }
 
+// each source is read ahead of the merge by a thread of its own, into a
+// ring of slots bounded by both count and bytes, when there's more than one
+// CPU to do it on
+#define READ_AHEAD_EVENTS 1024
+#define READ_AHEAD_BYTES (16*1024*1024)
+#define READ_AHEAD_BATCH 64 // events the reader hands over at once
+#define READ_AHEAD_PAGE_SIZE 4096
+
+typedef struct {
+    lcm_log_event_t event;
+    char *channel;  // the event's channel and, for logs that aren't mapped,
+    int channel_sz; // its data, copied since the cursor reuses its own
+    uint8_t *data;
+    int data_sz;
+} slot_t;
+
+typedef struct {
+    lcm_log_cursor_t *cursor;
+    lcm_log_index_t *index; // NULL if the log hasn't been indexed
+    uint8_t *wanted;        // which of the index's channels are extracted, NULL for all
+    int next_chunk;
+
+    GThread *thread;        // NULL if the source isn't read ahead
+    GMutex *lock;           // protects everything below
+    GCond *cond;            // signalled whenever any of it changes
+    int count;              // slots filled and not yet handed back, including the one being merged
+    int64_t bytes;          // of event data in them
+    int eof;
+    int quit;
+    int reader_waiting;     // for the merge to hand back slots
+    int merge_waiting;      // for the reader to fill them
+    int have_window;        // the reader waits for the window after the first event
+    int64_t start_timestamp;
+    int64_t end_timestamp;
+
+    slot_t slots[READ_AHEAD_EVENTS];
+    int tail;               // the next slot the reader fills
+    uint8_t touched;        // so that touching the pages isn't optimized out
+
+    // only used by the merge
+    int head;               // the slot being merged
+    int ready;              // filled slots after head that the merge knows about
+    int released;           // slots merged but not yet handed back
+    int64_t released_bytes;
+} source_t;
+
+// reads the source's next event straight from its log, skipping the chunks
+// that the index says have nothing in the window to extract
+static const lcm_log_event_t *
+_source_read(source_t *src, int have_window, int64_t start_timestamp, int64_t end_timestamp)
+{
+    if (have_window && src->index)
+        lcm_log_index_skip(src->index, src->cursor, &src->next_chunk, src->wanted,
+                start_timestamp, end_timestamp);
+    return lcm_log_cursor_next(src->cursor);
+}
+
+// returns a sum over the pages touched
+static uint8_t
+_fill_slot(slot_t *slot, const lcm_log_event_t *event)
+{
+    slot->event = *event;
+    if (slot->channel_sz < event->channellen + 1) {
+        free(slot->channel);
+        slot->channel_sz = event->channellen + 1;
+        slot->channel = malloc(slot->channel_sz);
+    }
+    memcpy(slot->channel, event->channel, event->channellen + 1);
+    slot->event.channel = slot->channel;
+
+    if (event->offset < 0) {
+        if (slot->data_sz < event->datalen) {
+            free(slot->data);
+            slot->data_sz = event->datalen;
+            slot->data = malloc(slot->data_sz);
+        }
+        memcpy(slot->data, event->data, event->datalen);
+        slot->event.data = slot->data;
+        return 0;
+    }
+    // the data stays in the mapping, but fault it in here rather than on
+    // the merge's thread
+    uint8_t sum = 0;
+    for (int32_t i = 0; i < event->datalen; i += READ_AHEAD_PAGE_SIZE)
+        sum += event->data[i];
+    return sum;
+}
+
+static gpointer
+_read_ahead_thread(gpointer user_data)
+{
+    source_t *src = (source_t *) user_data;
+    int nread = 0;
+
+    g_mutex_lock(src->lock);
+    while (1) {
+        while (!src->quit && (src->count == READ_AHEAD_EVENTS || src->bytes >= READ_AHEAD_BYTES
+                || (nread > 0 && !src->have_window))) {
+            src->reader_waiting = 1;
+            g_cond_wait(src->cond, src->lock);
+            src->reader_waiting = 0;
+        }
+        if (src->quit)
+            break;
+        int room = READ_AHEAD_EVENTS - src->count;
+        int64_t room_bytes = READ_AHEAD_BYTES - src->bytes;
+        int have_window = src->have_window;
+        int64_t start_timestamp = src->start_timestamp;
+        int64_t end_timestamp = src->end_timestamp;
+        g_mutex_unlock(src->lock);
+
+        // fill a batch of slots before taking the lock again
+        int n = 0;
+        int64_t nbytes = 0;
+        int eof = 0;
+        uint8_t touched = 0;
+        while (n < room && n < READ_AHEAD_BATCH && nbytes < room_bytes) {
+            const lcm_log_event_t *event = _source_read(src, have_window, start_timestamp, end_timestamp);
+            if (!event) {
+                eof = 1;
+                break;
+            }
+            touched += _fill_slot(&src->slots[src->tail], event);
+            src->tail = (src->tail + 1) % READ_AHEAD_EVENTS;
+            n++;
+            nbytes += event->datalen;
+            // the first event goes over on its own, the window depends on it
+            if (nread++ == 0)
+                break;
+        }
+        src->touched += touched;
+
+        g_mutex_lock(src->lock);
+        src->count += n;
+        src->bytes += nbytes;
+        src->eof = eof;
+        if (src->merge_waiting)
+            g_cond_broadcast(src->cond);
+        if (eof)
+            break;
+    }
+    g_mutex_unlock(src->lock);
+    return NULL;
+}
+
+// hands the merged slots back to the reader, and waits for the next event
+// if the merge doesn't already know it's there
+static const lcm_log_event_t *
+_source_sync(source_t *src)
+{
+    if (!src->thread)
+        return _source_read(src, src->have_window, src->start_timestamp, src->end_timestamp);
+    g_mutex_lock(src->lock);
+    if (src->released) {
+        src->count -= src->released;
+        src->bytes -= src->released_bytes;
+        src->released = 0;
+        src->released_bytes = 0;
+        if (src->reader_waiting)
+            g_cond_broadcast(src->cond);
+    }
+    while (src->count == 0 && !src->eof) {
+        src->merge_waiting = 1;
+        g_cond_wait(src->cond, src->lock);
+        src->merge_waiting = 0;
+    }
+    src->ready = src->count > 0 ? src->count - 1 : 0;
+    int count = src->count;
+    g_mutex_unlock(src->lock);
+    return count > 0 ? &src->slots[src->head].event : NULL;
+}
+
+// the source's next event, which stays valid until the source is advanced
+// again
+static const lcm_log_event_t *
+_source_next(source_t *src)
+{
+    if (!src->thread)
+        return _source_read(src, src->have_window, src->start_timestamp, src->end_timestamp);
+    src->released++;
+    src->released_bytes += src->slots[src->head].event.datalen;
+    src->head = (src->head + 1) % READ_AHEAD_EVENTS;
+    // only take the lock once in a while, to hand back a batch of slots
+    if (src->ready > 0 && src->released < READ_AHEAD_EVENTS / 4
+            && src->released_bytes < READ_AHEAD_BYTES / 4) {
+        src->ready--;
+        return &src->slots[src->head].event;
+    }
+    return _source_sync(src);
+}
+
+static void
+_source_set_window(source_t *src, int64_t start_timestamp, int64_t end_timestamp)
+{
+    if (src->thread)
+        g_mutex_lock(src->lock);
+    src->start_timestamp = start_timestamp;
+    src->end_timestamp = end_timestamp;
+    src->have_window = 1;
+    if (src->thread) {
+        g_cond_broadcast(src->cond);
+        g_mutex_unlock(src->lock);
+    }
+}
+
+static void
+_source_destroy(source_t *src)
+{
+    if (src->thread) {
+        g_mutex_lock(src->lock);
+        src->quit = 1;
+        g_cond_broadcast(src->cond);
+        g_mutex_unlock(src->lock);
+        g_thread_join(src->thread);
+        g_mutex_free(src->lock);
+        g_cond_free(src->cond);
+    }
+    for (int i = 0; i < READ_AHEAD_EVENTS; i++) {
+        free(src->slots[i].channel);
+        free(src->slots[i].data);
+    }
+    if (src->cursor)
+        lcm_log_cursor_destroy(src->cursor);
+    if (src->index)
+        lcm_log_index_destroy(src->index);
+    free(src->wanted);
+}
+
+// the merge keeps the sources with events left in a min heap on their next
+// event's timestamp, earlier sources first on ties.  The timestamps are
+// kept in the heap so that comparing doesn't go through the slots.
+typedef struct {
+    int64_t timestamp;
+    int src;
+} heap_entry_t;
+
+static inline int
+_heap_before(const heap_entry_t *a, const heap_entry_t *b)
+{
+    return a->timestamp < b->timestamp || (a->timestamp == b->timestamp && a->src < b->src);
+}
+
+static void
+_heap_sift_down(heap_entry_t *heap, int n, int i)
+{
+    heap_entry_t e = heap[i];
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && _heap_before(&heap[child + 1], &heap[child]))
+            child++;
+        if (!_heap_before(&heap[child], &e))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = e;
+}
+
+// moves the source at the top of the heap on to its next event
+static void
+_advance(source_t *src_logs, const lcm_log_event_t **events, heap_entry_t *heap, int *heap_size)
+{
+    int mind = heap[0].src;
+    events[mind] = _source_next(&src_logs[mind]);
+    if (events[mind] == NULL)
+        heap[0] = heap[--(*heap_size)];
+    else
+        heap[0].timestamp = events[mind]->timestamp;
+    _heap_sift_down(heap, *heap_size, 0);
+}
+
 static void
 _verbose_entry_summary(gpointer key, gpointer value, gpointer user_data)
 {
@@ -49,14 +338,14 @@ main(int argc, char **argv)
 {
     int verbose = 0;
     int filterChannels =0;
-    char *pattern = strdup(".*");
     char *dest_fname = NULL;
     int64_t start_utime = 0;
     int64_t end_utime = -1;
     int have_end_utime = 0;
     int invert_regex = 0;
+    lcm_channel_filter_t *channels = lcm_channel_filter_create();
 
-    char *optstring = "hc:vs:e:i";
+    char *optstring = "hc:vs:e:il:x:L:";
     int c;
 
     while ((c = getopt_long(argc, argv, optstring, NULL, 0)) >= 0) {
@@ -89,8 +378,11 @@ main(int argc, char **argv)
             filterChannels = 1;
             break;
         case 'c':
-            free(pattern);
-            pattern = strdup(optarg);
+        case 'l':
+        case 'x':
+        case 'L':
+            if (lcm_channel_filter_add_rule(channels, c, optarg) != 0)
+                exit(1);
             filterChannels = 1;
             break;
         case 'v':
@@ -108,35 +400,41 @@ main(int argc, char **argv)
     if (optind > argc - 3)
         usage();
 
-    regex_t preg;
-    if (0 != regcomp(&preg, pattern, REG_NOSUB | REG_EXTENDED)) {
-        fprintf(stderr, "bad regex\n");
-        exit(1);
-    }
+    // with a single CPU, the read ahead threads would only take turns with
+    // the merge, so the sources are read as they're needed instead
+    int read_ahead = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    if (read_ahead && !g_thread_supported())
+        g_thread_init(NULL);
+
+    // the channels to copy are decided once for each channel name, not for
+    // every event
+    lcm_channel_filter_finish_rules(channels, invert_regex);
 
     int num_src_logs = argc - optind - 1;
     fprintf(stderr, "Splicing together %d logs\n", num_src_logs);
-    lcm_eventlog_t *src_logs[num_src_logs];
-    for (int i = 0; i < argc - optind - 1; i++) {
+    source_t *src_logs = calloc(num_src_logs, sizeof(source_t));
+    for (int i = 0; i < num_src_logs; i++) {
         char * src_fname = argv[optind + i];
-        src_logs[i] = lcm_eventlog_create(src_fname, "r");
-        if (!src_logs[i]) {
+        src_logs[i].cursor = lcm_log_cursor_create(src_fname);
+        if (!src_logs[i].cursor) {
             perror("Unable to open source logfile");
             for (int j = 0; j < i; j++)
-                lcm_eventlog_destroy(src_logs[j]);
-            regfree(&preg);
+                _source_destroy(&src_logs[j]);
+            free(src_logs);
+            lcm_channel_filter_destroy(channels);
             return 1;
         }
     }
 
     dest_fname = argv[argc - 1];
 
-    lcm_eventlog_t *dst_log = lcm_eventlog_create(dest_fname, "w");
+    lcm_log_writer_t *dst_log = lcm_log_writer_create(dest_fname);
     if (!dst_log) {
         perror("Unable to open destination logfile");
         for (int i = 0; i < num_src_logs; i++)
-            lcm_eventlog_destroy(src_logs[i]);
-        regfree(&preg);
+            _source_destroy(&src_logs[i]);
+        free(src_logs);
+        lcm_channel_filter_destroy(channels);
         return 1;
     }
 
@@ -145,27 +443,68 @@ main(int argc, char **argv)
     int nwritten = 0;
     int have_first_event_timestamp = 0;
     int64_t first_event_timestamp = -1;
+    int write_failed = 0;
 
-    lcm_eventlog_event_t *events[num_src_logs];
-    for (int i = 0; i < num_src_logs; i++)
-        events[i] = lcm_eventlog_read_next_event(src_logs[i]);
-    while (1) {
-        lcm_eventlog_event_t *event;
-        int mind = -1;
-        int64_t mtime = INT64_MAX;
+    // each source's next event, which stays valid until that source is
+    // advanced again
+    const lcm_log_event_t *events[num_src_logs];
+    if (read_ahead) {
         for (int i = 0; i < num_src_logs; i++) {
-            if (events[i] == NULL)
-                continue;
-            else if (events[i]->timestamp < mtime) {
-                mtime = events[i]->timestamp;
-                mind = i;
+            src_logs[i].lock = g_mutex_new();
+            src_logs[i].cond = g_cond_new();
+            src_logs[i].thread = g_thread_create(_read_ahead_thread, &src_logs[i], 1, NULL);
+        }
+    }
+    for (int i = 0; i < num_src_logs; i++)
+        events[i] = _source_sync(&src_logs[i]);
+
+    // the first event out is the earliest of the first ones read, so the time
+    // window is known now, and the indexed logs can skip ahead to it
+    int64_t start_timestamp = INT64_MIN;
+    int64_t end_timestamp = INT64_MAX;
+    for (int i = 0; i < num_src_logs; i++)
+        if (events[i] && (!have_first_event_timestamp || events[i]->timestamp < first_event_timestamp)) {
+            first_event_timestamp = events[i]->timestamp;
+            have_first_event_timestamp = 1;
+        }
+    if (have_first_event_timestamp) {
+        start_timestamp = first_event_timestamp + start_utime;
+        if (have_end_utime)
+            end_timestamp = first_event_timestamp + end_utime;
+    }
+    for (int i = 0; i < num_src_logs && have_first_event_timestamp; i++) {
+        lcm_log_index_t *index = lcm_log_index_open(argv[optind + i]);
+        if (!index)
+            continue;
+        src_logs[i].index = index;
+        if (filterChannels) {
+            src_logs[i].wanted = calloc(index->num_channels + 1, 1);
+            for (int j = 0; j < index->num_channels; j++) {
+                src_logs[i].wanted[j] = lcm_channel_filter_match(channels, index->channels[j].name);
             }
         }
-        if (mind < 0) //all are null
-            break;
+        if (verbose)
+            printf("using the index of %s\n", argv[optind + i]);
+    }
+    for (int i = 0; i < num_src_logs; i++)
+        _source_set_window(&src_logs[i], start_timestamp, end_timestamp);
+
+    heap_entry_t heap[num_src_logs];
+    int heap_size = 0;
+    for (int i = 0; i < num_src_logs; i++)
+        if (events[i] != NULL) {
+            heap[heap_size].timestamp = events[i]->timestamp;
+            heap[heap_size].src = i;
+            heap_size++;
+        }
+    for (int i = heap_size / 2 - 1; i >= 0; i--)
+        _heap_sift_down(heap, heap_size, i);
+
+    while (heap_size > 0) {
+        const lcm_log_event_t *event;
+        int mind = heap[0].src;
 
         event = events[mind];
-        events[mind] = lcm_eventlog_read_next_event(src_logs[mind]);
 
         if (!have_first_event_timestamp) {
             first_event_timestamp = event->timestamp;
@@ -174,22 +513,17 @@ main(int argc, char **argv)
 
         int64_t elapsed = event->timestamp - first_event_timestamp;
         if (elapsed < start_utime) {
-            lcm_eventlog_free_event(event);
+            _advance(src_logs, events, heap, &heap_size);
             continue;
         }
-        if (have_end_utime && elapsed > end_utime) {
-            lcm_eventlog_free_event(event);
+        if (have_end_utime && elapsed > end_utime)
             break;
-        }
 
-        int copy_to_dest = 1;
-        if (filterChannels) {
-            int regmatch = regexec(&preg, event->channel, 0, NULL, 0);
-            copy_to_dest = (regmatch == 0 && !invert_regex) || (regmatch != 0
-                    && invert_regex);
-        }
-        if (copy_to_dest) {
-            lcm_eventlog_write_event(dst_log, event);
+        if (!filterChannels || lcm_channel_filter_match(channels, event->channel)) {
+            if (lcm_log_writer_write_event(dst_log, event) != 0) {
+                write_failed = 1;
+                break;
+            }
             nwritten++;
 
             if (verbose) {
@@ -204,7 +538,7 @@ main(int argc, char **argv)
                 }
             }
         }
-        lcm_eventlog_free_event(event);
+        _advance(src_logs, events, heap, &heap_size);
     }
 
     if (verbose) {
@@ -213,10 +547,16 @@ main(int argc, char **argv)
         printf("Events written: %d\n", nwritten);
     }
 
-    regfree(&preg);
+    lcm_channel_filter_destroy(channels);
     for (int i = 0; i < num_src_logs; i++)
-        lcm_eventlog_destroy(src_logs[i]);
-    lcm_eventlog_destroy(dst_log);
+        _source_destroy(&src_logs[i]);
+    free(src_logs);
+    if (lcm_log_writer_destroy(dst_log) != 0)
+        write_failed = 1;
     g_hash_table_destroy(counts);
+    if (write_failed) {
+        perror("Unable to write destination logfile");
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,69 @@
+/*
+ * channel_regex_test.c
+ *
+ * checks that the channel patterns bot-lcm-tunnel subscribes with, including
+ * the lookaheads that -S and -R generate, compile and match the channels
+ * they should
+ */
+#include <stdio.h>
+
+#include "lcm_util.h"
+
+static int failures = 0;
+
+static void
+check(const char *channels, const char *channel, int expected)
+{
+    GRegex *regex = bot_lcm_channel_regex_new(channels);
+    int matched = regex != NULL && g_regex_match(regex, channel, (GRegexMatchFlags) 0, NULL);
+    if (matched != expected) {
+        printf("FAIL: \"%s\" %s \"%s\"\n", channels, expected ? "should match" : "shouldn't match", channel);
+        failures++;
+    }
+    if (regex != NULL)
+        g_regex_unref(regex);
+}
+
+static void
+check_invalid(const char *channels)
+{
+    GRegex *regex = bot_lcm_channel_regex_new(channels);
+    if (regex != NULL) {
+        printf("FAIL: \"%s\" shouldn't compile\n", channels);
+        failures++;
+        g_regex_unref(regex);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    // anchored at both ends, with ^ and $ around the pattern as it's given,
+    // just like LCM does it
+    check("(POSE|GPS)", "POSE", 1);
+    check("(POSE|GPS)", "GPS", 1);
+    check("(POSE|GPS)", "POSE_2", 0);
+    check("(POSE|GPS)", "XGPS", 0);
+    check("POSE|GPS", "POSE_2", 1);
+    check(".*", "ANYTHING", 1);
+
+    // what -S FOO and -R FOO generate
+    check("^(?!^FOO$).*+$", "FOO", 0);
+    check("^(?!^FOO$).*+$", "FOOD", 1);
+    check("^(?!^FOO$).*+$", "BAR", 1);
+    check("^(?!^(FOO|BAR)$).*+$", "BAR", 0);
+    check("^(?!^(FOO|BAR)$).*+$", "BAZ", 1);
+
+    // backreferences keep their numbering
+    check("(CAM)_\\1", "CAM_CAM", 1);
+    check("(CAM)_\\1", "CAM_LEFT", 0);
+
+    check_invalid("(BAD");
+    check_invalid("");
+
+    if (failures)
+        printf("%d checks failed\n", failures);
+    else
+        printf("all checks passed\n");
+    return failures != 0;
+}
@@ -4,30 +4,28 @@
 #include <inttypes.h>
 #include <getopt.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <assert.h>
+#include <errno.h>
 #include <signal.h>
+#include <zlib.h>
 
 #include <lcm/lcm.h>
 
 #include "ssocket.h"
 #include "lcm_tunnel.h"
 #include "lcm_tunnel_server.h"
+#include "lz_codec.h"
+#include "lcm_util.h"
 
 static inline void check_ret(int ret)
 {
   assert(ret==0);
 }
 
-static inline int64_t _timestamp_now()
-{
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-  return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
-}
-
 static inline void _timestamp_to_GTimeVal(int64_t v, GTimeVal *ts)
 {
   ts->tv_sec = v / 1000000;
@@ -52,19 +50,263 @@ static int _fileutils_write_fully(int fd, const void *b, int len)
   return cnt;
 }
 
+//fields in the TCP receive buffer aren't necessarily aligned
+static inline int _read_field_size(const char *field)
+{
+  uint32_t size_n;
+  memcpy(&size_n, field, 4);
+  return ntohl(size_n);
+}
+
+//writes out all of iov, picking up where a short write left off.  Returns
+//the number of bytes written, or -1 on an error.  iov gets clobbered.
+static int _fileutils_writev_fully(int fd, struct iovec *iov, int iovcnt)
+{
+  int cnt = 0;
+  while (iovcnt > 0) {
+    ssize_t thiscnt = writev(fd, iov, iovcnt);
+    if (thiscnt < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("writev");
+      return -1;
+    }
+    cnt += thiscnt;
+    //skip what went out
+    while (iovcnt > 0 && (size_t) thiscnt >= iov->iov_len) {
+      thiscnt -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *) iov->iov_base + thiscnt;
+      iov->iov_len -= thiscnt;
+    }
+  }
+  return cnt;
+}
+
+//size of everything in an encoded lcm_tunnel_udp_msg_t but the data
+#define UDP_MSG_HEADER_SIZE 26
+//a sub message encodes to at least 17 bytes, which bounds how many of them a fragment can span
+#define MAX_IOV_PER_FRAGMENT (MAX_PAYLOAD_BYTES_PER_FRAGMENT / 17 + 2)
+
+static int _encode_udp_msg_header(uint8_t *buf, const lcm_tunnel_udp_msg_t *msg)
+{
+  int64_t hash = __lcm_tunnel_udp_msg_t_get_hash();
+  int pos = 0;
+  pos += __int64_t_encode_array(buf, pos, UDP_MSG_HEADER_SIZE - pos, &hash, 1);
+  pos += __int16_t_encode_array(buf, pos, UDP_MSG_HEADER_SIZE - pos, &msg->seqno, 1);
+  pos += __int16_t_encode_array(buf, pos, UDP_MSG_HEADER_SIZE - pos, &msg->fragno, 1);
+  pos += __int16_t_encode_array(buf, pos, UDP_MSG_HEADER_SIZE - pos, &msg->fec_rate, 1);
+  pos += __int32_t_encode_array(buf, pos, UDP_MSG_HEADER_SIZE - pos, &msg->datagram_no, 1);
+  pos += __int32_t_encode_array(buf, pos, UDP_MSG_HEADER_SIZE - pos, &msg->payload_size, 1);
+  pos += __int32_t_encode_array(buf, pos, UDP_MSG_HEADER_SIZE - pos, &msg->data_size, 1);
+  assert(pos == UDP_MSG_HEADER_SIZE);
+  return pos;
+}
+
+//fills dst with the next len bytes of the stream made up of src, starting at
+//(*srcIdx, *srcOffset), and advances the position.  Returns the number of
+//entries used in dst.
+static int _slice_iov(const struct iovec *src, int *srcIdx, size_t *srcOffset, size_t len, struct iovec *dst)
+{
+  int n = 0;
+  while (len > 0) {
+    size_t sliceLen = MIN(len, src[*srcIdx].iov_len - *srcOffset);
+    dst[n].iov_base = (uint8_t *) src[*srcIdx].iov_base + *srcOffset;
+    dst[n].iov_len = sliceLen;
+    n++;
+    len -= sliceLen;
+    *srcOffset += sliceLen;
+    if (*srcOffset == src[*srcIdx].iov_len) {
+      (*srcIdx)++;
+      *srcOffset = 0;
+    }
+  }
+  return n;
+}
+
+//finds where offset bytes into the stream made up of src is
+static void _seek_iov(const struct iovec *src, size_t offset, int *srcIdx, size_t *srcOffset)
+{
+  *srcIdx = 0;
+  while (offset >= src[*srcIdx].iov_len) {
+    offset -= src[*srcIdx].iov_len;
+    (*srcIdx)++;
+  }
+  *srcOffset = offset;
+}
+
+//how far seqno a is ahead of b, allowing for the wrap around
+static inline int _seqno_diff(int32_t a, int32_t b)
+{
+  int d = (a - b) % SEQNO_WRAP_VAL;
+  if (d < 0)
+    d += SEQNO_WRAP_VAL;
+  return d < SEQNO_WRAP_VAL / 2 ? d : d - SEQNO_WRAP_VAL;
+}
+
+//rounds an FEC rate up to the next FEC_RATE_STEP, in hundredths
+static gint _quantize_fec_rate(double fec)
+{
+  return (gint) (ceil(fec / FEC_RATE_STEP - 1e-6) * FEC_RATE_STEP * 100 + 0.5);
+}
+
+//decodes an lcm_tunnel_udp_msg_t in place, msg->data points into buf
+static int _decode_udp_msg_header(const uint8_t *buf, int len, lcm_tunnel_udp_msg_t *msg)
+{
+  if (len < UDP_MSG_HEADER_SIZE)
+    return -1;
+  int64_t hash;
+  int pos = 0;
+  pos += __int64_t_decode_array(buf, pos, len - pos, &hash, 1);
+  if (hash != __lcm_tunnel_udp_msg_t_get_hash())
+    return -1;
+  pos += __int16_t_decode_array(buf, pos, len - pos, &msg->seqno, 1);
+  pos += __int16_t_decode_array(buf, pos, len - pos, &msg->fragno, 1);
+  pos += __int16_t_decode_array(buf, pos, len - pos, &msg->fec_rate, 1);
+  pos += __int32_t_decode_array(buf, pos, len - pos, &msg->datagram_no, 1);
+  pos += __int32_t_decode_array(buf, pos, len - pos, &msg->payload_size, 1);
+  pos += __int32_t_decode_array(buf, pos, len - pos, &msg->data_size, 1);
+  if (msg->data_size < 0 || msg->data_size > len - pos)
+    return -1;
+  msg->data = (uint8_t *) buf + pos;
+  return pos + msg->data_size;
+}
+
+static const char * _compression_name(int8_t compression)
+{
+  switch (compression) {
+  case LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE:
+    return "none";
+  case LCM_TUNNEL_SUB_MSG_T_COMPRESSION_ZLIB:
+    return "zlib";
+  case LCM_TUNNEL_SUB_MSG_T_COMPRESSION_LZ:
+    return "lz";
+  default:
+    return "unknown";
+  }
+}
+
+static int _compress_bound(int8_t compression, int size)
+{
+  switch (compression) {
+  case LCM_TUNNEL_SUB_MSG_T_COMPRESSION_ZLIB:
+    return compressBound(size);
+  case LCM_TUNNEL_SUB_MSG_T_COMPRESSION_LZ:
+    return lz_compress_bound(size);
+  default:
+    return size;
+  }
+}
+
+//returns the compressed size, or 0 if it didn't fit in dst
+static int _compress(int8_t compression, const void *src, int size, uint8_t *dst, int dst_size)
+{
+  switch (compression) {
+  case LCM_TUNNEL_SUB_MSG_T_COMPRESSION_ZLIB:
+    {
+      uLongf len = dst_size;
+      if (compress2(dst, &len, (const Bytef *) src, size, Z_BEST_SPEED) != Z_OK)
+        return 0;
+      return len;
+    }
+  case LCM_TUNNEL_SUB_MSG_T_COMPRESSION_LZ:
+    return lz_compress((const uint8_t *) src, size, dst, dst_size);
+  default:
+    return 0;
+  }
+}
+
+//returns false unless src decompresses to exactly dst_size bytes
+static bool _decompress(int8_t compression, const uint8_t *src, int size, uint8_t *dst, int dst_size)
+{
+  switch (compression) {
+  case LCM_TUNNEL_SUB_MSG_T_COMPRESSION_ZLIB:
+    {
+      uLongf len = dst_size;
+      return uncompress(dst, &len, src, size) == Z_OK && len == (uLongf) dst_size;
+    }
+  case LCM_TUNNEL_SUB_MSG_T_COMPRESSION_LZ:
+    return lz_decompress(src, size, dst, dst_size) == dst_size;
+  default:
+    return false;
+  }
+}
+
+//the compression, delta, uncompressed_size and data_size fields, which come
+//between the channel and the data in an encoded lcm_tunnel_sub_msg_t
+#define SUB_MSG_SIZES_SIZE 10
+
+TunnelLcmMessage::TunnelLcmMessage(const char *chan, const void *payload, int32_t payload_size, int64_t recv_utime_,
+    int8_t compression_, int8_t delta_) :
+  data_size(payload_size), compression(LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE), delta(delta_),
+      uncompressed_size(payload_size), compress_usec(-1), recv_utime(recv_utime_), refcount(1)
+{
+  //encode the lcm_tunnel_sub_msg_t by hand, so the payload is copied (or
+  //compressed) straight from the receive buffer into its final place
+  int32_t chan_len = strlen(chan) + 1;
+  int header_size = 8 + 4 + chan_len + SUB_MSG_SIZES_SIZE;
+  int data_capacity = payload_size;
+  if (compression_ != LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE)
+    data_capacity = MAX(data_capacity, _compress_bound(compression_, payload_size));
+  encoded = (uint8_t *) malloc(header_size + data_capacity);
+
+  if (compression_ != LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE) {
+    int64_t start = _timestamp_now();
+    int compressed_size = _compress(compression_, payload, payload_size, encoded + header_size, data_capacity);
+    compress_usec = _timestamp_now() - start;
+    if (compressed_size > 0 && compressed_size < payload_size) {
+      compression = compression_;
+      data_size = compressed_size;
+      encoded = (uint8_t *) realloc(encoded, header_size + data_size); //don't hold on to the slack
+    }
+  }
+  if (compression == LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE)
+    memcpy(encoded + header_size, payload, data_size);
+  encoded_size = header_size + data_size;
+
+  int64_t hash = __lcm_tunnel_sub_msg_t_get_hash();
+  int pos = 0;
+  pos += __int64_t_encode_array(encoded, pos, encoded_size - pos, &hash, 1);
+  pos += __string_encode_array(encoded, pos, encoded_size - pos, (char * const *) &chan, 1);
+  channel = (const char *) encoded + pos - chan_len;
+  pos += __int8_t_encode_array(encoded, pos, encoded_size - pos, &compression, 1);
+  pos += __int8_t_encode_array(encoded, pos, encoded_size - pos, &delta, 1);
+  pos += __int32_t_encode_array(encoded, pos, encoded_size - pos, &uncompressed_size, 1);
+  pos += __int32_t_encode_array(encoded, pos, encoded_size - pos, &data_size, 1);
+  assert(pos == header_size);
+  data = encoded + pos;
+}
+
 LcmTunnel::LcmTunnel(bool verbose, const char *lcm_channel) :
-  verbose(verbose), regex(NULL), buf_sz(65536), buf((char*) calloc(65536, sizeof(char))), channel_sz(65536), channel(
-      (char*) calloc(65536, sizeof(char))), recFlags_sz(1024), recFlags((char*) calloc(1024, sizeof(char))), ldpc_dec(
-      NULL), udp_fd(-1), server_udp_port(-1), udp_send_seqno(0), stopSendThread(false), bytesInQueue(0), cur_seqno(0),
-      errorStartTime(-1), numSuccessful(0), lastErrorPrintTime(-1), subscription(NULL)
+  verbose(verbose), regex(NULL), tunnel_params(NULL), buf_sz(65536), buf((char*) calloc(65536, sizeof(char))), channel_sz(65536), channel(
+      (char*) calloc(65536, sizeof(char))), decompressBuf(NULL), decompressBuf_sz(0), udp_fd(-1), server_udp_port(-1), udp_send_seqno(0), udpSendBatch(NULL), udpRecvRing(NULL), udpPacer(NULL),
+      udp_datagram_no(0), report_sid(0), recvDatagrams(0), recvBytes(0), recvAnyDatagram(false),
+      recvHighestDatagramNo(0), reportedHighestDatagramNo(0), peerReportUtime(0), peerReportRecvTime(0),
+      udpRtt(-1), fecRate(0), smoothedLoss(0), nack_sid(0), newestSeqno(-1), reassemblyBytes(0),
+      stopSendThread(false), bytesInQueue(0),
+      errorStartTime(-1), numSuccessful(0), lastErrorPrintTime(-1), nextClassToVisit(0),
+      coalesceRegex(NULL), lastLimitReportTime(0), compression(LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE),
+      deltaRegex(NULL), deltaBuf(NULL), deltaBuf_sz(0), undeltaBuf(NULL), undeltaBuf_sz(0), stats_sid(0),
+      numQueueLatencies(0), fragmentsReceived(0), batchesReceived(0), batchesLost(0), fecRecoveries(0),
+      reportedLoss(0)
 {
   //allocate and initialize things
+  memset(&sendThreadCounts, 0, sizeof(sendThreadCounts));
+  memset(&sendCounts, 0, sizeof(sendCounts));
+  recvCounts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
   init_regex(lcm_channel);
 
   //sendThread stuff
   sendQueueLock = g_mutex_new();
   sendQueueCond = g_cond_new();
+  channelInfo = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  deltaSent = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, freeDeltaChannel);
+  deltaReceived = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, freeDeltaChannel);
+  addSendClass(NULL, 0, 1, 0); //until we know the tunnel params
   sendThread = g_thread_create(sendThreadFunc, (void *) this, 1, NULL);
 
 }
@@ -93,11 +335,81 @@ bool LcmTunnel::match_regex(const char *lcm_channel)
   return regex != NULL && (g_regex_match(regex, lcm_channel, (GRegexMatchFlags) 0, NULL));
 }
 
-LcmTunnel::~LcmTunnel()
+void LcmTunnel::init_send_queues()
+{
+  g_mutex_lock(sendQueueLock);
+  clearSendQueues();
+  for (int i = 0; i < tunnel_params->num_classes; i++) {
+    const lcm_tunnel_class_t * cls = &tunnel_params->classes[i];
+    GRegex * class_regex = bot_lcm_channel_regex_new(cls->channels);
+    if (class_regex != NULL)
+      addSendClass(class_regex, cls->priority, MAX(cls->weight, 1), cls->max_delay_ms);
+  }
+  //the default class for everything else
+  addSendClass(NULL, 0, 1, tunnel_params->max_delay_ms);
+
+  coalesceRegex = bot_lcm_channel_regex_new(tunnel_params->coalesce_channels);
+  deltaRegex = bot_lcm_channel_regex_new(tunnel_params->delta_channels);
+
+  for (int i = 0; i < tunnel_params->num_limits; i++) {
+    const lcm_tunnel_limit_t * lim = &tunnel_params->limits[i];
+    rate_limit_t limit;
+    limit.regex = bot_lcm_channel_regex_new(lim->channels);
+    limit.max_rate = lim->max_rate;
+    limit.max_bandwidth = lim->max_bandwidth;
+    if (limit.regex != NULL)
+      rateLimits.push_back(limit);
+  }
+  lastLimitReportTime = _timestamp_now();
+
+  compression = tunnel_params->compression;
+  g_mutex_unlock(sendQueueLock);
+}
+
+void LcmTunnel::addSendClass(GRegex *class_regex, int priority, int weight, int max_delay_ms)
+{
+  send_class_t cls;
+  cls.regex = class_regex;
+  cls.priority = priority;
+  cls.weight = weight;
+  cls.max_delay_ms = max_delay_ms;
+  cls.bytesInQueue = 0;
+  cls.popped = 0;
+  cls.firstQueuedTime = 0;
+  cls.deficit = 0;
+  sendClasses.push_back(cls);
+}
+
+void LcmTunnel::clearSendQueues()
 {
-  if (subscription) {
-    lcm_unsubscribe(lcm, subscription);
+  for (size_t c = 0; c < sendClasses.size(); c++) {
+    send_class_t &cls = sendClasses[c];
+    while (!cls.queue.empty()) {
+      cls.queue.front()->unref();
+      cls.queue.pop_front();
+    }
+    if (cls.regex != NULL)
+      g_regex_unref(cls.regex);
   }
+  sendClasses.clear();
+  bytesInQueue = 0;
+  nextClassToVisit = 0;
+
+  if (coalesceRegex != NULL)
+    g_regex_unref(coalesceRegex);
+  coalesceRegex = NULL;
+  if (deltaRegex != NULL)
+    g_regex_unref(deltaRegex);
+  deltaRegex = NULL;
+  for (size_t i = 0; i < rateLimits.size(); i++)
+    g_regex_unref(rateLimits[i].regex);
+  rateLimits.clear();
+  g_hash_table_remove_all(channelInfo);
+}
+
+LcmTunnel::~LcmTunnel()
+{
+  LcmTunnelServer::unsubscribe(this);
 
   //cleanup the sending thread state
   g_mutex_lock(sendQueueLock);
@@ -107,14 +419,28 @@ LcmTunnel::~LcmTunnel()
   g_thread_join(sendThread); //wait for thread to exit
 
   g_mutex_lock(sendQueueLock);
-  while (!sendQueue.empty()) {
-    delete sendQueue.front();
-    sendQueue.pop_front();
+  reportRateLimits();
+  clearSendQueues();
+  while (!nackQueue.empty()) {
+    lcm_tunnel_udp_nack_t_destroy(nackQueue.front());
+    nackQueue.pop_front();
+  }
+  while (!deltaAckQueue.empty()) {
+    lcm_tunnel_delta_ack_t_destroy(deltaAckQueue.front());
+    deltaAckQueue.pop_front();
   }
   g_mutex_unlock(sendQueueLock);
+  while (!sentBatches.empty()) {
+    forgetSentBatch(sentBatches.front());
+    sentBatches.pop_front();
+  }
 
   g_mutex_free(sendQueueLock);
   g_cond_free(sendQueueCond);
+  g_hash_table_destroy(channelInfo);
+  g_hash_table_destroy(recvCounts);
+  g_hash_table_destroy(deltaSent);
+  g_hash_table_destroy(deltaReceived);
 
 
   if (udp_fd >= 0) {
@@ -126,11 +452,29 @@ LcmTunnel::~LcmTunnel()
     lcm_tunnel_disconnect_msg_t_encode(msg_buf, 0, msg_sz, &disc_msg);
     send(udp_fd, msg_buf, msg_sz, 0);
 
+    if (verbose)
+      printf("sent %lld UDP datagrams in %lld syscalls, received %lld in %lld\n",
+          (long long) udpSendBatch->datagramsSent, (long long) udpSendBatch->syscalls,
+          (long long) udpRecvRing->datagramsReceived, (long long) udpRecvRing->syscalls);
+
+    if (udpPacer != NULL && verbose)
+      printf("link rate was %.1fkB/s with %.1f%% loss and a round trip time of %.1fms\n", udpPacer->getRate()
+          / 1024.0, udpPacer->loss * 100, udpPacer->rtt * 1e-3);
+
     //close UDP socket
     close(udp_fd);
     g_io_channel_unref(udp_ioc);
     g_source_remove(udp_sid);
   }
+  if (report_sid > 0)
+    g_source_remove(report_sid);
+  if (nack_sid > 0)
+    g_source_remove(nack_sid);
+  if (stats_sid > 0)
+    g_source_remove(stats_sid);
+  delete udpSendBatch;
+  delete udpRecvRing;
+  delete udpPacer;
 
   //close TCP socket
   closeTCPSocket();
@@ -140,11 +484,18 @@ LcmTunnel::~LcmTunnel()
 
   free(buf);
   free(channel);
-  free(recFlags);
-  free(tunnel_params);
-
-  if (ldpc_dec != NULL)
-    delete ldpc_dec;
+  free(decompressBuf);
+  free(deltaBuf);
+  free(undeltaBuf);
+  if (tunnel_params != NULL)
+    lcm_tunnel_params_t_destroy(tunnel_params);
+
+  while (!reassemblies.empty()) {
+    reassembly_t * ra = reassemblies.front();
+    reassemblies.pop_front();
+    finishReassembly(ra, true);
+    delete ra;
+  }
 
 }
 
@@ -181,6 +532,7 @@ int LcmTunnel::connectToClient(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
 
   tcp_ioc = g_io_channel_unix_new(ssocket_get_fd(tcp_sock));
   tcp_sid = g_io_add_watch(tcp_ioc, G_IO_IN, on_tcp_data, this);
+  startStats();
 
   bytes_to_read = 4;
   bytes_read = 0;
@@ -195,6 +547,7 @@ int LcmTunnel::connectToServer(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
 
   tunnel_params = lcm_tunnel_params_t_copy(tunnel_params_);
   server_params = server_params_;
+  init_send_queues();
   lcm = lcm_;
   introspect = introspect_;
   mainloop = mainloop_;
@@ -221,6 +574,9 @@ int LcmTunnel::connectToServer(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
 
     getsockname(udp_fd, (struct sockaddr*) &udp_addr, &udp_addr_len);
     tunnel_params->udp_port = ntohs(udp_addr.sin_port);
+    udpSendBatch = new UdpSendBatch(udp_fd);
+    udpRecvRing = new UdpRecvRing(udp_fd);
+    initUdpLink();
 
     udp_ioc = g_io_channel_unix_new(udp_fd);
     udp_sid = g_io_add_watch(udp_ioc, G_IO_IN, LcmTunnel::on_udp_data, this);
@@ -237,6 +593,7 @@ int LcmTunnel::connectToServer(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
   }
   tcp_ioc = g_io_channel_unix_new(ssocket_get_fd(tcp_sock));
   tcp_sid = g_io_add_watch(tcp_ioc, G_IO_IN, on_tcp_data, this);
+  startStats();
 
   //fill out the name info
   struct sockaddr_in server_addr;
@@ -279,176 +636,444 @@ int LcmTunnel::connectToServer(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
     tunnel_state = SERVER_MSG_SZ; //wait for udp port from server
   }
   else {
+    //messages go out in batches, so there's nothing for Nagle to coalesce
+    if (ssocket_disable_nagle(tcp_sock) != 0)
+      return 0;
     tunnel_state = RECV_CHAN_SZ;
     //subscribe to the channels we want to send out
     //only subscribe if we're doing TCP, since UDP socket hasn't been setup yet
-    subscription = lcm_subscribe(lcm, tunnel_params->channels, on_lcm_message, this);
+    if (!LcmTunnelServer::subscribe(this, tunnel_params->channels))
+      return 0;
 
   }
   return 1;
 }
 
-int LcmTunnel::publishLcmMessagesInBuf(int numBytes)
+int LcmTunnel::publishLcmMessagesInBuf(const char *msgBuf, int numBytes)
 {
   uint32_t msgOffset = 0;
   while (msgOffset < numBytes) {
     //decode
     lcm_tunnel_sub_msg_t p;
-    msgOffset += lcm_tunnel_sub_msg_t_decode(buf, msgOffset, numBytes - msgOffset, &p);
+    msgOffset += lcm_tunnel_sub_msg_t_decode(msgBuf, msgOffset, numBytes - msgOffset, &p);
+    const uint8_t * data;
+    int32_t data_size;
     // and publish
-    LcmTunnelServer::check_and_send_to_tunnels(p.channel, p.data, p.data_size, this);
-    lcm_publish(lcm, p.channel, p.data, p.data_size);
-    if (verbose)
-      printf("publishing [%s] (%.3fKb)\n", p.channel, p.data_size * 1e-3);
+    if (decompress(p.compression, p.data, p.data_size, p.uncompressed_size, &data) && deltaDecode(p.channel,
+        p.delta, data, p.uncompressed_size, &data, &data_size)) {
+      LcmTunnelServer::check_and_send_to_tunnels(p.channel, data, data_size, this);
+      lcm_publish(lcm, p.channel, data, data_size);
+      countReceived(p.channel, data_size);
+      if (verbose)
+        printf("publishing [%s] (%.3fKb)\n", p.channel, data_size * 1e-3);
+    }
 
     check_ret(lcm_tunnel_sub_msg_t_decode_cleanup(&p));
   }
   assert(msgOffset==numBytes);
+  return msgOffset;
+}
+
+//points uncompressed at the payload, which may be in decompressBuf.
+//Returns false if it's corrupt.
+bool LcmTunnel::decompress(int8_t data_compression, const uint8_t *data, int32_t data_size,
+    int32_t uncompressed_size, const uint8_t **uncompressed)
+{
+  if (data_compression == LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE && data_size == uncompressed_size) {
+    *uncompressed = data;
+    return true;
+  }
+  if (data_compression == LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE || uncompressed_size < 0) {
+    fprintf(stderr, "Received a corrupt compressed message!\n");
+    return false;
+  }
+  if (decompressBuf_sz < uncompressed_size) {
+    free(decompressBuf);
+    decompressBuf = (uint8_t *) malloc(uncompressed_size);
+    decompressBuf_sz = decompressBuf != NULL ? uncompressed_size : 0;
+  }
+  if (decompressBuf == NULL || !_decompress(data_compression, data, data_size, decompressBuf, uncompressed_size)) {
+    fprintf(stderr, "Received a corrupt compressed message!\n");
+    return false;
+  }
+  *uncompressed = decompressBuf;
+  return true;
 }
 
 int LcmTunnel::on_udp_data(GIOChannel * source, GIOCondition cond, void *user_data)
 {
   LcmTunnel * self = (LcmTunnel*) user_data;
 
-  uint8_t recv_buffer[65535];
-
-  int recv_status = recv(self->udp_fd, recv_buffer, 65535, 0);
-
-  if (recv_status < 0) {
-    perror("recv error: ");
+  //drain everything that's waiting on the socket in one go
+  int numRecv = self->udpRecvRing->receive();
+  if (numRecv < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+      perror("recv error: ");
     return TRUE;
     //    LcmTunnelServer::disconnectClient(self);
   }
 
-  lcm_tunnel_udp_msg_t * recv_udp_msg = (lcm_tunnel_udp_msg_t *) calloc(1, sizeof(lcm_tunnel_udp_msg_t));
-  int decode_ret = lcm_tunnel_udp_msg_t_decode(recv_buffer, 0, recv_status, recv_udp_msg);
-  if (decode_ret < 0) {
-    lcm_tunnel_disconnect_msg_t disc_msg;
-    decode_ret = lcm_tunnel_disconnect_msg_t_decode(recv_buffer, 0, recv_status, &disc_msg);
-    if (decode_ret >= 0) {
-      fprintf(stderr, "Received a disconnect message... disconnecting!\n");
-      LcmTunnelServer::disconnectClient(self);
+  for (int i = 0; i < numRecv; i++) {
+    const uint8_t * recv_buffer = self->udpRecvRing->data(i);
+    int recv_status = self->udpRecvRing->size(i);
+
+    lcm_tunnel_udp_msg_t recv_udp_msg;
+    int decode_ret = -1;
+    if (!self->udpRecvRing->truncated(i))
+      decode_ret = _decode_udp_msg_header(recv_buffer, recv_status, &recv_udp_msg);
+    if (decode_ret < 0) {
+      lcm_tunnel_udp_report_t report;
+      if (lcm_tunnel_udp_report_t_decode(recv_buffer, 0, recv_status, &report) >= 0) {
+        self->handleUdpReport(&report);
+        continue;
+      }
+      lcm_tunnel_udp_nack_t nack;
+      if (lcm_tunnel_udp_nack_t_decode(recv_buffer, 0, recv_status, &nack) >= 0) {
+        //the send thread owns what's been sent, so it answers
+        g_mutex_lock(self->sendQueueLock);
+        self->nackQueue.push_back(lcm_tunnel_udp_nack_t_copy(&nack));
+        g_cond_broadcast(self->sendQueueCond);
+        g_mutex_unlock(self->sendQueueLock);
+        lcm_tunnel_udp_nack_t_decode_cleanup(&nack);
+        continue;
+      }
+      lcm_tunnel_delta_ack_t ack;
+      if (lcm_tunnel_delta_ack_t_decode(recv_buffer, 0, recv_status, &ack) >= 0) {
+        //likewise for what it's sent
+        g_mutex_lock(self->sendQueueLock);
+        self->deltaAckQueue.push_back(lcm_tunnel_delta_ack_t_copy(&ack));
+        g_mutex_unlock(self->sendQueueLock);
+        lcm_tunnel_delta_ack_t_decode_cleanup(&ack);
+        continue;
+      }
+      lcm_tunnel_disconnect_msg_t disc_msg;
+      decode_ret = lcm_tunnel_disconnect_msg_t_decode(recv_buffer, 0, recv_status, &disc_msg);
+      if (decode_ret >= 0) {
+        fprintf(stderr, "Received a disconnect message... disconnecting!\n");
+        LcmTunnelServer::disconnectClient(self);
+        return TRUE; //self is gone
+      }
+      else {
+        fprintf(stderr, "Received Corrupted UDP packet!\n");
+      }
+      continue;
     }
-    else {
-      fprintf(stderr, "Received Corrupted UDP packet!\n");
+
+    //for the next report
+    self->fragmentsReceived++;
+    self->recvDatagrams++;
+    self->recvBytes += recv_status;
+    if (!self->recvAnyDatagram) {
+      self->reportedHighestDatagramNo = recv_udp_msg.datagram_no - 1;
+      self->recvHighestDatagramNo = recv_udp_msg.datagram_no;
+      self->recvAnyDatagram = true;
+    }
+    else if (recv_udp_msg.datagram_no - self->recvHighestDatagramNo > 0) {
+      self->recvHighestDatagramNo = recv_udp_msg.datagram_no;
     }
 
+    self->handleUdpFragment(&recv_udp_msg);
   }
 
-  //  printf("received: %d, %d / %d\n", recv_udp_msg->seqno, recv_udp_msg->fragment, recv_udp_msg->nfrags);
+  return TRUE;
+}
 
+void LcmTunnel::initUdpLink()
+{
+  delete udpPacer;
+  udpPacer = NULL;
+  if (tunnel_params->link_rate != 0)
+    udpPacer = new UdpPacer(tunnel_params->link_rate);
+  if (report_sid > 0)
+    g_source_remove(report_sid);
+  report_sid = g_timeout_add(UDP_REPORT_INTERVAL_MS, on_report_timer, this);
+
+  //start out at the FEC rate we were asked for, the reports take it from there
+  if (tunnel_params->fec > 1)
+    g_atomic_int_set(&fecRate, _quantize_fec_rate(tunnel_params->fec));
+  smoothedLoss = 0;
+  if (nack_sid > 0)
+    g_source_remove(nack_sid);
+  nack_sid = g_timeout_add(NACK_CHECK_INTERVAL_MS, on_nack_timer, this);
+}
+
+double LcmTunnel::currentFecRate()
+{
+  if (tunnel_params->fec > 1)
+    return g_atomic_int_get(&fecRate) / 100.0;
+  return tunnel_params->fec;
+}
+
+gboolean LcmTunnel::on_report_timer(gpointer user_data)
+{
+  LcmTunnel * self = (LcmTunnel*) user_data;
+  if (self->server_udp_port <= 0)
+    return TRUE; //not connected yet
 
-  if (self->verbose, recv_udp_msg->seqno < self->cur_seqno) {
-    printf("Got Out of order packet!\n");
+  lcm_tunnel_udp_report_t report;
+  int64_t now = _timestamp_now();
+  report.utime = now;
+  report.echo_utime = self->peerReportUtime;
+  report.echo_delay = self->peerReportUtime > 0 ? now - self->peerReportRecvTime : 0;
+  report.datagrams_received = self->recvDatagrams;
+  report.datagrams_expected = self->recvHighestDatagramNo - self->reportedHighestDatagramNo;
+  report.bytes_received = self->recvBytes;
+  self->recvDatagrams = 0;
+  self->recvBytes = 0;
+  self->reportedHighestDatagramNo = self->recvHighestDatagramNo;
+
+  int msg_sz = lcm_tunnel_udp_report_t_encoded_size(&report);
+  uint8_t msg_buf[msg_sz];
+  lcm_tunnel_udp_report_t_encode(msg_buf, 0, msg_sz, &report);
+  send(self->udp_fd, msg_buf, msg_sz, 0);
+  return TRUE;
+}
+
+void LcmTunnel::handleUdpReport(const lcm_tunnel_udp_report_t *report)
+{
+  int64_t now = _timestamp_now();
+  int64_t rtt = -1;
+  if (report->echo_utime > 0)
+    rtt = now - report->echo_utime - report->echo_delay;
+  double deliveredRate = -1;
+  if (peerReportUtime > 0 && report->utime > peerReportUtime)
+    deliveredRate = report->bytes_received * 1e6 / (report->utime - peerReportUtime);
+  peerReportUtime = report->utime;
+  peerReportRecvTime = now;
+  if (rtt >= 0)
+    udpRtt = rtt;
+
+  //nothing to go on unless we've been sending
+  if (report->datagrams_expected <= 0)
+    return;
+  double loss = MAX(0, 1 - (double) report->datagrams_received / report->datagrams_expected);
+  reportedLoss = loss;
+  if (udpPacer != NULL) {
+    udpPacer->onReport(loss, rtt, deliveredRate, now);
+    if (verbose && rtt >= 0 && deliveredRate >= 0)
+      printf("%s link rate %.1fkB/s, delivered %.1fkB/s with %.1f%% loss and a round trip time of %.1fms\n", name,
+          udpPacer->getRate() / 1024.0, deliveredRate / 1024.0, loss * 100, rtt * 1e-3);
   }
 
-  // start of a new message?
-  if (recv_udp_msg->seqno > self->cur_seqno || recv_udp_msg->seqno < (int32_t) self->cur_seqno - SEQNO_WRAP_GAP) { //handle wrap-around with second part
-    if (!self->message_complete && self->cur_seqno > 0 || recv_udp_msg->seqno > (self->cur_seqno + 1)) {
-      printf("packets %d to %d dropped! with %d of %d fragments received, ", self->cur_seqno, recv_udp_msg->seqno - 1,
-          self->numFragsRec, self->nfrags);
-      if (self->tunnel_params->fec > 1 && self->nfrags >= MIN_NUM_FRAGMENTS_FOR_FEC) {
-        printf("was FECed\n");
-      }
-      else
-        printf("not FECed\n");
-    }
-    self->cur_seqno = recv_udp_msg->seqno;
-    self->nfrags = getNumFragments(recv_udp_msg->payload_size);
-    self->numFragsRec = 0;
-    //increase the recFlags buffers
-    if (self->recFlags_sz < self->nfrags) {
-      self->recFlags_sz = self->nfrags;
-      self->recFlags = (char *) realloc(self->recFlags, self->recFlags_sz);
-    }
-    memset(self->recFlags, 0, self->recFlags_sz); //mark all frags as unreceived
-    self->completeTo_fragno = 0;
-    self->fragment_buf_offset = 0;
-
-    int messageSize = recv_udp_msg->payload_size;
-    // increase buffer size if needed, also make enough space for the channel in case we're using FEC
-    if (self->buf_sz < messageSize) {
-      self->buf = (char *) realloc(self->buf, messageSize);
-      self->buf_sz = messageSize;
+  if (tunnel_params->fec > 1) {
+    //code for the loss we're seeing, going up with it straight away, but
+    //only coming down slowly
+    smoothedLoss = MAX(loss, smoothedLoss * 0.8 + loss * 0.2);
+    double target = FEC_LOSS_MARGIN / (1 - MIN(smoothedLoss, 0.9));
+    gint rate = _quantize_fec_rate(CLAMP(target, MIN_FEC_RATE, MAX_FEC_RATE));
+    if (rate != g_atomic_int_get(&fecRate)) {
+      g_atomic_int_set(&fecRate, rate);
+      if (verbose)
+        printf("%s FEC rate now %.2f for %.1f%% loss\n", name, rate / 100.0, smoothedLoss * 100);
     }
+  }
+}
+
+//asks for the fragments a batch is missing, if it's stalled
+void LcmTunnel::sendNack(reassembly_t *ra, int64_t now)
+{
+  if (ra->nacksSent >= MAX_NACKS_PER_BATCH || now - ra->startTime > RETRANSMIT_DEADLINE_USEC)
+    return; //not worth asking any more
+
+  //give fragments that are only slow to arrive, e.g. because they're being
+  //paced, or that we've already asked for, a chance to get here
+  int64_t delay = MIN_NACK_DELAY_USEC;
+  if (ra->numFragsRec > 1)
+    delay = MAX(delay, 4 * (ra->lastFragmentTime - ra->startTime) / (ra->numFragsRec - 1));
+  if (ra->nacksSent > 0 && udpRtt > 0)
+    delay = MAX(delay, udpRtt + MIN_NACK_DELAY_USEC);
+  if (now - ra->lastFragmentTime < delay)
+    return;
+
+  int16_t missing[MAX_NACK_FRAGMENTS];
+  lcm_tunnel_udp_nack_t nack;
+  nack.seqno = ra->seqno;
+  nack.num_missing = 0;
+  nack.missing = missing;
+  for (uint32_t i = 0; i < ra->nfrags && nack.num_missing < MAX_NACK_FRAGMENTS; i++) {
+    if (!ra->recFlags[i])
+      missing[nack.num_missing++] = i;
+  }
+  if (nack.num_missing == 0)
+    return;
+
+  int msg_sz = lcm_tunnel_udp_nack_t_encoded_size(&nack);
+  uint8_t msg_buf[msg_sz];
+  lcm_tunnel_udp_nack_t_encode(msg_buf, 0, msg_sz, &nack);
+  send(udp_fd, msg_buf, msg_sz, 0);
+  ra->nacksSent++;
+  ra->lastFragmentTime = now; //wait as long again before asking again
+  if (verbose)
+    printf("%s asked for %d missing fragments of batch %d\n", name, nack.num_missing, nack.seqno);
+}
+
+//asks for what stalled batches are missing, and gives up on the ones that
+//have gone quiet for too long
+gboolean LcmTunnel::on_nack_timer(gpointer user_data)
+{
+  LcmTunnel * self = (LcmTunnel*) user_data;
+  if (self->server_udp_port <= 0)
+    return TRUE;
+  int64_t now = _timestamp_now();
+  for (unsigned i = 0; i < self->reassemblies.size(); i++) {
+    reassembly_t * ra = self->reassemblies[i];
+    if (ra->done)
+      continue;
+    if (now - ra->lastFragmentTime > REASSEMBLY_TIMEOUT_USEC)
+      self->finishReassembly(ra, false);
+    else
+      self->sendNack(ra, now);
+  }
+  return TRUE;
+}
+
+//frees a batch's buffers once it's been published, or given up on.  Its
+//entry stays in the window so that late fragments of it get ignored.
+void LcmTunnel::finishReassembly(reassembly_t *ra, bool complete)
+{
+  if (ra->done)
+    return;
+  if (!complete) {
+    batchesLost++;
+    printf("packet %d dropped! with %d of %d fragments received, %s\n", ra->seqno, ra->numFragsRec, ra->nfrags,
+        ra->ldpc_dec != NULL ? "was FECed" : "not FECed");
+  }
+  free(ra->recFlags);
+  free(ra->buf);
+  delete ra->ldpc_dec;
+  ra->recFlags = NULL;
+  ra->buf = NULL;
+  ra->ldpc_dec = NULL;
+  reassemblyBytes -= ra->payloadSize;
+  ra->done = true;
+}
 
-    //create a new FEC decoder
-    if (self->ldpc_dec != NULL) {
-      delete self->ldpc_dec; //delete the old one if we haven't already
-      self->ldpc_dec = NULL;
+//finds the batch a fragment belongs to, starting on it if it's the first
+//fragment of it we've seen.  Returns NULL if it's too old to bother with.
+LcmTunnel::reassembly_t * LcmTunnel::getReassembly(const lcm_tunnel_udp_msg_t *msg)
+{
+  for (unsigned i = 0; i < reassemblies.size(); i++) {
+    if (reassemblies[i]->seqno == msg->seqno)
+      return reassemblies[i];
+  }
+  if (newestSeqno >= 0 && _seqno_diff(msg->seqno, newestSeqno) <= -REASSEMBLY_WINDOW)
+    return NULL; //long gone
+  if (msg->payload_size < 0 || msg->payload_size > MAX_PAYLOAD_BYTES_PER_FRAGMENT * MAX_NUM_FRAGMENTS)
+    return NULL; //corrupt
+
+  reassembly_t * ra = new reassembly_t;
+  ra->seqno = msg->seqno;
+  ra->payloadSize = msg->payload_size;
+  ra->nfrags = getNumFragments(msg->payload_size);
+  ra->numFragsRec = 0;
+  ra->completeTo_fragno = 0;
+  ra->ldpc_dec = NULL;
+  if (tunnel_params->fec > 1 && ra->nfrags >= MIN_NUM_FRAGMENTS_FOR_FEC) {
+    //a decoder for the rate the sender coded at
+    if (msg->fec_rate < 100 || msg->fec_rate > 100 * MAX(MAX_FEC_RATE, tunnel_params->fec)) {
+      delete ra;
+      return NULL;
     }
-    if (self->tunnel_params->fec > 1 && self->nfrags >= MIN_NUM_FRAGMENTS_FOR_FEC) {
-      //allocate the new one
-      self->ldpc_dec = new ldpc_dec_wrapper(messageSize, MAX_PAYLOAD_BYTES_PER_FRAGMENT, self->tunnel_params->fec);
+    ra->ldpc_dec = new ldpc_dec_wrapper(ra->payloadSize, MAX_PAYLOAD_BYTES_PER_FRAGMENT, msg->fec_rate / 100.0);
+  }
+  ra->recFlags = (char *) calloc(MAX(ra->nfrags, 1), sizeof(char)); //mark all frags as unreceived
+  ra->buf = (char *) malloc(MAX(ra->payloadSize, 1));
+  ra->done = false;
+  ra->startTime = ra->lastFragmentTime = _timestamp_now();
+  ra->nacksSent = 0;
+
+  //make room for it
+  for (unsigned i = 0; i < reassemblies.size() && reassemblyBytes + ra->payloadSize > REASSEMBLY_MAX_BYTES; i++)
+    finishReassembly(reassemblies[i], false);
+  reassemblyBytes += ra->payloadSize;
+  reassemblies.push_back(ra);
+  if (newestSeqno < 0 || _seqno_diff(ra->seqno, newestSeqno) > 0)
+    newestSeqno = ra->seqno;
+
+  //and slide the window along
+  for (std::deque<reassembly_t *>::iterator it = reassemblies.begin(); it != reassemblies.end();) {
+    if (_seqno_diff((*it)->seqno, newestSeqno) <= -REASSEMBLY_WINDOW) {
+      finishReassembly(*it, false);
+      delete *it;
+      it = reassemblies.erase(it);
     }
-    self->message_complete = 0;
-  }
-
-  if (!self->message_complete && recv_udp_msg->seqno == self->cur_seqno && getNumFragments(recv_udp_msg->payload_size)
-      == self->nfrags) {
-    self->numFragsRec++;
-    if (self->tunnel_params->fec < 1 || self->nfrags < MIN_NUM_FRAGMENTS_FOR_FEC) { //we're not using FEC for this message
-      // have we already received this fragment?
-      if (recv_udp_msg->fragno < self->nfrags && !self->recFlags[recv_udp_msg->fragno]) {
-        self->recFlags[recv_udp_msg->fragno] = 1;
-
-        //copy everything to the app->buf
-        int64_t pos_start = recv_udp_msg->fragno * MAX_PAYLOAD_BYTES_PER_FRAGMENT;
-        int64_t pos_end = MIN(recv_udp_msg->payload_size, (recv_udp_msg->fragno + 1) * MAX_PAYLOAD_BYTES_PER_FRAGMENT);
-        int64_t curPayloadSize = pos_end - pos_start;
-        assert(recv_udp_msg->data_size==curPayloadSize);
-        memcpy(self->buf + pos_start, recv_udp_msg->data, curPayloadSize);
-
-        self->message_complete = 1;
-        for (int i = self->completeTo_fragno; i < self->nfrags; i++) {
-          if (!self->recFlags[i]) {
-            self->message_complete = 0;
-            break;
-          }
-          else
-            self->completeTo_fragno = i;
-        }
+    else
+      it++;
+  }
+  return ra;
+}
 
-        if (self->message_complete) {
-          //publish all the lcm messages in the buffer
-          self->publishLcmMessagesInBuf(recv_udp_msg->payload_size);
-        }
+void LcmTunnel::handleUdpFragment(const lcm_tunnel_udp_msg_t *recv_udp_msg)
+{
+  //  printf("received: %d, %d / %d\n", recv_udp_msg->seqno, recv_udp_msg->fragment, recv_udp_msg->nfrags);
+
+  reassembly_t * ra = getReassembly(recv_udp_msg);
+  if (ra == NULL || ra->done || getNumFragments(recv_udp_msg->payload_size) != ra->nfrags) {
+    if (verbose && (ra == NULL || !ra->done))
+      printf("ignoring udp packet seqno=%d, nfrag =%d\n", recv_udp_msg->seqno,
+          getNumFragments(recv_udp_msg->payload_size));
+    return;
+  }
 
+  ra->numFragsRec++;
+  ra->lastFragmentTime = _timestamp_now();
+  if (ra->ldpc_dec == NULL) { //we're not using FEC for this message
+    // have we already received this fragment?
+    int64_t pos_start = recv_udp_msg->fragno * MAX_PAYLOAD_BYTES_PER_FRAGMENT;
+    int64_t pos_end = MIN(ra->payloadSize, (recv_udp_msg->fragno + 1) * MAX_PAYLOAD_BYTES_PER_FRAGMENT);
+    if (recv_udp_msg->fragno >= 0 && recv_udp_msg->fragno < ra->nfrags && !ra->recFlags[recv_udp_msg->fragno]
+        && recv_udp_msg->data_size == pos_end - pos_start) {
+      ra->recFlags[recv_udp_msg->fragno] = 1;
+
+      //copy everything to the batch's buf
+      memcpy(ra->buf + pos_start, recv_udp_msg->data, pos_end - pos_start);
+
+      bool complete = true;
+      for (int i = ra->completeTo_fragno; i < ra->nfrags; i++) {
+        if (!ra->recFlags[i]) {
+          complete = false;
+          break;
+        }
+        else
+          ra->completeTo_fragno = i;
       }
-      else if (self->verbose) {
-        printf("ignoring udp packet\n");
-        //        printf("seqno: %d (%d)  fragment: %d (%d) nfrags: %d (%d)\n",
-        //                recv_udp_msg->seqno, app->cur_seqno,
-        //                recv_udp_msg->fragment, app->expected_fragno,
-        //                recv_udp_msg->nfrags, app->nfrags);
+
+      if (complete) {
+        //publish all the lcm messages in the buffer
+        publishLcmMessagesInBuf(ra->buf, ra->payloadSize);
+        batchesReceived++;
+        finishReassembly(ra, true);
       }
+
     }
-    else { //we're using FEC
-      int dec_done = self->ldpc_dec->processPacket(recv_udp_msg->data, recv_udp_msg->fragno);
-      if (dec_done != 0) {
-        if (dec_done == 1) {
-          check_ret(self->ldpc_dec->getObject((uint8_t*) self->buf));
-          //publish all the lcm messages in the buffer
-          self->publishLcmMessagesInBuf(recv_udp_msg->payload_size);
-        }
-        else {
-          fprintf(stderr, "ldpc got all the sent packets, but couldn't reconstruct... this shouldn't happen!\n");
-        }
-        self->message_complete = 1;
-        delete self->ldpc_dec; //we're all done, so we can delete it
-        self->ldpc_dec = NULL;
-      }
+    else if (verbose) {
+      printf("ignoring udp packet\n");
     }
   }
-  else if (self->verbose && !self->message_complete) {
-    //    if (!self->message_complete && recv_udp_msg->seqno == self->cur_seqno && recv_udp_msg->nfrags == self->nfrags) {
-    printf("ignoring udp packet seqno=%d, nfrag =%d, \t self-> seqno=%d, nfrags=%d\n", recv_udp_msg->seqno,
-        getNumFragments(recv_udp_msg->payload_size), self->cur_seqno, self->nfrags);
+  else { //we're using FEC
+    //keep track of the source packets, in case we need to ask for them
+    int pkt = ra->ldpc_dec->getSourcePacket(recv_udp_msg->fragno);
+    if (pkt >= 0 && pkt < (int) ra->nfrags)
+      ra->recFlags[pkt] = 1;
+    int dec_done = ra->ldpc_dec->processPacket(recv_udp_msg->data, recv_udp_msg->fragno);
+    if (dec_done != 0) {
+      if (dec_done == 1) {
+        check_ret(ra->ldpc_dec->getObject((uint8_t*) ra->buf));
+        //publish all the lcm messages in the buffer
+        publishLcmMessagesInBuf(ra->buf, ra->payloadSize);
+        batchesReceived++;
+        if (memchr(ra->recFlags, 0, ra->nfrags) != NULL)
+          fecRecoveries++; //some of the source packets had to be decoded
+      }
+      else if (ra->nacksSent > 0) {
+        return; //the retransmissions count as extra packets, wait for the rest of them
+      }
+      else {
+        fprintf(stderr, "ldpc got all the sent packets, but couldn't reconstruct... this shouldn't happen!\n");
+      }
+      finishReassembly(ra, true); //we're all done, so we can delete the decoder
+    }
   }
-
-  lcm_tunnel_udp_msg_t_destroy(recv_udp_msg);
-
-  return TRUE;
 }
 
 int LcmTunnel::on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_data)
@@ -458,13 +1083,12 @@ int LcmTunnel::on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_da
 
   // increase buffer size if needed
   if (self->buf_sz < self->bytes_to_read) {
-    assert(self->bytes_read == 0);
     self->buf = (char *) realloc(self->buf, self->bytes_to_read);
     self->buf_sz = self->bytes_to_read;
   }
 
-  ssize_t nread = read(ssocket_get_fd(self->tcp_sock), self->buf + self->bytes_read, self->bytes_to_read
-      - self->bytes_read);
+  //read whatever's there, which is usually several messages worth
+  ssize_t nread = read(ssocket_get_fd(self->tcp_sock), self->buf + self->bytes_read, self->buf_sz - self->bytes_read);
 
   if (nread <= 0) {
     perror("tcp receive error: ");
@@ -473,179 +1097,354 @@ int LcmTunnel::on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_da
   }
 
   self->bytes_read += nread;
-  assert(self->bytes_read <= self->bytes_to_read);
 
-  if (self->bytes_read != self->bytes_to_read)
-    return TRUE;
+  //step through every field that's all here
+  int consumed = 0;
+  while (self->bytes_read - consumed >= self->bytes_to_read) {
+    const char * field = self->buf + consumed;
+    int field_sz = self->bytes_to_read;
+    consumed += field_sz;
+
+    switch (self->tunnel_state) {
+    case CLIENT_MSG_SZ:
+      self->bytes_to_read = _read_field_size(field);
+      self->tunnel_state = CLIENT_MSG_DATA;
+      break;
+    case CLIENT_MSG_DATA:
+      {
+        lcm_tunnel_params_t tp_rec;
+        int decode_status = lcm_tunnel_params_t_decode(field, 0, field_sz, &tp_rec);
+        if (decode_status <= 0) {
+          fprintf(stdout, "invalid request (%d)\n", decode_status);
+          return FALSE;
+        }
+        self->tunnel_params = lcm_tunnel_params_t_copy(&tp_rec);
+        if (self->tunnel_params->compression < 0 || self->tunnel_params->compression >= NUM_COMPRESSIONS) {
+          fprintf(stderr, "%s asked for an unknown compression (%d), not compressing\n", self->name,
+              self->tunnel_params->compression);
+          self->tunnel_params->compression = LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE;
+        }
 
-  switch (self->tunnel_state) {
-  case CLIENT_MSG_SZ:
-    self->bytes_to_read = ntohl(*(uint32_t*) self->buf);
-    self->tunnel_state = CLIENT_MSG_DATA;
-    break;
-  case CLIENT_MSG_DATA:
-    {
-      lcm_tunnel_params_t tp_rec;
-      int decode_status = lcm_tunnel_params_t_decode(self->buf, 0, self->bytes_read, &tp_rec);
-      if (decode_status <= 0) {
-        fprintf(stdout, "invalid request (%d)\n", decode_status);
-        return FALSE;
-      }
-      self->tunnel_params = lcm_tunnel_params_t_copy(&tp_rec);
+        if (self->udp_fd >= 0) {
+          close(self->udp_fd);
+        }
+        self->udp_fd = -1;
+        delete self->udpSendBatch;
+        self->udpSendBatch = NULL;
+        delete self->udpRecvRing;
+        self->udpRecvRing = NULL;
+
+        if (self->tunnel_params->udp) {
+          //setup our UDP socket, and send info to client
+          struct sockaddr_in client_addr;
+          socklen_t addrlen = sizeof(client_addr);
+          getpeername(self->tcp_sock->socket, (struct sockaddr*) &client_addr, &addrlen);
+          self->server_udp_port = ntohs(client_addr.sin_port);
+          client_addr.sin_port = htons(self->tunnel_params->udp_port);
+
+          // allocate UDP socket
+          self->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+          if (self->udp_fd < 0) {
+            perror("allocating UDP socket");
+            LcmTunnelServer::disconnectClient(self);
+            return FALSE;
+          }
 
-      if (self->udp_fd >= 0) {
-        close(self->udp_fd);
-      }
-      self->udp_fd = -1;
+          connect(self->udp_fd, (struct sockaddr*) &client_addr, sizeof(client_addr));
+          self->udpSendBatch = new UdpSendBatch(self->udp_fd);
+          self->udpRecvRing = new UdpRecvRing(self->udp_fd);
+          self->initUdpLink();
+
+          // transmit the udp port info
+          struct sockaddr_in udp_addr;
+          socklen_t udp_addr_len = sizeof(udp_addr);
+          memset(&udp_addr, 0, sizeof(udp_addr));
+          udp_addr.sin_family = AF_INET;
+          udp_addr.sin_addr.s_addr = INADDR_ANY;
+          udp_addr.sin_port = 0;
+          getsockname(self->udp_fd, (struct sockaddr*) &udp_addr, &udp_addr_len);
+          lcm_tunnel_params_t tp_port_msg;
+          tp_port_msg.channels = (char *) " ";
+          tp_port_msg.coalesce_channels = (char *) "";
+          tp_port_msg.delta_channels = (char *) "";
+          tp_port_msg.num_classes = 0;
+          tp_port_msg.num_limits = 0;
+          tp_port_msg.compression = self->tunnel_params->compression; //what we agreed to
+          tp_port_msg.link_rate = self->tunnel_params->link_rate;
+          tp_port_msg.udp_port = ntohs(udp_addr.sin_port);
+          int msg_sz = lcm_tunnel_params_t_encoded_size(&tp_port_msg);
+          uint8_t msg[msg_sz];
+          lcm_tunnel_params_t_encode(msg, 0, msg_sz, &tp_port_msg);
+          uint32_t msg_sz_n = htonl(msg_sz);
+          if (4 != _fileutils_write_fully(ssocket_get_fd(self->tcp_sock), &msg_sz_n, 4)) {
+            perror("sending subscription data");
+            LcmTunnelServer::disconnectClient(self);
+            return FALSE;
+          }
+          if (msg_sz != _fileutils_write_fully(ssocket_get_fd(self->tcp_sock), msg, msg_sz)) {
+            perror("sending subscription data");
+            LcmTunnelServer::disconnectClient(self);
+            return FALSE;
+          }
 
-      if (self->tunnel_params->udp) {
-        //setup our UDP socket, and send info to client
-        struct sockaddr_in client_addr;
-        socklen_t addrlen = sizeof(client_addr);
-        getpeername(self->tcp_sock->socket, (struct sockaddr*) &client_addr, &addrlen);
-        self->server_udp_port = ntohs(client_addr.sin_port);
-        client_addr.sin_port = htons(self->tunnel_params->udp_port);
+          self->udp_ioc = g_io_channel_unix_new(self->udp_fd);
+          self->udp_sid = g_io_add_watch(self->udp_ioc, G_IO_IN, LcmTunnel::on_udp_data, self);
 
-        // allocate UDP socket
-        self->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
-        if (self->udp_fd < 0) {
-          perror("allocating UDP socket");
+          //we're done setting up the UDP connection...Disconnect tcp socket
+          self->closeTCPSocket();
+          ret = false;
+        }
+        else if (ssocket_disable_nagle(self->tcp_sock) != 0) {
+          //messages go out in batches, so there's nothing for Nagle to coalesce
           LcmTunnelServer::disconnectClient(self);
           return FALSE;
         }
 
-        connect(self->udp_fd, (struct sockaddr*) &client_addr, sizeof(client_addr));
+        //get ready to receive
+        self->tunnel_state = RECV_CHAN_SZ;
+        self->bytes_to_read = 4;
+
+        //      if (self->server_params->verbose)
+        fprintf(stderr, "%s subscribed to \"%s\" -- ", self->name, self->tunnel_params->channels);
+
+        if (self->udp_fd >= 0) {
+          if (self->tunnel_params->fec > 1)
+            fprintf(stderr, "UDP with FEC rate of %.2f and max_delay of %dms\n", self->tunnel_params->fec,
+                self->tunnel_params->max_delay_ms);
+          else if (self->tunnel_params->fec < -1)
+            fprintf(stderr, "UDP with DUP rate of %d and max_delay of %dms\n", (int) -self->tunnel_params->fec,
+                self->tunnel_params->max_delay_ms);
+          else
+            fprintf(stderr, "UDP with a max_delay of %dms\n", self->tunnel_params->max_delay_ms);
+        }
+        else {
+          fprintf(stderr, "TCP with max_delay of %dms and tcp_max_age_ms of %d\n", self->tunnel_params->max_delay_ms,
+              self->tunnel_params->tcp_max_age_ms);
+        }
 
-        // transmit the udp port info
-        struct sockaddr_in udp_addr;
-        socklen_t udp_addr_len = sizeof(udp_addr);
-        memset(&udp_addr, 0, sizeof(udp_addr));
-        udp_addr.sin_family = AF_INET;
-        udp_addr.sin_addr.s_addr = INADDR_ANY;
-        udp_addr.sin_port = 0;
-        getsockname(self->udp_fd, (struct sockaddr*) &udp_addr, &udp_addr_len);
-        lcm_tunnel_params_t tp_port_msg;
-        tp_port_msg.channels = (char *) " ";
-        tp_port_msg.udp_port = ntohs(udp_addr.sin_port);
-        int msg_sz = lcm_tunnel_params_t_encoded_size(&tp_port_msg);
-        uint8_t msg[msg_sz];
-        lcm_tunnel_params_t_encode(msg, 0, msg_sz, &tp_port_msg);
-        uint32_t msg_sz_n = htonl(msg_sz);
-        if (4 != _fileutils_write_fully(ssocket_get_fd(self->tcp_sock), &msg_sz_n, 4)) {
-          perror("sending subscription data");
+        for (int i = 0; i < self->tunnel_params->num_classes; i++) {
+          const lcm_tunnel_class_t * cls = &self->tunnel_params->classes[i];
+          fprintf(stderr, "%s priority %d, weight %d and max_delay of %dms for \"%s\"\n", self->name, cls->priority,
+              cls->weight, cls->max_delay_ms, cls->channels);
+        }
+        for (int i = 0; i < self->tunnel_params->num_limits; i++) {
+          const lcm_tunnel_limit_t * lim = &self->tunnel_params->limits[i];
+          fprintf(stderr, "%s max rate of %gHz and max bandwidth of %dB/s for \"%s\"\n", self->name, lim->max_rate,
+              lim->max_bandwidth, lim->channels);
+        }
+        if (self->tunnel_params->link_rate > 0)
+          fprintf(stderr, "%s pacing UDP at up to %.1fkB/s\n", self->name, self->tunnel_params->link_rate / 1024.0);
+        else if (self->tunnel_params->link_rate < 0)
+          fprintf(stderr, "%s pacing UDP at an estimated link rate\n", self->name);
+        if (self->tunnel_params->compression != LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE)
+          fprintf(stderr, "%s compressing with %s\n", self->name, _compression_name(self->tunnel_params->compression));
+        if (strlen(self->tunnel_params->coalesce_channels))
+          fprintf(stderr, "%s only keeps the latest queued message on \"%s\"\n", self->name,
+              self->tunnel_params->coalesce_channels);
+        if (strlen(self->tunnel_params->delta_channels))
+          fprintf(stderr, "%s delta encodes \"%s\"\n", self->name, self->tunnel_params->delta_channels);
+
+        self->init_send_queues();
+        self->init_regex(self->tunnel_params->channels);
+
+        //subscribe to the LCM channels
+        if (!LcmTunnelServer::subscribe(self, self->tunnel_params->channels)) {
+          fprintf(stderr, "%s asked for invalid channels, refusing it\n", self->name);
           LcmTunnelServer::disconnectClient(self);
           return FALSE;
         }
-        if (msg_sz != _fileutils_write_fully(ssocket_get_fd(self->tcp_sock), msg, msg_sz)) {
-          perror("sending subscription data");
-          LcmTunnelServer::disconnectClient(self);
+
+      }
+      break;
+    case SERVER_MSG_SZ:
+      self->bytes_to_read = _read_field_size(field);
+      self->tunnel_state = SERVER_MSG_DATA;
+      break;
+    case SERVER_MSG_DATA:
+      {
+        lcm_tunnel_params_t tp_rec;
+        int decode_status = lcm_tunnel_params_t_decode(field, 0, field_sz, &tp_rec);
+        if (decode_status <= 0) {
+          fprintf(stderr, "invalid request (%d)\n", decode_status);
           return FALSE;
         }
+        assert(self->udp_fd>0);
+        struct sockaddr_in client_addr;
+        socklen_t addrlen = sizeof(client_addr);
+        getpeername(self->tcp_sock->socket, (struct sockaddr*) &client_addr, &addrlen);
+        self->server_udp_port = tp_rec.udp_port;
+        client_addr.sin_port = htons(tp_rec.udp_port);
+        //connect the udp socket
+        connect(self->udp_fd, (struct sockaddr*) &client_addr, sizeof(client_addr));
+
+        //the server has the final say on compression
+        if (tp_rec.compression != self->tunnel_params->compression) {
+          fprintf(stderr, "%s can't do %s compression, using %s\n", self->name,
+              _compression_name(self->tunnel_params->compression), _compression_name(tp_rec.compression));
+          self->tunnel_params->compression = tp_rec.compression;
+          self->compression = tp_rec.compression;
+        }
 
-        self->udp_ioc = g_io_channel_unix_new(self->udp_fd);
-        self->udp_sid = g_io_add_watch(self->udp_ioc, G_IO_IN, LcmTunnel::on_udp_data, self);
+        //now we can subscribe to LCM
+        if (!LcmTunnelServer::subscribe(self, self->tunnel_params->channels)) {
+          LcmTunnelServer::disconnectClient(self);
+          return FALSE;
+        }
+        fprintf(stderr, "%s subscribed to \"%s\" \n", self->name, self->tunnel_params->channels);
 
         //we're done setting up the UDP connection...Disconnect tcp socket
         self->closeTCPSocket();
-        ret = false;
+        ret = FALSE; //don't want the TCP handler to be run again
       }
+      break;
+    case RECV_CHAN_SZ:
+      self->bytes_to_read = _read_field_size(field);
+      self->tunnel_state = RECV_CHAN;
 
-      //get ready to receive
-      self->tunnel_state = RECV_CHAN_SZ;
-      self->bytes_to_read = 4;
-
-      //      if (self->server_params->verbose)
-      fprintf(stderr, "%s subscribed to \"%s\" -- ", self->name, self->tunnel_params->channels);
+      if (self->channel_sz < self->bytes_to_read + 1) {
+        self->channel = (char *) realloc(self->channel, self->bytes_to_read + 1);
+        self->channel_sz = self->bytes_to_read + 1;
+      }
+      break;
+    case RECV_CHAN:
+      memcpy(self->channel, field, field_sz);
+      self->channel[field_sz] = 0;
 
-      if (self->udp_fd >= 0) {
-        if (self->tunnel_params->fec > 1)
-          fprintf(stderr, "UDP with FEC rate of %.2f and max_delay of %dms\n", self->tunnel_params->fec,
-              self->tunnel_params->max_delay_ms);
-        else if (self->tunnel_params->fec < -1)
-          fprintf(stderr, "UDP with DUP rate of %d and max_delay of %dms\n", (int) -self->tunnel_params->fec,
-              self->tunnel_params->max_delay_ms);
-        else
-          fprintf(stderr, "UDP with a max_delay of %dms\n", self->tunnel_params->max_delay_ms);
+      self->bytes_to_read = SUB_MSG_SIZES_SIZE;
+      self->tunnel_state = RECV_DATA_SZ;
+      break;
+    case RECV_DATA_SZ:
+      {
+        //same encoding as in an lcm_tunnel_sub_msg_t
+        int32_t data_size;
+        int pos = 0;
+        pos += __int8_t_decode_array(field, pos, field_sz - pos, &self->recv_compression, 1);
+        pos += __int8_t_decode_array(field, pos, field_sz - pos, &self->recv_delta, 1);
+        pos += __int32_t_decode_array(field, pos, field_sz - pos, &self->recv_uncompressed_size, 1);
+        pos += __int32_t_decode_array(field, pos, field_sz - pos, &data_size, 1);
+        self->bytes_to_read = data_size;
+        self->tunnel_state = RECV_DATA;
       }
-      else {
-        fprintf(stderr, "TCP with max_delay of %dms and tcp_max_age_ms of %d\n", self->tunnel_params->max_delay_ms,
-            self->tunnel_params->tcp_max_age_ms);
+      break;
+    case RECV_DATA:
+      {
+        if (self->verbose)
+          printf("Recieved TCP message on channel \"%s\"\n", self->channel);
+        const uint8_t * data;
+        int32_t data_size;
+        if (self->decompress(self->recv_compression, (const uint8_t *) field, field_sz,
+            self->recv_uncompressed_size, &data) && self->deltaDecode(self->channel, self->recv_delta, data,
+            self->recv_uncompressed_size, &data, &data_size)) {
+          LcmTunnelServer::check_and_send_to_tunnels(self->channel, data, data_size, self);
+          lcm_publish(self->lcm, self->channel, data, data_size);
+          self->countReceived(self->channel, data_size);
+        }
       }
+      self->bytes_to_read = 4;
+      self->tunnel_state = RECV_CHAN_SZ;
+      break;
+
+    }
+
+    if (!ret)
+      return FALSE; //the TCP socket is closed
+    if (self->bytes_to_read < 0) {
+      fprintf(stderr, "%s sent a corrupt message over TCP\n", self->name);
+      LcmTunnelServer::disconnectClient(self);
+      return FALSE;
+    }
+  }
 
-      self->init_regex(self->tunnel_params->channels);
+  //keep the start of the next field for later
+  self->bytes_read -= consumed;
+  if (consumed > 0 && self->bytes_read > 0)
+    memmove(self->buf, self->buf + consumed, self->bytes_read);
 
-      //subscribe to the LCM channels
-      if (self->subscription) {
-        lcm_unsubscribe(self->lcm, self->subscription);
-      }
-      self->subscription = lcm_subscribe(self->lcm, self->tunnel_params->channels, on_lcm_message, self);
+  return TRUE;
+}
 
+bool LcmTunnel::readyToSend(const send_class_t &cls, int64_t now)
+{
+  return !cls.queue.empty() && (cls.max_delay_ms <= 0 || cls.bytesInQueue >= NUM_BYTES_TO_SEND_IMMEDIATELY
+      || cls.firstQueuedTime + cls.max_delay_ms * 1000 <= now);
+}
+
+//picks the class to send from next, or returns -1 if none of them are ready,
+//in which case wakeTime is set to when the first one will be (or -1)
+int LcmTunnel::nextSendClass(int64_t now, int64_t *wakeTime)
+{
+  int numClasses = sendClasses.size();
+  int priority = 0;
+  bool anyReady = false;
+  *wakeTime = -1;
+  for (int c = 0; c < numClasses; c++) {
+    const send_class_t &cls = sendClasses[c];
+    if (readyToSend(cls, now)) {
+      if (!anyReady || cls.priority > priority)
+        priority = cls.priority;
+      anyReady = true;
     }
-    break;
-  case SERVER_MSG_SZ:
-    self->bytes_to_read = ntohl(*(uint32_t*) self->buf);
-    self->tunnel_state = SERVER_MSG_DATA;
-    break;
-  case SERVER_MSG_DATA:
-    {
-      lcm_tunnel_params_t tp_rec;
-      int decode_status = lcm_tunnel_params_t_decode(self->buf, 0, self->bytes_read, &tp_rec);
-      if (decode_status <= 0) {
-        fprintf(stderr, "invalid request (%d)\n", decode_status);
-        return FALSE;
+    else if (!cls.queue.empty()) {
+      int64_t readyTime = cls.firstQueuedTime + cls.max_delay_ms * 1000;
+      if (*wakeTime < 0 || readyTime < *wakeTime)
+        *wakeTime = readyTime;
+    }
+  }
+  if (!anyReady)
+    return -1;
+
+  //deficit round robin between the ready classes at the top priority.  If
+  //none of them can afford its next message, they all get another quantum.
+  while (true) {
+    for (int i = 0; i < numClasses; i++) {
+      int c = (nextClassToVisit + i) % numClasses;
+      const send_class_t &cls = sendClasses[c];
+      if (cls.priority == priority && readyToSend(cls, now) && cls.deficit >= cls.queue.front()->encoded_size) {
+        nextClassToVisit = (c + 1) % numClasses;
+        return c;
       }
-      assert(self->udp_fd>0);
-      struct sockaddr_in client_addr;
-      socklen_t addrlen = sizeof(client_addr);
-      getpeername(self->tcp_sock->socket, (struct sockaddr*) &client_addr, &addrlen);
-      self->server_udp_port = tp_rec.udp_port;
-      client_addr.sin_port = htons(tp_rec.udp_port);
-      //connect the udp socket
-      connect(self->udp_fd, (struct sockaddr*) &client_addr, sizeof(client_addr));
-
-      //now we can subscribe to LCM
-      fprintf(stderr, "%s subscribed to \"%s\" \n", self->name, self->tunnel_params->channels);
-      self->subscription = lcm_subscribe(self->lcm, self->tunnel_params->channels, on_lcm_message, self);
-
-      //we're done setting up the UDP connection...Disconnect tcp socket
-      self->closeTCPSocket();
-      ret = FALSE; //don't want the TCP handler to be run again
     }
-    break;
-  case RECV_CHAN_SZ:
-    self->bytes_to_read = ntohl(*(uint32_t*) self->buf);
-    self->tunnel_state = RECV_CHAN;
-
-    if (self->channel_sz < self->bytes_to_read + 1) {
-      self->channel = (char *) realloc(self->channel, self->bytes_to_read + 1);
-      self->channel_sz = self->bytes_to_read + 1;
+    for (int c = 0; c < numClasses; c++) {
+      send_class_t &cls = sendClasses[c];
+      if (cls.priority == priority && readyToSend(cls, now))
+        cls.deficit += (int64_t) cls.weight * SEND_CLASS_QUANTUM;
     }
-    break;
-  case RECV_CHAN:
-    memcpy(self->channel, self->buf, self->bytes_read);
-    self->channel[self->bytes_read] = 0;
-
-    self->bytes_to_read = 4;
-    self->tunnel_state = RECV_DATA_SZ;
-    break;
-  case RECV_DATA_SZ:
-    self->bytes_to_read = ntohl(*(uint32_t*) self->buf);
-    self->tunnel_state = RECV_DATA;
-    break;
-  case RECV_DATA:
-    if (self->verbose)
-      printf("Recieved TCP message on channel \"%s\"\n", self->channel);
-    LcmTunnelServer::check_and_send_to_tunnels(self->channel, self->buf, self->bytes_read, self);
-    lcm_publish(self->lcm, self->channel, (uint8_t*) self->buf, self->bytes_read);
-
-    self->bytes_to_read = 4;
-    self->tunnel_state = RECV_CHAN_SZ;
-    break;
-  }
-
-  self->bytes_read = 0;
+  }
+}
 
-  return ret;
+//moves as many messages as the class can afford from its queue to msgQueue
+uint32_t LcmTunnel::takeFromSendClass(int c, std::deque<TunnelLcmMessage *> &msgQueue)
+{
+  send_class_t &cls = sendClasses[c];
+  uint32_t bytes = 0;
+  int64_t now = _timestamp_now();
+  while (!cls.queue.empty() && cls.deficit >= cls.queue.front()->encoded_size) {
+    TunnelLcmMessage * msg = cls.queue.front();
+    cls.queue.pop_front();
+    cls.popped++;
+    cls.deficit -= msg->encoded_size;
+    bytes += msg->encoded_size;
+    msgQueue.push_back(msg);
+
+    channel_info_t * info = getChannelInfo(msg->channel);
+    info->msgsOut++;
+    info->bytesOut += msg->uncompressed_size;
+    //keep a uniform sample of the latencies, once there are too many of them
+    int32_t latency = (int32_t) MIN(now - msg->recv_utime, G_MAXINT32);
+    numQueueLatencies++;
+    if (queueLatencies.size() < STATS_MAX_LATENCY_SAMPLES)
+      queueLatencies.push_back(latency);
+    else {
+      int64_t i = g_random_double() * numQueueLatencies;
+      if (i < STATS_MAX_LATENCY_SAMPLES)
+        queueLatencies[i] = latency;
+    }
+  }
+  if (cls.queue.empty())
+    cls.deficit = 0; //an idle class doesn't get to save up
+  cls.bytesInQueue -= bytes;
+  bytesInQueue -= bytes;
+  return bytes;
 }
 
 gpointer LcmTunnel::sendThreadFunc(gpointer user_data)
@@ -654,38 +1453,55 @@ gpointer LcmTunnel::sendThreadFunc(gpointer user_data)
   LcmTunnel *self = (LcmTunnel*) user_data;
 
   g_mutex_lock(self->sendQueueLock);
-  int64_t nextFlushTime = 0;
   while (!self->stopSendThread) {
-    if (self->sendQueue.empty()) {
-      g_cond_wait(self->sendQueueCond, self->sendQueueLock);
-      nextFlushTime = _timestamp_now() + self->tunnel_params->max_delay_ms * 1000;
+    if (!self->nackQueue.empty()) {
+      //answer NACKs before sending anything new, they're on a deadline
+      std::deque<lcm_tunnel_udp_nack_t *> nacks;
+      nacks.swap(self->nackQueue);
+      g_mutex_unlock(self->sendQueueLock);
+      bool success = true;
+      for (unsigned i = 0; i < nacks.size(); i++) {
+        if (success)
+          success = self->retransmit(nacks[i]);
+        lcm_tunnel_udp_nack_t_destroy(nacks[i]);
+      }
+      g_mutex_lock(self->sendQueueLock);
+      self->updateSendCounts();
+      if (!success)
+        break;
       continue;
     }
-    int64_t now = _timestamp_now();
-    if (self->tunnel_params->max_delay_ms > 0 && self->bytesInQueue < NUM_BYTES_TO_SEND_IMMEDIATELY && nextFlushTime
-        > now && !self->flushImmediately) {
-      GTimeVal next_timeout;
-      _timestamp_to_GTimeVal(nextFlushTime, &next_timeout);
-      g_cond_timed_wait(self->sendQueueCond, self->sendQueueLock, &next_timeout);
 
+    int64_t wakeTime;
+    int c = self->nextSendClass(_timestamp_now(), &wakeTime);
+    if (c < 0) {
+      if (wakeTime < 0) {
+        g_cond_wait(self->sendQueueCond, self->sendQueueLock);
+      }
+      else {
+        GTimeVal next_timeout;
+        _timestamp_to_GTimeVal(wakeTime, &next_timeout);
+        g_cond_timed_wait(self->sendQueueCond, self->sendQueueLock, &next_timeout);
+      }
       continue;
     }
-    //there is stuff in the queue that we need to handle
-    self->flushImmediately = false;
 
-    //take current contents out of the queue
+    //take this class' share out of its queue
     std::deque<TunnelLcmMessage *> tmpQueue;
-    tmpQueue.swap(self->sendQueue);
-    uint32_t bytesInTmpQueue = self->bytesInQueue;
-    self->bytesInQueue = 0;
+    uint32_t bytesInTmpQueue = self->takeFromSendClass(c, tmpQueue);
+    std::deque<lcm_tunnel_delta_ack_t *> deltaAcks;
+    deltaAcks.swap(self->deltaAckQueue);
     g_mutex_unlock(self->sendQueueLock);
     //release lock for sending
 
+    self->handleDeltaAcks(deltaAcks);
+
     //process whats in the queue
     bool success = self->send_lcm_messages(tmpQueue, bytesInTmpQueue);
 
     //reaquire lock to go around the loop
     g_mutex_lock(self->sendQueueLock);
+    self->updateSendCounts();
     if (!success)
       break;
   }
@@ -696,44 +1512,238 @@ gpointer LcmTunnel::sendThreadFunc(gpointer user_data)
 
 void LcmTunnel::send_to_remote(const void *data, uint32_t len, const char *lcm_channel)
 {
-  lcm_recv_buf_t rbuf;
-  rbuf.data = (void *) data;
-  rbuf.data_size = len;
-  rbuf.recv_utime = _timestamp_now(); //use current timestamp, should be close to when received...
-  rbuf.lcm = this->lcm;
-  send_to_remote(&rbuf, lcm_channel);
- }
+  //use current timestamp, should be close to when received...
+  TunnelLcmMessage * new_msg = new TunnelLcmMessage(lcm_channel, data, len, _timestamp_now(),
+      compression_for(lcm_channel, len));
+  send_to_remote(new_msg);
+  new_msg->unref();
+}
+
+//the regexes are only matched the first time a channel is seen
+LcmTunnel::channel_info_t * LcmTunnel::getChannelInfo(const char *lcm_channel)
+{
+  channel_info_t * info = (channel_info_t *) g_hash_table_lookup(channelInfo, lcm_channel);
+  if (info == NULL) {
+    info = g_new(channel_info_t, 1);
+    info->sendClass = sendClasses.size() - 1;
+    for (size_t c = 0; c + 1 < sendClasses.size(); c++) {
+      if (g_regex_match(sendClasses[c].regex, lcm_channel, (GRegexMatchFlags) 0, NULL)) {
+        info->sendClass = c;
+        break;
+      }
+    }
+    info->coalesce = coalesceRegex != NULL && g_regex_match(coalesceRegex, lcm_channel, (GRegexMatchFlags) 0, NULL);
+    info->delta = deltaRegex != NULL && g_regex_match(deltaRegex, lcm_channel, (GRegexMatchFlags) 0, NULL);
+    info->queuePos = -1;
+    info->maxRate = 0;
+    info->maxBandwidth = 0;
+    for (size_t i = 0; i < rateLimits.size(); i++) {
+      if (g_regex_match(rateLimits[i].regex, lcm_channel, (GRegexMatchFlags) 0, NULL)) {
+        info->maxRate = rateLimits[i].max_rate;
+        info->maxBandwidth = rateLimits[i].max_bandwidth;
+        break;
+      }
+    }
+    //start with full buckets
+    info->rateTokens = 1;
+    info->bandwidthTokens = info->maxBandwidth;
+    info->lastRefillTime = _timestamp_now();
+    info->numLimited = 0;
+    info->recentSeen = 0;
+    info->recentLimited = 0;
+    info->compress = true;
+    info->compressRetryTime = 0;
+    info->compressSamples = 0;
+    info->compressRawBytes = 0;
+    info->compressedBytes = 0;
+    info->compressUsec = 0;
+    info->msgsOut = 0;
+    info->bytesOut = 0;
+    info->numCoalesced = 0;
+    info->numQueueFull = 0;
+    info->numLinkRate = 0;
+    g_hash_table_insert(channelInfo, g_strdup(lcm_channel), info);
+  }
+  return info;
+}
 
-void LcmTunnel::send_to_remote(const lcm_recv_buf_t *rbuf, const char *lcm_channel)
+//Each limited channel has two token buckets, refilled at max_rate messages
+//and max_bandwidth bytes per second.  The first holds a single message, so
+//a faster channel is decimated down to max_rate, and the second holds a
+//second's worth of bytes, with a message bigger than that allowed to go
+//out of a full bucket and leave it in debt.
+bool LcmTunnel::passes_rate_limits(const char *lcm_channel, uint32_t len)
 {
+  //only ever changed from the main loop, which is where we get called from
+  if (rateLimits.empty())
+    return true;
+
   g_mutex_lock(sendQueueLock);
-  TunnelLcmMessage * new_msg = new TunnelLcmMessage(rbuf, lcm_channel);
-  bytesInQueue += new_msg->encoded_size;
-  sendQueue.push_back(new_msg);
-  while (bytesInQueue > MAX_SEND_BUFFER_SIZE) {
-    fprintf(stderr, "Warning: send queue is too big (%dMB), dropping messages\n", bytesInQueue / (2 << 20));
-    //need to drop some stuff
-    TunnelLcmMessage * drop_msg = sendQueue.front();
-    sendQueue.pop_front();
-    bytesInQueue -= drop_msg->encoded_size;
-    delete drop_msg;
+  channel_info_t * info = getChannelInfo(lcm_channel);
+  bool pass = true;
+  if (info->maxRate > 0 || info->maxBandwidth > 0) {
+    int64_t now = _timestamp_now();
+    double dt = MAX(now - info->lastRefillTime, 0) * 1e-6;
+    info->lastRefillTime = now;
+    if (info->maxRate > 0) {
+      info->rateTokens = MIN(info->rateTokens + dt * info->maxRate, 1.0);
+      pass = info->rateTokens >= 1;
+    }
+    if (info->maxBandwidth > 0) {
+      info->bandwidthTokens = MIN(info->bandwidthTokens + dt * info->maxBandwidth, (double) info->maxBandwidth);
+      pass = pass && info->bandwidthTokens >= MIN(len, (uint32_t) info->maxBandwidth);
+    }
+
+    info->recentSeen++;
+    if (pass) {
+      if (info->maxRate > 0)
+        info->rateTokens -= 1;
+      if (info->maxBandwidth > 0)
+        info->bandwidthTokens -= len;
+    }
+    else {
+      info->numLimited++;
+      info->recentLimited++;
+      if (now - lastLimitReportTime > RATE_LIMIT_REPORT_INTERVAL) {
+        reportRateLimits();
+        lastLimitReportTime = now;
+      }
+    }
   }
-  //hack to not delay time sync messages
-  flushImmediately = strcmp(lcm_channel, "TIMESYNC") == 0;
   g_mutex_unlock(sendQueueLock);
-  g_cond_broadcast(sendQueueCond); //signal to say there is a message waiting
+  return pass;
 }
 
-void LcmTunnel::on_lcm_message(const lcm_recv_buf_t *rbuf, const char *channel, void *user_data)
+//prints what the rate limits dropped since last time, per channel
+void LcmTunnel::reportRateLimits()
 {
-  LcmTunnel *self = (LcmTunnel*) user_data;
-  if (introspect_is_message_from_self(self->introspect, rbuf, channel)) {
-    if (self->verbose && !LcmTunnelServer::matches_a_client(channel))
-      printf("Warning: Got message from self. There's a loop scenario.\n");
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, channelInfo);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    channel_info_t * info = (channel_info_t *) value;
+    if (info->recentLimited > 0)
+      fprintf(stderr, "%s rate limits dropped %d of %d messages on \"%s\" (%lld in total)\n", name,
+          info->recentLimited, info->recentSeen, (const char *) key, (long long) info->numLimited);
+    info->recentSeen = 0;
+    info->recentLimited = 0;
+  }
+}
+
+//Channels get compressed until it's found not to be worth it, say because
+//they carry JPEGs, then they're left alone for a while before being given
+//another try.  Delta encoded channels are compressed by the send thread
+//instead, after they've been XORed.
+int8_t LcmTunnel::compression_for(const char *lcm_channel, uint32_t len)
+{
+  if (compression == LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE || len < MIN_BYTES_TO_COMPRESS)
+    return LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE;
+
+  g_mutex_lock(sendQueueLock);
+  channel_info_t * info = getChannelInfo(lcm_channel);
+  if (!info->compress && _timestamp_now() >= info->compressRetryTime)
+    info->compress = true;
+  int8_t ret = info->compress && !info->delta ? compression : LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE;
+  g_mutex_unlock(sendQueueLock);
+  return ret;
+}
+
+//called with sendQueueLock held
+void LcmTunnel::updateCompressionStats(channel_info_t *info, const TunnelLcmMessage *msg)
+{
+  info->compressSamples++;
+  info->compressRawBytes += msg->uncompressed_size;
+  info->compressedBytes += msg->data_size;
+  info->compressUsec += msg->compress_usec;
+  if (info->compressSamples < COMPRESS_SAMPLES)
     return;
+
+  double ratio = (double) info->compressedBytes / MAX(info->compressRawBytes, 1);
+  double usec = MAX(info->compressUsec, 1);
+  bool worthIt = ratio <= COMPRESS_MAX_RATIO && (info->compressRawBytes - info->compressedBytes) / usec
+      >= COMPRESS_MIN_BYTES_SAVED_PER_USEC;
+  if (verbose || !worthIt)
+    fprintf(stderr, "%s compressed \"%s\" to %.0f%% at %.1fMB/s%s\n", name, msg->channel, ratio * 100,
+        info->compressRawBytes / usec, worthIt ? "" : ", not worth it for now");
+  if (!worthIt) {
+    info->compress = false;
+    info->compressRetryTime = _timestamp_now() + COMPRESS_RETRY_INTERVAL;
+  }
+  info->compressSamples = 0;
+  info->compressRawBytes = 0;
+  info->compressedBytes = 0;
+  info->compressUsec = 0;
+}
+
+void LcmTunnel::send_to_remote(TunnelLcmMessage *new_msg)
+{
+  g_mutex_lock(sendQueueLock);
+  channel_info_t * info = getChannelInfo(new_msg->channel);
+  if (new_msg->compress_usec >= 0)
+    updateCompressionStats(info, new_msg);
+  send_class_t &cls = sendClasses[info->sendClass];
+  if (info->coalesce && info->queuePos >= cls.popped) {
+    //the previous message on this channel hasn't gone out yet, so the new
+    //one takes its place in line
+    TunnelLcmMessage *& queued = cls.queue[info->queuePos - cls.popped];
+    cls.bytesInQueue -= queued->encoded_size;
+    bytesInQueue -= queued->encoded_size;
+    queued->unref();
+    queued = new_msg->ref();
+    info->numCoalesced++;
+  }
+  else {
+    if (cls.queue.empty())
+      cls.firstQueuedTime = _timestamp_now();
+    info->queuePos = cls.popped + cls.queue.size();
+    cls.queue.push_back(new_msg->ref());
+  }
+  cls.bytesInQueue += new_msg->encoded_size;
+  bytesInQueue += new_msg->encoded_size;
+
+  uint32_t max_bytes = maxBytesInQueue();
+  int num_dropped = 0;
+  while (bytesInQueue > max_bytes) {
+    //need to drop some stuff, starting with the lowest priority.  The message
+    //that was just queued always stays, or one bigger than the limit could
+    //never be sent, and with an estimated link rate, the estimate would
+    //never get to go up.
+    send_class_t * drop_cls = NULL;
+    for (size_t c = 0; c < sendClasses.size(); c++) {
+      if (!sendClasses[c].queue.empty() && sendClasses[c].queue.front() != new_msg
+          && (drop_cls == NULL || sendClasses[c].priority < drop_cls->priority))
+        drop_cls = &sendClasses[c];
+    }
+    if (drop_cls == NULL)
+      break;
+    TunnelLcmMessage * drop_msg = drop_cls->queue.front();
+    drop_cls->queue.pop_front();
+    drop_cls->popped++;
+    drop_cls->bytesInQueue -= drop_msg->encoded_size;
+    bytesInQueue -= drop_msg->encoded_size;
+    channel_info_t * drop_info = getChannelInfo(drop_msg->channel);
+    if (bytesInQueue + drop_msg->encoded_size > MAX_SEND_BUFFER_SIZE)
+      drop_info->numQueueFull++;
+    else
+      drop_info->numLinkRate++;
+    drop_msg->unref();
+    num_dropped++;
   }
+  if (num_dropped > 0)
+    fprintf(stderr, "Warning: send queue is over its %.1fKB limit, dropped %d messages\n", max_bytes / 1024.0,
+        num_dropped);
+  g_mutex_unlock(sendQueueLock);
+  g_cond_broadcast(sendQueueCond); //signal to say there is a message waiting
+}
 
-  self->send_to_remote(rbuf, channel);
+//when pacing, there's no point queueing more than the link can get through
+//in a reasonable time, the messages would only be stale when they got there
+uint32_t LcmTunnel::maxBytesInQueue()
+{
+  if (udpPacer == NULL)
+    return MAX_SEND_BUFFER_SIZE;
+  double bytes = udpPacer->getRate() * (MAX_SEND_QUEUE_DELAY_USEC * 1e-6);
+  return (uint32_t) CLAMP(bytes, MIN_SEND_BUFFER_SIZE, MAX_SEND_BUFFER_SIZE);
 }
 
 void LcmTunnel::checkUDPSendStatus(int send_status)
@@ -755,6 +1765,7 @@ void LcmTunnel::checkUDPSendStatus(int send_status)
       fprintf(stderr, "Connection may be back up after %fsec send_status=%d numSuccessful=%d\n", (double) (now
           - errorStartTime) * 1e-6, send_status, numSuccessful);
       perror("perror: ");
+      sendThreadCounts.linkErrorUsec += now - errorStartTime;
       lastErrorPrintTime = -1;
       errorStartTime = -1;
       errno = 0;
@@ -763,12 +1774,328 @@ void LcmTunnel::checkUDPSendStatus(int send_status)
   }
 }
 
+//waits until the pacer lets bytes go out.  Returns false if the tunnel is
+//shutting down in the meantime.
+bool LcmTunnel::paceUdpSend(int bytes)
+{
+  int64_t wait = udpPacer->reserve(bytes, _timestamp_now());
+  if (wait <= 0)
+    return true;
+  flushUdpFragments(); //get what's batched up out of the door first
+
+  int64_t wakeTime = _timestamp_now() + wait;
+  GTimeVal wake_tv;
+  _timestamp_to_GTimeVal(wakeTime, &wake_tv);
+  g_mutex_lock(sendQueueLock);
+  while (!stopSendThread && _timestamp_now() < wakeTime)
+    g_cond_timed_wait(sendQueueCond, sendQueueLock, &wake_tv);
+  bool ret = !stopSendThread;
+  g_mutex_unlock(sendQueueLock);
+  return ret;
+}
+
+//returns false if the tunnel is shutting down
+bool LcmTunnel::sendUdpFragment(const lcm_tunnel_udp_msg_t *msg, const struct iovec *data, int iovcnt)
+{
+  if (udpPacer != NULL && !paceUdpSend(UDP_MSG_HEADER_SIZE + msg->data_size))
+    return false;
+  lcm_tunnel_udp_msg_t numbered = *msg;
+  numbered.datagram_no = ++udp_datagram_no;
+  uint8_t header[UDP_MSG_HEADER_SIZE];
+  _encode_udp_msg_header(header, &numbered);
+  int numFailed = udpSendBatch->add(header, UDP_MSG_HEADER_SIZE, data, iovcnt);
+  checkUDPSendStatus(numFailed > 0 ? -1 : 0);
+  sendThreadCounts.fragmentsSent++;
+  return true;
+}
+
+void LcmTunnel::flushUdpFragments()
+{
+  int numFailed = udpSendBatch->flush();
+  checkUDPSendStatus(numFailed > 0 ? -1 : 0);
+}
+
+void LcmTunnel::forgetSentBatch(sent_batch_t *batch)
+{
+  while (!batch->msgs.empty()) {
+    batch->msgs.front()->unref();
+    batch->msgs.pop_front();
+  }
+  free(batch->msgIov);
+  delete batch->ldpc_enc;
+  delete batch;
+}
+
+//sends the fragments of a recent batch that the other end says it's
+//missing.  Returns false if the tunnel is shutting down.
+bool LcmTunnel::retransmit(const lcm_tunnel_udp_nack_t *nack)
+{
+  sent_batch_t * batch = NULL;
+  for (unsigned i = 0; i < sentBatches.size(); i++) {
+    if (sentBatches[i]->seqno == nack->seqno)
+      batch = sentBatches[i];
+  }
+  if (batch == NULL || _timestamp_now() - batch->sendTime > RETRANSMIT_DEADLINE_USEC)
+    return true; //too late
+
+  lcm_tunnel_udp_msg_t msg;
+  msg.seqno = batch->seqno;
+  msg.payload_size = batch->payloadSize;
+  msg.fec_rate = batch->fecRate;
+  int nfragments = getNumFragments(batch->payloadSize);
+  struct iovec fragIov[MAX_IOV_PER_FRAGMENT];
+  bool sending = true;
+  int numSent = 0;
+  for (int i = 0; i < nack->num_missing && sending; i++) {
+    int fragno = nack->missing[i];
+    if (fragno < 0 || fragno >= nfragments)
+      continue;
+    int iovcnt;
+    if (batch->ldpc_enc != NULL) {
+      //the source packets are what it's asking for
+      if (fragno >= batch->ldpc_enc->getNumDataPackets())
+        continue;
+      batch->ldpc_enc->getPacket(fragno, fragIov, &msg.fragno);
+      msg.data_size = MAX_PAYLOAD_BYTES_PER_FRAGMENT;
+      iovcnt = batch->ldpc_enc->getNumSymbolsPerPacket();
+    }
+    else {
+      int msgIdx;
+      size_t msgOffset;
+      _seek_iov(batch->msgIov, fragno * MAX_PAYLOAD_BYTES_PER_FRAGMENT, &msgIdx, &msgOffset);
+      msg.fragno = fragno;
+      msg.data_size = MIN(MAX_PAYLOAD_BYTES_PER_FRAGMENT, batch->payloadSize - fragno * MAX_PAYLOAD_BYTES_PER_FRAGMENT);
+      iovcnt = _slice_iov(batch->msgIov, &msgIdx, &msgOffset, msg.data_size, fragIov);
+    }
+    sending = sendUdpFragment(&msg, fragIov, iovcnt);
+    numSent++;
+  }
+  flushUdpFragments();
+  sendThreadCounts.fragmentsResent += numSent;
+  if (verbose)
+    printf("resent %d fragments of batch %d\n", numSent, batch->seqno);
+  return sending;
+}
+
+void LcmTunnel::freeDeltaChannel(gpointer data)
+{
+  delta_channel_t * dc = (delta_channel_t *) data;
+  for (unsigned i = 0; i < dc->keyframes.size(); i++)
+    free(dc->keyframes[i].data);
+  delete dc;
+}
+
+LcmTunnel::delta_channel_t * LcmTunnel::getDeltaChannel(GHashTable *deltaChannels, const char *lcm_channel)
+{
+  delta_channel_t * dc = (delta_channel_t *) g_hash_table_lookup(deltaChannels, lcm_channel);
+  if (dc == NULL) {
+    dc = new delta_channel_t;
+    dc->delta = deltaRegex != NULL && g_regex_match(deltaRegex, lcm_channel, (GRegexMatchFlags) 0, NULL);
+    dc->nextFrameNo = 0;
+    dc->lastKeyframeTime = 0;
+    dc->keyframeRequested = false;
+    g_hash_table_insert(deltaChannels, g_strdup(lcm_channel), dc);
+  }
+  return dc;
+}
+
+//keeps a copy of the keyframe, making room for it by dropping the oldest one.
+//That goes by frame number, so that keyframes arriving out of order don't
+//push out newer ones.  Returns false if the new one was the oldest.
+bool LcmTunnel::addKeyframe(delta_channel_t *dc, int32_t frameNo, const uint8_t *data, int32_t size, bool acked)
+{
+  delta_keyframe_t kf;
+  kf.frameNo = frameNo;
+  kf.data = (uint8_t *) malloc(MAX(size, 1));
+  memcpy(kf.data, data, size);
+  kf.size = size;
+  kf.acked = acked;
+  dc->keyframes.push_back(kf);
+  if (dc->keyframes.size() <= DELTA_MAX_KEYFRAMES)
+    return true;
+
+  unsigned oldest = 0;
+  for (unsigned i = 1; i < dc->keyframes.size(); i++) {
+    if (dc->keyframes[i].frameNo < dc->keyframes[oldest].frameNo)
+      oldest = i;
+  }
+  bool kept = oldest != dc->keyframes.size() - 1;
+  free(dc->keyframes[oldest].data);
+  dc->keyframes.erase(dc->keyframes.begin() + oldest);
+  return kept;
+}
+
+//Replaces msg with its delta encoding if it's on a delta channel.  It's done
+//by the send thread just before msg goes out, since what it can be XORed
+//with depends on what's been sent and acknowledged by then.
+//
+//Over UDP, deltas are only taken against keyframes the other end has
+//acknowledged, and only against the last DELTA_MAX_KEYFRAMES keyframes sent,
+//which it's sure to still have.  Keyframes go out whole, and until one is
+//acknowledged, messages go out whole without being kept.
+TunnelLcmMessage * LcmTunnel::deltaEncode(TunnelLcmMessage *msg)
+{
+  delta_channel_t * dc = getDeltaChannel(deltaSent, msg->channel);
+  if (!dc->delta || msg->delta != LCM_TUNNEL_SUB_MSG_T_DELTA_NONE || msg->compression
+      != LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE)
+    return msg; //it was queued before we knew to leave it uncompressed
+
+  int64_t now = _timestamp_now();
+  bool reliable = udp_fd < 0;
+  const delta_keyframe_t * ref = NULL; //the newest one the other end has
+  for (int i = dc->keyframes.size() - 1; i >= 0 && ref == NULL; i--) {
+    if (dc->keyframes[i].acked)
+      ref = &dc->keyframes[i];
+  }
+  bool keyframe = reliable || dc->keyframeRequested || now - dc->lastKeyframeTime >= DELTA_KEYFRAME_INTERVAL_USEC;
+  if (ref == NULL && now - dc->lastKeyframeTime >= MAX(2 * udpRtt, DELTA_KEYFRAME_RETRY_USEC))
+    keyframe = true; //the last one hasn't been acknowledged, it or the ack must have been lost
+  if (keyframe && !reliable)
+    ref = NULL;
+
+  int8_t delta_compression = compression;
+  if (delta_compression == LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE)
+    delta_compression = LCM_TUNNEL_SUB_MSG_T_COMPRESSION_LZ; //XORing doesn't make anything smaller by itself
+  TunnelLcmMessage * dmsg;
+  if (!keyframe && ref == NULL) {
+    dmsg = new TunnelLcmMessage(msg->channel, msg->data, msg->data_size, msg->recv_utime, delta_compression);
+  }
+  else {
+    int32_t size = DELTA_HEADER_SIZE + msg->data_size;
+    if (deltaBuf_sz < size) {
+      free(deltaBuf);
+      deltaBuf = (uint8_t *) malloc(size);
+      deltaBuf_sz = size;
+    }
+    int32_t frameNo = keyframe ? dc->nextFrameNo++ : -1;
+    int32_t refNo = ref != NULL ? ref->frameNo : -1;
+    int pos = 0;
+    pos += __int32_t_encode_array(deltaBuf, pos, size - pos, &frameNo, 1);
+    pos += __int32_t_encode_array(deltaBuf, pos, size - pos, &refNo, 1);
+    int32_t n = ref != NULL ? MIN(msg->data_size, ref->size) : 0;
+    for (int32_t i = 0; i < n; i++)
+      deltaBuf[pos + i] = msg->data[i] ^ ref->data[i];
+    memcpy(deltaBuf + pos + n, msg->data + n, msg->data_size - n);
+    dmsg = new TunnelLcmMessage(msg->channel, deltaBuf, size, msg->recv_utime, delta_compression,
+        keyframe ? LCM_TUNNEL_SUB_MSG_T_DELTA_KEYFRAME : LCM_TUNNEL_SUB_MSG_T_DELTA_XOR);
+
+    if (keyframe) {
+      //over TCP, the other end gets everything we send
+      addKeyframe(dc, frameNo, msg->data, msg->data_size, reliable);
+      dc->lastKeyframeTime = now;
+      dc->keyframeRequested = false;
+    }
+  }
+  msg->unref();
+  return dmsg;
+}
+
+void LcmTunnel::handleDeltaAcks(std::deque<lcm_tunnel_delta_ack_t *> &acks)
+{
+  for (unsigned i = 0; i < acks.size(); i++) {
+    delta_channel_t * dc = (delta_channel_t *) g_hash_table_lookup(deltaSent, acks[i]->channel);
+    for (unsigned k = 0; dc != NULL && k < dc->keyframes.size(); k++) {
+      if (acks[i]->frame_no < 0)
+        dc->keyframes[k].acked = false; //the other end lost track, so none of them can be relied on
+      else if (dc->keyframes[k].frameNo == acks[i]->frame_no)
+        dc->keyframes[k].acked = true;
+    }
+    if (dc != NULL && acks[i]->frame_no < 0)
+      dc->keyframeRequested = true;
+    lcm_tunnel_delta_ack_t_destroy(acks[i]);
+  }
+  acks.clear();
+}
+
+//Undoes deltaEncode(), pointing payload at the message, which may be in
+//undeltaBuf.  Returns false if it can't be, because it was XORed with a
+//keyframe we don't have, in which case we ask for a new one.
+bool LcmTunnel::deltaDecode(const char *lcm_channel, int8_t data_delta, const uint8_t *data, int32_t size,
+    const uint8_t **payload, int32_t *payload_size)
+{
+  if (data_delta == LCM_TUNNEL_SUB_MSG_T_DELTA_NONE) {
+    *payload = data;
+    *payload_size = size;
+    return true;
+  }
+  if ((data_delta != LCM_TUNNEL_SUB_MSG_T_DELTA_KEYFRAME && data_delta != LCM_TUNNEL_SUB_MSG_T_DELTA_XOR) || size
+      < DELTA_HEADER_SIZE) {
+    fprintf(stderr, "Received a corrupt delta encoded message!\n");
+    return false;
+  }
+  int32_t frameNo;
+  int32_t refNo;
+  int pos = 0;
+  pos += __int32_t_decode_array(data, pos, size - pos, &frameNo, 1);
+  pos += __int32_t_decode_array(data, pos, size - pos, &refNo, 1);
+  data += pos;
+  size -= pos;
+
+  delta_channel_t * dc = getDeltaChannel(deltaReceived, lcm_channel);
+  const delta_keyframe_t * ref = NULL;
+  for (unsigned i = 0; refNo >= 0 && i < dc->keyframes.size(); i++) {
+    if (dc->keyframes[i].frameNo == refNo)
+      ref = &dc->keyframes[i];
+  }
+  if (refNo >= 0 && ref == NULL) {
+    int64_t now = _timestamp_now();
+    if (udp_fd >= 0 && now - dc->lastKeyframeTime >= DELTA_KEYFRAME_RETRY_USEC) {
+      if (verbose)
+        fprintf(stderr, "%s is missing keyframe %d of \"%s\", asking for a new one\n", name, refNo, lcm_channel);
+      sendDeltaAck(lcm_channel, -1);
+      dc->lastKeyframeTime = now;
+    }
+    return false;
+  }
+
+  if (ref == NULL) {
+    *payload = data;
+  }
+  else {
+    if (undeltaBuf_sz < size) {
+      free(undeltaBuf);
+      undeltaBuf = (uint8_t *) malloc(size);
+      undeltaBuf_sz = size;
+    }
+    int32_t n = MIN(size, ref->size);
+    for (int32_t i = 0; i < n; i++)
+      undeltaBuf[i] = data[i] ^ ref->data[i];
+    memcpy(undeltaBuf + n, data + n, size - n);
+    *payload = undeltaBuf;
+  }
+  *payload_size = size;
+
+  if (data_delta == LCM_TUNNEL_SUB_MSG_T_DELTA_KEYFRAME && addKeyframe(dc, frameNo, *payload, size, true)
+      && udp_fd >= 0)
+    sendDeltaAck(lcm_channel, frameNo);
+  return true;
+}
+
+void LcmTunnel::sendDeltaAck(const char *lcm_channel, int32_t frameNo)
+{
+  lcm_tunnel_delta_ack_t ack;
+  ack.channel = (char *) lcm_channel;
+  ack.frame_no = frameNo;
+  int msg_sz = lcm_tunnel_delta_ack_t_encoded_size(&ack);
+  uint8_t msg_buf[msg_sz];
+  lcm_tunnel_delta_ack_t_encode(msg_buf, 0, msg_sz, &ack);
+  send(udp_fd, msg_buf, msg_sz, 0);
+}
+
 bool LcmTunnel::send_lcm_messages(std::deque<TunnelLcmMessage *> &msgQueue, uint32_t bytesInQueue)
 {
   if (udp_fd >= 0) {
     if (server_udp_port <= 0)
       return true; //connection hasn't been setup yet.
 
+    if (deltaRegex != NULL) {
+      bytesInQueue = 0;
+      for (unsigned i = 0; i < msgQueue.size(); i++) {
+        msgQueue[i] = deltaEncode(msgQueue[i]);
+        bytesInQueue += msgQueue[i]->encoded_size;
+      }
+    }
+
     udp_send_seqno++;//increment the sequence counter
     udp_send_seqno = udp_send_seqno % SEQNO_WRAP_VAL;
     if (verbose)
@@ -776,142 +2103,317 @@ bool LcmTunnel::send_lcm_messages(std::deque<TunnelLcmMessage *> &msgQueue, uint
 
     uint32_t msgSize = bytesInQueue;
     int nfragments = getNumFragments(msgSize);
-    if ((tunnel_params->fec <= 0 && nfragments > MAX_NUM_FRAGMENTS) || (tunnel_params->fec > 0 && nfragments
-        > MAX_NUM_FRAGMENTS / tunnel_params->fec)) {
+    double fec = currentFecRate();
+    if ((fec <= 0 && nfragments > MAX_NUM_FRAGMENTS) || (fec > 0 && nfragments > MAX_NUM_FRAGMENTS / fec)) {
       uint32_t maxMsgSize;
-      if (tunnel_params->fec > 0)
-        maxMsgSize = MAX_PAYLOAD_BYTES_PER_FRAGMENT * MAX_NUM_FRAGMENTS / tunnel_params->fec;
+      if (fec > 0)
+        maxMsgSize = MAX_PAYLOAD_BYTES_PER_FRAGMENT * MAX_NUM_FRAGMENTS / fec;
       else
         maxMsgSize = MAX_PAYLOAD_BYTES_PER_FRAGMENT * MAX_NUM_FRAGMENTS;
       fprintf(stderr,
           "WARNING! Queue contains more than the max message size of %d bytes... we're WAY behind, dropping msgs\n",
           maxMsgSize);
-      while (msgSize < maxMsgSize) {
+      while (msgSize > maxMsgSize) {
         //drop messages
         TunnelLcmMessage * drop_msg = msgQueue.front();
         msgQueue.pop_front();
         msgSize -= drop_msg->encoded_size;
-        delete drop_msg;
+        drop_msg->unref();
+        sendThreadCounts.droppedTooBig++;
       }
+      nfragments = getNumFragments(msgSize);
     }
-    //put the entire queue into 1 big buffer
-    uint8_t * msgBuf = (uint8_t *) malloc(msgSize * sizeof(uint8_t));
-    uint32_t msgBufOffset = 0;
-    while (!msgQueue.empty()) {
-      TunnelLcmMessage * msg = msgQueue.front();
-      msgQueue.pop_front();
-      lcm_tunnel_sub_msg_t_encode(msgBuf, msgBufOffset, msgSize - msgBufOffset, msg->sub_msg);
-      msgBufOffset += msg->encoded_size;
-      delete msg;
+    //the queue is sent as one big message made up of the encoded sub
+    //messages back to back.  Rather than copying them into a single buffer,
+    //each fragment is sent as a gather list of slices of them.
+    int numMsgs = msgQueue.size();
+    struct iovec * msgIov = (struct iovec *) malloc(numMsgs * sizeof(struct iovec));
+    for (int i = 0; i < numMsgs; i++) {
+      msgIov[i].iov_base = msgQueue[i]->encoded;
+      msgIov[i].iov_len = msgQueue[i]->encoded_size;
     }
-    assert(msgBufOffset==msgSize);
 
-    if (tunnel_params->fec < 1 || nfragments < MIN_NUM_FRAGMENTS_FOR_FEC) { //don't use FEC
+    lcm_tunnel_udp_msg_t msg;
+    msg.seqno = udp_send_seqno;
+    msg.payload_size = msgSize;
+    msg.fec_rate = 0;
+    struct iovec fragIov[MAX_IOV_PER_FRAGMENT];
+    bool sending = true; //goes false if we're told to stop while being paced
+
+    //hang on to the batch for a while, in case the other end asks for some of it again
+    sent_batch_t * batch = new sent_batch_t;
+    batch->seqno = msg.seqno;
+    batch->payloadSize = msgSize;
+    batch->fecRate = 0;
+    batch->msgIov = NULL;
+    batch->ldpc_enc = NULL;
+
+    if (fec < 1 || nfragments < MIN_NUM_FRAGMENTS_FOR_FEC) { //don't use FEC
       int sendRepeats = 1;
-      if (fabs(tunnel_params->fec) > 1) { //fec <0 means always send duplicates
-        sendRepeats = (int) ceil(fabs(tunnel_params->fec)); //send ceil of the fec rate times
+      if (fabs(fec) > 1) { //fec <0 means always send duplicates
+        sendRepeats = (int) ceil(fabs(fec)); //send ceil of the fec rate times
       }
-      for (int r = 0; r < sendRepeats; r++) {
-        msgBufOffset = 0;
-        for (int i = 0; i < nfragments; i++) {
-          lcm_tunnel_udp_msg_t msg;
-          msg.seqno = udp_send_seqno;
+      for (int r = 0; r < sendRepeats && sending; r++) {
+        int msgIdx = 0;
+        size_t msgOffset = 0;
+        for (int i = 0; i < nfragments && sending; i++) {
           msg.fragno = i;
-          msg.payload_size = msgSize;
-
-          msg.data_size = MIN(MAX_PAYLOAD_BYTES_PER_FRAGMENT, msgSize - msgBufOffset);
-          msg.data = msgBuf + msgBufOffset;
-
-          msgBufOffset += msg.data_size;
-
-          int msg_sz = lcm_tunnel_udp_msg_t_encoded_size(&msg);
-          uint8_t msg_buf[msg_sz];
-          lcm_tunnel_udp_msg_t_encode(msg_buf, 0, msg_sz, &msg);
-          //          printf("sending: %d, %d / %d\n", msg.seqno, msg.fragment, msg.nfrags);
-          int send_status = send(udp_fd, msg_buf, msg_sz, 0);
-          //          fprintf(stderr,"sent packet\n");
-          checkUDPSendStatus(send_status);
+          msg.data_size = MIN(MAX_PAYLOAD_BYTES_PER_FRAGMENT, msgSize - i * MAX_PAYLOAD_BYTES_PER_FRAGMENT);
+          int iovcnt = _slice_iov(msgIov, &msgIdx, &msgOffset, msg.data_size, fragIov);
+          assert(iovcnt <= MAX_IOV_PER_FRAGMENT);
+          sending = sendUdpFragment(&msg, fragIov, iovcnt);
         }
       }
+      flushUdpFragments();
+      //the fragments point into the messages
+      batch->msgs.swap(msgQueue);
+      batch->msgIov = msgIov;
+      msgIov = NULL;
     }
     else { //use tunnel error correction to send
-      ldpc_enc_wrapper * ldpc_enc = new ldpc_enc_wrapper(msgBuf, msgSize, MAX_PAYLOAD_BYTES_PER_FRAGMENT,
-          tunnel_params->fec);
-
-      lcm_tunnel_udp_msg_t msg;
-      msg.seqno = udp_send_seqno;
-      msg.payload_size = msgSize;
-
-      //      printf("sending: %d, %d / %d\n", recv_udp_msg->seqno, recv_udp_msg->fragment, recv_udp_msg->nfrags);
+      //the encoder gathers the sub messages into its source symbols, and
+      //the packets are sent straight out of its symbol buffers
+      msg.fec_rate = g_atomic_int_get(&fecRate);
+      ldpc_enc_wrapper * ldpc_enc = new ldpc_enc_wrapper(msgIov, numMsgs, msgSize, MAX_PAYLOAD_BYTES_PER_FRAGMENT,
+          msg.fec_rate / 100.0);
+      int iovcnt = ldpc_enc->getNumSymbolsPerPacket();
+      assert(iovcnt <= MAX_IOV_PER_FRAGMENT);
 
       int enc_done = 0;
-      while (!enc_done) {
-        uint8_t data_buf[MAX_PAYLOAD_BYTES_PER_FRAGMENT];
+      while (!enc_done && sending) {
         msg.data_size = MAX_PAYLOAD_BYTES_PER_FRAGMENT;
-        msg.data = data_buf;
-        enc_done = ldpc_enc->getNextPacket(msg.data, &msg.fragno);
-
-        int msg_sz = lcm_tunnel_udp_msg_t_encoded_size(&msg);
-        uint8_t msg_buf[msg_sz];
-        lcm_tunnel_udp_msg_t_encode(msg_buf, 0, msg_sz, &msg);
-        //          printf("sending: %d, %d / %d\n", msg.seqno, msg.fragment, msg.nfrags);
-        int send_status = send(udp_fd, msg_buf, msg_sz, 0);
-        checkUDPSendStatus(send_status);
+        enc_done = ldpc_enc->getNextPacket(fragIov, &msg.fragno);
+        sending = sendUdpFragment(&msg, fragIov, iovcnt);
       }
-      //          printf("finished encoding and sending packet %d for channel: %s\n",recv_udp_msg->seqno,channel);
-      delete ldpc_enc;
+      flushUdpFragments(); //the batch points into the encoder's symbols
+      batch->fecRate = msg.fec_rate;
+      batch->ldpc_enc = ldpc_enc;
+    }
+
+    free(msgIov);
+    while (!msgQueue.empty()) {
+      msgQueue.front()->unref();
+      msgQueue.pop_front();
+    }
+
+    //make room for it among the batches we're keeping
+    int64_t now = _timestamp_now();
+    batch->sendTime = now;
+    uint32_t keptBytes = batch->payloadSize;
+    for (unsigned i = 0; i < sentBatches.size(); i++)
+      keptBytes += sentBatches[i]->payloadSize;
+    while (!sentBatches.empty() && (sentBatches.size() >= RETRANSMIT_MAX_BATCHES || keptBytes
+        > RETRANSMIT_MAX_BYTES || now - sentBatches.front()->sendTime > RETRANSMIT_DEADLINE_USEC)) {
+      keptBytes -= sentBatches.front()->payloadSize;
+      forgetSentBatch(sentBatches.front());
+      sentBatches.pop_front();
     }
-    free(msgBuf);
+    if (batch->payloadSize <= RETRANSMIT_MAX_BYTES)
+      sentBatches.push_back(batch);
+    else
+      forgetSentBatch(batch);
+
+    if (!sending)
+      return false;
   }
   else {
     int cfd = ssocket_get_fd(tcp_sock);
     assert(cfd>0);
 
+    //write the messages out TCP_MSGS_PER_WRITE at a time, each as its
+    //channel length, channel, then the compression, sizes and data, straight
+    //out of the encoding
+    TunnelLcmMessage * batch[TCP_MSGS_PER_WRITE];
+    uint32_t chan_len_n[TCP_MSGS_PER_WRITE];
+    struct iovec iov[3 * TCP_MSGS_PER_WRITE];
     while (!msgQueue.empty()) {
-      TunnelLcmMessage * msg = msgQueue.front();
-      msgQueue.pop_front();
-
+      int numMsgs = 0;
+      int batchBytes = 0;
       int64_t now = _timestamp_now();
-      double age_ms = (now - msg->recv_utime) * 1.0e-3;
-      if (tunnel_params->tcp_max_age_ms > 0 && age_ms > tunnel_params->tcp_max_age_ms) {
-        // message has been queued up for too long.  Drop it.
-        if (verbose)
-          fprintf(stderr, "%s message too old (age = %d, param = %d), dropping.\n", msg->sub_msg->channel,
-              (int) age_ms, tunnel_params->tcp_max_age_ms);
-      }
-      else {
-        // send channel
-        int chan_len = strlen(msg->sub_msg->channel);
-        uint32_t chan_len_n = htonl(chan_len);
-        if (4 != _fileutils_write_fully(cfd, &chan_len_n, 4)) {
-          delete msg;
-          return false;
-        }
-        if (chan_len != _fileutils_write_fully(cfd, msg->sub_msg->channel, chan_len)) {
-          delete msg;
-          return false;
-        }
+      while (!msgQueue.empty() && numMsgs < TCP_MSGS_PER_WRITE) {
+        TunnelLcmMessage * msg = msgQueue.front();
+        msgQueue.pop_front();
 
-        // send data
-        int data_size_n = htonl(msg->sub_msg->data_size);
-        if (4 != _fileutils_write_fully(cfd, &data_size_n, 4)) {
-          delete msg;
-          return false;
+        double age_ms = (now - msg->recv_utime) * 1.0e-3;
+        if (tunnel_params->tcp_max_age_ms > 0 && age_ms > tunnel_params->tcp_max_age_ms) {
+          // message has been queued up for too long.  Drop it.
+          if (verbose)
+            fprintf(stderr, "%s message too old (age = %d, param = %d), dropping.\n", msg->channel,
+                (int) age_ms, tunnel_params->tcp_max_age_ms);
+          msg->unref();
+          sendThreadCounts.droppedTooOld++;
+          continue;
         }
-        if (msg->sub_msg->data_size != _fileutils_write_fully(cfd, msg->sub_msg->data, msg->sub_msg->data_size)) {
-          delete msg;
-          return false;
+        if (deltaRegex != NULL)
+          msg = deltaEncode(msg);
+
+        int chan_len = strlen(msg->channel);
+        chan_len_n[numMsgs] = htonl(chan_len);
+        struct iovec *msg_iov = iov + 3 * numMsgs;
+        msg_iov[0].iov_base = &chan_len_n[numMsgs];
+        msg_iov[0].iov_len = 4;
+        msg_iov[1].iov_base = (char *) msg->channel;
+        msg_iov[1].iov_len = chan_len;
+        msg_iov[2].iov_base = (uint8_t *) msg->data - SUB_MSG_SIZES_SIZE;
+        msg_iov[2].iov_len = SUB_MSG_SIZES_SIZE + msg->data_size;
+        batchBytes += 4 + chan_len + SUB_MSG_SIZES_SIZE + msg->data_size;
+        batch[numMsgs++] = msg;
+      }
+
+      bool sent = numMsgs == 0 || batchBytes == _fileutils_writev_fully(cfd, iov, 3 * numMsgs);
+      for (int i = 0; i < numMsgs; i++) {
+        if (verbose && sent)
+          printf("Sent \"%s\".\n", batch[i]->channel);
+        batch[i]->unref();
+      }
+      if (!sent) {
+        //drop whatever's left, it can't go anywhere
+        while (!msgQueue.empty()) {
+          msgQueue.front()->unref();
+          msgQueue.pop_front();
         }
+        return false;
       }
-      if (verbose)
-        printf("Sent \"%s\".\n", msg->sub_msg->channel);
-      delete msg;
     }
   }
 
   return true;
 }
 
+void LcmTunnel::startStats()
+{
+  if (stats_sid > 0)
+    g_source_remove(stats_sid);
+  stats_sid = 0;
+  if (server_params != NULL && server_params->stats_interval_ms > 0)
+    stats_sid = g_timeout_add(server_params->stats_interval_ms, on_stats_timer, this);
+}
+
+gboolean LcmTunnel::on_stats_timer(gpointer user_data)
+{
+  LcmTunnel * self = (LcmTunnel*) user_data;
+  self->publishStats();
+  return TRUE;
+}
+
+//called by the send thread with sendQueueLock held
+void LcmTunnel::updateSendCounts()
+{
+  sendCounts = sendThreadCounts;
+  if (errorStartTime >= 0)
+    sendCounts.linkErrorUsec += _timestamp_now() - errorStartTime;
+}
+
+void LcmTunnel::countReceived(const char *lcm_channel, int32_t size)
+{
+  recv_counts_t * counts = (recv_counts_t *) g_hash_table_lookup(recvCounts, lcm_channel);
+  if (counts == NULL) {
+    counts = g_new0(recv_counts_t, 1);
+    g_hash_table_insert(recvCounts, g_strdup(lcm_channel), counts);
+  }
+  counts->msgs++;
+  counts->bytes += size;
+}
+
+static int _compare_int32(const void *a, const void *b)
+{
+  int32_t x = *(const int32_t *) a;
+  int32_t y = *(const int32_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+//Publishes what the tunnel has been up to on LCM_TUNNEL_STATS_CHANNEL, for
+//bot-lcm-tunnel-stats to show.  The counts are totals since the tunnel
+//started, so that a reader can take rates over any interval it likes, and
+//missing a message doesn't lose anything.
+void LcmTunnel::publishStats()
+{
+  lcm_tunnel_stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.utime = _timestamp_now();
+  stats.name = name;
+  stats.udp = udp_fd >= 0;
+
+  //a channel gets one entry for both directions
+  std::vector<lcm_tunnel_channel_stats_t> channels;
+  GHashTable * channelIdx = g_hash_table_new(g_str_hash, g_str_equal);
+  GHashTableIter iter;
+  gpointer key, value;
+
+  std::vector<int32_t> latencies;
+  g_mutex_lock(sendQueueLock);
+  for (size_t c = 0; c < sendClasses.size(); c++)
+    stats.queue_msgs += sendClasses[c].queue.size();
+  stats.queue_bytes = bytesInQueue;
+  stats.max_queue_bytes = maxBytesInQueue();
+  latencies.swap(queueLatencies);
+  numQueueLatencies = 0;
+  g_hash_table_iter_init(&iter, channelInfo);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    channel_info_t * info = (channel_info_t *) value;
+    lcm_tunnel_channel_stats_t ch;
+    memset(&ch, 0, sizeof(ch));
+    ch.channel = (char *) key; //only the main thread removes channels
+    ch.msgs_out = info->msgsOut;
+    ch.bytes_out = info->bytesOut;
+    ch.msgs_dropped = info->numLimited + info->numCoalesced + info->numQueueFull + info->numLinkRate;
+    stats.dropped_rate_limit += info->numLimited;
+    stats.dropped_coalesced += info->numCoalesced;
+    stats.dropped_queue_full += info->numQueueFull;
+    stats.dropped_link_rate += info->numLinkRate;
+    g_hash_table_insert(channelIdx, key, GINT_TO_POINTER(channels.size() + 1));
+    channels.push_back(ch);
+  }
+  send_counts_t counts = sendCounts;
+  g_mutex_unlock(sendQueueLock);
+
+  g_hash_table_iter_init(&iter, recvCounts);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    int idx = GPOINTER_TO_INT(g_hash_table_lookup(channelIdx, key)) - 1;
+    if (idx < 0) {
+      lcm_tunnel_channel_stats_t ch;
+      memset(&ch, 0, sizeof(ch));
+      ch.channel = (char *) key;
+      idx = channels.size();
+      channels.push_back(ch);
+    }
+    channels[idx].msgs_in = ((recv_counts_t *) value)->msgs;
+    channels[idx].bytes_in = ((recv_counts_t *) value)->bytes;
+  }
+  g_hash_table_destroy(channelIdx);
+  stats.num_channels = channels.size();
+  stats.channels = channels.empty() ? NULL : &channels[0];
+
+  stats.queue_latency_samples = latencies.size();
+  if (!latencies.empty()) {
+    qsort(&latencies[0], latencies.size(), sizeof(int32_t), _compare_int32);
+    int n = latencies.size();
+    stats.queue_latency_p50 = latencies[n * 50 / 100];
+    stats.queue_latency_p90 = latencies[n * 90 / 100];
+    stats.queue_latency_p99 = latencies[n * 99 / 100];
+    stats.queue_latency_max = latencies[n - 1];
+  }
+
+  stats.dropped_too_old = counts.droppedTooOld;
+  stats.dropped_too_big = counts.droppedTooBig;
+  stats.fragments_sent = counts.fragmentsSent;
+  stats.fragments_resent = counts.fragmentsResent;
+  stats.link_error_usec = counts.linkErrorUsec;
+  stats.fragments_received = fragmentsReceived;
+  stats.batches_received = batchesReceived;
+  stats.batches_lost = batchesLost;
+  stats.fec_recoveries = fecRecoveries;
+  stats.rtt = udpRtt;
+  stats.loss = reportedLoss;
+  if (udp_fd >= 0) {
+    double fec = currentFecRate();
+    stats.fec_rate = fec > 1 ? fec : 0;
+    stats.link_rate = udpPacer != NULL ? udpPacer->getRate() : 0;
+  }
+
+  lcm_tunnel_stats_t_publish(lcm, LCM_TUNNEL_STATS_CHANNEL, &stats);
+}
+
 static gboolean on_introspect_timer(void* user_data)
 {
   introspect_t* ini = (introspect_t*) user_data;
@@ -932,6 +2434,15 @@ typedef struct {
   int tcp_max_age_ms;
   int max_delay_ms;
   float fec;
+  char coalesce_channels[1024];
+  char delta_channels[1024];
+  int num_classes;
+  lcm_tunnel_class_t classes[MAX_SEND_CLASSES];
+  int num_limits;
+  lcm_tunnel_limit_t limits[MAX_RATE_LIMITS];
+  int compression;
+  int link_rate;
+  int stats_interval_ms;
 } app_params_t;
 
 static void usage(const char *progname)
@@ -971,6 +2482,10 @@ static void usage(const char *progname)
     "                              Error Correction applied at a rate of FEC \n"
     "                              (must be >1) small messages will be duplicated \n"
     "                              ceil(FEC) times instead of coding.       \n"
+    "                              The rate is adapted to the loss seen by the\n"
+    "                              other end from there, and fragments that\n"
+    "                              still go missing are sent again if they're\n"
+    "                              asked for in time.\n"
     "\n"
     "    -d, --dup=NDUP            Request server to use UDP packets with each\n"
     "                              packet sent NDUP times for drop resiliency\n"
@@ -981,6 +2496,64 @@ static void usage(const char *progname)
     "                              TIME ms before sending as a group\n"
     "                              for efficiency reasons\n"
     "\n"
+    "    -c, --coalesce=CHAN       On channels matching regex CHAN, only the\n"
+    "                              latest message is kept while waiting to be\n"
+    "                              sent, a newer one replaces it in the queue.\n"
+    "                              Applies in both directions.  CHAN is\n"
+    "                              automatically surrounded by ^ and $.\n"
+    "                              (Default: none)\n"
+    "\n"
+    "    -D, --delta=CHAN          Send the messages on channels matching regex\n"
+    "                              CHAN as the difference from an earlier one,\n"
+    "                              compressed, for channels like maps that only\n"
+    "                              change a little at a time.  Every so often a\n"
+    "                              whole one goes out, for UDP to recover from\n"
+    "                              loss.  Uses lz compression if -z isn't given.\n"
+    "                              Applies in both directions.  CHAN is\n"
+    "                              automatically surrounded by ^ and $.\n"
+    "                              (Default: none)\n"
+    "\n"
+    "    -P, --priority=PRIO:WEIGHT:DELAY:CHAN\n"
+    "                              Queue channels matching regex CHAN separately\n"
+    "                              from the rest.  Classes with a higher PRIO are\n"
+    "                              always sent first, classes of equal PRIO share\n"
+    "                              the link in proportion to their WEIGHT, and\n"
+    "                              DELAY replaces the -w wait time for the class.\n"
+    "                              Can be given several times, a channel goes in\n"
+    "                              the first class it matches, and anything\n"
+    "                              that matches none has a PRIO of 0 and a WEIGHT\n"
+    "                              of 1.  Applies in both directions.\n"
+    "                              (Default: 1:1:0:TIMESYNC)\n"
+    "\n"
+    "    -L, --limit=RATE:KBPS:CHAN\n"
+    "                              Forward at most RATE messages per second and\n"
+    "                              KBPS kilobytes per second on each channel\n"
+    "                              matching regex CHAN, dropping the rest.  0\n"
+    "                              means no limit.  Can be given several times,\n"
+    "                              a channel gets the first limit it matches.\n"
+    "                              Applies in both directions.\n"
+    "                              (Default: none)\n"
+    "\n"
+    "    -z, --compress=CODEC      Compress messages in both directions with\n"
+    "                              CODEC, either zlib or lz (faster, but doesn't\n"
+    "                              compress as well).  Channels that don't\n"
+    "                              compress well, like JPEG images, are\n"
+    "                              automatically left alone.  (Default: none)\n"
+    "\n"
+    "    -b, --bandwidth=KBPS      Request server to pace the UDP packets it sends\n"
+    "                              at no more than KBPS kilobytes per second,\n"
+    "                              backing off when the link gets congested.\n"
+    "                              \"auto\" estimates the link rate from scratch.\n"
+    "                              We pace what we send back the same way.\n"
+    "                              Implies -u.  (Default: no pacing)\n"
+    "\n"
+    "    -t, --stats-interval-ms=MS\n"
+    "                              Publish the queue depths, drops and link\n"
+    "                              health of each tunnel on %s every MS ms,\n"
+    "                              for bot-lcm-tunnel-stats.  0 turns this off.\n"
+    "                              Stats are never sent over the tunnel.\n"
+    "                              (Default: %d)\n"
+    "\n"
     "Examples:\n"
     "\n"
     " %s \n"
@@ -1001,7 +2574,8 @@ static void usage(const char *progname)
     " %s -u -f 1.5 -s \"ABC|DEF\" -r \"\" 192.168.1.1\n"
     "    We forward traffic on channels ABC and DEF to 192.168.1.1 via UDP with\n"
     "    FEC 1.5.  Server does not forward anything back.\n"
-    "\n", basename, DEFAULT_PORT, DEFAULT_PORT, basename, basename, basename, basename, basename);
+    "\n", basename, DEFAULT_PORT, DEFAULT_PORT, LCM_TUNNEL_STATS_CHANNEL, DEFAULT_STATS_INTERVAL_MS, basename, basename,
+      basename, basename, basename);
   free(basename);
   exit(1);
 }
@@ -1010,7 +2584,7 @@ int main(int argc, char **argv)
 {
   setlinebuf(stdout);
 
-  const char *optstring = "hvqur:s:R:S:p:f:l:m:d:w:";
+  const char *optstring = "hvqur:s:R:S:p:f:l:m:d:w:c:D:P:L:z:b:t:";
 
   app_params_t params;
   memset(&params, 0, sizeof(params));
@@ -1023,6 +2597,7 @@ int main(int argc, char **argv)
   params.tcp_max_age_ms = 10000;
   params.max_delay_ms = 0;
   params.fec = 0;
+  params.stats_interval_ms = DEFAULT_STATS_INTERVAL_MS;
   strcpy(params.channels_recv, ".*");
   strcpy(params.channels_send, ".*");
   memset(params.lcm_url, 0, sizeof(params.lcm_url));
@@ -1039,6 +2614,13 @@ int main(int argc, char **argv)
       { "wait-time-us", required_argument, 0, 'w' },
       { "lcm-url", required_argument, 0, 'l' },
       { "tcp-max-age-ms", required_argument, 0, 'm' },
+      { "coalesce", required_argument, 0, 'c' },
+      { "delta", required_argument, 0, 'D' },
+      { "priority", required_argument, 0, 'P' },
+      { "limit", required_argument, 0, 'L' },
+      { "compress", required_argument, 0, 'z' },
+      { "bandwidth", required_argument, 0, 'b' },
+      { "stats-interval-ms", required_argument, 0, 't' },
       { 0, 0, 0, 0 } };
 
   int c;
@@ -1094,6 +2676,91 @@ int main(int argc, char **argv)
     case 'u':
       params.udp = 1;
       break;
+    case 'c':
+      if (strlen(optarg) > sizeof(params.coalesce_channels) - 1) {
+        fprintf(stderr, "coalesce channels string too long\n");
+        return 1;
+      }
+      strcpy(params.coalesce_channels, optarg);
+      break;
+    case 'D':
+      if (strlen(optarg) > sizeof(params.delta_channels) - 1) {
+        fprintf(stderr, "delta channels string too long\n");
+        return 1;
+      }
+      strcpy(params.delta_channels, optarg);
+      break;
+    case 'P':
+      {
+        if (params.num_classes == MAX_SEND_CLASSES) {
+          fprintf(stderr, "too many priority classes\n");
+          return 1;
+        }
+        lcm_tunnel_class_t * cls = &params.classes[params.num_classes++];
+        char *e;
+        cls->priority = strtol(optarg, &e, 0);
+        if (*e != ':')
+          usage(argv[0]);
+        cls->weight = strtol(e + 1, &e, 0);
+        if (*e != ':' || cls->weight < 1)
+          usage(argv[0]);
+        cls->max_delay_ms = strtol(e + 1, &e, 0);
+        if (*e != ':')
+          usage(argv[0]);
+        cls->channels = e + 1;
+        break;
+      }
+    case 'L':
+      {
+        if (params.num_limits == MAX_RATE_LIMITS) {
+          fprintf(stderr, "too many rate limits\n");
+          return 1;
+        }
+        lcm_tunnel_limit_t * lim = &params.limits[params.num_limits++];
+        char *e;
+        lim->max_rate = strtod(optarg, &e);
+        if (*e != ':' || lim->max_rate < 0)
+          usage(argv[0]);
+        double kbps = strtod(e + 1, &e);
+        if (*e != ':' || kbps < 0 || kbps * 1024 > G_MAXINT32)
+          usage(argv[0]);
+        lim->max_bandwidth = (int32_t) (kbps * 1024);
+        lim->channels = e + 1;
+        break;
+      }
+    case 'z':
+      if (!strcmp(optarg, "zlib"))
+        params.compression = LCM_TUNNEL_SUB_MSG_T_COMPRESSION_ZLIB;
+      else if (!strcmp(optarg, "lz"))
+        params.compression = LCM_TUNNEL_SUB_MSG_T_COMPRESSION_LZ;
+      else if (!strcmp(optarg, "none"))
+        params.compression = LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE;
+      else
+        usage(argv[0]);
+      break;
+    case 'b':
+      {
+        if (!strcmp(optarg, "auto")) {
+          params.link_rate = -1;
+        }
+        else {
+          char *e;
+          double kbps = strtod(optarg, &e);
+          if (*e != '\0' || kbps <= 0 || kbps * 1024 > G_MAXINT32)
+            usage(argv[0]);
+          params.link_rate = (int) (kbps * 1024);
+        }
+        params.udp = 1; //pacing only applies to UDP
+        break;
+      }
+    case 't':
+      {
+        char *e;
+        params.stats_interval_ms = strtol(optarg, &e, 0);
+        if (*e != '\0' || params.stats_interval_ms < 0)
+          usage(argv[0]);
+        break;
+      }
     case 'l':
       if (strlen(optarg) > sizeof(params.lcm_url) - 1) {
         fprintf(stderr, "LCM URL string too long\n");
@@ -1150,6 +2817,14 @@ int main(int argc, char **argv)
   if (optind < argc - 1) {
     usage(argv[0]);
   }
+  if (params.num_classes == 0) {
+    //don't hold up time sync messages
+    params.classes[0].channels = (char *) "TIMESYNC";
+    params.classes[0].priority = 1;
+    params.classes[0].weight = 1;
+    params.classes[0].max_delay_ms = 0;
+    params.num_classes = 1;
+  }
   params.connectToServer = (optind == argc - 1);
   if (params.connectToServer) {
     strcpy(params.server_addr_str, argv[optind]);
@@ -1188,6 +2863,7 @@ int main(int argc, char **argv)
   serv_params.port = params.port;
   strcpy(serv_params.lcm_url, params.lcm_url);
   serv_params.verbose = params.verbose;
+  serv_params.stats_interval_ms = params.stats_interval_ms;
   if(!LcmTunnelServer::initializeServer(&serv_params)) {
     exit(1);
   }
@@ -1200,6 +2876,14 @@ int main(int argc, char **argv)
     tunnel_params.udp = params.udp;
     tunnel_params.max_delay_ms = params.max_delay_ms;
     tunnel_params.channels = strdup(params.channels_send);
+    tunnel_params.coalesce_channels = params.coalesce_channels;
+    tunnel_params.delta_channels = params.delta_channels;
+    tunnel_params.num_classes = params.num_classes;
+    tunnel_params.classes = params.classes;
+    tunnel_params.num_limits = params.num_limits;
+    tunnel_params.limits = params.limits;
+    tunnel_params.compression = params.compression;
+    tunnel_params.link_rate = params.link_rate;
     LcmTunnel * tunnelClient = new LcmTunnel(params.verbose, NULL);
     int ret = tunnelClient->connectToServer(LcmTunnelServer::lcm, LcmTunnelServer::introspect,
         LcmTunnelServer::mainloop, params.server_addr_str, params.server_port, params.channels_recv, &tunnel_params,
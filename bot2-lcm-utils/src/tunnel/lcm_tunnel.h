@@ -2,17 +2,25 @@
 #define __lcm_tunnel_h__
 
 #include <inttypes.h>
+#include <sys/time.h>
 #include <deque>
+#include <vector>
 #include <glib.h>
 
 #include "ldpc/ldpc_wrapper.h"
 #include "lcm_tunnel_params_t.h"
 #include "lcm_tunnel_sub_msg_t.h"
 #include "lcm_tunnel_udp_msg_t.h"
+#include "lcm_tunnel_udp_report_t.h"
+#include "lcm_tunnel_udp_nack_t.h"
+#include "lcm_tunnel_delta_ack_t.h"
 #include "lcm_tunnel_disconnect_msg_t.h"
+#include "lcm_tunnel_stats_t.h"
 
 #include "ssocket.h"
 #include "introspect.h"
+#include "udp_batch.h"
+#include "udp_pacer.h"
 
 #define DEFAULT_PORT 6141
 
@@ -25,8 +33,74 @@
  //wakeup the send thread immediately if there are this many bytes in the queue
 #define NUM_BYTES_TO_SEND_IMMEDIATELY (5*MAX_PAYLOAD_BYTES_PER_FRAGMENT)
 
+ //in TCP mode, queued messages are written out this many to a writev()
+#define TCP_MSGS_PER_WRITE 64
+
 
 #define MAX_SEND_BUFFER_SIZE 33554432 //2^25 ~33MB
+ //when pacing, the send queue is kept to this much time at the link rate, but no less than MIN_SEND_BUFFER_SIZE
+#define MAX_SEND_QUEUE_DELAY_USEC 2000000
+#define MIN_SEND_BUFFER_SIZE 65536
+
+ //how often each end of a UDP tunnel reports what it's been receiving
+#define UDP_REPORT_INTERVAL_MS 250
+
+ //with FEC, the code rate follows the loss the other end reports, with some to
+ //spare, in steps of FEC_RATE_STEP so that the LDPC sessions get reused
+#define FEC_LOSS_MARGIN 1.15
+#define MIN_FEC_RATE 1.1
+#define MAX_FEC_RATE 4.0
+#define FEC_RATE_STEP 0.05
+
+ //a batch that stops getting fragments for a while asks for the ones it's
+ //missing, until it's too old to be worth sending again
+#define NACK_CHECK_INTERVAL_MS 20
+#define MIN_NACK_DELAY_USEC 40000
+#define MAX_NACKS_PER_BATCH 3
+#define MAX_NACK_FRAGMENTS 512
+#define RETRANSMIT_DEADLINE_USEC 500000
+#define RETRANSMIT_MAX_BATCHES 8 //sent batches kept around to answer NACKs
+#define RETRANSMIT_MAX_BYTES (4*1024*1024)
+
+ //each tunnel publishes an lcm_tunnel_stats_t this often, with percentiles
+ //of the queueing latency taken over up to this many of the messages sent
+#define LCM_TUNNEL_STATS_CHANNEL "LCM_TUNNEL_STATS"
+#define DEFAULT_STATS_INTERVAL_MS 1000
+#define STATS_MAX_LATENCY_SAMPLES 4096
+
+ //batches up to this many back from the newest one can still be put back
+ //together, unless they go this long without a fragment, or the buffers
+ //for them get too big
+#define REASSEMBLY_WINDOW 8
+#define REASSEMBLY_TIMEOUT_USEC 1000000
+#define REASSEMBLY_MAX_BYTES (64*1024*1024)
+
+ //bytes per unit of weight that a priority class may send in each round of the scheduler
+#define SEND_CLASS_QUANTUM (64*MAX_PAYLOAD_BYTES_PER_FRAGMENT)
+#define MAX_SEND_CLASSES 32
+#define MAX_RATE_LIMITS 32
+
+ //how often messages dropped by the rate limits get reported
+#define RATE_LIMIT_REPORT_INTERVAL 10000000
+
+#define NUM_COMPRESSIONS 3 //the COMPRESSION_* values in lcm_tunnel_sub_msg_t
+#define MIN_BYTES_TO_COMPRESS 128
+ //messages on a channel to measure before deciding whether compressing it is worth it.
+ //It is if it saves at least 10%, at a rate of at least 1MB per second of CPU
+#define COMPRESS_SAMPLES 16
+#define COMPRESS_MAX_RATIO 0.9
+#define COMPRESS_MIN_BYTES_SAVED_PER_USEC 1.0
+ //how long a channel that didn't compress well goes before it gets tried again
+#define COMPRESS_RETRY_INTERVAL 30000000
+
+ //delta encoded channels keep this many keyframes at each end.  Over UDP, a
+ //keyframe is sent this often, or sooner if none of the kept ones have been
+ //acknowledged within a couple of round trips (but no sooner than
+ //DELTA_KEYFRAME_RETRY_USEC), and the receiver asks for one at most this often
+#define DELTA_MAX_KEYFRAMES 4
+#define DELTA_KEYFRAME_INTERVAL_USEC 1000000
+#define DELTA_KEYFRAME_RETRY_USEC 100000
+#define DELTA_HEADER_SIZE 8 //the keyframe numbers at the start of the data
 
 #define MAX_NUM_FRAGMENTS 32768  //since we're using a int16_t for the fragment number
   //and wrap around explicitly at this value
@@ -38,33 +112,63 @@ static inline int getNumFragments(int32_t msgSize){
   return (int) ceil((float) msgSize / MAX_PAYLOAD_BYTES_PER_FRAGMENT);
 }
 
+static inline int64_t _timestamp_now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 typedef struct {
     uint16_t port;
     int verbose;
     char lcm_url[1024];
     int startedAsClient;
+    int stats_interval_ms; //0 to not publish stats
 } tunnel_server_params_t;
 
 
-class  TunnelLcmMessage {
+// An LCM message waiting to go out over a tunnel.  The payload is copied out
+// of the LCM receive buffer exactly once, straight into its
+// lcm_tunnel_sub_msg_t encoding, so that the send path can hand slices of it
+// to the socket without touching it again.  The same message may sit in
+// several tunnels' send queues, so it is reference counted.  If asked to,
+// the payload is compressed on the way in, and if that doesn't make it any
+// smaller it's stored as is.
+class TunnelLcmMessage {
 public:
-  TunnelLcmMessage(const lcm_recv_buf_t *rbuf, const char *chan){
-    sub_msg = (lcm_tunnel_sub_msg_t *) malloc(sizeof(lcm_tunnel_sub_msg_t));
-    sub_msg->channel= strdup(chan);
-    recv_utime = rbuf->recv_utime;
-    sub_msg->data_size = rbuf->data_size;
-    sub_msg->data = (uint8_t *)malloc(sub_msg->data_size);
-    memcpy(sub_msg->data,rbuf->data,sub_msg->data_size);
-    encoded_size = lcm_tunnel_sub_msg_t_encoded_size(sub_msg);
+  TunnelLcmMessage(const char *chan, const void *payload, int32_t payload_size, int64_t recv_utime_,
+      int8_t compression_ = LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE, int8_t delta_ = LCM_TUNNEL_SUB_MSG_T_DELTA_NONE);
+
+  inline TunnelLcmMessage * ref()
+  {
+    g_atomic_int_inc(&refcount);
+    return this;
   }
-  ~TunnelLcmMessage(){
-    lcm_tunnel_sub_msg_t_destroy(sub_msg);
+  inline void unref()
+  {
+    if (g_atomic_int_dec_and_test(&refcount))
+      delete this;
   }
 
-  lcm_tunnel_sub_msg_t * sub_msg;
-  int64_t recv_utime;
+  uint8_t * encoded; //the encoded lcm_tunnel_sub_msg_t
   int encoded_size;
-} ;
+  const char * channel; //points into encoded
+  const uint8_t * data; //points into encoded
+  int32_t data_size;
+  int8_t compression; //of data
+  int8_t delta; //what the payload is, see lcm_tunnel_sub_msg_t
+  int32_t uncompressed_size;
+  int64_t compress_usec; //time spent compressing, -1 if it wasn't tried
+  int64_t recv_utime;
+
+private:
+  ~TunnelLcmMessage()
+  {
+    free(encoded);
+  }
+  volatile gint refcount;
+};
 
 
 
@@ -79,18 +183,22 @@ public:
       tunnel_server_params_t * server_params_);
 
   void send_to_remote(const void *data, uint32_t len, const char *lcm_channel);
-  void send_to_remote(const lcm_recv_buf_t *rbuf, const char *lcm_channel);
+  void send_to_remote(TunnelLcmMessage *msg); //takes a reference to msg
   bool match_regex(const char *channel);
   void init_regex(const char *channel);
+  void init_send_queues();
+  bool passes_rate_limits(const char *lcm_channel, uint32_t len);
+  int8_t compression_for(const char *lcm_channel, uint32_t len);
 
   ~LcmTunnel();
 
-  static void on_lcm_message(const lcm_recv_buf_t *rbuf, const char *channel, void *user_data);
   static gpointer sendThreadFunc(gpointer user_data);
   bool send_lcm_messages(std::deque<TunnelLcmMessage *> &msgQueue,uint32_t bytesInQueue);
   static int on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_data);
   static int on_udp_data(GIOChannel * source, GIOCondition cond, void *user_data);
-  int publishLcmMessagesInBuf(int numBytes);
+  static gboolean on_report_timer(gpointer user_data);
+  static gboolean on_nack_timer(gpointer user_data);
+  int publishLcmMessagesInBuf(const char *msgBuf, int numBytes);
 
   bool verbose;
 
@@ -118,18 +226,117 @@ private:
   } tunnel_state_t;
   tunnel_state_t tunnel_state;
 
-  int bytes_to_read;
-  int bytes_read;
+  int bytes_to_read; //the size of the field being read
+  int bytes_read; //received into buf, which can run past the field being read
 
   //threaded sending stuff:
   bool stopSendThread;
-  uint32_t bytesInQueue;
-  uint32_t minBytesToSendImmediately;
+  uint32_t bytesInQueue; //over all the send classes
   GThread * sendThread;
-  std::deque<TunnelLcmMessage *> sendQueue;
-  GMutex * sendQueueLock;
+  GMutex * sendQueueLock; //protects bytesInQueue and everything below
   GCond* sendQueueCond; //thread waits on this
-  bool flushImmediately;
+  std::deque<lcm_tunnel_udp_nack_t *> nackQueue; //NACKs for the send thread to answer
+
+  //messages wait in one queue per priority class.  The send thread always
+  //serves the highest priority class that is ready to go, and shares the
+  //link between ready classes of equal priority in proportion to their
+  //weights, by deficit round robin.
+  typedef struct {
+    GRegex * regex; //NULL for the default class, which takes everything else
+    int priority;
+    int weight;
+    int max_delay_ms; //how long messages may wait for others to be batched with
+    std::deque<TunnelLcmMessage *> queue;
+    uint32_t bytesInQueue;
+    int64_t popped; //number of messages ever taken off the front of queue
+    int64_t firstQueuedTime; //when the queue last became non-empty
+    int64_t deficit; //bytes the class may send before it needs another quantum
+  } send_class_t;
+  std::vector<send_class_t> sendClasses;
+  int nextClassToVisit; //where the next round robin pass starts
+  void addSendClass(GRegex *regex, int priority, int weight, int max_delay_ms);
+  void clearSendQueues();
+  static bool readyToSend(const send_class_t &cls, int64_t now);
+  int nextSendClass(int64_t now, int64_t *wakeTime);
+  uint32_t takeFromSendClass(int c, std::deque<TunnelLcmMessage *> &msgQueue);
+
+  //what we know about each channel that's been sent
+  typedef struct {
+    int sendClass; //index into sendClasses
+    bool coalesce; //only the latest message is kept while waiting to be sent
+    bool delta; //delta encoded by the send thread, so it's queued uncompressed
+    int64_t queuePos; //position in its class' queue of the waiting message, or -1
+    //token buckets for the rate limits, see passes_rate_limits()
+    float maxRate; //messages per second, 0 for no limit
+    int32_t maxBandwidth; //bytes per second, 0 for no limit
+    double rateTokens;
+    double bandwidthTokens;
+    int64_t lastRefillTime;
+    int64_t numLimited; //messages dropped by the limits, in total
+    int32_t recentSeen; //messages seen since the last report
+    int32_t recentLimited; //and how many of those were dropped
+    //compression, see compression_for()
+    bool compress; //whether it's been worth it lately
+    int64_t compressRetryTime; //when to try again if it hasn't
+    int32_t compressSamples; //messages measured since the last decision
+    int64_t compressRawBytes; //and their totals
+    int64_t compressedBytes;
+    int64_t compressUsec;
+    //for the stats, in total
+    int64_t msgsOut; //taken off the queue to be sent
+    int64_t bytesOut;
+    int64_t numCoalesced; //replaced in the queue by a newer message
+    int64_t numQueueFull; //dropped because the queue was too big
+    int64_t numLinkRate; //dropped because the queue was more than the paced link could send in time
+  } channel_info_t;
+  GRegex * coalesceRegex;
+  typedef struct {
+    GRegex * regex;
+    float max_rate;
+    int32_t max_bandwidth;
+  } rate_limit_t;
+  std::vector<rate_limit_t> rateLimits;
+  int64_t lastLimitReportTime;
+  void reportRateLimits();
+  int8_t compression; //what we compress with, settled in the params handshake
+  void updateCompressionStats(channel_info_t *info, const TunnelLcmMessage *msg);
+  GHashTable * channelInfo; //channel -> channel_info_t
+  channel_info_t * getChannelInfo(const char *lcm_channel);
+
+  //delta encoding.  Messages on the delta channels are XORed with a keyframe
+  //that the other end has, then compressed, see deltaEncode().  Over TCP
+  //every message is a keyframe for the next, over UDP the other end
+  //acknowledges the keyframes it gets, and deltas are only taken against
+  //acknowledged ones.
+  GRegex * deltaRegex;
+  typedef struct {
+    int32_t frameNo;
+    uint8_t * data;
+    int32_t size;
+    bool acked; //by the other end, for the ones we sent
+  } delta_keyframe_t;
+  typedef struct {
+    bool delta; //whether the channel is delta encoded at all
+    int32_t nextFrameNo;
+    int64_t lastKeyframeTime; //when we sent one, or asked for one
+    bool keyframeRequested; //by the other end
+    std::deque<delta_keyframe_t> keyframes; //the newest DELTA_MAX_KEYFRAMES
+  } delta_channel_t;
+  static void freeDeltaChannel(gpointer data);
+  static bool addKeyframe(delta_channel_t *dc, int32_t frameNo, const uint8_t *data, int32_t size, bool acked);
+  delta_channel_t * getDeltaChannel(GHashTable *deltaChannels, const char *lcm_channel);
+  GHashTable * deltaSent; //channel -> delta_channel_t, only touched by the send thread
+  GHashTable * deltaReceived; //channel -> delta_channel_t, only touched by the main thread
+  std::deque<lcm_tunnel_delta_ack_t *> deltaAckQueue; //acks for the send thread to take in, under sendQueueLock
+  uint8_t *deltaBuf; //the send thread's
+  int deltaBuf_sz;
+  uint8_t *undeltaBuf;
+  int undeltaBuf_sz;
+  TunnelLcmMessage * deltaEncode(TunnelLcmMessage *msg);
+  void handleDeltaAcks(std::deque<lcm_tunnel_delta_ack_t *> &acks);
+  bool deltaDecode(const char *lcm_channel, int8_t delta, const uint8_t *data, int32_t size,
+      const uint8_t **payload, int32_t *payload_size);
+  void sendDeltaAck(const char *lcm_channel, int32_t frameNo);
 
 
 
@@ -139,22 +346,83 @@ private:
   int channel_sz;
   char *buf;
   int buf_sz;
+  int8_t recv_compression; //of the TCP message being read
+  int8_t recv_delta;
+  int32_t recv_uncompressed_size;
+  uint8_t *decompressBuf;
+  int decompressBuf_sz;
+  bool decompress(int8_t data_compression, const uint8_t *data, int32_t data_size, int32_t uncompressed_size,
+      const uint8_t **uncompressed);
 
   int udp_fd;
   int server_udp_port;
   GIOChannel * udp_ioc;
   guint udp_sid;
   uint32_t udp_send_seqno;
-
-  //stuff to keep track of received fragments
-  char * recFlags;
-  int recFlags_sz;
-  int32_t cur_seqno;
-  uint32_t numFragsRec;
-  uint32_t completeTo_fragno;
-  uint32_t nfrags;
-  uint32_t fragment_buf_offset;
-  int message_complete;
+  UdpSendBatch * udpSendBatch; //only touched by the send thread
+  UdpRecvRing * udpRecvRing;
+  bool sendUdpFragment(const lcm_tunnel_udp_msg_t *msg, const struct iovec *data, int iovcnt);
+  void flushUdpFragments();
+  void handleUdpFragment(const lcm_tunnel_udp_msg_t *recv_udp_msg);
+
+  //pacing, and the reports about the link that it goes by
+  UdpPacer * udpPacer; //NULL unless pacing
+  bool paceUdpSend(int bytes);
+  uint32_t maxBytesInQueue();
+  int32_t udp_datagram_no; //of the last datagram sent, only touched by the send thread
+  guint report_sid;
+  int32_t recvDatagrams; //since the last report we sent
+  int32_t recvBytes;
+  bool recvAnyDatagram;
+  int32_t recvHighestDatagramNo;
+  int32_t reportedHighestDatagramNo; //as of the last report we sent
+  int64_t peerReportUtime; //utime of the last report from the other end, by its clock
+  int64_t peerReportRecvTime; //when it arrived, by ours
+  int64_t udpRtt; //the latest round trip time, -1 until we know
+  void initUdpLink();
+  void handleUdpReport(const lcm_tunnel_udp_report_t *report);
+
+  //adaptive FEC and retransmission
+  volatile gint fecRate; //in hundredths, what we're LDPC coding at, see handleUdpReport()
+  double smoothedLoss;
+  double currentFecRate();
+  typedef struct {
+    int16_t seqno;
+    int64_t sendTime;
+    uint32_t payloadSize;
+    int16_t fecRate; //0 if it wasn't FECed
+    std::deque<TunnelLcmMessage *> msgs; //what the fragments point into, if it wasn't
+    struct iovec * msgIov;
+    ldpc_enc_wrapper * ldpc_enc; //and what they point into if it was
+  } sent_batch_t;
+  std::deque<sent_batch_t *> sentBatches; //only touched by the send thread
+  void forgetSentBatch(sent_batch_t *batch);
+  bool retransmit(const lcm_tunnel_udp_nack_t *nack);
+  guint nack_sid;
+
+  //batches being put back together.  Fragments of the last
+  //REASSEMBLY_WINDOW batches are taken in any order, so that reordering on
+  //the link doesn't cost us whole batches.
+  typedef struct {
+    int32_t seqno;
+    int32_t payloadSize;
+    uint32_t nfrags;
+    uint32_t numFragsRec;
+    uint32_t completeTo_fragno;
+    char * recFlags; //fragments, or for FEC source packets, received
+    char * buf;
+    ldpc_dec_wrapper * ldpc_dec; //NULL if it wasn't FECed
+    bool done; //published or given up on, and the buffers freed
+    int64_t startTime; //when its first fragment arrived
+    int64_t lastFragmentTime;
+    int nacksSent;
+  } reassembly_t;
+  std::deque<reassembly_t *> reassemblies;
+  int32_t newestSeqno; //-1 until the first fragment arrives
+  uint32_t reassemblyBytes; //in the buffers of batches that aren't done
+  reassembly_t * getReassembly(const lcm_tunnel_udp_msg_t *msg);
+  void finishReassembly(reassembly_t *ra, bool complete);
+  void sendNack(reassembly_t *ra, int64_t now);
 
   //for monitoring the UDP link status
   void checkUDPSendStatus(int send_status);
@@ -162,11 +430,37 @@ private:
   int64_t lastErrorPrintTime;
   int numSuccessful;
 
-
-  //forward error correction variables
-  ldpc_dec_wrapper * ldpc_dec;
-
-  lcm_subscription_t *subscription;
+  //stats, see publishStats()
+  guint stats_sid;
+  static gboolean on_stats_timer(gpointer user_data);
+  void startStats();
+  void publishStats();
+  //totals that only the send thread touches, which it copies to sendCounts
+  //under sendQueueLock every time around its loop
+  typedef struct {
+    int64_t fragmentsSent;
+    int64_t fragmentsResent;
+    int64_t droppedTooOld;
+    int64_t droppedTooBig;
+    int64_t linkErrorUsec; //in sendCounts, this includes the current error
+  } send_counts_t;
+  send_counts_t sendThreadCounts;
+  send_counts_t sendCounts;
+  void updateSendCounts();
+  std::vector<int32_t> queueLatencies; //under sendQueueLock, a sample since the last stats
+  int64_t numQueueLatencies; //how many the sample was taken from
+  //only touched by the main thread
+  int64_t fragmentsReceived;
+  int64_t batchesReceived;
+  int64_t batchesLost;
+  int64_t fecRecoveries;
+  double reportedLoss; //by the other end, in its last report
+  typedef struct {
+    int64_t msgs;
+    int64_t bytes;
+  } recv_counts_t;
+  GHashTable * recvCounts; //channel -> recv_counts_t
+  void countReceived(const char *lcm_channel, int32_t size);
 
 };
 
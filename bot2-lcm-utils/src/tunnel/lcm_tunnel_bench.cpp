@@ -0,0 +1,604 @@
+//lcm-tunnel-bench: measures how well bot-lcm-tunnel gets traffic across a
+//bad link, without needing the radios.  It starts a tunnel server and a
+//client on this machine, each on its own LCM network, with a LinkEmulator
+//between them.  Then it plays synthetic or logged traffic into the client's
+//LCM, and reports what comes out on the server's: the throughput, and the
+//loss and latency on each channel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <glib.h>
+#include <lcm/lcm.h>
+
+#include "link_emulator.h"
+
+#define DEFAULT_BENCH_PORT 7700 //the tunnel server listens here, and the link emulator on the next one up
+#define DEFAULT_CLIENT_LCM_URL "udpm://239.255.76.67:7701?ttl=0"
+#define DEFAULT_SERVER_LCM_URL "udpm://239.255.76.67:7702?ttl=0"
+#define BENCH_CONNECT_TIMEOUT_USEC 10000000
+#define BENCH_WARMUP_USEC 1000000 //after the tunnel is up, before the traffic starts
+#define BENCH_HEADER_SIZE 16 //the send time and sequence number that start each message
+
+static inline int64_t _timestamp_now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+typedef struct {
+  int64_t sent;
+  int64_t bytesSent;
+  int64_t received;
+  int64_t bytesReceived;
+  int64_t reordered; //arrived after a later message on the same channel
+  int64_t lastSeqno;
+  std::vector<int32_t> latencies; //usec
+} channel_stats_t;
+
+typedef struct {
+  std::string channel;
+  double hz;
+  int size;
+  int64_t nextTime;
+  std::string payload;
+} synthetic_channel_t;
+
+typedef struct {
+  lcm_t * clientLcm;
+  lcm_t * serverLcm;
+  LinkEmulator * emulator;
+  pid_t server;
+  pid_t client;
+
+  std::map<std::string, channel_stats_t> stats;
+  std::vector<synthetic_channel_t> synthetic;
+  lcm_eventlog_t * log;
+  lcm_eventlog_event_t * nextEvent;
+  int64_t logOffset; //from log time to now
+  int64_t startTime;
+  int64_t endTime;
+} bench_t;
+
+static void on_message(const lcm_recv_buf_t *rbuf, const char *channel, void *user_data)
+{
+  bench_t * bench = (bench_t *) user_data;
+  //everything else, like the tunnel stats, isn't ours
+  std::map<std::string, channel_stats_t>::iterator it = bench->stats.find(channel);
+  if (it == bench->stats.end() || rbuf->data_size < BENCH_HEADER_SIZE)
+    return;
+  channel_stats_t &stats = it->second;
+  int64_t sendTime, seqno;
+  memcpy(&sendTime, rbuf->data, 8);
+  memcpy(&seqno, (const char *) rbuf->data + 8, 8);
+  stats.received++;
+  stats.bytesReceived += rbuf->data_size;
+  if (seqno < stats.lastSeqno)
+    stats.reordered++;
+  stats.lastSeqno = MAX(stats.lastSeqno, seqno);
+  stats.latencies.push_back((int32_t) MIN(_timestamp_now() - sendTime, G_MAXINT32));
+}
+
+//stamps the message with when it went out, so the other end can work out the latency
+static void publish(bench_t *bench, const char *channel, std::string &data)
+{
+  channel_stats_t &stats = bench->stats[channel];
+  if (data.size() < BENCH_HEADER_SIZE)
+    data.resize(BENCH_HEADER_SIZE);
+  int64_t now = _timestamp_now();
+  int64_t seqno = stats.sent;
+  memcpy(&data[0], &now, 8);
+  memcpy(&data[8], &seqno, 8);
+  lcm_publish(bench->clientLcm, channel, data.data(), data.size());
+  stats.sent++;
+  stats.bytesSent += data.size();
+}
+
+//publishes whatever is due, and returns when the next message will be, -1 if there are no more
+static int64_t play_traffic(bench_t *bench, int64_t now)
+{
+  if (now < bench->startTime)
+    return bench->startTime;
+  if (now >= bench->endTime)
+    return -1;
+  int64_t next = bench->endTime;
+  for (size_t i = 0; i < bench->synthetic.size(); i++) {
+    synthetic_channel_t &ch = bench->synthetic[i];
+    if (ch.nextTime < bench->startTime)
+      ch.nextTime = bench->startTime;
+    while (ch.nextTime <= now) {
+      publish(bench, ch.channel.c_str(), ch.payload);
+      ch.nextTime += (int64_t) (1e6 / ch.hz);
+    }
+    next = MIN(next, ch.nextTime);
+  }
+  if (bench->log != NULL) {
+    while (bench->nextEvent != NULL && bench->nextEvent->timestamp + bench->logOffset <= now) {
+      std::string data((const char *) bench->nextEvent->data, bench->nextEvent->datalen);
+      publish(bench, bench->nextEvent->channel, data);
+      lcm_eventlog_free_event(bench->nextEvent);
+      bench->nextEvent = lcm_eventlog_read_next_event(bench->log);
+    }
+    if (bench->nextEvent == NULL) {
+      bench->endTime = MIN(bench->endTime, now); //played it all
+      return -1;
+    }
+    next = MIN(next, bench->nextEvent->timestamp + bench->logOffset);
+  }
+  return next;
+}
+
+static bool tunnels_running(bench_t *bench)
+{
+  pid_t pids[2] = { bench->server, bench->client };
+  for (int i = 0; i < 2; i++) {
+    int status;
+    if (waitpid(pids[i], &status, WNOHANG) == pids[i]) {
+      fprintf(stderr, "the tunnel %s exited\n", pids[i] == bench->server ? "server" : "client");
+      if (pids[i] == bench->server)
+        bench->server = -1;
+      else
+        bench->client = -1;
+      return false;
+    }
+  }
+  return true;
+}
+
+//runs everything until the time comes, or the tunnel is up if waiting for it
+static bool run_until(bench_t *bench, int64_t endTime, bool untilConnected)
+{
+  int lcmFd = lcm_get_fileno(bench->serverLcm);
+  std::vector<struct pollfd> fds;
+  while (true) {
+    int64_t now = _timestamp_now();
+    if (now >= endTime || (untilConnected && bench->emulator->connected()))
+      return true;
+    if (!tunnels_running(bench))
+      return false;
+
+    int64_t timeout = MIN(endTime - now, 100000); //to keep an eye on the tunnels
+    int64_t next = play_traffic(bench, now);
+    if (next >= 0)
+      timeout = MIN(timeout, next - now);
+
+    fds.clear();
+    struct pollfd pfd = { lcmFd, POLLIN, 0 };
+    fds.push_back(pfd);
+    bench->emulator->preparePoll(fds, &timeout, now);
+    //poll only does milliseconds, and being late matters more than spinning
+    int status = poll(&fds[0], fds.size(), (int) (MAX(timeout, 0) / 1000));
+    if (status < 0 && errno != EINTR) {
+      perror("poll");
+      return false;
+    }
+    now = _timestamp_now();
+    if (status > 0 && (fds[0].revents & POLLIN))
+      lcm_handle(bench->serverLcm);
+    bench->emulator->dispatch(&fds[1], now);
+  }
+}
+
+static pid_t spawn(const std::vector<const char *> &args, bool verbose)
+{
+  if (verbose) {
+    for (size_t i = 0; i < args.size(); i++)
+      printf("%s%s", i > 0 ? " " : "", args[i]);
+    printf("\n");
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    if (!verbose) {
+      int devnull = open("/dev/null", O_WRONLY);
+      dup2(devnull, STDOUT_FILENO);
+      dup2(devnull, STDERR_FILENO);
+    }
+    std::vector<const char *> argv(args);
+    argv.push_back(NULL);
+    execvp(argv[0], (char * const *) &argv[0]);
+    perror(argv[0]);
+    _exit(1);
+  }
+  return pid;
+}
+
+static void stop(pid_t pid)
+{
+  if (pid <= 0)
+    return;
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+}
+
+static int _compare_int32(const void *a, const void *b)
+{
+  int32_t x = *(const int32_t *) a;
+  int32_t y = *(const int32_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static void print_link(const char *name, const ImpairedLink *link)
+{
+  printf("  %-16s %10lld %10lld %10lld %10lld %12.1f\n", name, (long long) link->numSent, (long long) link->numLost,
+      (long long) link->numOverflowed, (long long) link->numDelivered, link->bytesDelivered / 1024.0);
+}
+
+static void report(bench_t *bench)
+{
+  double duration = (bench->endTime - bench->startTime) * 1e-6;
+  printf("\n%-32s %8s %8s %7s %9s %8s %8s %8s %8s %9s\n", "channel", "sent", "recvd", "loss", "KB/s", "p50 ms",
+      "p90 ms", "p99 ms", "max ms", "reordered");
+  channel_stats_t total = channel_stats_t();
+  for (std::map<std::string, channel_stats_t>::iterator it = bench->stats.begin(); it != bench->stats.end(); it++) {
+    channel_stats_t &s = it->second;
+    std::vector<int32_t> &l = s.latencies;
+    printf("%-32s %8lld %8lld %6.2f%% %9.1f", it->first.c_str(), (long long) s.sent, (long long) s.received,
+        s.sent > 0 ? 100.0 * (s.sent - s.received) / s.sent : 0, s.bytesReceived / 1024.0 / duration);
+    if (!l.empty()) {
+      qsort(&l[0], l.size(), sizeof(int32_t), _compare_int32);
+      int n = l.size();
+      printf(" %8.1f %8.1f %8.1f %8.1f", l[n * 50 / 100] * 1e-3, l[n * 90 / 100] * 1e-3, l[n * 99 / 100] * 1e-3,
+          l[n - 1] * 1e-3);
+    }
+    else {
+      printf(" %8s %8s %8s %8s", "-", "-", "-", "-");
+    }
+    printf(" %9lld\n", (long long) s.reordered);
+    total.sent += s.sent;
+    total.received += s.received;
+    total.bytesSent += s.bytesSent;
+    total.bytesReceived += s.bytesReceived;
+  }
+  printf("%-32s %8lld %8lld %6.2f%% %9.1f\n", "total", (long long) total.sent, (long long) total.received,
+      total.sent > 0 ? 100.0 * (total.sent - total.received) / total.sent : 0, total.bytesReceived / 1024.0
+          / duration);
+  printf("offered %.1f KB/s over %.1f s\n", total.bytesSent / 1024.0 / duration, duration);
+
+  LinkEmulator * e = bench->emulator;
+  printf("\nlink (%s)        %10s %10s %10s %10s %12s\n", e->udp ? "udp" : "tcp", e->udp ? "datagrams" : "writes",
+      "lost", "overflowed", "delivered", "KB");
+  if (e->udp) {
+    print_link("to server", e->udpLinks[LinkEmulator::TO_SERVER]);
+    print_link("to client", e->udpLinks[LinkEmulator::TO_CLIENT]);
+  }
+  else {
+    print_link("to server", e->tcpLinks[LinkEmulator::TO_SERVER]);
+    print_link("to client", e->tcpLinks[LinkEmulator::TO_CLIENT]);
+  }
+}
+
+static void usage(const char *progname)
+{
+  char *basename = g_path_get_basename(progname);
+  printf("Usage: %s [options] [-- tunnel client options]\n"
+    "\n"
+    "Runs a bot-lcm-tunnel client and server on this machine, over an\n"
+    "emulated link, plays LCM traffic into the client and reports the\n"
+    "throughput, loss and latency of what comes out of the server.  Anything\n"
+    "after -- is passed on to the client, e.g. -- -u -f 1.5\n"
+    "\n"
+    "Options:\n"
+    "\n"
+    "    -h, --help                Shows this help text and exits\n"
+    "    -v, --verbose             Show what the tunnels print\n"
+    "    -T, --tunnel=PATH         The bot-lcm-tunnel to run\n"
+    "                              (Default: the one next to this program)\n"
+    "    -p, --port=N              Run the tunnel server on port N, and the link\n"
+    "                              emulator on N+1 (Default: %d)\n"
+    "    -n, --seed=N              Seed for the link emulator and the synthetic\n"
+    "                              traffic (Default: 1)\n"
+    "\n"
+    "Traffic:\n"
+    "\n"
+    "    -c, --channel=HZ:BYTES:CHAN\n"
+    "                              Publish BYTES of random data on CHAN at HZ.\n"
+    "                              Can be given several times.\n"
+    "                              (Default: 100:200:POSE 40:8000:LASER\n"
+    "                              10:60000:IMAGE)\n"
+    "    -L, --log=FILE            Replay the LCM log FILE at its own pace\n"
+    "                              instead, ending early if it runs out.\n"
+    "    -d, --duration=SEC        How long to play traffic for (Default: 10)\n"
+    "    -w, --drain=SEC           How long to wait for the stragglers\n"
+    "                              afterwards (Default: 2)\n"
+    "\n"
+    "Link, the same in both directions:\n"
+    "\n"
+    "    -l, --loss=FRAC           Drop FRAC of the datagrams (Default: 0)\n"
+    "    -B, --burst=LEN           Drop them in runs of LEN on average\n"
+    "                              (Default: 1, independent drops)\n"
+    "    -D, --delay=MS            One way delay (Default: 0)\n"
+    "    -j, --jitter=MS           Add up to MS to the delay at random,\n"
+    "                              which reorders datagrams (Default: 0)\n"
+    "    -o, --reorder=FRAC[:MS]   Hold FRAC of the datagrams back by MS more\n"
+    "                              (Default: 0, 10ms)\n"
+    "    -b, --bandwidth=KBPS      Cap the link at KBPS kilobytes per second\n"
+    "                              (Default: no cap)\n"
+    "    -q, --queue-ms=MS         Drop datagrams once the link is more than MS\n"
+    "                              behind the cap (Default: 100)\n"
+    "    TCP tunnels only see the delay and the bandwidth cap.\n"
+    "\n", basename, DEFAULT_BENCH_PORT);
+  free(basename);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  setlinebuf(stdout);
+  signal(SIGPIPE, SIG_IGN);
+
+  //stop at the first non-option, the rest is for the tunnel client
+  const char *optstring = "+hvT:p:n:c:L:d:w:l:B:D:j:o:b:q:";
+  struct option long_opts[] = { { "help", no_argument, 0, 'h' },
+      { "verbose", no_argument, 0, 'v' },
+      { "tunnel", required_argument, 0, 'T' },
+      { "port", required_argument, 0, 'p' },
+      { "seed", required_argument, 0, 'n' },
+      { "channel", required_argument, 0, 'c' },
+      { "log", required_argument, 0, 'L' },
+      { "duration", required_argument, 0, 'd' },
+      { "drain", required_argument, 0, 'w' },
+      { "loss", required_argument, 0, 'l' },
+      { "burst", required_argument, 0, 'B' },
+      { "delay", required_argument, 0, 'D' },
+      { "jitter", required_argument, 0, 'j' },
+      { "reorder", required_argument, 0, 'o' },
+      { "bandwidth", required_argument, 0, 'b' },
+      { "queue-ms", required_argument, 0, 'q' },
+      { 0, 0, 0, 0 } };
+
+  bool verbose = false;
+  std::string tunnel;
+  int port = DEFAULT_BENCH_PORT;
+  guint32 seed = 1;
+  const char *logfile = NULL;
+  double duration = 10;
+  double drain = 2;
+  std::vector<synthetic_channel_t> synthetic;
+  link_params_t link;
+  memset(&link, 0, sizeof(link));
+  link.burst = 1;
+  link.reorderDelay = 10000;
+  link.queueUsec = 100000;
+
+  int c;
+  while ((c = getopt_long(argc, argv, optstring, long_opts, 0)) >= 0) {
+    char *e;
+    switch (c) {
+    case 'v':
+      verbose = true;
+      break;
+    case 'T':
+      tunnel = optarg;
+      break;
+    case 'p':
+      port = strtol(optarg, &e, 0);
+      if (*e != '\0' || port <= 0 || port > 65534)
+        usage(argv[0]);
+      break;
+    case 'n':
+      seed = strtoul(optarg, &e, 0);
+      if (*e != '\0')
+        usage(argv[0]);
+      break;
+    case 'c':
+      {
+        synthetic_channel_t ch;
+        ch.hz = strtod(optarg, &e);
+        if (*e != ':' || ch.hz <= 0)
+          usage(argv[0]);
+        ch.size = strtol(e + 1, &e, 0);
+        if (*e != ':' || ch.size < 0 || e[1] == '\0')
+          usage(argv[0]);
+        ch.channel = e + 1;
+        synthetic.push_back(ch);
+        break;
+      }
+    case 'L':
+      logfile = optarg;
+      break;
+    case 'd':
+      duration = strtod(optarg, &e);
+      if (*e != '\0' || duration <= 0)
+        usage(argv[0]);
+      break;
+    case 'w':
+      drain = strtod(optarg, &e);
+      if (*e != '\0' || drain < 0)
+        usage(argv[0]);
+      break;
+    case 'l':
+      link.loss = strtod(optarg, &e);
+      if (*e != '\0' || link.loss < 0 || link.loss >= 1)
+        usage(argv[0]);
+      break;
+    case 'B':
+      link.burst = strtod(optarg, &e);
+      if (*e != '\0' || link.burst < 1)
+        usage(argv[0]);
+      break;
+    case 'D':
+      link.delay = (int64_t) (strtod(optarg, &e) * 1000);
+      if (*e != '\0' || link.delay < 0)
+        usage(argv[0]);
+      break;
+    case 'j':
+      link.jitter = (int64_t) (strtod(optarg, &e) * 1000);
+      if (*e != '\0' || link.jitter < 0)
+        usage(argv[0]);
+      break;
+    case 'o':
+      link.reorder = strtod(optarg, &e);
+      if (*e == ':')
+        link.reorderDelay = (int64_t) (strtod(e + 1, &e) * 1000);
+      if (*e != '\0' || link.reorder < 0 || link.reorder > 1 || link.reorderDelay < 0)
+        usage(argv[0]);
+      break;
+    case 'b':
+      {
+        double kbps = strtod(optarg, &e);
+        if (*e != '\0' || kbps <= 0 || kbps * 1024 > G_MAXINT32)
+          usage(argv[0]);
+        link.rate = (int) (kbps * 1024);
+        break;
+      }
+    case 'q':
+      link.queueUsec = (int64_t) (strtod(optarg, &e) * 1000);
+      if (*e != '\0' || link.queueUsec < 0)
+        usage(argv[0]);
+      break;
+    default:
+      usage(argv[0]);
+      break;
+    }
+  }
+  if (optind < argc && strcmp(argv[optind - 1], "--") != 0)
+    usage(argv[0]); //tunnel options have to come after --
+
+  if (tunnel.empty()) {
+    //look next to ourselves first
+    char self[4096];
+    int len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    tunnel = "bot-lcm-tunnel";
+    if (len > 0) {
+      self[len] = '\0';
+      char *dir = g_path_get_dirname(self);
+      std::string local = std::string(dir) + "/bot-lcm-tunnel";
+      if (access(local.c_str(), X_OK) == 0)
+        tunnel = local;
+      g_free(dir);
+    }
+  }
+
+  bench_t bench;
+  bench.log = NULL;
+  bench.nextEvent = NULL;
+  bench.server = -1;
+  bench.client = -1;
+  GRand * rand = g_rand_new_with_seed(seed);
+
+  if (logfile != NULL) {
+    bench.log = lcm_eventlog_create(logfile, "r");
+    if (bench.log == NULL) {
+      perror(logfile);
+      return 1;
+    }
+    bench.nextEvent = lcm_eventlog_read_next_event(bench.log);
+    if (bench.nextEvent == NULL) {
+      fprintf(stderr, "%s is empty\n", logfile);
+      return 1;
+    }
+  }
+  else {
+    if (synthetic.empty()) {
+      const char *defaults[][3] = { { "100", "200", "POSE" }, { "40", "8000", "LASER" }, { "10", "60000", "IMAGE" } };
+      for (int i = 0; i < 3; i++) {
+        synthetic_channel_t ch;
+        ch.hz = atof(defaults[i][0]);
+        ch.size = atoi(defaults[i][1]);
+        ch.channel = defaults[i][2];
+        synthetic.push_back(ch);
+      }
+    }
+    for (size_t i = 0; i < synthetic.size(); i++) {
+      synthetic[i].payload.resize(synthetic[i].size);
+      for (int j = 0; j < synthetic[i].size; j++)
+        synthetic[i].payload[j] = (char) g_rand_int(rand);
+      synthetic[i].nextTime = 0;
+    }
+  }
+  bench.synthetic = synthetic;
+
+  bench.clientLcm = lcm_create(DEFAULT_CLIENT_LCM_URL);
+  bench.serverLcm = lcm_create(DEFAULT_SERVER_LCM_URL);
+  if (bench.clientLcm == NULL || bench.serverLcm == NULL) {
+    fprintf(stderr, "Couldn't create LCM\n");
+    return 1;
+  }
+  lcm_subscribe(bench.serverLcm, ".*", on_message, &bench);
+
+  bench.emulator = new LinkEmulator(&link, rand);
+  if (!bench.emulator->start(port + 1, port))
+    return 1;
+
+  //nothing comes back from the server, so all the link carries that way
+  //is what the tunnel sends on its own
+  char portStr[32], emulatorStr[64];
+  snprintf(portStr, sizeof(portStr), "%d", port);
+  snprintf(emulatorStr, sizeof(emulatorStr), "127.0.0.1:%d", port + 1);
+  std::vector<const char *> serverArgs;
+  serverArgs.push_back(tunnel.c_str());
+  serverArgs.push_back("-p");
+  serverArgs.push_back(portStr);
+  serverArgs.push_back("-l");
+  serverArgs.push_back(DEFAULT_SERVER_LCM_URL);
+  std::vector<const char *> clientArgs;
+  clientArgs.push_back(tunnel.c_str());
+  clientArgs.push_back("-p");
+  clientArgs.push_back("0"); //it runs a server of its own too
+  clientArgs.push_back("-l");
+  clientArgs.push_back(DEFAULT_CLIENT_LCM_URL);
+  clientArgs.push_back("-r");
+  clientArgs.push_back("");
+  for (int i = optind; i < argc; i++)
+    clientArgs.push_back(argv[i]);
+  clientArgs.push_back(emulatorStr);
+
+  bench.server = spawn(serverArgs, verbose);
+  bench.client = spawn(clientArgs, verbose);
+  bench.startTime = G_MAXINT64;
+  bench.endTime = G_MAXINT64;
+
+  int ret = 1;
+  int64_t now = _timestamp_now();
+  if (bench.server < 0 || bench.client < 0) {
+    //couldn't start them
+  }
+  else if (!run_until(&bench, now + BENCH_CONNECT_TIMEOUT_USEC, true) || !bench.emulator->connected()) {
+    fprintf(stderr, "the tunnel didn't come up, try -v to see why\n");
+  }
+  else {
+    now = _timestamp_now();
+    bench.startTime = now + BENCH_WARMUP_USEC;
+    bench.endTime = bench.startTime + (int64_t) (duration * 1e6);
+    if (bench.log != NULL)
+      bench.logOffset = bench.startTime - bench.nextEvent->timestamp;
+    printf("tunnel is up over %s, playing traffic for %.1f s\n", bench.emulator->udp ? "udp" : "tcp", duration);
+    if (run_until(&bench, bench.endTime, false)) {
+      //the log may have run out early
+      if (run_until(&bench, MAX(bench.endTime, _timestamp_now()) + (int64_t) (drain * 1e6), false)) {
+        report(&bench);
+        ret = 0;
+      }
+    }
+  }
+
+  stop(bench.client);
+  stop(bench.server);
+  delete bench.emulator;
+  g_rand_free(rand);
+  if (bench.nextEvent != NULL)
+    lcm_eventlog_free_event(bench.nextEvent);
+  if (bench.log != NULL)
+    lcm_eventlog_destroy(bench.log);
+  lcm_destroy(bench.clientLcm);
+  lcm_destroy(bench.serverLcm);
+  return ret;
+}
@@ -20,13 +20,21 @@ int64_t __lcm_tunnel_params_t_hash_recursive(const __lcm_hash_ptr *p)
     const __lcm_hash_ptr cp = { p, (void*)__lcm_tunnel_params_t_get_hash };
     (void) cp;
  
-    int64_t hash = 0x88279ccb7db6160aLL
+    int64_t hash = 0x2f2c56b628a14491LL
          + __boolean_hash_recursive(&cp)
          + __int32_t_hash_recursive(&cp)
          + __int32_t_hash_recursive(&cp)
          + __int32_t_hash_recursive(&cp)
          + __string_hash_recursive(&cp)
          + __float_hash_recursive(&cp)
+         + __string_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __lcm_tunnel_class_t_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __lcm_tunnel_limit_t_hash_recursive(&cp)
+         + __int8_t_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __string_hash_recursive(&cp)
         ;
  
     return (hash<<1) + ((hash>>63)&1);
@@ -66,6 +74,30 @@ int __lcm_tunnel_params_t_encode_array(void *buf, int offset, int maxlen, const
         thislen = __float_encode_array(buf, offset + pos, maxlen - pos, &(p[element].fec), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
+        thislen = __string_encode_array(buf, offset + pos, maxlen - pos, &(p[element].coalesce_channels), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].num_classes), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __lcm_tunnel_class_t_encode_array(buf, offset + pos, maxlen - pos, p[element].classes, p[element].num_classes);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].num_limits), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __lcm_tunnel_limit_t_encode_array(buf, offset + pos, maxlen - pos, p[element].limits, p[element].num_limits);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int8_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].compression), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].link_rate), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __string_encode_array(buf, offset + pos, maxlen - pos, &(p[element].delta_channels), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
     }
     return pos;
 }
@@ -101,6 +133,22 @@ int __lcm_tunnel_params_t_encoded_array_size(const lcm_tunnel_params_t *p, int e
  
         size += __float_encoded_array_size(&(p[element].fec), 1);
  
+        size += __string_encoded_array_size(&(p[element].coalesce_channels), 1);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].num_classes), 1);
+ 
+        size += __lcm_tunnel_class_t_encoded_array_size(p[element].classes, p[element].num_classes);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].num_limits), 1);
+ 
+        size += __lcm_tunnel_limit_t_encoded_array_size(p[element].limits, p[element].num_limits);
+ 
+        size += __int8_t_encoded_array_size(&(p[element].compression), 1);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].link_rate), 1);
+ 
+        size += __string_encoded_array_size(&(p[element].delta_channels), 1);
+ 
     }
     return size;
 }
@@ -134,6 +182,32 @@ int __lcm_tunnel_params_t_decode_array(const void *buf, int offset, int maxlen,
         thislen = __float_decode_array(buf, offset + pos, maxlen - pos, &(p[element].fec), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
+        thislen = __string_decode_array(buf, offset + pos, maxlen - pos, &(p[element].coalesce_channels), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].num_classes), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        p[element].classes = (lcm_tunnel_class_t*) lcm_malloc(sizeof(lcm_tunnel_class_t) * p[element].num_classes);
+        thislen = __lcm_tunnel_class_t_decode_array(buf, offset + pos, maxlen - pos, p[element].classes, p[element].num_classes);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].num_limits), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        p[element].limits = (lcm_tunnel_limit_t*) lcm_malloc(sizeof(lcm_tunnel_limit_t) * p[element].num_limits);
+        thislen = __lcm_tunnel_limit_t_decode_array(buf, offset + pos, maxlen - pos, p[element].limits, p[element].num_limits);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int8_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].compression), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].link_rate), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __string_decode_array(buf, offset + pos, maxlen - pos, &(p[element].delta_channels), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
     }
     return pos;
 }
@@ -155,6 +229,24 @@ int __lcm_tunnel_params_t_decode_array_cleanup(lcm_tunnel_params_t *p, int eleme
  
         __float_decode_array_cleanup(&(p[element].fec), 1);
  
+        __string_decode_array_cleanup(&(p[element].coalesce_channels), 1);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].num_classes), 1);
+ 
+        __lcm_tunnel_class_t_decode_array_cleanup(p[element].classes, p[element].num_classes);
+        if (p[element].classes) free(p[element].classes);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].num_limits), 1);
+ 
+        __lcm_tunnel_limit_t_decode_array_cleanup(p[element].limits, p[element].num_limits);
+        if (p[element].limits) free(p[element].limits);
+ 
+        __int8_t_decode_array_cleanup(&(p[element].compression), 1);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].link_rate), 1);
+ 
+        __string_decode_array_cleanup(&(p[element].delta_channels), 1);
+ 
     }
     return 0;
 }
@@ -197,6 +289,24 @@ int __lcm_tunnel_params_t_clone_array(const lcm_tunnel_params_t *p, lcm_tunnel_p
  
         __float_clone_array(&(p[element].fec), &(q[element].fec), 1);
  
+        __string_clone_array(&(p[element].coalesce_channels), &(q[element].coalesce_channels), 1);
+ 
+        __int32_t_clone_array(&(p[element].num_classes), &(q[element].num_classes), 1);
+ 
+        q[element].classes = (lcm_tunnel_class_t*) lcm_malloc(sizeof(lcm_tunnel_class_t) * q[element].num_classes);
+        __lcm_tunnel_class_t_clone_array(p[element].classes, q[element].classes, p[element].num_classes);
+ 
+        __int32_t_clone_array(&(p[element].num_limits), &(q[element].num_limits), 1);
+ 
+        q[element].limits = (lcm_tunnel_limit_t*) lcm_malloc(sizeof(lcm_tunnel_limit_t) * q[element].num_limits);
+        __lcm_tunnel_limit_t_clone_array(p[element].limits, q[element].limits, p[element].num_limits);
+ 
+        __int8_t_clone_array(&(p[element].compression), &(q[element].compression), 1);
+ 
+        __int32_t_clone_array(&(p[element].link_rate), &(q[element].link_rate), 1);
+ 
+        __string_clone_array(&(p[element].delta_channels), &(q[element].delta_channels), 1);
+ 
     }
     return 0;
 }
@@ -8,6 +8,8 @@
 #include <stdlib.h>
 #include <lcm/lcm_coretypes.h>
 #include <lcm/lcm.h>
+#include "lcm_tunnel_class_t.h"
+#include "lcm_tunnel_limit_t.h"
 
 #ifndef _lcm_tunnel_params_t_h
 #define _lcm_tunnel_params_t_h
@@ -25,6 +27,14 @@ struct _lcm_tunnel_params_t
     int32_t    max_delay_ms;
     char*      channels;
     float      fec;
+    char*      coalesce_channels;
+    int32_t    num_classes;
+    lcm_tunnel_class_t *classes;
+    int32_t    num_limits;
+    lcm_tunnel_limit_t *limits;
+    int8_t     compression;
+    int32_t    link_rate;
+    char*      delta_channels;
 };
  
 lcm_tunnel_params_t   *lcm_tunnel_params_t_copy(const lcm_tunnel_params_t *p);
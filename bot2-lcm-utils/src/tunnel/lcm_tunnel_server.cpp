@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <getopt.h>
@@ -32,30 +33,148 @@ guint LcmTunnelServer::server_sock_sid;
 
 tunnel_server_params_t LcmTunnelServer::params;
 
-bool LcmTunnelServer::matches_a_client(const char *channel)
+GHashTable * LcmTunnelServer::channel_tunnels;
+std::list<LcmTunnelServer::subscriber_t> LcmTunnelServer::subscribers;
+
+static void _free_channel_tunnels(gpointer p)
 {
-  for (std::list<LcmTunnel*>::iterator iter =
-                LcmTunnelServer::clients_list.begin();
-        iter != clients_list.end(); iter++)
-  {
-    if ((*iter)->match_regex(channel))
-      return true;
+  delete (LcmTunnelServer::channel_tunnels_t *) p;
+}
+
+LcmTunnelServer::channel_tunnels_t * LcmTunnelServer::get_channel_tunnels(const char *channel)
+{
+  if (channel_tunnels == NULL)
+    channel_tunnels = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _free_channel_tunnels);
+  channel_tunnels_t * ct = (channel_tunnels_t *) g_hash_table_lookup(channel_tunnels, channel);
+  if (ct == NULL) {
+    ct = new channel_tunnels_t;
+    ct->last_rbuf = NULL;
+    ct->handlers_left = 0;
+    //each tunnel's stats are only for the LCM network it's on, so they never
+    //go out over a tunnel, whatever the channel regexes say
+    if (strcmp(channel, LCM_TUNNEL_STATS_CHANNEL) != 0) {
+      for (std::list<subscriber_t>::iterator iter = subscribers.begin();
+          iter != subscribers.end(); iter++)
+      {
+        if (g_regex_match(iter->regex, channel, (GRegexMatchFlags) 0, NULL))
+          ct->subscribers.push_back(iter->tunnel);
+      }
+      for (std::list<LcmTunnel*>::iterator iter = clients_list.begin();
+          iter != clients_list.end(); iter++)
+      {
+        if ((*iter)->match_regex(channel))
+          ct->clients.push_back(*iter);
+      }
+    }
+    g_hash_table_insert(channel_tunnels, g_strdup(channel), ct);
   }
-  return false;
+  return ct;
 }
 
-void LcmTunnelServer::check_and_send_to_tunnels(const char *channel,
-    const void *data, unsigned int len, LcmTunnel *to_skip)
+//has to be called whenever a tunnel comes or goes, or changes its channels
+void LcmTunnelServer::forget_channel_tunnels()
 {
-    for (std::list<LcmTunnel*>::iterator iter =
-            LcmTunnelServer::clients_list.begin();
-            iter != clients_list.end(); iter++)
+  if (channel_tunnels != NULL)
+    g_hash_table_remove_all(channel_tunnels);
+}
+
+bool LcmTunnelServer::matches_a_client(const char *channel)
+{
+  return !get_channel_tunnels(channel)->clients.empty();
+}
+
+void LcmTunnelServer::send_to_tunnels(const std::vector<LcmTunnel *> &tunnels,
+    const char *channel, const void *data, unsigned int len, int64_t recv_utime,
+    LcmTunnel *to_skip)
+{
+    //copy the message once for each way it gets compressed, and share the
+    //copies between all the tunnels they go out on
+    TunnelLcmMessage * msgs[NUM_COMPRESSIONS] = { NULL };
+    for (size_t i = 0; i < tunnels.size(); i++)
     {
-        if(*iter == to_skip)
+        LcmTunnel * tunnel = tunnels[i];
+        if(tunnel == to_skip)
             continue;
-        if ((*iter)->match_regex(channel))
-            (*iter)->send_to_remote(data, len, channel);
+        if (tunnel->passes_rate_limits(channel, len)) {
+            int8_t compression = tunnel->compression_for(channel, len);
+            if (msgs[compression] == NULL)
+                msgs[compression] = new TunnelLcmMessage(channel, data, len, recv_utime, compression);
+            tunnel->send_to_remote(msgs[compression]);
+        }
+    }
+    for (int c = 0; c < NUM_COMPRESSIONS; c++) {
+        if (msgs[c] != NULL)
+            msgs[c]->unref();
+    }
+}
+
+void LcmTunnelServer::check_and_send_to_tunnels(const char *channel,
+    const void *data, unsigned int len, LcmTunnel *to_skip)
+{
+  send_to_tunnels(get_channel_tunnels(channel)->clients, channel, data, len,
+      _timestamp_now(), to_skip);
+}
+
+//every tunnel subscribed to the channel gets called for each message on it,
+//and whichever LCM calls first sends it on to all of them
+void LcmTunnelServer::on_lcm_message(const lcm_recv_buf_t *rbuf,
+    const char *channel, void *user_data)
+{
+  channel_tunnels_t * ct = get_channel_tunnels(channel);
+  if (ct->handlers_left > 0 && rbuf == ct->last_rbuf && rbuf->data == ct->last_data
+      && rbuf->data_size == ct->last_data_size && rbuf->recv_utime == ct->last_recv_utime) {
+    ct->handlers_left--;
+    return; //already sent on
+  }
+  ct->handlers_left = ct->subscribers.size() - 1;
+  ct->last_rbuf = rbuf;
+  ct->last_data = rbuf->data;
+  ct->last_data_size = rbuf->data_size;
+  ct->last_recv_utime = rbuf->recv_utime;
+  if (introspect_is_message_from_self(introspect, rbuf, channel)) {
+    if (params.verbose && !matches_a_client(channel))
+      printf("Warning: Got message from self. There's a loop scenario.\n");
+    return;
+  }
+  send_to_tunnels(ct->subscribers, channel, rbuf->data, rbuf->data_size,
+      rbuf->recv_utime, NULL);
+}
+
+bool LcmTunnelServer::subscribe(LcmTunnel * tunnel, const char *channels)
+{
+  unsubscribe(tunnel);
+  subscriber_t sub;
+  sub.tunnel = tunnel;
+  if (strlen(channels) == 0)
+    return true; //nothing to send
+  //compiled just as LCM compiles it, so that the tunnels picked out by
+  //get_channel_tunnels() are the ones whose subscriptions get called
+  sub.regex = bot_lcm_channel_regex_new(channels);
+  if (sub.regex == NULL)
+    return false;
+  sub.subscription = lcm_subscribe(lcm, channels, on_lcm_message, tunnel);
+  if (sub.subscription == NULL) {
+    g_regex_unref(sub.regex);
+    return false;
+  }
+  subscribers.push_back(sub);
+  forget_channel_tunnels();
+  return true;
+}
+
+void LcmTunnelServer::unsubscribe(LcmTunnel * tunnel)
+{
+  for (std::list<subscriber_t>::iterator iter = subscribers.begin();
+      iter != subscribers.end(); iter++)
+  {
+    if (iter->tunnel == tunnel) {
+      lcm_unsubscribe(lcm, iter->subscription);
+      g_regex_unref(iter->regex);
+      subscribers.erase(iter);
+      break;
     }
+  }
+  forget_channel_tunnels();
 }
 
 int LcmTunnelServer::initializeServer(tunnel_server_params_t * params_)
@@ -116,8 +235,10 @@ int LcmTunnelServer::acceptClient(GIOChannel *source, GIOCondition cond, void *u
   if (!client_sock)
     return TRUE;
   LcmTunnel * tunnel_client = new LcmTunnel(params.verbose, NULL);
-  if (tunnel_client->connectToClient(lcm, introspect, mainloop, client_sock, &params))
+  if (tunnel_client->connectToClient(lcm, introspect, mainloop, client_sock, &params)) {
     clients_list.push_back(tunnel_client);
+    forget_channel_tunnels();
+  }
   else
     delete tunnel_client;
 
@@ -128,7 +249,7 @@ int LcmTunnelServer::acceptClient(GIOChannel *source, GIOCondition cond, void *u
 int LcmTunnelServer::disconnectClient(LcmTunnel * client){
   clients_list.remove(client);
   fprintf(stderr,"disconnecting client: %s\n",client->name);
-  delete client;
+  delete client; //which unsubscribes it, and forgets what it matched
   if (params.startedAsClient && clients_list.size()==0){
 //    if (params.verbose)
       fprintf(stderr,"All clients disconnected, exiting\n");
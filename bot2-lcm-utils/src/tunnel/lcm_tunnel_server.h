@@ -7,6 +7,7 @@
 #include "introspect.h"
 #include "ssocket.h"
 #include <list>
+#include <vector>
 
 class LcmTunnelServer {
 public:
@@ -26,8 +27,44 @@ public:
   static void check_and_send_to_tunnels(const char *channel,
       const void *data, unsigned int len, LcmTunnel * to_skip);
 
+  //each tunnel has its own LCM subscription to the channels it sends, but a
+  //message is only copied and compressed once however many tunnels it goes
+  //out on.  Returns false, leaving the tunnel unsubscribed, if channels
+  //isn't a valid regex.
+  static bool subscribe(LcmTunnel * tunnel, const char *channels);
+  static void unsubscribe(LcmTunnel * tunnel);
+  static void on_lcm_message(const lcm_recv_buf_t *rbuf, const char *channel,
+      void *user_data);
+
   static std::list<LcmTunnel *> clients_list;
 
+  //which tunnels a channel goes to, worked out the first time it's seen
+  typedef struct {
+    std::vector<LcmTunnel *> subscribers; //for what's published on it
+    std::vector<LcmTunnel *> clients; //for what other tunnels receive on it
+    //the last message LCM handed to a subscriber, which has been sent on to
+    //all of them, and how many of the other subscribers' handlers are still
+    //to be called with it, and can skip it
+    int handlers_left;
+    const lcm_recv_buf_t * last_rbuf;
+    const void * last_data;
+    uint32_t last_data_size;
+    int64_t last_recv_utime;
+  } channel_tunnels_t;
+  static GHashTable * channel_tunnels; //channel -> channel_tunnels_t
+  static channel_tunnels_t * get_channel_tunnels(const char *channel);
+  static void forget_channel_tunnels();
+  static void send_to_tunnels(const std::vector<LcmTunnel *> &tunnels,
+      const char *channel, const void *data, unsigned int len,
+      int64_t recv_utime, LcmTunnel * to_skip);
+
+  typedef struct {
+    LcmTunnel * tunnel;
+    lcm_subscription_t * subscription;
+    GRegex * regex; //of the subscription's channels
+  } subscriber_t;
+  static std::list<subscriber_t> subscribers;
+
   static ssocket_t * server_sock;
   static GIOChannel * server_sock_ioc;
   static guint server_sock_sid;
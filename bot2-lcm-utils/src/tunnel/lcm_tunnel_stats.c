@@ -0,0 +1,189 @@
+/**
+ * bot-lcm-tunnel-stats shows what the bot-lcm-tunnel processes on an LCM
+ * network are up to, from the stats they publish (see --stats-interval-ms).
+ *
+ * The tunnels publish totals, so each time a tunnel reports, the rates since
+ * its previous report are printed: the link health, where messages are
+ * being dropped, and the traffic on each channel.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <glib.h>
+#include <lcm/lcm.h>
+
+#include "lcm_tunnel_stats_t.h"
+
+#define LCM_TUNNEL_STATS_CHANNEL "LCM_TUNNEL_STATS" //as in lcm_tunnel.h
+
+typedef struct {
+    int verbose;
+    GHashTable *last; //tunnel name -> the last lcm_tunnel_stats_t it sent
+} state_t;
+
+static const lcm_tunnel_channel_stats_t *
+find_channel(const lcm_tunnel_stats_t *stats, const char *channel)
+{
+    for (int i = 0; i < stats->num_channels; i++)
+        if (!strcmp(stats->channels[i].channel, channel))
+            return &stats->channels[i];
+    return NULL;
+}
+
+static void
+print_stats(const state_t *app, const lcm_tunnel_stats_t *s, const lcm_tunnel_stats_t *prev)
+{
+    double dt = (s->utime - prev->utime) * 1e-6;
+    if (dt <= 0)
+        return;
+
+    time_t t = s->utime / 1000000;
+    char tm_buf[200];
+    strftime(tm_buf, sizeof(tm_buf), "%b %d %H:%M:%S", localtime(&t));
+
+#define RATE(field) ((s->field - prev->field) / dt)
+    printf("%s - %s (%s)\n", tm_buf, s->name, s->udp ? "udp" : "tcp");
+    printf("  queue      %d msgs  %.1f/%.1f KB", s->queue_msgs, s->queue_bytes / 1024.0,
+            s->max_queue_bytes / 1024.0);
+    if (s->queue_latency_samples > 0)
+        printf("  latency ms p50 %.1f  p90 %.1f  p99 %.1f  max %.1f", s->queue_latency_p50 * 1e-3,
+                s->queue_latency_p90 * 1e-3, s->queue_latency_p99 * 1e-3, s->queue_latency_max * 1e-3);
+    printf("\n");
+    printf("  dropped/s  rate limit %.1f  coalesced %.1f  queue full %.1f  link rate %.1f  too old %.1f"
+            "  too big %.1f\n", RATE(dropped_rate_limit), RATE(dropped_coalesced), RATE(dropped_queue_full),
+            RATE(dropped_link_rate), RATE(dropped_too_old), RATE(dropped_too_big));
+    if (s->udp) {
+        printf("  frags/s    sent %.1f  resent %.1f  received %.1f\n", RATE(fragments_sent),
+                RATE(fragments_resent), RATE(fragments_received));
+        printf("  batches/s  received %.1f  lost %.1f  fec recovered %.1f\n", RATE(batches_received),
+                RATE(batches_lost), RATE(fec_recoveries));
+        printf("  link       loss %.1f%%  rtt ", s->loss * 100);
+        if (s->rtt >= 0)
+            printf("%.1f ms", s->rtt * 1e-3);
+        else
+            printf("?");
+        if (s->fec_rate > 0)
+            printf("  fec %.2f", s->fec_rate);
+        if (s->link_rate > 0)
+            printf("  rate %.1f KB/s", s->link_rate / 1024.0);
+        double err = RATE(link_error_usec) * 1e-6;
+        if (err > 0)
+            printf("  failing %.0f%% of the time", MIN(err, 1) * 100);
+        printf("\n");
+    }
+#undef RATE
+
+    if (s->num_channels == 0)
+        return;
+    printf("  %-32s %10s %10s %10s %10s %10s\n", "channel", "out msg/s", "out KB/s", "in msg/s", "in KB/s",
+            "dropped/s");
+    for (int i = 0; i < s->num_channels; i++) {
+        const lcm_tunnel_channel_stats_t *ch = &s->channels[i];
+        lcm_tunnel_channel_stats_t zero;
+        memset(&zero, 0, sizeof(zero));
+        const lcm_tunnel_channel_stats_t *pch = find_channel(prev, ch->channel);
+        if (pch == NULL)
+            pch = &zero;
+        double msgs_out = (ch->msgs_out - pch->msgs_out) / dt;
+        double msgs_in = (ch->msgs_in - pch->msgs_in) / dt;
+        double dropped = (ch->msgs_dropped - pch->msgs_dropped) / dt;
+        //only the channels that are doing something, unless asked
+        if (!app->verbose && msgs_out == 0 && msgs_in == 0 && dropped == 0)
+            continue;
+        printf("  %-32s %10.1f %10.1f %10.1f %10.1f %10.1f\n", ch->channel, msgs_out,
+                (ch->bytes_out - pch->bytes_out) / dt / 1024.0, msgs_in,
+                (ch->bytes_in - pch->bytes_in) / dt / 1024.0, dropped);
+    }
+}
+
+static void
+on_stats(const lcm_recv_buf_t *rbuf, const char *channel, const lcm_tunnel_stats_t *msg, void *user_data)
+{
+    state_t *app = (state_t*) user_data;
+
+    lcm_tunnel_stats_t *prev = g_hash_table_lookup(app->last, msg->name);
+    if (prev == NULL)
+        printf("new tunnel: %s\n", msg->name);
+    else if (msg->utime < prev->utime || msg->fragments_sent < prev->fragments_sent)
+        printf("%s restarted\n", msg->name);
+    else
+        print_stats(app, msg, prev);
+    g_hash_table_replace(app->last, g_strdup(msg->name), lcm_tunnel_stats_t_copy(msg));
+}
+
+static void usage(const char *progname)
+{
+    char *basename = g_path_get_basename(progname);
+    printf("Usage: %s [options]\n"
+        "\n"
+        "Shows the queue depths, drops and link health of the bot-lcm-tunnel\n"
+        "processes on the LCM network, as rates between their stats messages.\n"
+        "\n"
+        "Options:\n"
+        "\n"
+        "    -h, --help                Shows this help text and exits\n"
+        "    -v, --verbose             List all the channels, not just the busy ones\n"
+        "    -c, --channel=CHAN        Listen for stats on CHAN (Default: %s)\n"
+        "    -l, --lcm-url=URL         Listen on the specified LCM URL\n"
+        "\n", basename, LCM_TUNNEL_STATS_CHANNEL);
+    free(basename);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    setlinebuf(stdout);
+
+    const char *optstring = "hvc:l:";
+    struct option long_opts[] = { { "help", no_argument, 0, 'h' },
+        { "verbose", no_argument, 0, 'v' },
+        { "channel", required_argument, 0, 'c' },
+        { "lcm-url", required_argument, 0, 'l' },
+        { 0, 0, 0, 0 } };
+
+    const char *channel = LCM_TUNNEL_STATS_CHANNEL;
+    const char *lcm_url = NULL;
+    state_t app;
+    memset(&app, 0, sizeof(app));
+
+    int c;
+    while ((c = getopt_long(argc, argv, optstring, long_opts, 0)) >= 0) {
+        switch (c) {
+        case 'v':
+            app.verbose = 1;
+            break;
+        case 'c':
+            channel = optarg;
+            break;
+        case 'l':
+            lcm_url = optarg;
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            break;
+        }
+    }
+    if (optind < argc)
+        usage(argv[0]);
+
+    lcm_t *lcm = lcm_create(lcm_url);
+    if (!lcm) {
+        fprintf(stderr, "Couldn't create LCM\n");
+        return 1;
+    }
+
+    app.last = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+            (GDestroyNotify) lcm_tunnel_stats_t_destroy);
+    lcm_tunnel_stats_t_subscribe(lcm, channel, on_stats, &app);
+
+    while (lcm_handle(lcm) == 0)
+        ;
+
+    g_hash_table_destroy(app.last);
+    lcm_destroy(lcm);
+    return 0;
+}
@@ -0,0 +1,600 @@
+/** THIS IS AN AUTOMATICALLY GENERATED FILE.  DO NOT MODIFY
+ * BY HAND!!
+ *
+ * Generated by lcm-gen
+ **/
+
+#include <string.h>
+#include "lcm_tunnel_stats_t.h"
+
+static int __lcm_tunnel_stats_t_hash_computed;
+static int64_t __lcm_tunnel_stats_t_hash;
+ 
+int64_t __lcm_tunnel_stats_t_hash_recursive(const __lcm_hash_ptr *p)
+{
+    const __lcm_hash_ptr *fp;
+    for (fp = p; fp != NULL; fp = fp->parent)
+        if (fp->v == __lcm_tunnel_stats_t_get_hash)
+            return 0;
+ 
+    const __lcm_hash_ptr cp = { p, (void*)__lcm_tunnel_stats_t_get_hash };
+    (void) cp;
+ 
+    int64_t hash = 0x85fa2183b4170d63LL
+         + __int64_t_hash_recursive(&cp)
+         + __string_hash_recursive(&cp)
+         + __boolean_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __double_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __double_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __lcm_tunnel_channel_stats_t_hash_recursive(&cp)
+        ;
+ 
+    return (hash<<1) + ((hash>>63)&1);
+}
+ 
+int64_t __lcm_tunnel_stats_t_get_hash(void)
+{
+    if (!__lcm_tunnel_stats_t_hash_computed) {
+        __lcm_tunnel_stats_t_hash = __lcm_tunnel_stats_t_hash_recursive(NULL);
+        __lcm_tunnel_stats_t_hash_computed = 1;
+    }
+ 
+    return __lcm_tunnel_stats_t_hash;
+}
+ 
+int __lcm_tunnel_stats_t_encode_array(void *buf, int offset, int maxlen, const lcm_tunnel_stats_t *p, int elements)
+{
+    int pos = 0, thislen, element;
+ 
+    for (element = 0; element < elements; element++) {
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].utime), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __string_encode_array(buf, offset + pos, maxlen - pos, &(p[element].name), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __boolean_encode_array(buf, offset + pos, maxlen - pos, &(p[element].udp), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_msgs), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_bytes), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].max_queue_bytes), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_latency_samples), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_latency_p50), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_latency_p90), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_latency_p99), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_latency_max), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_rate_limit), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_coalesced), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_queue_full), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_link_rate), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_too_old), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_too_big), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].fragments_sent), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].fragments_resent), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].fragments_received), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].batches_received), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].batches_lost), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].fec_recoveries), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].link_error_usec), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __double_encode_array(buf, offset + pos, maxlen - pos, &(p[element].fec_rate), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].link_rate), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].rtt), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __double_encode_array(buf, offset + pos, maxlen - pos, &(p[element].loss), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].num_channels), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __lcm_tunnel_channel_stats_t_encode_array(buf, offset + pos, maxlen - pos, p[element].channels, p[element].num_channels);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+    }
+    return pos;
+}
+ 
+int lcm_tunnel_stats_t_encode(void *buf, int offset, int maxlen, const lcm_tunnel_stats_t *p)
+{
+    int pos = 0, thislen;
+    int64_t hash = __lcm_tunnel_stats_t_get_hash();
+ 
+    thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &hash, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+ 
+    thislen = __lcm_tunnel_stats_t_encode_array(buf, offset + pos, maxlen - pos, p, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+ 
+    return pos;
+}
+ 
+int __lcm_tunnel_stats_t_encoded_array_size(const lcm_tunnel_stats_t *p, int elements)
+{
+    int size = 0, element;
+    for (element = 0; element < elements; element++) {
+ 
+        size += __int64_t_encoded_array_size(&(p[element].utime), 1);
+ 
+        size += __string_encoded_array_size(&(p[element].name), 1);
+ 
+        size += __boolean_encoded_array_size(&(p[element].udp), 1);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].queue_msgs), 1);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].queue_bytes), 1);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].max_queue_bytes), 1);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].queue_latency_samples), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].queue_latency_p50), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].queue_latency_p90), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].queue_latency_p99), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].queue_latency_max), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].dropped_rate_limit), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].dropped_coalesced), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].dropped_queue_full), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].dropped_link_rate), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].dropped_too_old), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].dropped_too_big), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].fragments_sent), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].fragments_resent), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].fragments_received), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].batches_received), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].batches_lost), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].fec_recoveries), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].link_error_usec), 1);
+ 
+        size += __double_encoded_array_size(&(p[element].fec_rate), 1);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].link_rate), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].rtt), 1);
+ 
+        size += __double_encoded_array_size(&(p[element].loss), 1);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].num_channels), 1);
+ 
+        size += __lcm_tunnel_channel_stats_t_encoded_array_size(p[element].channels, p[element].num_channels);
+ 
+    }
+    return size;
+}
+ 
+int lcm_tunnel_stats_t_encoded_size(const lcm_tunnel_stats_t *p)
+{
+    return 8 + __lcm_tunnel_stats_t_encoded_array_size(p, 1);
+}
+ 
+int __lcm_tunnel_stats_t_decode_array(const void *buf, int offset, int maxlen, lcm_tunnel_stats_t *p, int elements)
+{
+    int pos = 0, thislen, element;
+ 
+    for (element = 0; element < elements; element++) {
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].utime), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __string_decode_array(buf, offset + pos, maxlen - pos, &(p[element].name), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __boolean_decode_array(buf, offset + pos, maxlen - pos, &(p[element].udp), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_msgs), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_bytes), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].max_queue_bytes), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_latency_samples), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_latency_p50), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_latency_p90), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_latency_p99), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].queue_latency_max), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_rate_limit), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_coalesced), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_queue_full), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_link_rate), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_too_old), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].dropped_too_big), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].fragments_sent), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].fragments_resent), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].fragments_received), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].batches_received), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].batches_lost), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].fec_recoveries), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].link_error_usec), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __double_decode_array(buf, offset + pos, maxlen - pos, &(p[element].fec_rate), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].link_rate), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].rtt), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __double_decode_array(buf, offset + pos, maxlen - pos, &(p[element].loss), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].num_channels), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        p[element].channels = (lcm_tunnel_channel_stats_t*) lcm_malloc(sizeof(lcm_tunnel_channel_stats_t) * p[element].num_channels);
+        thislen = __lcm_tunnel_channel_stats_t_decode_array(buf, offset + pos, maxlen - pos, p[element].channels, p[element].num_channels);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+    }
+    return pos;
+}
+ 
+int __lcm_tunnel_stats_t_decode_array_cleanup(lcm_tunnel_stats_t *p, int elements)
+{
+    int element;
+    for (element = 0; element < elements; element++) {
+ 
+        __int64_t_decode_array_cleanup(&(p[element].utime), 1);
+ 
+        __string_decode_array_cleanup(&(p[element].name), 1);
+ 
+        __boolean_decode_array_cleanup(&(p[element].udp), 1);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].queue_msgs), 1);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].queue_bytes), 1);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].max_queue_bytes), 1);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].queue_latency_samples), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].queue_latency_p50), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].queue_latency_p90), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].queue_latency_p99), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].queue_latency_max), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].dropped_rate_limit), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].dropped_coalesced), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].dropped_queue_full), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].dropped_link_rate), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].dropped_too_old), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].dropped_too_big), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].fragments_sent), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].fragments_resent), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].fragments_received), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].batches_received), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].batches_lost), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].fec_recoveries), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].link_error_usec), 1);
+ 
+        __double_decode_array_cleanup(&(p[element].fec_rate), 1);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].link_rate), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].rtt), 1);
+ 
+        __double_decode_array_cleanup(&(p[element].loss), 1);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].num_channels), 1);
+ 
+        __lcm_tunnel_channel_stats_t_decode_array_cleanup(p[element].channels, p[element].num_channels);
+        if (p[element].channels) free(p[element].channels);
+ 
+    }
+    return 0;
+}
+ 
+int lcm_tunnel_stats_t_decode(const void *buf, int offset, int maxlen, lcm_tunnel_stats_t *p)
+{
+    int pos = 0, thislen;
+    int64_t hash = __lcm_tunnel_stats_t_get_hash();
+ 
+    int64_t this_hash;
+    thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &this_hash, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+    if (this_hash != hash) return -1;
+ 
+    thislen = __lcm_tunnel_stats_t_decode_array(buf, offset + pos, maxlen - pos, p, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+ 
+    return pos;
+}
+ 
+int lcm_tunnel_stats_t_decode_cleanup(lcm_tunnel_stats_t *p)
+{
+    return __lcm_tunnel_stats_t_decode_array_cleanup(p, 1);
+}
+ 
+int __lcm_tunnel_stats_t_clone_array(const lcm_tunnel_stats_t *p, lcm_tunnel_stats_t *q, int elements)
+{
+    int element;
+    for (element = 0; element < elements; element++) {
+ 
+        __int64_t_clone_array(&(p[element].utime), &(q[element].utime), 1);
+ 
+        __string_clone_array(&(p[element].name), &(q[element].name), 1);
+ 
+        __boolean_clone_array(&(p[element].udp), &(q[element].udp), 1);
+ 
+        __int32_t_clone_array(&(p[element].queue_msgs), &(q[element].queue_msgs), 1);
+ 
+        __int32_t_clone_array(&(p[element].queue_bytes), &(q[element].queue_bytes), 1);
+ 
+        __int32_t_clone_array(&(p[element].max_queue_bytes), &(q[element].max_queue_bytes), 1);
+ 
+        __int32_t_clone_array(&(p[element].queue_latency_samples), &(q[element].queue_latency_samples), 1);
+ 
+        __int64_t_clone_array(&(p[element].queue_latency_p50), &(q[element].queue_latency_p50), 1);
+ 
+        __int64_t_clone_array(&(p[element].queue_latency_p90), &(q[element].queue_latency_p90), 1);
+ 
+        __int64_t_clone_array(&(p[element].queue_latency_p99), &(q[element].queue_latency_p99), 1);
+ 
+        __int64_t_clone_array(&(p[element].queue_latency_max), &(q[element].queue_latency_max), 1);
+ 
+        __int64_t_clone_array(&(p[element].dropped_rate_limit), &(q[element].dropped_rate_limit), 1);
+ 
+        __int64_t_clone_array(&(p[element].dropped_coalesced), &(q[element].dropped_coalesced), 1);
+ 
+        __int64_t_clone_array(&(p[element].dropped_queue_full), &(q[element].dropped_queue_full), 1);
+ 
+        __int64_t_clone_array(&(p[element].dropped_link_rate), &(q[element].dropped_link_rate), 1);
+ 
+        __int64_t_clone_array(&(p[element].dropped_too_old), &(q[element].dropped_too_old), 1);
+ 
+        __int64_t_clone_array(&(p[element].dropped_too_big), &(q[element].dropped_too_big), 1);
+ 
+        __int64_t_clone_array(&(p[element].fragments_sent), &(q[element].fragments_sent), 1);
+ 
+        __int64_t_clone_array(&(p[element].fragments_resent), &(q[element].fragments_resent), 1);
+ 
+        __int64_t_clone_array(&(p[element].fragments_received), &(q[element].fragments_received), 1);
+ 
+        __int64_t_clone_array(&(p[element].batches_received), &(q[element].batches_received), 1);
+ 
+        __int64_t_clone_array(&(p[element].batches_lost), &(q[element].batches_lost), 1);
+ 
+        __int64_t_clone_array(&(p[element].fec_recoveries), &(q[element].fec_recoveries), 1);
+ 
+        __int64_t_clone_array(&(p[element].link_error_usec), &(q[element].link_error_usec), 1);
+ 
+        __double_clone_array(&(p[element].fec_rate), &(q[element].fec_rate), 1);
+ 
+        __int32_t_clone_array(&(p[element].link_rate), &(q[element].link_rate), 1);
+ 
+        __int64_t_clone_array(&(p[element].rtt), &(q[element].rtt), 1);
+ 
+        __double_clone_array(&(p[element].loss), &(q[element].loss), 1);
+ 
+        __int32_t_clone_array(&(p[element].num_channels), &(q[element].num_channels), 1);
+ 
+        q[element].channels = (lcm_tunnel_channel_stats_t*) lcm_malloc(sizeof(lcm_tunnel_channel_stats_t) * q[element].num_channels);
+        __lcm_tunnel_channel_stats_t_clone_array(p[element].channels, q[element].channels, p[element].num_channels);
+ 
+    }
+    return 0;
+}
+ 
+lcm_tunnel_stats_t *lcm_tunnel_stats_t_copy(const lcm_tunnel_stats_t *p)
+{
+    lcm_tunnel_stats_t *q = (lcm_tunnel_stats_t*) malloc(sizeof(lcm_tunnel_stats_t));
+    __lcm_tunnel_stats_t_clone_array(p, q, 1);
+    return q;
+}
+ 
+void lcm_tunnel_stats_t_destroy(lcm_tunnel_stats_t *p)
+{
+    __lcm_tunnel_stats_t_decode_array_cleanup(p, 1);
+    free(p);
+}
+ 
+int lcm_tunnel_stats_t_publish(lcm_t *lc, const char *channel, const lcm_tunnel_stats_t *p)
+{
+      int max_data_size = lcm_tunnel_stats_t_encoded_size (p);
+      uint8_t *buf = (uint8_t*) malloc (max_data_size);
+      if (!buf) return -1;
+      int data_size = lcm_tunnel_stats_t_encode (buf, 0, max_data_size, p);
+      if (data_size < 0) {
+          free (buf);
+          return data_size;
+      }
+      int status = lcm_publish (lc, channel, buf, data_size);
+      free (buf);
+      return status;
+}
+
+struct _lcm_tunnel_stats_t_subscription_t {
+    lcm_tunnel_stats_t_handler_t user_handler;
+    void *userdata;
+    lcm_subscription_t *lc_h;
+};
+static
+void lcm_tunnel_stats_t_handler_stub (const lcm_recv_buf_t *rbuf, 
+                            const char *channel, void *userdata)
+{
+    int status;
+    lcm_tunnel_stats_t p;
+    memset(&p, 0, sizeof(lcm_tunnel_stats_t));
+    status = lcm_tunnel_stats_t_decode (rbuf->data, 0, rbuf->data_size, &p);
+    if (status < 0) {
+        fprintf (stderr, "error %d decoding lcm_tunnel_stats_t!!!\n", status);
+        return;
+    }
+
+    lcm_tunnel_stats_t_subscription_t *h = (lcm_tunnel_stats_t_subscription_t*) userdata;
+    h->user_handler (rbuf, channel, &p, h->userdata);
+
+    lcm_tunnel_stats_t_decode_cleanup (&p);
+}
+
+lcm_tunnel_stats_t_subscription_t* lcm_tunnel_stats_t_subscribe (lcm_t *lcm, 
+                    const char *channel, 
+                    lcm_tunnel_stats_t_handler_t f, void *userdata)
+{
+    lcm_tunnel_stats_t_subscription_t *n = (lcm_tunnel_stats_t_subscription_t*)
+                       malloc(sizeof(lcm_tunnel_stats_t_subscription_t));
+    n->user_handler = f;
+    n->userdata = userdata;
+    n->lc_h = lcm_subscribe (lcm, channel, 
+                                 lcm_tunnel_stats_t_handler_stub, n);
+    if (n->lc_h == NULL) {
+        fprintf (stderr,"couldn't reg lcm_tunnel_stats_t LCM handler!\n");
+        free (n);
+        return NULL;
+    }
+    return n;
+}
+
+int lcm_tunnel_stats_t_unsubscribe(lcm_t *lcm, lcm_tunnel_stats_t_subscription_t* hid)
+{
+    int status = lcm_unsubscribe (lcm, hid->lc_h);
+    if (0 != status) {
+        fprintf(stderr, 
+           "couldn't unsubscribe lcm_tunnel_stats_t_handler %p!\n", hid);
+        return -1;
+    }
+    free (hid);
+    return 0;
+}
+
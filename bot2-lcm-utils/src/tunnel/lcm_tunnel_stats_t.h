@@ -0,0 +1,84 @@
+/** THIS IS AN AUTOMATICALLY GENERATED FILE.  DO NOT MODIFY
+ * BY HAND!!
+ *
+ * Generated by lcm-gen
+ **/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <lcm/lcm_coretypes.h>
+#include <lcm/lcm.h>
+#include "lcm_tunnel_channel_stats_t.h"
+
+#ifndef _lcm_tunnel_stats_t_h
+#define _lcm_tunnel_stats_t_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _lcm_tunnel_stats_t lcm_tunnel_stats_t;
+struct _lcm_tunnel_stats_t
+{
+    int64_t    utime;
+    char*      name;
+    int8_t     udp;
+    int32_t    queue_msgs;
+    int32_t    queue_bytes;
+    int32_t    max_queue_bytes;
+    int32_t    queue_latency_samples;
+    int64_t    queue_latency_p50;
+    int64_t    queue_latency_p90;
+    int64_t    queue_latency_p99;
+    int64_t    queue_latency_max;
+    int64_t    dropped_rate_limit;
+    int64_t    dropped_coalesced;
+    int64_t    dropped_queue_full;
+    int64_t    dropped_link_rate;
+    int64_t    dropped_too_old;
+    int64_t    dropped_too_big;
+    int64_t    fragments_sent;
+    int64_t    fragments_resent;
+    int64_t    fragments_received;
+    int64_t    batches_received;
+    int64_t    batches_lost;
+    int64_t    fec_recoveries;
+    int64_t    link_error_usec;
+    double     fec_rate;
+    int32_t    link_rate;
+    int64_t    rtt;
+    double     loss;
+    int32_t    num_channels;
+    lcm_tunnel_channel_stats_t *channels;
+};
+ 
+lcm_tunnel_stats_t   *lcm_tunnel_stats_t_copy(const lcm_tunnel_stats_t *p);
+void lcm_tunnel_stats_t_destroy(lcm_tunnel_stats_t *p);
+
+typedef struct _lcm_tunnel_stats_t_subscription_t lcm_tunnel_stats_t_subscription_t;
+typedef void(*lcm_tunnel_stats_t_handler_t)(const lcm_recv_buf_t *rbuf, 
+             const char *channel, const lcm_tunnel_stats_t *msg, void *user);
+
+int lcm_tunnel_stats_t_publish(lcm_t *lcm, const char *channel, const lcm_tunnel_stats_t *p);
+lcm_tunnel_stats_t_subscription_t* lcm_tunnel_stats_t_subscribe(lcm_t *lcm, const char *channel, lcm_tunnel_stats_t_handler_t f, void *userdata);
+int lcm_tunnel_stats_t_unsubscribe(lcm_t *lcm, lcm_tunnel_stats_t_subscription_t* hid);
+
+int  lcm_tunnel_stats_t_encode(void *buf, int offset, int maxlen, const lcm_tunnel_stats_t *p);
+int  lcm_tunnel_stats_t_decode(const void *buf, int offset, int maxlen, lcm_tunnel_stats_t *p);
+int  lcm_tunnel_stats_t_decode_cleanup(lcm_tunnel_stats_t *p);
+int  lcm_tunnel_stats_t_encoded_size(const lcm_tunnel_stats_t *p);
+
+// LCM support functions. Users should not call these
+int64_t __lcm_tunnel_stats_t_get_hash(void);
+int64_t __lcm_tunnel_stats_t_hash_recursive(const __lcm_hash_ptr *p);
+int     __lcm_tunnel_stats_t_encode_array(void *buf, int offset, int maxlen, const lcm_tunnel_stats_t *p, int elements);
+int     __lcm_tunnel_stats_t_decode_array(const void *buf, int offset, int maxlen, lcm_tunnel_stats_t *p, int elements);
+int     __lcm_tunnel_stats_t_decode_array_cleanup(lcm_tunnel_stats_t *p, int elements);
+int     __lcm_tunnel_stats_t_encoded_array_size(const lcm_tunnel_stats_t *p, int elements);
+int     __lcm_tunnel_stats_t_clone_array(const lcm_tunnel_stats_t *p, lcm_tunnel_stats_t *q, int elements);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,8 +20,11 @@ int64_t __lcm_tunnel_sub_msg_t_hash_recursive(const __lcm_hash_ptr *p)
     const __lcm_hash_ptr cp = { p, (void*)__lcm_tunnel_sub_msg_t_get_hash };
     (void) cp;
  
-    int64_t hash = 0xbd03d96a31b72228LL
+    int64_t hash = 0x3adf4a323032fb8eLL
          + __string_hash_recursive(&cp)
+         + __int8_t_hash_recursive(&cp)
+         + __int8_t_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
          + __int32_t_hash_recursive(&cp)
          + __byte_hash_recursive(&cp)
         ;
@@ -48,6 +51,15 @@ int __lcm_tunnel_sub_msg_t_encode_array(void *buf, int offset, int maxlen, const
         thislen = __string_encode_array(buf, offset + pos, maxlen - pos, &(p[element].channel), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
+        thislen = __int8_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].compression), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int8_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].delta), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].uncompressed_size), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
         thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].data_size), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
@@ -79,6 +91,12 @@ int __lcm_tunnel_sub_msg_t_encoded_array_size(const lcm_tunnel_sub_msg_t *p, int
  
         size += __string_encoded_array_size(&(p[element].channel), 1);
  
+        size += __int8_t_encoded_array_size(&(p[element].compression), 1);
+ 
+        size += __int8_t_encoded_array_size(&(p[element].delta), 1);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].uncompressed_size), 1);
+ 
         size += __int32_t_encoded_array_size(&(p[element].data_size), 1);
  
         size += __byte_encoded_array_size(p[element].data, p[element].data_size);
@@ -101,6 +119,15 @@ int __lcm_tunnel_sub_msg_t_decode_array(const void *buf, int offset, int maxlen,
         thislen = __string_decode_array(buf, offset + pos, maxlen - pos, &(p[element].channel), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
+        thislen = __int8_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].compression), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int8_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].delta), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].uncompressed_size), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
         thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].data_size), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
@@ -119,6 +146,12 @@ int __lcm_tunnel_sub_msg_t_decode_array_cleanup(lcm_tunnel_sub_msg_t *p, int ele
  
         __string_decode_array_cleanup(&(p[element].channel), 1);
  
+        __int8_t_decode_array_cleanup(&(p[element].compression), 1);
+ 
+        __int8_t_decode_array_cleanup(&(p[element].delta), 1);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].uncompressed_size), 1);
+ 
         __int32_t_decode_array_cleanup(&(p[element].data_size), 1);
  
         __byte_decode_array_cleanup(p[element].data, p[element].data_size);
@@ -156,6 +189,12 @@ int __lcm_tunnel_sub_msg_t_clone_array(const lcm_tunnel_sub_msg_t *p, lcm_tunnel
  
         __string_clone_array(&(p[element].channel), &(q[element].channel), 1);
  
+        __int8_t_clone_array(&(p[element].compression), &(q[element].compression), 1);
+ 
+        __int8_t_clone_array(&(p[element].delta), &(q[element].delta), 1);
+ 
+        __int32_t_clone_array(&(p[element].uncompressed_size), &(q[element].uncompressed_size), 1);
+ 
         __int32_t_clone_array(&(p[element].data_size), &(q[element].data_size), 1);
  
         q[element].data = (uint8_t*) lcm_malloc(sizeof(uint8_t) * q[element].data_size);
@@ -16,10 +16,20 @@
 extern "C" {
 #endif
 
+#define LCM_TUNNEL_SUB_MSG_T_COMPRESSION_NONE 0
+#define LCM_TUNNEL_SUB_MSG_T_COMPRESSION_ZLIB 1
+#define LCM_TUNNEL_SUB_MSG_T_COMPRESSION_LZ 2
+#define LCM_TUNNEL_SUB_MSG_T_DELTA_NONE 0
+#define LCM_TUNNEL_SUB_MSG_T_DELTA_KEYFRAME 1
+#define LCM_TUNNEL_SUB_MSG_T_DELTA_XOR 2
+
 typedef struct _lcm_tunnel_sub_msg_t lcm_tunnel_sub_msg_t;
 struct _lcm_tunnel_sub_msg_t
 {
     char*      channel;
+    int8_t     compression;
+    int8_t     delta;
+    int32_t    uncompressed_size;
     int32_t    data_size;
     uint8_t    *data;
 };
@@ -20,9 +20,11 @@ int64_t __lcm_tunnel_udp_msg_t_hash_recursive(const __lcm_hash_ptr *p)
     const __lcm_hash_ptr cp = { p, (void*)__lcm_tunnel_udp_msg_t_get_hash };
     (void) cp;
  
-    int64_t hash = 0x5434a3800a827fc8LL
+    int64_t hash = 0xc2cb1edf35d20513LL
          + __int16_t_hash_recursive(&cp)
          + __int16_t_hash_recursive(&cp)
+         + __int16_t_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
          + __int32_t_hash_recursive(&cp)
          + __int32_t_hash_recursive(&cp)
          + __byte_hash_recursive(&cp)
@@ -53,6 +55,12 @@ int __lcm_tunnel_udp_msg_t_encode_array(void *buf, int offset, int maxlen, const
         thislen = __int16_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].fragno), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
+        thislen = __int16_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].fec_rate), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].datagram_no), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
         thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].payload_size), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
@@ -89,6 +97,10 @@ int __lcm_tunnel_udp_msg_t_encoded_array_size(const lcm_tunnel_udp_msg_t *p, int
  
         size += __int16_t_encoded_array_size(&(p[element].fragno), 1);
  
+        size += __int16_t_encoded_array_size(&(p[element].fec_rate), 1);
+ 
+        size += __int32_t_encoded_array_size(&(p[element].datagram_no), 1);
+ 
         size += __int32_t_encoded_array_size(&(p[element].payload_size), 1);
  
         size += __int32_t_encoded_array_size(&(p[element].data_size), 1);
@@ -116,6 +128,12 @@ int __lcm_tunnel_udp_msg_t_decode_array(const void *buf, int offset, int maxlen,
         thislen = __int16_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].fragno), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
+        thislen = __int16_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].fec_rate), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].datagram_no), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
         thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].payload_size), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
@@ -139,6 +157,10 @@ int __lcm_tunnel_udp_msg_t_decode_array_cleanup(lcm_tunnel_udp_msg_t *p, int ele
  
         __int16_t_decode_array_cleanup(&(p[element].fragno), 1);
  
+        __int16_t_decode_array_cleanup(&(p[element].fec_rate), 1);
+ 
+        __int32_t_decode_array_cleanup(&(p[element].datagram_no), 1);
+ 
         __int32_t_decode_array_cleanup(&(p[element].payload_size), 1);
  
         __int32_t_decode_array_cleanup(&(p[element].data_size), 1);
@@ -180,6 +202,10 @@ int __lcm_tunnel_udp_msg_t_clone_array(const lcm_tunnel_udp_msg_t *p, lcm_tunnel
  
         __int16_t_clone_array(&(p[element].fragno), &(q[element].fragno), 1);
  
+        __int16_t_clone_array(&(p[element].fec_rate), &(q[element].fec_rate), 1);
+ 
+        __int32_t_clone_array(&(p[element].datagram_no), &(q[element].datagram_no), 1);
+ 
         __int32_t_clone_array(&(p[element].payload_size), &(q[element].payload_size), 1);
  
         __int32_t_clone_array(&(p[element].data_size), &(q[element].data_size), 1);
@@ -21,6 +21,8 @@ struct _lcm_tunnel_udp_msg_t
 {
     int16_t    seqno;
     int16_t    fragno;
+    int16_t    fec_rate;
+    int32_t    datagram_no;
     int32_t    payload_size;
     int32_t    data_size;
     uint8_t    *data;
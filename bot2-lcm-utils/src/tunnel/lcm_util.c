@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "lcm_util.h"
 
@@ -115,3 +116,19 @@ bot_lcm_get_global(const char *provider)
     g_static_mutex_unlock (&lcm_glib_sources_mutex);
     return global_lcm;
 }
+
+GRegex *
+bot_lcm_channel_regex_new(const char *channels)
+{
+    if (channels == NULL || strlen(channels) == 0)
+        return NULL;
+    char *rchannel = g_strdup_printf("^%s$", channels);
+    GError *rerr = NULL;
+    GRegex *ret = g_regex_new(rchannel, (GRegexCompileFlags) 0, (GRegexMatchFlags) 0, &rerr);
+    if (rerr != NULL) {
+        fprintf(stderr, "Invalid regex: \"%s\"\n", rchannel);
+        g_error_free(rerr);
+    }
+    g_free(rchannel);
+    return ret;
+}
@@ -84,6 +84,18 @@ int bot_glib_mainloop_attach_lcm_full(GMainLoop * mainloop, lcm_t *lcm,
  */
 lcm_t *bot_lcm_get_global(const char *provider);
 
+/**
+ * bot_lcm_channel_regex_new:
+ * @channels: A channel regular expression, as passed to lcm_subscribe().
+ *
+ * Compiles @channels the way LCM compiles a subscription's channel, as a
+ * #GRegex anchored at both ends, so that it matches exactly the channels the
+ * subscription would get.  Prints a message if @channels isn't valid.
+ *
+ * Returns: the compiled #GRegex, or %NULL if @channels is empty or invalid.
+ */
+GRegex *bot_lcm_channel_regex_new(const char *channels);
+
 
 #ifdef __cplusplus
 }
@@ -67,8 +67,6 @@ LDPCFecSession::InitSession (	int nbSourceSymbols,
 				SessionType codecType,
 				int leftDegree)
 {
-	mod2entry	*e;
-
 	m_initialized	= false;
 	m_sessionFlags	= flags;
 	m_sessionType	= codecType;
@@ -144,8 +142,39 @@ LDPCFecSession::InitSession (	int nbSourceSymbols,
 				m_nb_unknown_symbols_encoder[row]++;
 			}
 		}
+
+		// flatten the rows into a table of symbol seqnos, so that
+		// BuildParitySymbol reads an array rather than chasing
+		// pointers all over the matrix
+		int	nbEntries = 0;
+		for (int row = 0; row < m_nbCheck; row++) {
+			nbEntries += m_nb_unknown_symbols_encoder[row];
+		}
+		m_encRowStart = (int*)malloc((m_nbCheck + 1) * sizeof(int));
+		m_encRowSymbols = (int*)malloc(nbEntries * sizeof(int));
+		if (m_encRowStart == NULL || m_encRowSymbols == NULL) {
+			fprintf(stderr, "LDPCFecSession::InitSession: ERROR: call to malloc failed for m_encRowSymbols!\n");
+			return LDPC_ERROR;
+		}
+		nbEntries = 0;
+		for (int row = 0; row < m_nbCheck; row++) {
+			mod2entry *e;
+			m_encRowStart[row] = nbEntries;
+			for (e = mod2sparse_first_in_row(m_pchkMatrix, row);
+			     !mod2sparse_at_end(e);
+			     e = mod2sparse_next_in_row(e)) {
+				// paritySymbol_index in {0.. n-k-1} range, so
+				// this test is ok: don't add paritySymbol to itself
+				if (e->col != row) {
+					m_encRowSymbols[nbEntries++] = GetSymbolSeqno(e->col);
+				}
+			}
+		}
+		m_encRowStart[m_nbCheck] = nbEntries;
 	} else {
 		m_nb_unknown_symbols_encoder = NULL;
+		m_encRowStart = NULL;
+		m_encRowSymbols = NULL;
 	}
 
 	if (m_sessionFlags & FLAG_DECODER) {
@@ -158,27 +187,17 @@ LDPCFecSession::InitSession (	int nbSourceSymbols,
 			fprintf(stderr, "LDPCFecSession::InitSession: ERROR: call to calloc failed for m_parity_symbol_canvas!\n");
 			return LDPC_ERROR;
 		}
+		// the decoder deletes entries from the matrix as it goes, so
+		// work on a copy and keep the original for ResetDecoding()
+		m_pchkMatrixOrig = m_pchkMatrix;
+		m_pchkMatrix = mod2sparse_allocate(mod2sparse_rows(m_pchkMatrixOrig),
+						   mod2sparse_cols(m_pchkMatrixOrig));
+		mod2sparse_copy_recycle(m_pchkMatrixOrig, m_pchkMatrix);
 		// and update the various tables now
-		for (int row = 0; row < m_nbCheck; row++) {
-			for (e = mod2sparse_first_in_row(m_pchkMatrix, row);
-			     !mod2sparse_at_end(e);
-			     e = mod2sparse_next_in_row(e))
-			{
-				m_nbSymbols_in_equ[row]++;
-				m_nb_unknown_symbols[row]++;
-			}
-		}
-		for (int seq = m_nbSourceSymbols; seq < m_nbTotalSymbols; seq++) {
-			for (e = mod2sparse_first_in_col(m_pchkMatrix,
-						    GetMatrixCol(seq));
-			     !mod2sparse_at_end(e);
-			     e = mod2sparse_next_in_col(e))
-			{
-				m_nbEqu_for_parity[seq - m_nbSourceSymbols]++;
-			}
-		}
+		InitDecoderCounters();
 	} else {
 		// CODER session
+		m_pchkMatrixOrig = NULL;
 		m_checkValues = NULL;
 		m_nbSymbols_in_equ = NULL;
 		m_nb_unknown_symbols = NULL;
@@ -203,6 +222,36 @@ LDPCFecSession::InitSession (	int nbSourceSymbols,
 }
 
 
+/******************************************************************************
+ * InitDecoderCounters: Sets up the decoder counters from the parity check matrix.
+ * => See header file for more informations.
+ */
+void
+LDPCFecSession::InitDecoderCounters ()
+{
+	mod2entry	*e;
+
+	for (int row = 0; row < m_nbCheck; row++) {
+		for (e = mod2sparse_first_in_row(m_pchkMatrix, row);
+		     !mod2sparse_at_end(e);
+		     e = mod2sparse_next_in_row(e))
+		{
+			m_nbSymbols_in_equ[row]++;
+			m_nb_unknown_symbols[row]++;
+		}
+	}
+	for (int seq = m_nbSourceSymbols; seq < m_nbTotalSymbols; seq++) {
+		for (e = mod2sparse_first_in_col(m_pchkMatrix,
+					    GetMatrixCol(seq));
+		     !mod2sparse_at_end(e);
+		     e = mod2sparse_next_in_col(e))
+		{
+			m_nbEqu_for_parity[seq - m_nbSourceSymbols]++;
+		}
+	}
+}
+
+
 /******************************************************************************
  * SetDecodedFunctions: Call the function whenever BuildParitySymbol decodes
  * a new parity or source symbol.
@@ -286,6 +335,10 @@ LDPCFecSession::EndSession()
 
 		mod2sparse_free(m_pchkMatrix);
 		free(m_pchkMatrix);	/* mod2sparse_free does not free it! */
+		if (m_pchkMatrixOrig != NULL) {
+			mod2sparse_free(m_pchkMatrixOrig);
+			free(m_pchkMatrixOrig);
+		}
 #endif // #if defined(DECODER_ITERATIVE)
 
 		if (m_checkValues != NULL) {
@@ -332,12 +385,66 @@ LDPCFecSession::EndSession()
 		if (m_nb_unknown_symbols_encoder != NULL) {
 			free(m_nb_unknown_symbols_encoder);
 		}
+		if (m_encRowStart != NULL) {
+			free(m_encRowStart);
+		}
+		if (m_encRowSymbols != NULL) {
+			free(m_encRowSymbols);
+		}
 	}
 	// and now init everything!
 	memset(this, 0, sizeof(*this));
 }
 
 
+/******************************************************************************
+ * ResetDecoding : Gets a decoding session ready for a new block.
+ * => See header file for more informations.
+ */
+ldpc_error_status
+LDPCFecSession::ResetDecoding()
+{
+	if (!m_initialized || !(m_sessionFlags & FLAG_DECODER) || m_pchkMatrixOrig == NULL) {
+		fprintf(stderr, "LDPCFecSession::ResetDecoding: ERROR: not an initialized DECODER session!\n");
+		return LDPC_ERROR;
+	}
+	for (int i = 0; i < m_nbCheck; i++) {
+		if (m_checkValues[i] != NULL) {
+#ifdef EXTERNAL_MEMORY_MGMT_SUPPORT
+			if (m_freeSymbol_callback != NULL) {
+				m_freeSymbol_callback(m_context_4_callback,
+						   m_checkValues[i]);
+			} else
+#endif
+			{
+				free(m_checkValues[i]);
+			}
+			m_checkValues[i] = NULL;
+		}
+		if (m_parity_symbol_canvas[i] != NULL) {
+#ifdef EXTERNAL_MEMORY_MGMT_SUPPORT
+			if (m_freeSymbol_callback != NULL) {
+				m_freeSymbol_callback(m_context_4_callback,
+						   m_parity_symbol_canvas[i]);
+			} else
+#endif
+			{
+				free(m_parity_symbol_canvas[i]);
+			}
+			m_parity_symbol_canvas[i] = NULL;
+		}
+	}
+	// restore the matrix, re-using the entries the decoder deleted
+	mod2sparse_copy_recycle(m_pchkMatrixOrig, m_pchkMatrix);
+	memset(m_nbSymbols_in_equ, 0, m_nbCheck * sizeof(int));
+	memset(m_nb_unknown_symbols, 0, m_nbCheck * sizeof(int));
+	memset(m_nbEqu_for_parity, 0, m_nbCheck * sizeof(int));
+	InitDecoderCounters();
+	m_firstNonDecoded = 0;
+	return LDPC_OK;
+}
+
+
 /******************************************************************************
  * SetVerbosity: Sets the verbosity level.
  * => See header file for more informations.
@@ -380,74 +487,184 @@ LDPCFecSession::MoreAbout (FILE		*out)
 
 
 /******************************************************************************
- * Calculates the XOR sum of two symbols: to = to + from.
- * => See header file for more informations.
+ * XOR kernels used by AddToSymbol: to = to + from, over len bytes.
+ * The SSE2/AVX2 kernels use unaligned loads/stores, which cost nothing extra
+ * on aligned buffers (see ldpc_wrapper.cpp), and finish with the scalar
+ * kernel for what's left of symbols that are not a multiple of the vector
+ * width. The kernel is picked at startup, from what the CPU supports.
  */
-void
-LDPCFecSession::AddToSymbol	(void	*to,
-				void	*from)
+static void
+XorSymbolScalar	(UINT8	*to,
+		 const UINT8	*from,
+		 unsigned int	len)
 {
-	unsigned int		i;
+	unsigned int	i;
 #if defined (__LP64__) || (__WORDSIZE == 64) // {
 	// 64-bit machines
 	/* First perform as many 64-bit XORs as needed... */
-	UINT64		*t = (UINT64*)to;	// to pointer to 64-bit integers
-	UINT64		*f = (UINT64*)from;	// from pointer to 64-bit integers
-	for (i = m_symbolSize64; i > 0; i--) {
-		*t ^= *f;
-		t++;
-		f++;
-#ifdef PERF_COUNT_XOR
-		m_nbXor++;
-#endif
+	for (i = len >> 3; i > 0; i--) {
+		*(UINT64*)to ^= *(const UINT64*)from;
+		to += 8;
+		from += 8;
+	}
+	len &= 7;
+#endif //defined (__LP64__) || (__WORDSIZE == 64) }
+	/* then as many 32-bit XORs as needed... */
+	for (i = len >> 2; i > 0; i--) {
+		*(UINT32*)to ^= *(const UINT32*)from;
+		to += 4;
+		from += 4;
 	}
-	UINT32		*t32 = (UINT32*)t;	// to pointer to 32-bit integers
-	UINT32		*f32 = (UINT32*)f;	// from pointer to 32-bit integers
-	/* then perform a 32-bit XOR if needed... */
-	if ((m_symbolSize64 << 1) < m_symbolSize32) {
-		*(UINT32*)t32 ^= *(UINT32*)f32;
-		t32++;
-		f32++;
-#ifdef PERF_COUNT_XOR
-		m_nbXor++;
-#endif
-	} 
 	/* finally perform as many 8-bit XORs as needed if symbol size is not
 	 * multiple of 32 bits... */
-	if (m_symbolSize32rem > 0) {
-		for (i = 0; i < m_symbolSize32rem; i++) {
-			*(UINT8*)((UINT8*)t32 + i) ^= *(UINT8*)((UINT8*)f32 + i);
-#ifdef PERF_COUNT_XOR
-			m_nbXor++;
-#endif
-		}
+	for (i = 0; i < (len & 3); i++) {
+		to[i] ^= from[i];
 	}
+}
 
-#else //defined (__LP64__) || (__WORDSIZE == 64) } {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) // {
+#include <immintrin.h>
 
-	// 32-bit machines
-	UINT32		*t32 = (UINT32*)to;	// to pointer to 32-bit integers
-	UINT32		*f32 = (UINT32*)from;	// from pointer	to 32-bit integers
-	/* First perform as many 32-bit XORs as needed... */
-	for (i = m_symbolSize32; i > 0; i--) {
-		*t32 ^= *f32;
-		t32++;
-		f32++;
-#ifdef PERF_COUNT_XOR
-		m_nbXor++;
+#define LDPC_SIMD_XOR
+
+__attribute__((target("sse2"))) static void
+XorSymbolSSE2	(UINT8	*to,
+		 const UINT8	*from,
+		 unsigned int	len)
+{
+	unsigned int	i = 0;
+	for (; i + 64 <= len; i += 64) {
+		__m128i a0 = _mm_loadu_si128((const __m128i*)(to + i));
+		__m128i a1 = _mm_loadu_si128((const __m128i*)(to + i + 16));
+		__m128i a2 = _mm_loadu_si128((const __m128i*)(to + i + 32));
+		__m128i a3 = _mm_loadu_si128((const __m128i*)(to + i + 48));
+		a0 = _mm_xor_si128(a0, _mm_loadu_si128((const __m128i*)(from + i)));
+		a1 = _mm_xor_si128(a1, _mm_loadu_si128((const __m128i*)(from + i + 16)));
+		a2 = _mm_xor_si128(a2, _mm_loadu_si128((const __m128i*)(from + i + 32)));
+		a3 = _mm_xor_si128(a3, _mm_loadu_si128((const __m128i*)(from + i + 48)));
+		_mm_storeu_si128((__m128i*)(to + i), a0);
+		_mm_storeu_si128((__m128i*)(to + i + 16), a1);
+		_mm_storeu_si128((__m128i*)(to + i + 32), a2);
+		_mm_storeu_si128((__m128i*)(to + i + 48), a3);
+	}
+	for (; i + 16 <= len; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(to + i));
+		a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i*)(from + i)));
+		_mm_storeu_si128((__m128i*)(to + i), a);
+	}
+	if (i < len) {
+		XorSymbolScalar(to + i, from + i, len - i);
+	}
+}
+
+__attribute__((target("avx2"))) static void
+XorSymbolAVX2	(UINT8	*to,
+		 const UINT8	*from,
+		 unsigned int	len)
+{
+	unsigned int	i = 0;
+	for (; i + 64 <= len; i += 64) {
+		__m256i a0 = _mm256_loadu_si256((const __m256i*)(to + i));
+		__m256i a1 = _mm256_loadu_si256((const __m256i*)(to + i + 32));
+		a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((const __m256i*)(from + i)));
+		a1 = _mm256_xor_si256(a1, _mm256_loadu_si256((const __m256i*)(from + i + 32)));
+		_mm256_storeu_si256((__m256i*)(to + i), a0);
+		_mm256_storeu_si256((__m256i*)(to + i + 32), a1);
+	}
+	if (i + 32 <= len) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(to + i));
+		a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i*)(from + i)));
+		_mm256_storeu_si256((__m256i*)(to + i), a);
+		i += 32;
+	}
+	if (i < len) {
+		XorSymbolSSE2(to + i, from + i, len - i);
+	}
+}
+#endif // } defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+typedef void (*XorSymbolFunc) (UINT8 *to, const UINT8 *from, unsigned int len);
+
+static XorSymbolFunc	XorSymbol = XorSymbolScalar;
+static const char	*XorSymbolName = "scalar";
+
+
+/******************************************************************************
+ * SetXorKernel: Selects the XOR kernel used by AddToSymbol.
+ * => See header file for more informations.
+ */
+bool
+LDPCFecSession::SetXorKernel (const char	*name)
+{
+	if (strcmp(name, "scalar") == 0) {
+		XorSymbol = XorSymbolScalar;
+		XorSymbolName = "scalar";
+		return true;
+	}
+#ifdef LDPC_SIMD_XOR
+	__builtin_cpu_init();
+	if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+		XorSymbol = XorSymbolSSE2;
+		XorSymbolName = "sse2";
+		return true;
+	}
+	if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+		XorSymbol = XorSymbolAVX2;
+		XorSymbolName = "avx2";
+		return true;
+	}
 #endif
+	return false;
+}
+
+
+/******************************************************************************
+ * GetXorKernel: Returns the name of the XOR kernel in use.
+ * => See header file for more informations.
+ */
+const char *
+LDPCFecSession::GetXorKernel ()
+{
+	return XorSymbolName;
+}
+
+
+/*
+ * Picks the fastest kernel at startup, unless LDPC_XOR names one.
+ */
+static bool
+InitXorKernel (void)
+{
+	const char	*forced = getenv("LDPC_XOR");
+
+	if (forced != NULL && LDPCFecSession::SetXorKernel(forced)) {
+		return true;
 	}
-	/* finally perform as many 8-bit XORs as needed if symbol size is not
-	 * multiple of 32 bits... */
-	if (m_symbolSize32rem > 0) {
-		for (i = 0; i < m_symbolSize32rem; i++) {
-			*(UINT8*)((UINT8*)t32 + i) ^= *(UINT8*)((UINT8*)f32 + i);
+	return LDPCFecSession::SetXorKernel("avx2") ||
+		LDPCFecSession::SetXorKernel("sse2") ||
+		LDPCFecSession::SetXorKernel("scalar");
+}
+
+static bool	XorKernelInitialized = InitXorKernel();
+
+
+/******************************************************************************
+ * Calculates the XOR sum of two symbols: to = to + from.
+ * => See header file for more informations.
+ */
+void
+LDPCFecSession::AddToSymbol	(void	*to,
+				void	*from)
+{
 #ifdef PERF_COUNT_XOR
-			m_nbXor++;
+	// same count as 64/32/8-bit scalar XORs would give
+#if defined (__LP64__) || (__WORDSIZE == 64)
+	m_nbXor += m_symbolSize64 + (m_symbolSize32 - (m_symbolSize64 << 1)) + m_symbolSize32rem;
+#else
+	m_nbXor += m_symbolSize32 + m_symbolSize32rem;
 #endif
-		}
-	}
-#endif //defined (__LP64__) || (__WORDSIZE == 64) }
+#endif
+	XorSymbol((UINT8*)to, (const UINT8*)from, m_symbolSize);
 }
 
 
@@ -462,7 +679,6 @@ LDPCFecSession::BuildParitySymbol (void* symbol_canvas[],
 {
 	uintptr_t	*fec_buf;	// buffer for this parity symbol
 	uintptr_t	*to_add_buf;	// buffer for the  source.parity symbol to add
-        mod2entry	*e;
 	int seqno;
 
 	ASSERT(paritySymbol_index >= 0);
@@ -477,22 +693,18 @@ LDPCFecSession::BuildParitySymbol (void* symbol_canvas[],
 	ASSERT(m_sessionType == TypeSTAIRS ||
 		m_sessionType == TypeTRIANGLE ||
 		m_sessionType == TypeLDGM);
-	e = mod2sparse_first_in_row(m_pchkMatrix, paritySymbol_index);
-	ASSERT(!mod2sparse_at_end(e));
-	while (!mod2sparse_at_end(e)) {
-		// paritySymbol_index in {0.. n-k-1} range, so this test is ok
-		if (e->col != paritySymbol_index) {
-			// don't add paritySymbol to itself
-			seqno = GetSymbolSeqno(e->col);
-			to_add_buf = (uintptr_t*)
-					GetBuffer(symbol_canvas[seqno]);
-			if (to_add_buf == NULL) {
-				fprintf(stderr, "LDPCFecSession::BuildParitySymbol: FATAL ERROR, symbol %d is not allocated!\n", seqno);
-				return LDPC_ERROR;
-			}
-			AddToSymbol(fec_buf, to_add_buf);
+	ASSERT(m_encRowStart[paritySymbol_index] < m_encRowStart[paritySymbol_index + 1]);
+	for (int i = m_encRowStart[paritySymbol_index];
+	     i < m_encRowStart[paritySymbol_index + 1];
+	     i++) {
+		seqno = m_encRowSymbols[i];
+		to_add_buf = (uintptr_t*)
+				GetBuffer(symbol_canvas[seqno]);
+		if (to_add_buf == NULL) {
+			fprintf(stderr, "LDPCFecSession::BuildParitySymbol: FATAL ERROR, symbol %d is not allocated!\n", seqno);
+			return LDPC_ERROR;
 		}
-		e = mod2sparse_next_in_row(e);
+		AddToSymbol(fec_buf, to_add_buf);
 	}
 #ifdef EXTERNAL_MEMORY_MGMT_SUPPORT
 	if (m_storeData_callback) {
@@ -227,6 +227,20 @@ public:
 	void EndSession ();
 
 
+/**
+ * ResetDecoding: Brings a DECODER session back to the state it was in right
+ * after InitSession, so that it can decode a new block with the same
+ * parameters without regenerating the parity check matrix.
+ * Partial sums and parity symbols still held by the session are freed.
+ * The symbol_canvas used for the previous block must be cleared (memset(0))
+ * by the caller before the next call to DecodingStepWithSymbol.
+ * An encoding session never needs to be reset as BuildParitySymbol does
+ * not modify it.
+ * @return		Completion status (LDPC_OK or LDPC_ERROR).
+ */
+	ldpc_error_status ResetDecoding ();
+
+
 /**
  * IsInitialized: Check if the LDPC session has been initialized.
  * @return	  TRUE if the session is ready and initialized, FALSE if not.
@@ -266,6 +280,23 @@ public:
 	int	GetMaxN ();
 
 
+/**
+ * Selects the kernel used to XOR symbols together, for all sessions.
+ * By default the fastest one the CPU supports is picked at startup,
+ * unless the LDPC_XOR environment variable names another one.
+ * @param name		(IN) "scalar", "sse2" or "avx2".
+ * @return		false if that kernel is not available on this
+ *			CPU or build, in which case nothing changes.
+ */
+	static bool SetXorKernel (const char	*name);
+
+
+/**
+ * Returns the name of the XOR kernel in use.
+ */
+	static const char *GetXorKernel ();
+
+
 /**
  * Build a new parity symbol.
  * @param symbol_canvas	(IN)	Array of source and parity symbols.
@@ -416,6 +447,13 @@ protected:
 	 */
 	int	GetSymbolSeqno	(int matrixCol);
 
+	/**
+	 * Sets up the per check node and per parity symbol counters
+	 * used by the decoder from the (pristine) parity check matrix.
+	 * The counter tables must be allocated and cleared.
+	 */
+	void	InitDecoderCounters	();
+
 	/**
 	 * Get the data buffer associated to a symbol stored in the
 	 * symbol_canvas[] / m_parity_symbol_canvas[] / m_checkValues[] tables.
@@ -483,6 +521,9 @@ protected:
 	mod2sparse*	m_pchkMatrix;	// Parity Check matrix in sparse mode 
 					// format. This matrix is also used as
 					// a generator matrix in LDGM-* modes.
+	mod2sparse*	m_pchkMatrixOrig; // Decoder specific: untouched copy
+					// of m_pchkMatrix, which the decoder
+					// consumes, used by ResetDecoding.
 
 	int		m_leftDegree;	// Number of equations per data symbol
 
@@ -490,6 +531,11 @@ protected:
 	int*		m_nb_unknown_symbols_encoder; // Array: nb unknown symbols
 					// per check node. Used during per column
 					// encoding.
+	int*		m_encRowSymbols; // Array: seqnos of the symbols summed
+					// into each parity symbol, row by row.
+	int*		m_encRowStart;	// Array: index in m_encRowSymbols of
+					// the first symbol of each row, plus
+					// one past the end.
 
 	// Decoder specific...
 	void**		m_checkValues;	// Array: current check-nodes value.
@@ -210,6 +210,63 @@ void mod2sparse_copy
 #endif // #if 0
 
 
+/* COPY A SPARSE MATRIX, RE-USING THE ENTRIES OF THE DESTINATION.  Unlike
+   mod2sparse_copy, the entries already allocated in r are put back on its
+   free list rather than freed, so refreshing a working copy of a matrix
+   doesn't go through malloc at all once r has grown to the size of m.
+   Entries are inserted in row order, which makes each insertion O(1). */
+
+void mod2sparse_copy_recycle
+( mod2sparse *m,	/* Matrix to copy */
+  mod2sparse *r		/* Place to store copy of matrix */
+)
+{
+  mod2block *b;
+  mod2entry *e;
+  int i, j, k;
+
+  if (mod2sparse_rows(m)>mod2sparse_rows(r) 
+   || mod2sparse_cols(m)>mod2sparse_cols(r))
+  { fprintf(stderr,"mod2sparse_copy_recycle: Destination matrix is too small\n");
+    exit(1);
+  }
+
+  for (i = 0; i<mod2sparse_rows(r); i++)
+  { e = &r->rows[i];
+#ifndef SPARSE_MATRIX_OPT_FOR_LDPC_STAIRCASE
+    e->left = e->right = e->up = e->down = e;
+#else
+    e->left = e->right = e->down = e;
+#endif
+  }
+
+  for (j = 0; j<mod2sparse_cols(r); j++)
+  { e = &r->cols[j];
+#ifndef SPARSE_MATRIX_OPT_FOR_LDPC_STAIRCASE
+    e->left = e->right = e->up = e->down = e;
+#else
+    e->left = e->right = e->down = e;
+#endif
+  }
+
+  r->next_free = 0;
+  for (b = r->blocks; b!=0; b = b->next)
+  { for (k = 0; k<Mod2sparse_block; k++)
+    { b->entry[k].left = r->next_free;
+      r->next_free = &b->entry[k];
+    }
+  }
+
+  for (i = 0; i<mod2sparse_rows(m); i++)
+  { for (e = mod2sparse_first_in_row(m,i);
+         !mod2sparse_at_end(e);
+         e = mod2sparse_next_in_row(e))
+    { mod2sparse_insert(r,e->row,e->col);
+    }
+  }
+}
+
+
 
 /* PRINT A SPARSE MOD2 MATRIX IN HUMAN-READABLE FORM. */
 
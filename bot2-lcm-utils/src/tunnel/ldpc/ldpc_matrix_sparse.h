@@ -161,6 +161,7 @@ void mod2sparse_clear    (mod2sparse *);
 #if 0
 void mod2sparse_copy     (mod2sparse *, mod2sparse *);
 #endif // #if 0
+void mod2sparse_copy_recycle (mod2sparse *, mod2sparse *);
 
 
 void mod2sparse_print       (FILE *, mod2sparse *);
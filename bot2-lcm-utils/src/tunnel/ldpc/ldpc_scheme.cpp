@@ -267,6 +267,53 @@ LDPCFecScheme::BuildPkt (int	pktIdx,
 }
 
 
+/******************************************************************************
+ *
+ * => See header file for more informations.
+ */
+ldpc_error_status
+LDPCFecScheme::GetPktSymbols (int	pktIdx,
+			      void*	symbol_canvas[],
+			      void*	pktSymbols[],
+			      int*	ESIofFirstSymbol)
+{
+	int	j;
+
+	ASSERT(pktIdx >= 0);
+	ASSERT(pktIdx < m_nbPkts);
+	ASSERT(symbol_canvas);
+	ASSERT(pktSymbols);
+	ASSERT(ESIofFirstSymbol);
+
+	if (m_nbSymbolsPerPkt == 1) {
+		/* simple case, one symbol per packet */
+		*ESIofFirstSymbol = pktIdx;
+		pktSymbols[0] = symbol_canvas[pktIdx];
+	} else if (pktIdx < m_nbSourcePkts) {
+		/* a source packet */
+		*ESIofFirstSymbol = (pktIdx * m_nbSymbolsPerPkt);
+		ASSERT(*ESIofFirstSymbol < m_nbSourceSymbols);
+		for (j = 0; j < m_nbSymbolsPerPkt; j++) {
+			pktSymbols[j] = symbol_canvas[(j + *ESIofFirstSymbol)
+						      % m_nbSourceSymbols];
+		}
+	} else {
+		/* a parity (repair) packet */
+		*ESIofFirstSymbol =
+			m_nbSourceSymbols +
+			m_txseqToESI[((pktIdx - m_nbSourcePkts) * m_nbSymbolsPerPkt)
+					% m_nbParitySymbols];
+		for (j = 0; j < m_nbSymbolsPerPkt; j++) {
+			pktSymbols[j] = symbol_canvas[m_nbSourceSymbols +
+					m_txseqToESI[(j + (pktIdx - m_nbSourcePkts)
+						      * m_nbSymbolsPerPkt)
+						     % m_nbParitySymbols]];
+		}
+	}
+	return LDPC_OK;
+}
+
+
 /******************************************************************************
  *
  * => See header file for more informations.
@@ -127,6 +127,27 @@ public:
 				    void*	symbol_canvas[],
 				    int*	ESIofFirstSymbol);
 
+	/**
+	 * Same as BuildPkt(), but rather than copying the symbols into a
+	 * packet buffer, return pointers to them in transmission order,
+	 * so that the caller can hand them to a scatter-gather send.
+	 *
+	 * @param pktIdx	(IN) Index of the packet to build, in
+	 *			[0; getNbPkts() - 1] range.
+	 * @param symbol_canvas	(IN) Global array of source and parity
+	 *			symbols.
+	 * @param pktSymbols	(OUT) table of getNbSymbolsPerPkt() entries,
+	 *			filled with pointers into symbol_canvas.
+	 * @param ESIofFirstSymbol
+	 *			(OUT) ESI of the first symbol chosen
+	 *			to be included in this packet.
+	 * @return		Completion status (LDPC_OK or LDPC_ERROR).
+	 */
+	ldpc_error_status GetPktSymbols (int	pktIdx,
+					 void*	symbol_canvas[],
+					 void*	pktSymbols[],
+					 int*	ESIofFirstSymbol);
+
 	/**
 	 * Split a received packet into the set of its constituting symbols.
 	 * @param pktBuffer	(IN) Data buffer containing the packet
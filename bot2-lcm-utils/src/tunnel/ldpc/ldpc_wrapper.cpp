@@ -34,12 +34,210 @@
 #include <stdio.h>
 #include "ldpc_wrapper.h"
 #include <math.h>
+#include <assert.h>
+#include <pthread.h>
 
 #include <getopt.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#ifndef EXTERNAL_MEMORY_MGMT_SUPPORT
+#error "ldpc_wrapper manages the decoder's symbol buffers through the EXTERNAL_MEMORY_MGMT_SUPPORT callbacks, see ldpc_profile.h"
+#endif
+
+//An initialized LDPC session along with the symbol buffers that go with it.
+struct ldpc_session {
+  //cache key
+  int nbDATA;
+  int nbFEC;
+  int symbolSize;
+  int pktSize;
+  int seed;
+  int typeFlag;
+
+  LDPCFecScheme * scheme;
+  uint8_t * symbols; //one buffer for the source symbols, followed by the FEC symbols for an encoder
+  int symbolStride; //symbolSize rounded up to LDPC_SYMBOL_ALIGN
+  size_t symbolsBytes;
+  uint8_t ** canvas; //nbDATA + nbFEC symbol pointers
+
+  //scratch symbols (partial sums, parity symbols) that the decoder has handed back
+  void ** freeBufs;
+  int numFreeBufs;
+  int freeBufsSize;
+
+  ldpc_session * next; //in the cache
+};
+
+//idle sessions, most recently used first.  Creating sessions is serialized
+//by the mutex too, which matters since matrix generation and the packet
+//permutation in InitScheme share the one global ldpc_rand() state.
+static pthread_mutex_t session_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ldpc_session * session_cache = NULL;
+static int session_cache_size = LDPC_SESSION_CACHE_SIZE;
+
+//decoder memory callbacks: decoded source symbols go straight into the
+//session's symbol buffer, scratch symbols are recycled
+static void * decoded_symbol_cb(void * context, int size, int symbol_seqno)
+{
+  ldpc_session * s = (ldpc_session *) context;
+  return s->symbols + (size_t) symbol_seqno * s->symbolStride;
+}
+
+static void * alloc_tmp_buffer_cb(void * context, int size)
+{
+  ldpc_session * s = (ldpc_session *) context;
+  void * buf;
+  if (s->numFreeBufs > 0)
+    buf = s->freeBufs[--s->numFreeBufs];
+  else if (posix_memalign(&buf, LDPC_SYMBOL_ALIGN, size) != 0)
+    return NULL;
+  memset(buf, 0, size);
+  return buf;
+}
+
+static ldpc_error_status free_symbol_cb(void * context, void * symbol)
+{
+  ldpc_session * s = (ldpc_session *) context;
+  if (s->numFreeBufs == s->freeBufsSize) {
+    s->freeBufsSize = s->freeBufsSize > 0 ? 2 * s->freeBufsSize : 64;
+    s->freeBufs = (void **) realloc(s->freeBufs, s->freeBufsSize * sizeof(void *));
+  }
+  s->freeBufs[s->numFreeBufs++] = symbol;
+  return LDPC_OK;
+}
+
+static size_t session_bytes(ldpc_session * s)
+{
+  return s->symbolsBytes + (size_t) s->numFreeBufs * s->symbolSize;
+}
+
+static ldpc_session * create_session(int nbDATA, int nbFEC, int symbolSize, int pktSize, int seed, int typeFlag)
+{
+  ldpc_session * s = (ldpc_session *) calloc(1, sizeof(ldpc_session));
+  s->nbDATA = nbDATA;
+  s->nbFEC = nbFEC;
+  s->symbolSize = symbolSize;
+  s->pktSize = pktSize;
+  s->seed = seed;
+  s->typeFlag = typeFlag;
+
+  s->scheme = new LDPCFecScheme();
+  if (s->scheme->InitSession(nbDATA, nbFEC, symbolSize, typeFlag, seed, TypeTRIANGLE, 3) == LDPC_ERROR) {
+    fprintf(stderr, "ERROR: Unable to initialize LDPC_TRIANGLE FEC session!\n");
+    exit(1);
+  }
+  /* then initialize the FEC Scheme */
+  if (s->scheme->InitScheme(symbolSize, pktSize) == LDPC_ERROR) {
+    fprintf(stderr, "ERROR: Unable to initialize LDPC_TRIANGLE FEC scheme!\n");
+    exit(1);
+  }
+
+  //allocate space for the symbols
+  //each symbol starts on its own LDPC_SYMBOL_ALIGN boundary, so that the XOR
+  //kernels in AddToSymbol run at full width
+  int nbBufs = (typeFlag & FLAG_CODER) ? nbDATA + nbFEC : nbDATA;
+  s->symbolStride = (symbolSize + LDPC_SYMBOL_ALIGN - 1) & ~(LDPC_SYMBOL_ALIGN - 1);
+  s->symbolsBytes = (size_t) nbBufs * s->symbolStride;
+  if (posix_memalign((void **) &s->symbols, LDPC_SYMBOL_ALIGN, s->symbolsBytes) != 0 || (s->canvas
+      = (uint8_t**) calloc(nbDATA + nbFEC, sizeof(uint8_t*))) == NULL) {
+    printf("ERROR: CANNOT ALLOCATE data buffers!\n");
+    exit(1);
+  }
+  if (typeFlag & FLAG_CODER) {
+    for (int i = 0; i < nbBufs; i++)
+      s->canvas[i] = s->symbols + (size_t) i * s->symbolStride;
+  }
+  else {
+    s->scheme->SetCallbackFunctions(decoded_symbol_cb, alloc_tmp_buffer_cb, NULL, NULL, NULL, free_symbol_cb, s);
+  }
+  return s;
+}
+
+static void destroy_session(ldpc_session * s)
+{
+  s->scheme->EndSession(); //tell it to remove the coding matrix too, handing scratch symbols back to us
+  delete s->scheme;
+  for (int i = 0; i < s->numFreeBufs; i++)
+    free(s->freeBufs[i]);
+  free(s->freeBufs);
+  free(s->symbols);
+  free(s->canvas);
+  free(s);
+}
+
+//unlinks the least recently used sessions until the cache is within bounds,
+//returning them as a list. Must be called with the mutex held
+static ldpc_session * trim_session_cache()
+{
+  int numSessions = 0;
+  size_t bytes = 0;
+  ldpc_session ** link = &session_cache;
+  while (*link != NULL) {
+    numSessions++;
+    bytes += session_bytes(*link);
+    if (numSessions > session_cache_size || bytes > LDPC_SESSION_CACHE_MAX_BYTES)
+      break;
+    link = &(*link)->next;
+  }
+  ldpc_session * evicted = *link;
+  *link = NULL;
+  return evicted;
+}
+
+static void destroy_sessions(ldpc_session * s)
+{
+  while (s != NULL) {
+    ldpc_session * next = s->next;
+    destroy_session(s);
+    s = next;
+  }
+}
+
+static ldpc_session * acquire_session(int nbDATA, int nbFEC, int symbolSize, int pktSize, int seed, int typeFlag)
+{
+  pthread_mutex_lock(&session_cache_mutex);
+  for (ldpc_session ** link = &session_cache; *link != NULL; link = &(*link)->next) {
+    ldpc_session * s = *link;
+    if (s->nbDATA == nbDATA && s->nbFEC == nbFEC && s->symbolSize == symbolSize && s->pktSize == pktSize && s->seed
+        == seed && s->typeFlag == typeFlag) {
+      *link = s->next;
+      pthread_mutex_unlock(&session_cache_mutex);
+      return s;
+    }
+  }
+  ldpc_session * s = create_session(nbDATA, nbFEC, symbolSize, pktSize, seed, typeFlag);
+  pthread_mutex_unlock(&session_cache_mutex);
+  return s;
+}
+
+static void release_session(ldpc_session * s)
+{
+  if (s->typeFlag & FLAG_DECODER) {
+    //get it ready for the next object now, so that its scratch symbols are
+    //back on the free list while it sits in the cache
+    s->scheme->ResetDecoding();
+    memset(s->canvas, 0, (s->nbDATA + s->nbFEC) * sizeof(uint8_t*));
+  }
+
+  pthread_mutex_lock(&session_cache_mutex);
+  s->next = session_cache;
+  session_cache = s;
+  ldpc_session * evicted = trim_session_cache();
+  pthread_mutex_unlock(&session_cache_mutex);
+  destroy_sessions(evicted);
+}
+
+void ldpc_wrapper::setSessionCacheSize(int numSessions)
+{
+  pthread_mutex_lock(&session_cache_mutex);
+  session_cache_size = numSessions;
+  ldpc_session * evicted = trim_session_cache();
+  pthread_mutex_unlock(&session_cache_mutex);
+  destroy_sessions(evicted);
+}
+
 int ldpc_wrapper::init(int objSize_, int pktSize_, double fec_ratio_, int typeFlag_)
 {
   pktSize = pktSize_;
@@ -47,10 +245,10 @@ int ldpc_wrapper::init(int objSize_, int pktSize_, double fec_ratio_, int typeFl
   fec_ratio = fec_ratio_;
   typeFlag = typeFlag_;
   /*
-   * step 1: initialize the LDPC FEC session/scheme
+   * step 1: get an LDPC FEC session/scheme with the right parameters
    */
-  MyFecScheme = new LDPCFecScheme();
-  if (MyFecScheme->DetermineSymbolSize(objSize, pktSize, &symbolSize, &nbDATA) == LDPC_ERROR) {
+  LDPCFecScheme sizing;
+  if (sizing.DetermineSymbolSize(objSize, pktSize, &symbolSize, &nbDATA) == LDPC_ERROR) {
     fprintf(stderr, "ERROR: MyFecScheme->DetermineSymbolSize() failed. Check the -ps value provided.\n");
     exit(1);
   }
@@ -62,15 +260,9 @@ int ldpc_wrapper::init(int objSize_, int pktSize_, double fec_ratio_, int typeFl
   nbFEC = (int) ceil((fec_ratio - 1.0) * nbDATA);
   nbSYMBOLS = nbDATA + nbFEC;
 
-  if (MyFecScheme->InitSession(nbDATA, nbFEC, symbolSize, typeFlag, 23, TypeTRIANGLE, 3) == LDPC_ERROR) {
-    fprintf(stderr, "ERROR: Unable to initialize LDPC_TRIANGLE FEC session!\n");
-    exit(1);
-  }
-  /* then initialize the FEC Scheme */
-  if (MyFecScheme->InitScheme(symbolSize, pktSize) == LDPC_ERROR) {
-    fprintf(stderr, "ERROR: Unable to initialize LDPC_TRIANGLE FEC scheme!\n");
-    exit(1);
-  }
+  session = acquire_session(nbDATA, nbFEC, symbolSize, pktSize, LDPC_SEED, typeFlag);
+  MyFecScheme = session->scheme;
+  data = session->canvas;
 
   /* and now adjust the various counters */
 
@@ -85,11 +277,6 @@ int ldpc_wrapper::init(int objSize_, int pktSize_, double fec_ratio_, int typeFl
   //      "data_symbols=%d  fec_symbols=%d  symbol_size=%d  nb_symbol_per_pkt=%d  total_nb_pkts=%d  pkt_size=%d  object_size=%d  left_degree=3\n",
   //      nbDATA, nbFEC, symbolSize, nbSymbolsPerPkt, nbPKT, pktSize, objSize);
 
-  //allocate space for the symbols
-  if ((data = (uint8_t**) calloc(nbSYMBOLS, sizeof(uint8_t*))) == NULL) {
-    printf("ERROR: CANNOT ALLOCATE data buffer array!\n");
-    exit(1);
-  }
   packetNum = 0;
   return 0;
 }
@@ -98,41 +285,25 @@ ldpc_wrapper::~ldpc_wrapper()
 {
   //  fprintf(stderr, "cleanup\n");
   /*
-   * close and free everything
+   * hand the session and its symbols back for the next object
    */
-  MyFecScheme->EndSession(); //tell it to remove the coding matrix too
-  delete MyFecScheme;
-  /* free all data and FEC packets created by the source */
-  for (int symbolseq = 0; symbolseq < nbSYMBOLS; symbolseq++) {
-    free(data[symbolseq]);
-  }
-  free(data);
+  release_session(session);
 }
 
 ldpc_enc_wrapper::ldpc_enc_wrapper(uint8_t * data_to_send, int objSize_, int packetSize, double fec_rate) //initializer for encoder
 {
 
   init(objSize_, packetSize, fec_rate, FLAG_CODER);
-
-  /*
-   * step 2: allocate space for  symbols
-   */
-  for (int sourceseq = 0; sourceseq < nbDATA; sourceseq++) {
-    if ((data[sourceseq] = (uint8_t*) calloc(symbolSize, 1)) == NULL) {
-      printf("ERROR: CANNOT ALLOCATE data buffers!\n");
-      exit(1);
-    }
-  }
-  /* allocate FEC symbol buffers */
-  for (int fecseq = 0; fecseq < nbFEC; fecseq++) {
-    if ((data[fecseq + nbDATA] = (uint8_t*) calloc(symbolSize, 1)) == NULL) {
-      printf("ERROR: CANNOT ALLOCATE FEC buffers!\n");
-      exit(1);
-    }
-  }
   encodeData(data_to_send);
 }
 
+ldpc_enc_wrapper::ldpc_enc_wrapper(const struct iovec * data_to_send, int iovcnt, int objSize_, int packetSize,
+    double fec_rate)
+{
+  init(objSize_, packetSize, fec_rate, FLAG_CODER);
+  encodeData(data_to_send, iovcnt);
+}
+
 int ldpc_enc_wrapper::getNextPacket(uint8_t * pktBuf, int16_t * ESI)
 {
   if (packetNum >= nbPKT) {
@@ -149,6 +320,31 @@ int ldpc_enc_wrapper::getNextPacket(uint8_t * pktBuf, int16_t * ESI)
   return packetNum >= nbPKT;
 }
 
+int ldpc_enc_wrapper::getNextPacket(struct iovec * pktIov, int16_t * ESI)
+{
+  if (packetNum >= nbPKT) {
+    printf("ERROR: can't generate more packets\n");
+    exit(1);
+  }
+
+  getPacket(packetNum, pktIov, ESI);
+
+  packetNum++;
+  return packetNum >= nbPKT;
+}
+
+void ldpc_enc_wrapper::getPacket(int pktIdx, struct iovec * pktIov, int16_t * ESI)
+{
+  void * symbols[nbSymbolsPerPkt];
+  int ESI_;
+  MyFecScheme->GetPktSymbols(pktIdx, (void**) data, symbols, &ESI_);
+  for (int i = 0; i < nbSymbolsPerPkt; i++) {
+    pktIov[i].iov_base = symbols[i];
+    pktIov[i].iov_len = symbolSize;
+  }
+  *ESI = (int16_t) ESI_;
+}
+
 ldpc_dec_wrapper::ldpc_dec_wrapper(int objSize_, int packetSize, double fec_rate)
 {
   init(objSize_, packetSize, fec_rate, FLAG_DECODER);
@@ -170,6 +366,14 @@ int ldpc_dec_wrapper::processPacket(uint8_t * pktBuf, int16_t ESI)
 
 }
 
+int ldpc_dec_wrapper::getSourcePacket(int16_t ESI)
+{
+  //source packets go out in order, with their symbols back to back
+  if (ESI < 0 || ESI >= nbDATA || ESI % nbSymbolsPerPkt != 0)
+    return -1;
+  return ESI / nbSymbolsPerPkt;
+}
+
 int ldpc_wrapper::getObject(uint8_t * buf)
 {
   if (!(packetNum >= nbDATAPkts && MyFecScheme->IsDecodingComplete((void**) data))) {
@@ -190,19 +394,63 @@ int ldpc_wrapper::getObject(uint8_t * buf)
 int ldpc_enc_wrapper::encodeData(uint8_t * data_to_send)
 {
   /*
-   * step 3: generate the original DATA symbols
+   * step 3: generate the original DATA symbols, zero padding the last one
+   * since the buffers are recycled
    */
   for (int sourceseq = 0; sourceseq < nbDATA; sourceseq++) {
     uint8_t * p = data_to_send + sourceseq * symbolSize;
     int numB = objSize - sourceseq * symbolSize;
     if (numB > symbolSize)
       numB = symbolSize;
+    if (numB < 0)
+      numB = 0;
     memcpy(data[sourceseq], p, numB);
+    memset(data[sourceseq] + numB, 0, symbolSize - numB);
   }
 
+  buildParitySymbols();
+  return 0;
+}
+
+int ldpc_enc_wrapper::encodeData(const struct iovec * data_to_send, int iovcnt)
+{
+  /*
+   * step 3: gather the original DATA symbols, copying each byte exactly once
+   */
+  int sourceseq = 0;
+  int symbolOffset = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    const uint8_t * p = (const uint8_t *) data_to_send[i].iov_base;
+    size_t remaining = data_to_send[i].iov_len;
+    while (remaining > 0) {
+      assert(sourceseq < nbDATA);
+      size_t numB = symbolSize - symbolOffset;
+      if (numB > remaining)
+        numB = remaining;
+      memcpy(data[sourceseq] + symbolOffset, p, numB);
+      p += numB;
+      remaining -= numB;
+      symbolOffset += numB;
+      if (symbolOffset == symbolSize) {
+        sourceseq++;
+        symbolOffset = 0;
+      }
+    }
+  }
+  //zero the padding, the buffers are recycled
+  for (; sourceseq < nbDATA; sourceseq++) {
+    memset(data[sourceseq] + symbolOffset, 0, symbolSize - symbolOffset);
+    symbolOffset = 0;
+  }
+
+  buildParitySymbols();
+  return 0;
+}
+
+void ldpc_enc_wrapper::buildParitySymbols()
+{
   /* and now do FEC encoding */
   for (int fecseq = 0; fecseq < nbFEC; fecseq++) {
     MyFecScheme->BuildParitySymbol((void**) data, fecseq, data[fecseq + nbDATA]);
   }
-  return 0;
 }
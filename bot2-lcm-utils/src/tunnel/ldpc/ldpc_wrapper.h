@@ -12,6 +12,7 @@
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
@@ -20,6 +21,14 @@
 #include "ldpc_scheme.h"
 #include "macros.h"
 
+#define LDPC_SEED 23
+#define LDPC_SYMBOL_ALIGN 64 //alignment of symbol buffers, enough for any of the XOR kernels
+//initialized sessions that are kept around for reuse once their wrapper is deleted
+#define LDPC_SESSION_CACHE_SIZE 8
+#define LDPC_SESSION_CACHE_MAX_BYTES (64*1024*1024) //bound on the symbol buffers held by idle sessions
+
+struct ldpc_session;
+
 class ldpc_wrapper {
 public:
   ldpc_wrapper()
@@ -32,9 +41,25 @@ public:
     return nbPKT;
   }
 
+  inline int getNumSymbolsPerPacket()
+  {
+    return nbSymbolsPerPkt;
+  }
+
+  inline int getNumDataPackets()
+  {
+    return nbDATAPkts;
+  }
+
   //used for both
   int getObject(uint8_t * pktBuf);
 
+  //Setting up a session means generating the parity check matrix, which
+  //costs far more than coding a typical message, so sessions are cached by
+  //(nbDATA, nbFEC, symbolSize, seed) along with their symbol buffers, and
+  //handed to the next wrapper with the same parameters. 0 disables the cache.
+  static void setSessionCacheSize(int numSessions);
+
 protected:
   int init(int objSize_, int pktSize_, double fec_rate_, int typeFlag);
   int typeFlag;
@@ -53,9 +78,10 @@ protected:
 
   int objSize;
   double fec_ratio;
-  LDPCFecScheme * MyFecScheme;
+  ldpc_session * session;
+  LDPCFecScheme * MyFecScheme; /* belongs to session */
 
-  uint8_t **data; /* filled with original data symbols AND  built FEC symbols */
+  uint8_t **data; /* filled with original data symbols AND  built FEC symbols, belongs to session */
   int packetNum; /* number of packets sent/received */
 
 };
@@ -64,8 +90,18 @@ class ldpc_enc_wrapper: public ldpc_wrapper {
 public:
   //encoder stuff:
   ldpc_enc_wrapper(uint8_t * data_to_send, int objSize, int packetSize, double fec_rate); //initializer for encoder
+  //gathers the object from iovcnt buffers whose lengths add up to objSize
+  ldpc_enc_wrapper(const struct iovec * data_to_send, int iovcnt, int objSize, int packetSize, double fec_rate);
   int getNextPacket(uint8_t * pktBuf, int16_t * ESI);
+  //points pktIov (getNumSymbolsPerPacket() entries) at the symbols of the next packet instead of copying them
+  int getNextPacket(struct iovec * pktIov, int16_t * ESI);
+  //same for any packet, packets 0 to getNumDataPackets()-1 being the source packets
+  void getPacket(int pktIdx, struct iovec * pktIov, int16_t * ESI);
   int encodeData(uint8_t * data_to_send);
+  int encodeData(const struct iovec * data_to_send, int iovcnt);
+
+private:
+  void buildParitySymbols();
 };
 
 class ldpc_dec_wrapper: public ldpc_wrapper {
@@ -73,5 +109,7 @@ public:
   //decoder stuff:
   ldpc_dec_wrapper(int objSize, int packetSize, double fec_rate); //initializer for decoder
   int processPacket(uint8_t * newPkt, int16_t ESI);
+  //index of the source packet with the given ESI, or -1 for a parity packet
+  int getSourcePacket(int16_t ESI);
 };
 #endif /* LDPC_WRAPPER_H_ */
@@ -6,6 +6,7 @@
  */
 #include "ldpc_wrapper.h"
 #include <time.h>
+#include <assert.h>
 #include <sys/time.h>   /* for gettimeofday */
 static inline double getTime(void)
 {
@@ -18,9 +19,128 @@ static inline double getTime(void)
   return t;
 }
 
+//encodes and decodes messages of a few sizes, without the session cache,
+//then with it for each of the XOR kernels, and reports the throughput of
+//each side
+static int benchmark(double fec_rate, double dropfrac)
+{
+  int packetSize = 1024;
+  int sizes[] = { 2000, 20000, 142230, 1000000, 4000000 };
+  int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+  const char * kernels[] = { "scalar", "sse2", "avx2" };
+  int numKernels = sizeof(kernels) / sizeof(kernels[0]);
+  const char * bestKernel = LDPCFecSession::GetXorKernel();
+  int ret = 0;
+
+  printf("fec_rate %.2f, drop %.1f%%\n", fec_rate, dropfrac * 100);
+  printf("%10s %8s %8s %12s %12s %8s\n", "size", "cache", "xor", "enc MB/s", "dec MB/s", "decoded");
+  for (int s = 0; s < numSizes; s++) {
+    int messageSize = sizes[s];
+    int numRuns = 64 * 1024 * 1024 / messageSize;
+    if (numRuns < 10)
+      numRuns = 10;
+    if (numRuns > 2000)
+      numRuns = 2000;
+
+    uint8_t * message = (uint8_t *) malloc(messageSize);
+    uint8_t * dataD = (uint8_t *) malloc(messageSize);
+    int maxPackets = 2 * fec_rate * (messageSize / 64 + 1); //at least one symbol per packet, of at least 64 bytes
+    uint8_t * pkts = (uint8_t *) malloc((size_t) maxPackets * packetSize);
+    int16_t * ESIs = (int16_t *) malloc(maxPackets * sizeof(int16_t));
+    bool * dropped = (bool *) malloc(maxPackets * sizeof(bool));
+    struct iovec * pktIov = (struct iovec *) malloc((size_t) maxPackets * 16 * sizeof(struct iovec));
+    for (int i = 0; i < messageSize; i++)
+      message[i] = (uint8_t) rand();
+
+    for (int config = -1; config < numKernels; config++) {
+      bool cached = config >= 0;
+      if (!LDPCFecSession::SetXorKernel(cached ? kernels[config] : bestKernel))
+        continue;
+      ldpc_wrapper::setSessionCacheSize(cached ? LDPC_SESSION_CACHE_SIZE : 0);
+      double encTime = 0, decTime = 0;
+      int numDecoded = 0;
+      for (int r = 0; r < numRuns; r++) {
+        message[r % messageSize]++; //so that each run codes a different message
+
+        //encode the way the tunnel does, pointing at the symbols of each packet
+        double t0 = getTime();
+        ldpc_enc_wrapper * ldpc_enc = new ldpc_enc_wrapper(message, messageSize, packetSize, fec_rate);
+        int numPackets = ldpc_enc->getNumPackets();
+        int symbolsPerPkt = ldpc_enc->getNumSymbolsPerPacket();
+        assert(numPackets <= maxPackets && symbolsPerPkt <= 16);
+        for (int p = 0; p < numPackets; p++)
+          ldpc_enc->getNextPacket(pktIov + p * symbolsPerPkt, &ESIs[p]);
+        double t1 = getTime();
+
+        //then gather the packets and pick the drops outside of the timed section
+        for (int p = 0; p < numPackets; p++) {
+          uint8_t * pkt = pkts + p * packetSize;
+          for (int i = 0; i < symbolsPerPkt; i++) {
+            memcpy(pkt, pktIov[p * symbolsPerPkt + i].iov_base, pktIov[p * symbolsPerPkt + i].iov_len);
+            pkt += pktIov[p * symbolsPerPkt + i].iov_len;
+          }
+          dropped[p] = rand() % 10000 < 10000 * dropfrac;
+        }
+        delete ldpc_enc;
+
+        double t2 = getTime();
+        ldpc_dec_wrapper * ldpc_dec = new ldpc_dec_wrapper(messageSize, packetSize, fec_rate);
+        int dec_done = 0;
+        for (int p = 0; p < numPackets && dec_done == 0; p++) {
+          if (!dropped[p])
+            dec_done = ldpc_dec->processPacket(pkts + p * packetSize, ESIs[p]);
+        }
+        if (dec_done == 1)
+          ldpc_dec->getObject(dataD);
+        delete ldpc_dec;
+        double t3 = getTime();
+
+        if (dec_done == 1) {
+          if (memcmp(message, dataD, messageSize) == 0) {
+            numDecoded++;
+          }
+          else {
+            printf("ERROR: decoded %d byte message doesn't match\n", messageSize);
+            ret = 1;
+          }
+        }
+        encTime += t1 - t0;
+        decTime += t3 - t2;
+      }
+      double mb = (double) messageSize * numRuns / 1e6;
+      printf("%10d %8s %8s %12.1f %12.1f %7.1f%%\n", messageSize, cached ? "on" : "off",
+          LDPCFecSession::GetXorKernel(), mb / encTime, mb / decTime, 100.0 * numDecoded / numRuns);
+    }
+    free(message);
+    free(dataD);
+    free(pkts);
+    free(ESIs);
+    free(dropped);
+    free(pktIov);
+  }
+  ldpc_wrapper::setSessionCacheSize(LDPC_SESSION_CACHE_SIZE);
+  LDPCFecSession::SetXorKernel(bestKernel);
+  return ret;
+}
+
+//usage: ldpc-wrapper-test [fec_rate [drop]]     round trips 1000 messages
+//       ldpc-wrapper-test -b [fec_rate [drop]]  throughput benchmark
 int main(int argc, char * argv[])
 {
   srand(time(NULL));
+  if (argc >= 2 && strcmp(argv[1], "-b") == 0) {
+    double fec_rate = 1.5;
+    double dropfrac = .1;
+    if (argc >= 3)
+      fec_rate = atof(argv[2]);
+    if (argc >= 4) {
+      dropfrac = atof(argv[3]);
+      if (dropfrac > 1)
+        dropfrac /= 100;
+    }
+    return benchmark(fec_rate, dropfrac);
+  }
+
   int numRuns = 1000;
   int numSuccess = 0;
 
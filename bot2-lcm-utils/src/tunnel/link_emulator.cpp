@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "link_emulator.h"
+#include "lcm_tunnel_params_t.h"
+
+ImpairedLink::ImpairedLink(const link_params_t *params_, bool stream_, GRand *rand_) :
+  params(*params_), numSent(0), numLost(0), numOverflowed(0), numDelivered(0), bytesDelivered(0), stream(stream_),
+      rand(rand_), bursting(false), linkFreeTime(0), lastArrival(0), seqno(0)
+{
+}
+
+ImpairedLink::~ImpairedLink()
+{
+  while (!inFlight.empty()) {
+    delete inFlight.top().data;
+    inFlight.pop();
+  }
+}
+
+//Gilbert model: a datagram is lost while the link is in a burst, and the
+//chances of going in and out of a burst are set so that the loss averages
+//out to params.loss, with bursts params.burst long on average
+bool ImpairedLink::lose()
+{
+  if (params.loss <= 0)
+    return false;
+  if (params.burst <= 1)
+    return g_rand_double(rand) < params.loss;
+  double toGood = 1 / params.burst;
+  double toBad = params.loss / (params.burst * (1 - params.loss));
+  if (g_rand_double(rand) < (bursting ? toGood : toBad))
+    bursting = !bursting;
+  return bursting;
+}
+
+bool ImpairedLink::send(const char *data, int len, int64_t now)
+{
+  numSent++;
+  if (!stream && lose()) {
+    numLost++;
+    return false;
+  }
+
+  int64_t departure = now;
+  if (params.rate > 0) {
+    linkFreeTime = MAX(linkFreeTime, now);
+    if (!stream && linkFreeTime - now > params.queueUsec) {
+      numOverflowed++;
+      return false;
+    }
+    linkFreeTime += (int64_t) len * 1000000 / params.rate;
+    departure = linkFreeTime;
+  }
+
+  packet_t p;
+  p.arrival = departure + params.delay;
+  if (params.jitter > 0)
+    p.arrival += (int64_t) (g_rand_double(rand) * params.jitter);
+  if (!stream && params.reorder > 0 && g_rand_double(rand) < params.reorder)
+    p.arrival += params.reorderDelay;
+  if (stream)
+    p.arrival = MAX(p.arrival, lastArrival); //a stream stays in order
+  lastArrival = MAX(lastArrival, p.arrival);
+  p.seqno = seqno++;
+  p.data = new std::string(data, len);
+  inFlight.push(p);
+  return true;
+}
+
+int64_t ImpairedLink::nextArrival()
+{
+  if (inFlight.empty())
+    return -1;
+  return inFlight.top().arrival;
+}
+
+bool ImpairedLink::receive(int64_t now, std::string &data)
+{
+  if (inFlight.empty() || inFlight.top().arrival > now)
+    return false;
+  std::string * p = inFlight.top().data;
+  inFlight.pop();
+  data.swap(*p);
+  delete p;
+  numDelivered++;
+  bytesDelivered += data.size();
+  return true;
+}
+
+int64_t ImpairedLink::backlog(int64_t now)
+{
+  return MAX(0, linkFreeTime - now);
+}
+
+static int _write_fully(int fd, const void *b, int len)
+{
+  int cnt = 0;
+  const char *bb = (const char *) b;
+  while (cnt < len) {
+    int thiscnt = write(fd, bb + cnt, len - cnt);
+    if (thiscnt < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    cnt += thiscnt;
+  }
+  return cnt;
+}
+
+static int _bind_loopback(int type, int port)
+{
+  int fd = socket(AF_INET, type, 0);
+  if (fd < 0) {
+    perror("allocating socket");
+    return -1;
+  }
+  int opt = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+    perror("binding socket");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int _local_port(int fd)
+{
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  getsockname(fd, (struct sockaddr*) &addr, &addrlen);
+  return ntohs(addr.sin_port);
+}
+
+static int _connect_loopback(int fd, int port)
+{
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  return connect(fd, (struct sockaddr*) &addr, sizeof(addr));
+}
+
+LinkEmulator::LinkEmulator(const link_params_t *params, GRand *rand) :
+  udp(false), listenFd(-1), serverPort(-1)
+{
+  for (int dir = 0; dir < 2; dir++) {
+    tcpLinks[dir] = new ImpairedLink(params, true, rand);
+    udpLinks[dir] = new ImpairedLink(params, false, rand);
+    tcpFds[dir] = -1;
+    udpFds[dir] = -1;
+    rewriting[dir] = false;
+    udpConnected[dir] = false;
+  }
+}
+
+LinkEmulator::~LinkEmulator()
+{
+  closeTcp();
+  if (listenFd >= 0)
+    close(listenFd);
+  for (int dir = 0; dir < 2; dir++) {
+    if (udpFds[dir] >= 0)
+      close(udpFds[dir]);
+    delete tcpLinks[dir];
+    delete udpLinks[dir];
+  }
+}
+
+bool LinkEmulator::start(int listenPort, int serverPort_)
+{
+  serverPort = serverPort_;
+  listenFd = _bind_loopback(SOCK_STREAM, listenPort);
+  if (listenFd < 0 || listen(listenFd, 1) < 0) {
+    perror("listening for the tunnel client");
+    return false;
+  }
+  for (int dir = 0; dir < 2; dir++) {
+    udpFds[dir] = _bind_loopback(SOCK_DGRAM, 0);
+    if (udpFds[dir] < 0)
+      return false;
+  }
+  return true;
+}
+
+bool LinkEmulator::connected()
+{
+  if (rewriting[TO_SERVER] || rewriting[TO_CLIENT] || handshake[TO_SERVER].empty())
+    return false;
+  if (udp)
+    return udpConnected[TO_SERVER] && udpConnected[TO_CLIENT];
+  return tcpFds[TO_SERVER] >= 0;
+}
+
+void LinkEmulator::closeTcp()
+{
+  for (int dir = 0; dir < 2; dir++) {
+    if (tcpFds[dir] >= 0)
+      close(tcpFds[dir]);
+    tcpFds[dir] = -1;
+  }
+}
+
+void LinkEmulator::acceptClient()
+{
+  int clientFd = accept(listenFd, NULL, NULL);
+  if (clientFd < 0)
+    return;
+  if (tcpFds[TO_CLIENT] >= 0 || !handshake[TO_SERVER].empty()) {
+    fprintf(stderr, "the link emulator only takes one client\n");
+    close(clientFd);
+    return;
+  }
+
+  //the server is started at the same time as the client, so it may take a
+  //little while to come up
+  int serverFd = -1;
+  for (int tries = 0; tries < 100; tries++) {
+    serverFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_connect_loopback(serverFd, serverPort) == 0)
+      break;
+    close(serverFd);
+    serverFd = -1;
+    usleep(50000);
+  }
+  if (serverFd < 0) {
+    perror("connecting to the tunnel server");
+    close(clientFd);
+    return;
+  }
+  tcpFds[TO_CLIENT] = clientFd;
+  tcpFds[TO_SERVER] = serverFd;
+  rewriting[TO_SERVER] = true;
+}
+
+//The first thing the client sends is its lcm_tunnel_params_t, and for UDP,
+//the server answers with one of its own.  Each has the UDP port its sender
+//wants datagrams on, which gets swapped for the emulator's socket facing
+//that end.  Returns false if the handshake doesn't make sense.
+bool LinkEmulator::rewriteHandshake(int dir, int64_t now)
+{
+  std::string &buf = handshake[dir];
+  if (buf.size() < 4)
+    return true;
+  uint32_t msg_sz_n;
+  memcpy(&msg_sz_n, buf.data(), 4);
+  uint32_t msg_sz = ntohl(msg_sz_n);
+  if (buf.size() < 4 + msg_sz)
+    return true;
+
+  lcm_tunnel_params_t params;
+  if (lcm_tunnel_params_t_decode(buf.data() + 4, 0, msg_sz, &params) != (int) msg_sz) {
+    fprintf(stderr, "couldn't decode the tunnel handshake\n");
+    return false;
+  }
+  //datagrams for the end that sent this go out of the socket facing it, and
+  //the other end is told to send to the socket facing that other end
+  int from = 1 - dir;
+  if (dir == TO_SERVER) {
+    udp = params.udp;
+    rewriting[TO_CLIENT] = udp; //the server only answers for UDP
+  }
+  if (udp) {
+    _connect_loopback(udpFds[from], params.udp_port);
+    udpConnected[from] = true;
+    params.udp_port = _local_port(udpFds[dir]);
+  }
+  std::string rest = buf.substr(4 + msg_sz);
+  buf.resize(4 + msg_sz);
+  lcm_tunnel_params_t_encode(&buf[4], 0, msg_sz, &params);
+  lcm_tunnel_params_t_decode_cleanup(&params);
+  if (_write_fully(tcpFds[dir], buf.data(), buf.size()) < 0)
+    return false;
+  rewriting[dir] = false;
+
+  //anything after the handshake goes over the link
+  if (!rest.empty())
+    tcpLinks[dir]->send(rest.data(), rest.size(), now);
+  return true;
+}
+
+void LinkEmulator::readTcp(int dir, int64_t now)
+{
+  char buf[LINK_TCP_READ_SIZE];
+  int n = read(tcpFds[1 - dir], buf, sizeof(buf));
+  if (n <= 0) {
+    //for UDP, both ends hang up once the handshake is done, and otherwise
+    //the tunnel is finished
+    closeTcp();
+    return;
+  }
+  if (rewriting[dir]) {
+    handshake[dir].append(buf, n);
+    if (!rewriteHandshake(dir, now))
+      closeTcp();
+    return;
+  }
+  tcpLinks[dir]->send(buf, n, now);
+}
+
+void LinkEmulator::readUdp(int dir, int64_t now)
+{
+  char buf[LINK_MAX_DATAGRAM];
+  int n = recv(udpFds[1 - dir], buf, sizeof(buf), 0);
+  if (n < 0)
+    return;
+  udpLinks[dir]->send(buf, n, now);
+}
+
+void LinkEmulator::deliver(int64_t now)
+{
+  std::string data;
+  for (int dir = 0; dir < 2; dir++) {
+    while (udpLinks[dir]->receive(now, data)) {
+      //the other end may not be listening yet, or any more
+      if (udpConnected[dir])
+        send(udpFds[dir], data.data(), data.size(), 0);
+    }
+    while (tcpLinks[dir]->receive(now, data)) {
+      if (tcpFds[dir] >= 0 && _write_fully(tcpFds[dir], data.data(), data.size()) < 0)
+        closeTcp();
+    }
+  }
+}
+
+void LinkEmulator::preparePoll(std::vector<struct pollfd> &fds, int64_t *timeout, int64_t now)
+{
+  polled.clear();
+  struct pollfd pfd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  if (listenFd >= 0) {
+    pfd.fd = listenFd;
+    fds.push_back(pfd);
+    polled.push_back(&listenFd);
+  }
+  for (int dir = 0; dir < 2; dir++) {
+    //hold off reading from TCP when the link is backed up, like a real one would
+    int64_t backlog = tcpLinks[dir]->backlog(now);
+    if (tcpFds[1 - dir] >= 0 && backlog <= tcpLinks[dir]->params.queueUsec) {
+      pfd.fd = tcpFds[1 - dir];
+      fds.push_back(pfd);
+      polled.push_back(&tcpFds[1 - dir]);
+    }
+    else if (tcpFds[1 - dir] >= 0) {
+      *timeout = MIN(*timeout, backlog - tcpLinks[dir]->params.queueUsec);
+    }
+    if (udpFds[1 - dir] >= 0) {
+      pfd.fd = udpFds[1 - dir];
+      fds.push_back(pfd);
+      polled.push_back(&udpFds[1 - dir]);
+    }
+
+    int64_t arrival = tcpLinks[dir]->nextArrival();
+    if (arrival >= 0)
+      *timeout = MIN(*timeout, MAX(0, arrival - now));
+    arrival = udpLinks[dir]->nextArrival();
+    if (arrival >= 0)
+      *timeout = MIN(*timeout, MAX(0, arrival - now));
+  }
+}
+
+void LinkEmulator::dispatch(const struct pollfd *fds, int64_t now)
+{
+  //work out which socket each of the fds was before anything gets closed
+  std::vector<int *> ready;
+  for (size_t i = 0; i < polled.size(); i++) {
+    if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+      ready.push_back(polled[i]);
+  }
+  for (size_t i = 0; i < ready.size(); i++) {
+    if (ready[i] == &listenFd)
+      acceptClient();
+    else if (ready[i] == &tcpFds[TO_CLIENT] && tcpFds[TO_CLIENT] >= 0)
+      readTcp(TO_SERVER, now);
+    else if (ready[i] == &tcpFds[TO_SERVER] && tcpFds[TO_SERVER] >= 0)
+      readTcp(TO_CLIENT, now);
+    else if (ready[i] == &udpFds[TO_CLIENT])
+      readUdp(TO_SERVER, now);
+    else if (ready[i] == &udpFds[TO_SERVER])
+      readUdp(TO_CLIENT, now);
+  }
+  deliver(now);
+}
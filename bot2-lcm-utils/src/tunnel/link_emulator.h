@@ -0,0 +1,132 @@
+#ifndef __link_emulator_h__
+#define __link_emulator_h__
+
+#include <inttypes.h>
+#include <poll.h>
+#include <glib.h>
+#include <string>
+#include <vector>
+#include <queue>
+
+#define LINK_MAX_DATAGRAM 65536
+#define LINK_TCP_READ_SIZE 65536 //the most of a TCP stream that goes on the link as one piece
+
+typedef struct {
+  double loss; //fraction of datagrams dropped
+  double burst; //mean length of a run of drops, 1 or less for independent drops
+  int64_t delay; //usec
+  int64_t jitter; //usec, added uniformly on top of the delay
+  double reorder; //fraction of datagrams held back by an extra reorderDelay
+  int64_t reorderDelay; //usec
+  int rate; //bytes per second, 0 for no cap
+  int64_t queueUsec; //how far behind the rate cap the link can get before it drops datagrams
+} link_params_t;
+
+// One direction of an emulated link.  Data goes in with send() and comes
+// out of receive() once it's through: after waiting its turn behind the
+// rate cap, then the delay and jitter, if it wasn't dropped on the way.
+//
+// A stream (TCP) link never drops or reorders, it makes the sender wait
+// instead, see backlog().
+class ImpairedLink {
+public:
+  ImpairedLink(const link_params_t *params, bool stream, GRand *rand);
+  ~ImpairedLink();
+
+  // returns false if the link drops it
+  bool send(const char *data, int len, int64_t now);
+
+  // when the next piece of data comes out of the link, -1 if there's nothing on it
+  int64_t nextArrival();
+  // gets the next piece of data that's through by now, if there is one
+  bool receive(int64_t now, std::string &data);
+
+  // how long until the rate cap lets something else on the link
+  int64_t backlog(int64_t now);
+  link_params_t params;
+
+  // in total
+  int64_t numSent;
+  int64_t numLost; //to the loss model
+  int64_t numOverflowed; //dropped because the link was too far behind the rate cap
+  int64_t numDelivered;
+  int64_t bytesDelivered;
+
+private:
+  bool stream;
+  GRand * rand;
+  bool bursting; //in a run of drops
+  int64_t linkFreeTime; //when the rate cap lets the next byte on
+  int64_t lastArrival;
+  int64_t seqno; //to keep things that arrive at the same time in order
+
+  typedef struct {
+    int64_t arrival;
+    int64_t seqno;
+    std::string * data;
+  } packet_t;
+  struct later_packet {
+    bool operator()(const packet_t &a, const packet_t &b) const
+    {
+      return a.arrival > b.arrival || (a.arrival == b.arrival && a.seqno > b.seqno);
+    }
+  };
+  std::priority_queue<packet_t, std::vector<packet_t>, later_packet> inFlight;
+
+  bool lose();
+};
+
+// Sits between a tunnel client and server on this machine, and carries the
+// TCP connection and the UDP datagrams between them over a pair of
+// ImpairedLinks, one per direction.  The client connects to the emulator
+// instead of the server.  For UDP tunnels, the emulator rewrites the ports
+// the two ends tell each other about during the handshake, so that the
+// datagrams come through it too.  The handshake itself isn't impaired.
+//
+// The emulator doesn't have a thread of its own, the caller polls on its
+// sockets along with whatever else it's waiting for.
+class LinkEmulator {
+public:
+  LinkEmulator(const link_params_t *params, GRand *rand);
+  ~LinkEmulator();
+
+  // listens for the client on listenPort, and connects it to the server
+  // on serverPort when it turns up
+  bool start(int listenPort, int serverPort);
+
+  // adds the sockets to wait on to fds, and lowers timeout (usec) to when
+  // something next needs doing
+  void preparePoll(std::vector<struct pollfd> &fds, int64_t *timeout, int64_t now);
+  // deals with what the poll turned up, from the fds that preparePoll added onwards
+  void dispatch(const struct pollfd *fds, int64_t now);
+
+  // whether the tunnel is up: the handshake is done, and the UDP ports are known
+  bool connected();
+  bool udp;
+
+  // client to server, and server to client
+  enum {
+    TO_SERVER = 0, TO_CLIENT = 1
+  };
+  ImpairedLink * tcpLinks[2];
+  ImpairedLink * udpLinks[2];
+
+private:
+  int listenFd;
+  int serverPort;
+  int tcpFds[2]; //to the server, and to the client
+  bool rewriting[2]; //still waiting for the handshake in this direction
+  std::string handshake[2];
+  int udpFds[2]; //facing the server, and facing the client
+  bool udpConnected[2];
+  std::vector<int *> polled; //what preparePoll asked about
+
+  void acceptClient();
+  void readTcp(int dir, int64_t now);
+  bool rewriteHandshake(int dir, int64_t now);
+  void readUdp(int dir, int64_t now);
+  void deliver(int64_t now);
+  void closeTcp();
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include <string.h>
+
+#include "lz_codec.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+//the format requires the last 5 bytes to be literals, and the last match to
+//start at least 12 bytes before the end
+#define LZ_LAST_LITERALS 5
+#define LZ_MF_LIMIT 12
+//after this many bytes without a match, start skipping ahead faster
+#define LZ_SKIP_TRIGGER 6
+
+static inline uint32_t _read32(const uint8_t *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t _hash(uint32_t v)
+{
+  return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+//writes the part of a length that didn't fit in its 4 bits of the token
+static inline uint8_t * _write_length(uint8_t *op, int len)
+{
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (uint8_t) len;
+  return op;
+}
+
+//reads the rest of a length whose 4 bits in the token were all set
+static inline int _read_length(const uint8_t **ip, const uint8_t *iend, int len, int maxLen)
+{
+  uint8_t b;
+  do {
+    if (*ip >= iend || len > maxLen)
+      return -1;
+    b = *(*ip)++;
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+int lz_compress(const uint8_t *src, int srcLen, uint8_t *dst, int dstCap)
+{
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src; //start of the literals not yet written out
+  const uint8_t *iend = src + srcLen;
+  const uint8_t *mflimit = iend - LZ_MF_LIMIT;
+  const uint8_t *matchlimit = iend - LZ_LAST_LITERALS;
+  uint8_t *op = dst;
+  uint8_t *oend = dst + dstCap;
+
+  //positions of recently seen 4 byte sequences, by hash
+  int32_t table[1 << LZ_HASH_BITS];
+  memset(table, 0xff, sizeof(table));
+
+  if (srcLen > LZ_MF_LIMIT) {
+    while (ip < mflimit) {
+      uint32_t seq = _read32(ip);
+      uint32_t h = _hash(seq);
+      int32_t ref = table[h];
+      table[h] = ip - src;
+      if (ref < 0 || (ip - src) - ref > LZ_MAX_OFFSET || _read32(src + ref) != seq) {
+        ip += 1 + ((ip - anchor) >> LZ_SKIP_TRIGGER);
+        continue;
+      }
+
+      //extend the match backwards into the pending literals, then forwards
+      const uint8_t *match = src + ref;
+      while (ip > anchor && match > src && ip[-1] == match[-1]) {
+        ip--;
+        match--;
+      }
+      const uint8_t *mend = ip + LZ_MIN_MATCH;
+      const uint8_t *mref = match + LZ_MIN_MATCH;
+      while (mend < matchlimit && *mend == *mref) {
+        mend++;
+        mref++;
+      }
+
+      int litLen = ip - anchor;
+      int matchLen = mend - ip - LZ_MIN_MATCH;
+      if (oend - op < 1 + litLen + litLen / 255 + 1 + 2 + matchLen / 255 + 1)
+        return 0;
+      uint8_t *token = op++;
+      *token = ((litLen < 15 ? litLen : 15) << 4) | (matchLen < 15 ? matchLen : 15);
+      if (litLen >= 15)
+        op = _write_length(op, litLen - 15);
+      memcpy(op, anchor, litLen);
+      op += litLen;
+      uint16_t offset = ip - match;
+      *op++ = offset & 0xff;
+      *op++ = offset >> 8;
+      if (matchLen >= 15)
+        op = _write_length(op, matchLen - 15);
+
+      ip = anchor = mend;
+      //remember a position inside the match too, it's cheap and helps the ratio
+      if (ip < mflimit)
+        table[_hash(_read32(ip - 2))] = ip - 2 - src;
+    }
+  }
+
+  //whatever is left goes out as literals
+  int litLen = iend - anchor;
+  if (oend - op < 1 + litLen + litLen / 255 + 1)
+    return 0;
+  *op++ = (litLen < 15 ? litLen : 15) << 4;
+  if (litLen >= 15)
+    op = _write_length(op, litLen - 15);
+  memcpy(op, anchor, litLen);
+  op += litLen;
+  return op - dst;
+}
+
+int lz_decompress(const uint8_t *src, int srcLen, uint8_t *dst, int dstLen)
+{
+  const uint8_t *ip = src;
+  const uint8_t *iend = src + srcLen;
+  uint8_t *op = dst;
+  uint8_t *oend = dst + dstLen;
+
+  while (ip < iend) {
+    int token = *ip++;
+
+    int litLen = token >> 4;
+    if (litLen == 15 && (litLen = _read_length(&ip, iend, litLen, srcLen)) < 0)
+      return -1;
+    if (litLen > iend - ip || litLen > oend - op)
+      return -1;
+    memcpy(op, ip, litLen);
+    op += litLen;
+    ip += litLen;
+    if (ip == iend)
+      break; //the last sequence has no match
+
+    if (iend - ip < 2)
+      return -1;
+    int offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > op - dst)
+      return -1;
+    int matchLen = token & 15;
+    if (matchLen == 15 && (matchLen = _read_length(&ip, iend, matchLen, dstLen)) < 0)
+      return -1;
+    matchLen += LZ_MIN_MATCH;
+    if (matchLen > oend - op)
+      return -1;
+
+    const uint8_t *match = op - offset;
+    if (offset >= matchLen) {
+      memcpy(op, match, matchLen);
+      op += matchLen;
+    }
+    else {
+      //the match overlaps what it's producing, e.g. a run of one byte
+      for (int i = 0; i < matchLen; i++)
+        *op++ = *match++;
+    }
+  }
+  return op - dst;
+}
@@ -0,0 +1,27 @@
+#ifndef __lz_codec_h__
+#define __lz_codec_h__
+
+#include <inttypes.h>
+
+// A small, fast LZ77 compressor for tunnel payloads.  It writes the LZ4
+// block format (a token byte holding the literal and match lengths, the
+// literals, then a 16 bit offset back into the output), so it trades some
+// ratio against zlib for running several times faster, which is what we
+// want for sensor data going out as fast as it comes in.
+
+// the most compressed output lz_compress() can produce for len bytes
+static inline int lz_compress_bound(int len)
+{
+  return len + len / 255 + 16;
+}
+
+// compresses src into dst, which has room for dstCap bytes.  Returns the
+// compressed size, or 0 if it didn't fit.
+int lz_compress(const uint8_t *src, int srcLen, uint8_t *dst, int dstCap);
+
+// decompresses src into dst, which has room for dstLen bytes.  Returns the
+// decompressed size, or -1 if src is corrupt or doesn't fit.  Safe to call
+// on anything that comes in off the network.
+int lz_decompress(const uint8_t *src, int srcLen, uint8_t *dst, int dstLen);
+
+#endif
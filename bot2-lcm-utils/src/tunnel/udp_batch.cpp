@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include "udp_batch.h"
+
+#define GSO_CMSG_SPACE CMSG_SPACE(sizeof(uint16_t))
+
+UdpSendBatch::UdpSendBatch(int fd_) :
+  datagramsSent(0), syscalls(0), fd(fd_), useGSO(false), numMsgs(0), numIov(0), numDatagrams(0)
+{
+#ifdef UDP_SEGMENT
+  //probe for kernel support, a segment size of 0 leaves the socket as it was
+  int gso_size = 0;
+  useGSO = setsockopt(fd, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size)) == 0;
+#endif
+  cmsgs = (uint8_t *) calloc(UDP_SEND_BATCH_SIZE, GSO_CMSG_SPACE);
+}
+
+UdpSendBatch::~UdpSendBatch()
+{
+  free(cmsgs);
+}
+
+int UdpSendBatch::add(const void *header, int headerSize, const struct iovec *payload, int payloadIovcnt)
+{
+  assert(headerSize <= UDP_BATCH_MAX_HEADER_SIZE);
+  assert(1 + payloadIovcnt <= IOV_MAX);
+
+  int ret = 0;
+  if (numDatagrams == UDP_SEND_BATCH_SIZE || numIov + 1 + payloadIovcnt > UDP_SEND_BATCH_IOV)
+    ret = flush();
+
+  int size = headerSize;
+  for (int i = 0; i < payloadIovcnt; i++)
+    size += payload[i].iov_len;
+
+  //can this go out as another segment of the previous datagram?
+  int e = numMsgs - 1;
+  bool extend = useGSO && e >= 0 && !closed[e] && segments[e] < UDP_MAX_GSO_SEGMENTS && size <= segmentSize[e]
+      && (segments[e] + 1) * segmentSize[e] <= UDP_MAX_GSO_BYTES
+      && msgs[e].msg_hdr.msg_iovlen + 1 + payloadIovcnt <= IOV_MAX;
+  if (!extend) {
+    e = numMsgs++;
+    memset(&msgs[e], 0, sizeof(msgs[e]));
+    msgs[e].msg_hdr.msg_iov = &iov[numIov];
+    segments[e] = 0;
+    segmentSize[e] = size;
+    closed[e] = false;
+  }
+
+  memcpy(headers[numDatagrams], header, headerSize);
+  iov[numIov].iov_base = headers[numDatagrams];
+  iov[numIov].iov_len = headerSize;
+  memcpy(&iov[numIov + 1], payload, payloadIovcnt * sizeof(struct iovec));
+  numIov += 1 + payloadIovcnt;
+  msgs[e].msg_hdr.msg_iovlen += 1 + payloadIovcnt;
+
+  segments[e]++;
+  if (size < segmentSize[e])
+    closed[e] = true;
+  numDatagrams++;
+  return ret;
+}
+
+int UdpSendBatch::flush()
+{
+  if (numMsgs == 0)
+    return 0;
+
+  for (int e = 0; e < numMsgs; e++) {
+    if (segments[e] < 2)
+      continue;
+#ifdef UDP_SEGMENT
+    struct msghdr *mh = &msgs[e].msg_hdr;
+    mh->msg_control = cmsgs + e * GSO_CMSG_SPACE;
+    mh->msg_controllen = GSO_CMSG_SPACE;
+    struct cmsghdr *cm = CMSG_FIRSTHDR(mh);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    uint16_t gso_size = segmentSize[e];
+    memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+#endif
+  }
+
+  int numFailed = 0;
+  int failedErrno = 0;
+  int sent = 0;
+  while (sent < numMsgs) {
+    int ret = sendmmsg(fd, msgs + sent, numMsgs - sent, 0);
+    syscalls++;
+    if (ret > 0) {
+      sent += ret;
+      continue;
+    }
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (segments[sent] > 1 && (errno == EIO || errno == EINVAL)) {
+      //the device can't segment for us, so stop trying and send the rest
+      //of this super-datagram one segment at a time
+      fprintf(stderr, "UDP segmentation offload unavailable, falling back to plain sendmmsg\n");
+      useGSO = false;
+      if (splitEntry(sent) == 0)
+        continue;
+    }
+    //skip the datagram the kernel choked on, and carry on with the rest
+    failedErrno = errno;
+    numFailed += segments[sent];
+    sent++;
+  }
+
+  datagramsSent += numDatagrams - numFailed;
+  numMsgs = 0;
+  numIov = 0;
+  numDatagrams = 0;
+  if (numFailed > 0)
+    errno = failedErrno;
+  return numFailed;
+}
+
+int UdpSendBatch::splitEntry(int e)
+{
+  //the segments of an entry are its iovecs cut every segmentSize bytes,
+  //which always falls between a payload and the next header
+  int numSegments = segments[e];
+  if (numMsgs + numSegments - 1 > UDP_SEND_BATCH_SIZE)
+    return -1;
+  memmove(&msgs[e + numSegments], &msgs[e + 1], (numMsgs - e - 1) * sizeof(msgs[0]));
+  memmove(&segments[e + numSegments], &segments[e + 1], (numMsgs - e - 1) * sizeof(segments[0]));
+  memmove(&segmentSize[e + numSegments], &segmentSize[e + 1], (numMsgs - e - 1) * sizeof(segmentSize[0]));
+  memmove(&closed[e + numSegments], &closed[e + 1], (numMsgs - e - 1) * sizeof(closed[0]));
+  numMsgs += numSegments - 1;
+
+  struct iovec *v = msgs[e].msg_hdr.msg_iov;
+  int iovRemaining = msgs[e].msg_hdr.msg_iovlen;
+  int size = segmentSize[e];
+  for (int s = 0; s < numSegments; s++) {
+    int n = 0;
+    int bytes = 0;
+    while (n < iovRemaining && bytes < size)
+      bytes += v[n++].iov_len;
+    struct mmsghdr *m = &msgs[e + s];
+    memset(m, 0, sizeof(*m));
+    m->msg_hdr.msg_iov = v;
+    m->msg_hdr.msg_iovlen = n;
+    segments[e + s] = 1;
+    segmentSize[e + s] = bytes;
+    closed[e + s] = false;
+    v += n;
+    iovRemaining -= n;
+  }
+  return 0;
+}
+
+UdpRecvRing::UdpRecvRing(int fd_) :
+  datagramsReceived(0), syscalls(0), fd(fd_)
+{
+  slots = (uint8_t *) malloc(UDP_RECV_BATCH_SIZE * UDP_RECV_SLOT_SIZE);
+  for (int i = 0; i < UDP_RECV_BATCH_SIZE; i++) {
+    iov[i].iov_base = slots + i * UDP_RECV_SLOT_SIZE;
+    iov[i].iov_len = UDP_RECV_SLOT_SIZE;
+  }
+}
+
+UdpRecvRing::~UdpRecvRing()
+{
+  free(slots);
+}
+
+int UdpRecvRing::receive()
+{
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < UDP_RECV_BATCH_SIZE; i++) {
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  int ret;
+  do {
+    ret = recvmmsg(fd, msgs, UDP_RECV_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    syscalls++;
+  } while (ret < 0 && errno == EINTR);
+  if (ret > 0)
+    datagramsReceived += ret;
+  return ret;
+}
@@ -0,0 +1,97 @@
+#ifndef __udp_batch_h__
+#define __udp_batch_h__
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define UDP_SEND_BATCH_SIZE 256 //max number of datagrams handed to the kernel per sendmmsg call
+#define UDP_SEND_BATCH_IOV 4096 //total number of iovecs (headers plus payload slices) a batch can reference
+#define UDP_BATCH_MAX_HEADER_SIZE 32
+
+#define UDP_MAX_GSO_SEGMENTS 62 //keeps a GSO send under the 64k limit on the size of a UDP datagram
+#define UDP_MAX_GSO_BYTES 65000
+
+#define UDP_RECV_BATCH_SIZE 64 //max number of datagrams read per recvmmsg call
+#define UDP_RECV_SLOT_SIZE 2048 //datagrams bigger than this are truncated
+
+
+// Collects outgoing datagrams on a connected UDP socket and sends them with
+// as few syscalls as possible: sendmmsg, and where the kernel supports it,
+// UDP generic segmentation offload so that runs of equal sized datagrams
+// go down as a single super-datagram.  Only the (small) headers are copied,
+// payloads are referenced and must stay valid until flush() returns.
+class UdpSendBatch {
+public:
+  UdpSendBatch(int fd);
+  ~UdpSendBatch();
+
+  // queue one datagram made up of header followed by the payload buffers.
+  // Flushes first if the batch is full; returns the result of that flush,
+  // or 0.
+  int add(const void *header, int headerSize, const struct iovec *payload, int payloadIovcnt);
+
+  // send everything queued.  Returns the number of datagrams that couldn't
+  // be sent, with errno set for the last failure.
+  int flush();
+
+  // totals, for the curious
+  int64_t datagramsSent;
+  int64_t syscalls;
+
+private:
+  int fd;
+  bool useGSO;
+
+  struct mmsghdr msgs[UDP_SEND_BATCH_SIZE];
+  int numMsgs;
+  // GSO bookkeeping for each entry in msgs
+  int segments[UDP_SEND_BATCH_SIZE];
+  int segmentSize[UDP_SEND_BATCH_SIZE];
+  bool closed[UDP_SEND_BATCH_SIZE]; //a short segment has to be the last one
+  uint8_t *cmsgs;
+
+  struct iovec iov[UDP_SEND_BATCH_IOV];
+  int numIov;
+  uint8_t headers[UDP_SEND_BATCH_SIZE][UDP_BATCH_MAX_HEADER_SIZE];
+  int numDatagrams;
+
+  int splitEntry(int e);
+};
+
+// A preallocated ring of receive slots that a UDP socket is drained into
+// with recvmmsg.
+class UdpRecvRing {
+public:
+  UdpRecvRing(int fd);
+  ~UdpRecvRing();
+
+  // reads whatever is waiting on the socket, without blocking.  Returns the
+  // number of datagrams read, or -1 on error.
+  int receive();
+
+  inline const uint8_t * data(int i)
+  {
+    return slots + i * UDP_RECV_SLOT_SIZE;
+  }
+  inline int size(int i)
+  {
+    return msgs[i].msg_len;
+  }
+  inline bool truncated(int i)
+  {
+    return (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+  }
+
+  int64_t datagramsReceived;
+  int64_t syscalls;
+
+private:
+  int fd;
+  uint8_t *slots;
+  struct mmsghdr msgs[UDP_RECV_BATCH_SIZE];
+  struct iovec iov[UDP_RECV_BATCH_SIZE];
+};
+
+#endif
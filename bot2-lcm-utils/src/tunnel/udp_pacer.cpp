@@ -0,0 +1,70 @@
+#include "udp_pacer.h"
+
+UdpPacer::UdpPacer(int maxRate_) :
+  loss(0), rtt(-1), minRtt(-1), tokens(0), lastReserveTime(-1), lastDecreaseTime(0), rttWindowStart(0),
+      windowMinRtt(-1), prevWindowMinRtt(-1)
+{
+  if (maxRate_ > 0) {
+    maxRate = maxRate_;
+    rate = maxRate_;
+    slowStart = false;
+  }
+  else {
+    maxRate = PACER_MAX_RATE;
+    rate = PACER_INITIAL_RATE;
+    slowStart = true;
+  }
+}
+
+int64_t UdpPacer::reserve(int bytes, int64_t now)
+{
+  int r = getRate();
+  double burst = MAX(PACER_MIN_BURST, (double) r * PACER_BURST_USEC * 1e-6);
+  if (lastReserveTime < 0)
+    tokens = burst;
+  else
+    tokens = MIN(burst, tokens + (now - lastReserveTime) * 1e-6 * r);
+  lastReserveTime = now;
+
+  //go into debt, and wait until it's paid off
+  tokens -= bytes;
+  if (tokens >= 0)
+    return 0;
+  return (int64_t) (-tokens * 1e6 / r);
+}
+
+void UdpPacer::onReport(double loss_, int64_t rtt_, double deliveredRate, int64_t now)
+{
+  loss = loss_;
+  rtt = rtt_;
+  if (rtt >= 0) {
+    if (now - rttWindowStart > PACER_RTT_WINDOW_USEC) {
+      prevWindowMinRtt = windowMinRtt;
+      windowMinRtt = -1;
+      rttWindowStart = now;
+    }
+    if (windowMinRtt < 0 || rtt < windowMinRtt)
+      windowMinRtt = rtt;
+    minRtt = prevWindowMinRtt >= 0 ? MIN(windowMinRtt, prevWindowMinRtt) : windowMinRtt;
+  }
+
+  bool congested = loss > PACER_MAX_LOSS || (rtt >= 0 && rtt > minRtt * PACER_MAX_RTT_GROWTH
+      + PACER_RTT_SLACK_USEC);
+  double r = getRate();
+  if (congested) {
+    //back off at most once per round trip, to below what actually got through
+    if (now - lastDecreaseTime > MAX(rtt, 0)) {
+      if (deliveredRate > 0)
+        r = MIN(r, deliveredRate);
+      r *= PACER_BACKOFF;
+      lastDecreaseTime = now;
+    }
+    slowStart = false;
+  }
+  else if (deliveredRate >= 0.8 * r) {
+    //only grow when we're actually using the rate we have
+    r *= slowStart ? 1.25 : 1.05;
+  }
+  r = CLAMP(r, PACER_MIN_RATE, maxRate);
+  g_atomic_int_set(&rate, (gint) r);
+}
@@ -0,0 +1,70 @@
+#ifndef __udp_pacer_h__
+#define __udp_pacer_h__
+
+#include <inttypes.h>
+#include <glib.h>
+
+#define PACER_INITIAL_RATE 65536 //bytes per second to start from when estimating the link rate
+#define PACER_MIN_RATE 8192
+#define PACER_MAX_RATE 125000000 //a gigabit, the ceiling when estimating
+#define PACER_BURST_USEC 2000 //how far ahead of the rate a burst may get
+#define PACER_MIN_BURST 4096
+
+ //the link counts as congested when more than this fraction of datagrams
+ //are lost, or the round trip time grows this far past its recent minimum
+#define PACER_MAX_LOSS 0.1
+#define PACER_MAX_RTT_GROWTH 2.0
+#define PACER_RTT_SLACK_USEC 20000
+#define PACER_RTT_WINDOW_USEC 10000000 //the minimum round trip time is taken over about this long
+#define PACER_BACKOFF 0.85
+
+
+// Spaces out the datagrams sent on a UDP tunnel so that they leave at the
+// link rate, rather than in bursts that overflow the buffer of a slow
+// radio.  The rate is either configured, in which case it's a ceiling that
+// the pacer backs off from when the link gets congested, or estimated from
+// scratch.  Either way it follows the loss and round trip times that the
+// other end reports: multiplicative decrease when congested, and growth
+// when the rate is being used and the link is keeping up.
+//
+// reserve() is for the send thread, onReport() for the main thread.
+class UdpPacer {
+public:
+  // maxRate in bytes per second, or -1 to estimate the rate
+  UdpPacer(int maxRate);
+
+  // takes bytes worth of tokens out of the bucket, and returns how long to
+  // wait before sending them, in usec
+  int64_t reserve(int bytes, int64_t now);
+
+  // loss is the fraction of datagrams lost, rtt is -1 if unknown, and
+  // deliveredRate (bytes per second) is -1 if unknown
+  void onReport(double loss, int64_t rtt, double deliveredRate, int64_t now);
+
+  inline int getRate()
+  {
+    return g_atomic_int_get(&rate);
+  }
+
+  // what the last report said, for the curious
+  double loss;
+  int64_t rtt;
+  int64_t minRtt;
+
+private:
+  volatile gint rate; //bytes per second
+
+  //only touched by the send thread
+  double tokens;
+  int64_t lastReserveTime;
+
+  //only touched by the main thread
+  int maxRate;
+  bool slowStart; //grow fast until the first sign of congestion
+  int64_t lastDecreaseTime;
+  int64_t rttWindowStart;
+  int64_t windowMinRtt; //minimum rtt since rttWindowStart
+  int64_t prevWindowMinRtt; //and over the window before that
+};
+
+#endif
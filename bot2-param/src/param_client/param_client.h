@@ -20,6 +20,18 @@ extern "C" {
 #endif
 
 typedef struct _BotParam BotParam;
+typedef struct _BotParamHandle BotParamHandle;
+
+/**
+ * BotParamHandleType:
+ *
+ * The type of the value read through a %BotParamHandle.
+ */
+typedef enum {
+  BOT_PARAM_HANDLE_INT,
+  BOT_PARAM_HANDLE_BOOLEAN,
+  BOT_PARAM_HANDLE_DOUBLE
+} BotParamHandleType;
 
 /**
  * bot_param_new_from_server:
@@ -82,6 +94,40 @@ typedef void(bot_param_update_handler_t)(BotParam * old_param,BotParam * new_par
 void bot_param_add_update_subscriber(BotParam *param,
     bot_param_update_handler_t * callback_func, void * user);
 
+/**
+ * bot_param_prefix_handler_t
+ *
+ * Handler function template for a bot_param_subscribe_prefix callback
+ *
+ * param: The BotParam structure, which already holds the new values
+ * keys: The full keys that were added, removed or changed
+ * num_keys: The number of keys
+ * user: user data that was passed to bot_param_subscribe_prefix
+ */
+typedef void(bot_param_prefix_handler_t)(BotParam * param, const char ** keys, int num_keys, int64_t utime,
+    void *user);
+
+/**
+ * bot_param_subscribe_prefix
+ *
+ * add a callback handler to get called when keys under a prefix are updated
+ *
+ * Each update from the server is compared with the current params once, and
+ * the callback gets the changed keys that are equal to @prefix or lie
+ * beneath it (e.g. "controller.gains" matches "controller.gains.kp" but
+ * not "controller.gains_scale").  It is not called if none of them changed.
+ * Neither these callbacks nor those added with
+ * bot_param_add_update_subscriber are called for an update that changes
+ * nothing.
+ *
+ * param: the BotParam structure that should have updates
+ * prefix: the key prefix to watch, or "" for all keys
+ * callback_func: function to call with the changed keys
+ * user: user data to be passed to the function
+ */
+void bot_param_subscribe_prefix(BotParam * param, const char * prefix,
+    bot_param_prefix_handler_t * callback_func, void * user);
+
 
 /**
  * bot_param_new_from_file:
@@ -124,6 +170,37 @@ bot_param_new_from_file (const char * filename);
 BotParam *
 bot_param_new_from_string (const char * string, int length);
 
+/**
+ * bot_param_new_from_binary:
+ * @param filename The name of a snapshot written by bot_param_write_binary().
+ *
+ * Maps the snapshot into memory and uses it in place.  Keys and values are
+ * not copied, values are already cast to the numeric types, and lookups of
+ * full keys use the snapshot's sorted index, so this is much cheaper than
+ * parsing the original config.
+ *
+ * Snapshots are not portable between hosts of different byte order.
+ *
+ * @return A handle to a newly-allocated %BotParam or %NULL if the file is
+ * not a valid snapshot.
+ */
+BotParam *
+bot_param_new_from_binary (const char * filename);
+
+/**
+ * bot_param_new_from_binary_buffer:
+ * @param buf    A snapshot written by bot_param_write_binary().
+ * @param length The length of the snapshot in bytes.
+ *
+ * Like bot_param_new_from_binary(), but for a snapshot in memory.  The
+ * snapshot is copied, so @buf can be freed afterwards.
+ *
+ * @return A handle to a newly-allocated %BotParam or %NULL if the buffer is
+ * not a valid snapshot.
+ */
+BotParam *
+bot_param_new_from_binary_buffer (const void * buf, int length);
+
 /**
  * bot_param_alloc:
  *
@@ -169,6 +246,19 @@ bot_param_write (BotParam * param, FILE * f);
 int
 bot_param_write_to_string (BotParam * param, char ** s);
 
+/**
+ * bot_param_write_binary:
+ * @param param The configuration to write.
+ * @param f     File handle to write to.
+ *
+ * Writes a binary snapshot of the configuration that can be loaded with
+ * bot_param_new_from_binary().
+ *
+ * return -1 on error, 0 on success.
+ */
+int
+bot_param_write_binary (BotParam * param, FILE * f);
+
 /**
  * bot_param_print:
  * @param param The configuration to print.
@@ -446,6 +536,62 @@ bot_param_get_str_array_alloc (BotParam * param, const char * key);
  */
 void bot_param_str_array_free ( char **data);
 
+/**
+ * bot_param_get_handle:
+ * @param param The configuration.
+ * @param key   The key to look for a value.
+ * @param type  The type to cast the value to.
+ *
+ * Looks up @key and casts its value once, for code that reads the same
+ * key over and over (e.g. a gain in a control loop).  Reading the value
+ * through the handle is a version check and a load.  When the tree changes,
+ * because of an update from the server or a call to one of the set
+ * functions, the next read looks the key up again.  If the key is gone or
+ * no longer casts to @type, the handle keeps its previous value.
+ *
+ * A handle may only be read from one thread at a time, and must be
+ * destroyed before @param.
+ *
+ * @return A handle to free with bot_param_handle_destroy(), or %NULL if
+ * the key does not exist or its value does not cast to @type.
+ */
+BotParamHandle *
+bot_param_get_handle (BotParam * param, const char * key, BotParamHandleType type);
+
+/**
+ * bot_param_handle_destroy:
+ * @param h The handle to free.
+ */
+void
+bot_param_handle_destroy (BotParamHandle * h);
+
+/**
+ * bot_param_handle_get_int:
+ * @param h A handle created with type %BOT_PARAM_HANDLE_INT.
+ *
+ * @return The current value of the handle's key.
+ */
+int
+bot_param_handle_get_int (BotParamHandle * h);
+
+/**
+ * bot_param_handle_get_boolean:
+ * @param h A handle created with type %BOT_PARAM_HANDLE_BOOLEAN.
+ *
+ * @return The current value of the handle's key.
+ */
+int
+bot_param_handle_get_boolean (BotParamHandle * h);
+
+/**
+ * bot_param_handle_get_double:
+ * @param h A handle created with type %BOT_PARAM_HANDLE_DOUBLE.
+ *
+ * @return The current value of the handle's key.
+ */
+double
+bot_param_handle_get_double (BotParamHandle * h);
+
 
 /**
  * bot_param_get_global:
@@ -4,6 +4,11 @@
  * are nested within higher level structures denoted by { or }.  Every
  * token is an array of strings, with simplified syntax for arrays of length
  * one.
+ *
+ * The whole input (a memory-mapped file or a caller's string) is tokenized
+ * in a single pass, and the parse tree is carved out of an arena owned by
+ * the BotParam, so that loading a large config does not cost one malloc per
+ * element and per value.
  */
 
 #include <stdio.h>
@@ -13,51 +18,71 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <bot_core/lcm_util.h>
 #include "param_client.h"
 #include "param_internal.h"
 #include "misc_utils.h"
 #include <lcmtypes/bot2_param.h>
 #include <glib.h>
+#include <zlib.h>
 
 #define err(args...) fprintf(stderr, args)
 
 #define MAX_REFERENCES ((1LL << 60))
 
+#define ARENA_MIN_CHUNK_SIZE 4096
+#define ARENA_MAX_CHUNK_SIZE (1 << 20)
+
 typedef struct _Parser Parser;
-typedef struct _ParserFile ParserFile;
-typedef struct _ParserString ParserString;
 typedef struct _BotParamElement BotParamElement;
-
-typedef int (*GetChFunc)(Parser *);
-
-typedef enum {
-  ParserTypeFile, ParserTypeString
-} ParserType;
-
-struct _Parser {
-  ParserType type;
-  GetChFunc get_ch;
-  int extra_ch;
+typedef struct _BotParamArena BotParamArena;
+typedef struct _BotParamArenaChunk BotParamArenaChunk;
+typedef struct _BotParamBinaryHeader BotParamBinaryHeader;
+typedef struct _BotParamBinaryElement BotParamBinaryElement;
+typedef struct _BotParamBinaryValue BotParamBinaryValue;
+typedef struct _BotParamBinaryIndexEntry BotParamBinaryIndexEntry;
+
+/* Character classes used by the tokenizer.  These replace the ctype calls
+ * (and their locale lookups) on every input byte. */
+#define CH_PRINT 0x01  /* printable (isprint in the C locale) */
+#define CH_SPACE 0x02  /* whitespace, converted to a plain space */
+#define CH_IDENT 0x04  /* may appear in an identifier */
+
+static const unsigned char char_class[256] = {
+  ['\t'] = CH_SPACE, ['\n'] = CH_SPACE, ['\v'] = CH_SPACE,
+  ['\f'] = CH_SPACE, ['\r'] = CH_SPACE,
+  [' '] = CH_PRINT | CH_SPACE,
+  ['!' ... '~'] = CH_PRINT,
+  ['0' ... '9'] = CH_PRINT | CH_IDENT,
+  ['A' ... 'Z'] = CH_PRINT | CH_IDENT,
+  ['a' ... 'z'] = CH_PRINT | CH_IDENT,
+  ['_'] = CH_PRINT | CH_IDENT,
+  ['-'] = CH_PRINT | CH_IDENT,
+  ['.'] = CH_PRINT | CH_IDENT,
+  ['+'] = CH_PRINT | CH_IDENT,
 };
 
-struct _ParserFile {
-  Parser p;
-  const char * filename;
-  FILE * file;
+struct _Parser {
+  const char * filename; /* NULL when parsing a string buffer */
+  const char * pos;
+  const char * end;
   int row;
-  int col;
-  int in_comment;
-};
 
-struct _ParserString {
-  Parser p;
-  const char * string;
-  int length;
-  int ind;
-  int row;
-  int col;
-  int in_comment;
+  BotParamArena * arena;
+
+  /* scratch space for quoted tokens that need whitespace or comments
+   * stripped before they can be stored */
+  char * scratch;
+  int scratch_size;
+
+  /* values of the assignment currently being parsed */
+  const char ** vals;
+  int vals_size;
 };
 
 typedef enum {
@@ -90,18 +115,115 @@ struct _BotParamElement {
   char * name;
   BotParamElement * next;
   BotParamElement * children;
+  BotParamElement * last_child;
   int num_values;
   char ** values;
+  /* values[0] when it was assigned by bot_param_set_*; malloc'd rather
+   * than taken from the arena, so that it can be freed when replaced */
+  char * set_value;
+  /* pre-cast values, only set for trees loaded from a binary snapshot */
+  const BotParamBinaryValue * typed_values;
+};
+
+struct _BotParamArenaChunk {
+  BotParamArenaChunk * next;
+  size_t size;
+};
+
+/* Bump allocator backing every element, name and value of a parse tree.
+ * Nothing is freed individually; the whole arena goes away with the tree. */
+struct _BotParamArena {
+  BotParamArenaChunk * chunks;
+  char * ptr;
+  size_t remaining;
+  size_t chunk_size;
+};
+
+/* Binary snapshot layout (see bot_param_write_binary).
+ *
+ * A snapshot is a header followed by four sections, each aligned to 8 bytes
+ * and located by its offset from the start of the snapshot: the elements of
+ * the tree in depth-first order (root first), the values of all arrays, an
+ * index of full key names sorted with strcmp, and a table of NUL-terminated
+ * strings.  All references are indices or string table offsets, so a
+ * snapshot can be mapped and used in place.  Numbers are stored in host
+ * byte order; endian_check rejects snapshots from the other kind of host.
+ */
+#define BOT_PARAM_BINARY_MAGIC "BOTPARAM"
+#define BOT_PARAM_BINARY_VERSION 1
+#define BOT_PARAM_BINARY_ENDIAN_CHECK 0x01020304
+#define BOT_PARAM_BINARY_NONE 0xffffffff
+
+#define BOT_PARAM_BINARY_IS_INT     0x01
+#define BOT_PARAM_BINARY_IS_BOOL    0x02
+#define BOT_PARAM_BINARY_IS_DOUBLE  0x04
+
+struct _BotParamBinaryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian_check;
+  uint32_t total_size;
+  uint32_t num_elements;
+  uint32_t num_values;
+  uint32_t num_index_entries;
+  uint32_t elements_offset;
+  uint32_t values_offset;
+  uint32_t index_offset;
+  uint32_t strings_offset;
+  uint32_t strings_size;
+  uint32_t reserved;
+};
+
+struct _BotParamBinaryElement {
+  uint32_t type;
+  uint32_t parent;      /* element index, NONE for the root */
+  uint32_t name;        /* string offset, NONE for the root */
+  uint32_t num_values;
+  uint32_t first_value; /* value index */
+  uint32_t reserved;
+};
+
+struct _BotParamBinaryValue {
+  double double_val;
+  int32_t int_val;
+  int32_t bool_val;
+  uint32_t str;         /* string offset */
+  uint32_t flags;       /* which of the casts succeeded */
+};
+
+struct _BotParamBinaryIndexEntry {
+  uint32_t key;         /* string offset of the full key */
+  uint32_t element;     /* element index */
 };
 
 struct _BotParam {
   BotParamElement * root;
+  BotParamArena * arena;
+  /* binary snapshot backing the tree, if it was loaded from one */
+  void * image;
+  size_t image_size;
+  int image_mapped;
+  BotParamElement * image_elements;
   GMutex * lock;
   int64_t server_id;
   int64_t sequence_number;
+  /* bumped whenever the tree changes, so that handles know to refresh */
+  volatile gint version;
 
   GList * update_callbacks;
+  GList * prefix_callbacks;
+
+};
 
+struct _BotParamHandle {
+  BotParam * param;
+  char * key;
+  BotParamHandleType type;
+  gint version;
+  union {
+    int int_val;
+    double double_val;
+  } val;
 };
 
 typedef struct {
@@ -109,73 +231,127 @@ typedef struct {
   void * user;
 } update_handler_t;
 
+typedef struct {
+  char * prefix;
+  bot_param_prefix_handler_t * callback_func;
+  void * user;
+} prefix_handler_t;
+
 
 static BotParamElement *
 find_key(BotParamElement * el, const char * key, int inherit);
 
+static BotParam *
+_new_from_image(void * image, size_t size, int mapped);
+
+static void
+_unmap_file(char * buf, size_t length, int mapped);
+
+static BotParamArena *
+arena_new(size_t size_hint)
+{
+  BotParamArena * arena = calloc(1, sizeof(BotParamArena));
+  arena->chunk_size = MAX(size_hint, ARENA_MIN_CHUNK_SIZE);
+  return arena;
+}
+
+static void
+arena_destroy(BotParamArena * arena)
+{
+  BotParamArenaChunk * chunk, *next;
+  for (chunk = arena->chunks; chunk; chunk = next) {
+    next = chunk->next;
+    free(chunk);
+  }
+  free(arena);
+}
+
+static void *
+arena_alloc(BotParamArena * arena, size_t size)
+{
+  size = (size + 7) & ~((size_t) 7);
+  if (size > arena->remaining) {
+    size_t chunk_size = MAX(arena->chunk_size, size);
+    BotParamArenaChunk * chunk = malloc(sizeof(BotParamArenaChunk) + chunk_size);
+    if (!chunk)
+      return NULL;
+    chunk->size = chunk_size;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->ptr = (char *) (chunk + 1);
+    arena->remaining = chunk_size;
+    /* grow geometrically, up to a point, so that a large parse doesn't cost
+     * many small chunks */
+    if (arena->chunk_size < ARENA_MAX_CHUNK_SIZE)
+      arena->chunk_size *= 2;
+  }
+  void * ret = arena->ptr;
+  arena->ptr += size;
+  arena->remaining -= size;
+  return ret;
+}
+
+static char *
+arena_strndup(BotParamArena * arena, const char * str, size_t len)
+{
+  char * ret = arena_alloc(arena, len + 1);
+  if (!ret)
+    return NULL;
+  memcpy(ret, str, len);
+  ret[len] = '\0';
+  return ret;
+}
+
 /* Prints an error message, preceeded by useful context information from the
  * parser (i.e. line number). */
 static int print_msg(Parser * p, char * format, ...)
 {
   va_list args;
-  if (p->type == ParserTypeFile) {
-    ParserFile * pf = (ParserFile *) p;
-    const char * fname = strrchr(pf->filename, '/');
+  if (p->filename) {
+    const char * fname = strrchr(p->filename, '/');
     if (fname)
       fname++;
     else
-      fname = pf->filename;
-    fprintf(stderr, "%s:%d ", fname, pf->row + 1);
-    va_start (args, format);
-    vfprintf(stderr, format, args);
-    va_end (args);
-    return 0;
+      fname = p->filename;
+    fprintf(stderr, "%s:%d ", fname, p->row + 1);
   }
-  else if (p->type == ParserTypeFile) {
-    ParserString * ps = (ParserString *) p;
-    fprintf(stderr, "%s:%d ", "STRING_BUFFER", ps->row + 1);
-    va_start (args, format);
-    vfprintf(stderr, format, args);
-    va_end (args);
-    return 0;
+  else {
+    fprintf(stderr, "%s:%d ", "STRING_BUFFER", p->row + 1);
   }
-  return -1;
+  va_start (args, format);
+  vfprintf(stderr, format, args);
+  va_end (args);
+  return 0;
 }
 
-/* Get the next character from a file, while converting all forms of
- * whitespace into plain spaces and stripping comments.
+/* Get the next character from the buffer, while converting all forms of
+ * whitespace into plain spaces and stripping comments.  Only used for the
+ * uncommon parts of the input (quoted tokens spanning comments, newlines or
+ * tabs); everything else is scanned directly by get_token.
  *
- * Returns the next printable character on success, 0 on EOF, -1 on
- * error.
+ * Returns the next printable character on success, 0 at the end of the
+ * buffer, -1 on error (including a NUL inside it).
  */
-static int get_ch_file(Parser * p)
+static int get_ch(Parser * p)
 {
-  ParserFile * pf = (ParserFile *) p;
-  int ch;
-
-  /* If a character has been put back with unget_ch, get it. */
-  if (p->extra_ch) {
-    ch = p->extra_ch;
-    p->extra_ch = 0;
-    return ch;
-  }
-
-  while ((ch = getc (pf->file)) != EOF) {
+  while (p->pos < p->end) {
+    unsigned char ch = *p->pos++;
     if (ch == '\n') {
-      pf->row++;
-      pf->col = 0;
-      pf->in_comment = 0;
+      p->row++;
       return ' ';
     }
-    if (ch == '#')
-      pf->in_comment = 1;
-    if (pf->in_comment)
+    if (ch == '#') {
+      while (p->pos < p->end && *p->pos != '\n')
+        p->pos++;
       continue;
-
-    pf->col++;
-    if (isspace (ch))
+    }
+    if (ch == '\0') {
+      print_msg(p, "Error: NUL character before the end of the input\n");
+      return -1;
+    }
+    if (char_class[ch] & CH_SPACE)
       return ' ';
-    if (!isprint (ch)) {
+    if (!(char_class[ch] & CH_PRINT)) {
       print_msg(p, "Error: Non-printable character 0x%02x\n", ch);
       return -1;
     }
@@ -184,215 +360,209 @@ static int get_ch_file(Parser * p)
   return 0;
 }
 
-/* Get the next character from the string buffer, while converting all forms of
- * whitespace into plain spaces and stripping comments.
+/* Skips whitespace and comments in front of the next token.
  *
- * Returns the next printable character on success, 0 on EOF, -1 on
- * error.
+ * Returns the first character of the token without consuming it, 0 at the
+ * end of the buffer, -1 on error (including a NUL inside it).
  */
-static int get_ch_string(Parser * p)
+static int skip_space(Parser * p)
 {
-  ParserString * ps = (ParserString *) p;
-  int ch;
-
-  /* If a character has been put back with unget_ch, get it. */
-  if (p->extra_ch) {
-    ch = p->extra_ch;
-    p->extra_ch = 0;
-    return ch;
-  }
-
-  while (ps->ind < ps->length) {
-    ch = ps->string[ps->ind++];
-    if (ch == '\n') {
-      ps->row++;
-      ps->col = 0;
-      ps->in_comment = 0;
-      return ' ';
+  while (p->pos < p->end) {
+    unsigned char ch = *p->pos;
+    if (ch == ' ' || ch == '\t' || ch == '\r') {
+      p->pos++;
     }
-    if (ch == '#')
-      ps->in_comment = 1;
-    if (ps->in_comment)
-      continue;
-
-    ps->col++;
-    if (isspace (ch))
-      return ' ';
-    if (!isprint (ch)) {
+    else if (ch == '\n') {
+      p->row++;
+      p->pos++;
+    }
+    else if (ch == '#') {
+      while (p->pos < p->end && *p->pos != '\n')
+        p->pos++;
+    }
+    else if (ch == '\0') {
+      print_msg(p, "Error: NUL character before the end of the input\n");
+      return -1;
+    }
+    else if (char_class[ch] & CH_SPACE) {
+      p->pos++;
+    }
+    else if (!(char_class[ch] & CH_PRINT)) {
       print_msg(p, "Error: Non-printable character 0x%02x\n", ch);
       return -1;
     }
-    return ch;
+    else {
+      return ch;
+    }
   }
   return 0;
 }
 
-/* Returns a previously gotten character to the buffer, so it will be gotten
- * next.  This function cannot be used more than once before getting the
- * next character. */
-static int unget_ch(Parser * p, int ch)
+/* Reads the remainder of a string or cast, up to the unescaped end_ch.
+ *
+ * Most quoted tokens are plain printable text, in which case the token
+ * simply points into the input.  If the token contains anything that
+ * get_ch would rewrite, it is assembled in the parser's scratch buffer
+ * instead.
+ */
+static int get_quoted(Parser * p, int end_ch, int escape, const char ** str, int * len)
 {
-  p->extra_ch = ch;
+  const char * start = p->pos;
+  const char * s = start;
+  int prev_ch = 0;
+
+  while (s < p->end) {
+    unsigned char ch = *s;
+    if (ch == '#' || (ch != ' ' && (char_class[ch] & CH_SPACE)) || !(char_class[ch] & CH_PRINT))
+      break;
+    if (ch == end_ch && prev_ch != escape) {
+      *str = start;
+      *len = s - start;
+      p->pos = s + 1;
+      return 0;
+    }
+    prev_ch = ch;
+    s++;
+  }
+
+  /* slow path: copy what has been scanned so far, then continue one
+   * character at a time */
+  int c = s - start;
+  if (c + 1 >= p->scratch_size) {
+    p->scratch_size = MAX(2 * p->scratch_size, c + 256);
+    p->scratch = realloc(p->scratch, p->scratch_size);
+  }
+  memcpy(p->scratch, start, c);
+  p->pos = s;
+  while (1) {
+    int ch = get_ch(p);
+    if (ch == -1)
+      return -1;
+    if (ch == 0) {
+      print_msg(p, "Error: Expected '%c' but got end-of-file\n", end_ch);
+      return -1;
+    }
+    if (ch == end_ch && prev_ch != escape)
+      break;
+    prev_ch = ch;
+    if (c + 1 >= p->scratch_size) {
+      p->scratch_size *= 2;
+      p->scratch = realloc(p->scratch, p->scratch_size);
+    }
+    p->scratch[c++] = ch;
+  }
+  *str = p->scratch;
+  *len = c;
   return 0;
 }
 
 /* Get the next token from the parser.  All information about what constitutes
  * a token is expressed in this function.
  *
- * The type of token is stored in tok.  The actual text of the token is stored
- * in str, a buffer of length len passed by the caller.
+ * The type of token is stored in tok.  The text of the token is returned in
+ * str and len; it is not NUL-terminated, and it only stays valid until the
+ * next call.
  */
-static int get_token(Parser * p, BotParamToken * tok, char * str, int len)
+static int get_token(Parser * p, BotParamToken * tok, const char ** str, int * len)
 {
-  int ch, end_ch = 0, c = 0, escape = 0;
   *tok = TokInvalid;
 
-  /* Skip whitespace (all whitespace converted to ' ' already) */
-  while ((ch = p->get_ch(p)) == ' ')
-    ;
-
+  int ch = skip_space(p);
   if (ch == -1)
     return -1;
 
-  if (len < 4) {
-    fprintf(stderr, "Error: not enough space to store token\n");
-    return -1;
-  }
-
   if (ch == 0) {
-    snprintf(str, len, "EOF");
+    *str = "EOF";
+    *len = 3;
     *tok = TokEOF;
     return 0;
   }
 
-  str[c++] = ch;
-  if (ch == ';') {
+  *str = p->pos;
+  *len = 1;
+  switch (ch) {
+  case ';':
     *tok = TokEndStatement;
-    goto finish;
-  }
-  if (ch == '=') {
+    break;
+  case '=':
     *tok = TokAssign;
-    goto finish;
-  }
-  if (ch == '[') {
+    break;
+  case '[':
     *tok = TokOpenArray;
-    goto finish;
-  }
-  if (ch == ']') {
+    break;
+  case ']':
     *tok = TokCloseArray;
-    goto finish;
-  }
-  if (ch == '{') {
+    break;
+  case '{':
     *tok = TokOpenStruct;
-    goto finish;
-  }
-  if (ch == '}') {
+    break;
+  case '}':
     *tok = TokCloseStruct;
-    goto finish;
-  }
-  if (ch == ',') {
+    break;
+  case ',':
     *tok = TokArraySep;
-    goto finish;
-  }
-
+    break;
   /* A string always starts with a double quote */
-  if (ch == '\"') {
-    c--;
+  case '\"':
+    p->pos++;
     *tok = TokString;
-    end_ch = '\"';
-    escape = '\\';
-  }
+    return get_quoted(p, '\"', '\\', str, len);
   /* A cast always starts with an open paren.
    * TODO: this will need to be tokenized further once the cast is actually
    * used for something. */
-  if (ch == '(') {
-    c--;
+  case '(':
+    p->pos++;
     *tok = TokCast;
-    end_ch = ')';
-    escape = 0;
-  }
-  /* An identifier starts with alpha-numeric text or a few symbols */
-  if (isalnum (ch) || ch == '_' || ch == '-' || ch == '.' || ch == '+') {
-    *tok = TokIdentifier;
-    end_ch = 0;
-    escape = 0;
-  }
-
-  if (*tok == TokInvalid) {
+    return get_quoted(p, ')', 0, str, len);
+  default:
+    /* An identifier starts with alpha-numeric text or a few symbols, and is
+     * terminated as soon as we see a character which itself cannot be part
+     * of an identifier. */
+    if (char_class[ch] & CH_IDENT) {
+      const char * s = p->pos + 1;
+      while (s < p->end && (char_class[(unsigned char) *s] & CH_IDENT))
+        s++;
+      *tok = TokIdentifier;
+      *len = s - p->pos;
+      p->pos = s;
+      return 0;
+    }
     print_msg(p, "Error: Unexpected character \"%c\"\n", ch);
     return -1;
   }
 
-  /* Read the remaining text of a string, cast, or identifier */
-  int prev_ch = 0;
-  while (1) {
-    ch = p->get_ch(p);
-    /* An identifier is terminated as soon as we see a character which
-     * itself cannot be part of an identifier. */
-    if (*tok == TokIdentifier && !isalnum (ch) && ch != '_' && ch != '-' && ch != '.' && ch != '+') {
-      if (ch != 0)
-        unget_ch(p, ch);
-      goto finish;
-    }
-    if (ch == 0) {
-      print_msg(p, "Error: Expected '%c' but got end-of-file\n", end_ch);
-      return -1;
-    }
-    /* Strings or casts are terminated when their respective end
-     * characters are read, as long as the character is not escaped. */
-    if (ch == end_ch && prev_ch != escape)
-      goto finish;
-    prev_ch = ch;
-    str[c++] = ch;
-
-    if (c >= len) {
-      print_msg(p, "Error: Token is too large for buffer (%d bytes)\n", len);
-      return -1;
-    }
-  }
-  finish: str[c] = '\0';
+  p->pos++;
   return 0;
 }
 
+/* Creates a new element in the arena.  name must already be stored in the
+ * arena (or be NULL). */
 static BotParamElement *
-new_element(const char * name)
+new_element(BotParamArena * arena, char * name)
 {
   BotParamElement * el;
 
-  el = malloc(sizeof(BotParamElement));
+  el = arena_alloc(arena, sizeof(BotParamElement));
+  if (!el)
+    return NULL;
   memset(el, 0, sizeof(BotParamElement));
-  if (name)
-    el->name = strdup(name);
+  el->name = name;
   el->data_type = BotParamDataString;
 
   return el;
 }
 
-static void free_element(BotParamElement * el)
-{
-  free(el->name);
-  BotParamElement * child, *next;
-  for (child = el->children; child; child = next) {
-    next = child->next;
-    free_element(child);
-  }
-  int i;
-  for (i = 0; i < el->num_values; i++)
-    free(el->values[i]);
-  free(el->values);
-  free(el);
-}
-
 #if 0
-/* Debugging function that prints all tokens sequentially from a file */
+/* Debugging function that prints all tokens sequentially from a buffer */
 static int
 print_all_tokens (Parser * p)
 {
   BotParamToken tok;
-  char str[256];
+  const char * str;
+  int len;
 
-  while (get_token (p, &tok, str, sizeof (str)) == 0) {
-    printf ("tok %d: %s\n", tok, str);
+  while (get_token (p, &tok, &str, &len) == 0) {
+    printf ("tok %d: %.*s\n", tok, len, str);
     if (tok == TokEOF)
     return 0;
   }
@@ -401,53 +571,81 @@ print_all_tokens (Parser * p)
 #endif
 
 /* Appends child to the list of el's children. */
-static int add_child(Parser * p, BotParamElement * el, BotParamElement * child)
+static int add_child(BotParamElement * el, BotParamElement * child)
 {
-  BotParamElement ** nptr;
-  for (nptr = &el->children; *nptr != NULL; nptr = &((*nptr)->next))
-    ;
-  *nptr = child;
+  if (el->last_child)
+    el->last_child->next = child;
+  else
+    el->children = child;
+  el->last_child = child;
   child->next = NULL;
   child->parent = el;
   return 0;
 }
 
-/* Appends str to the list of el's values. */
-static int add_value(Parser * p, BotParamElement * el, const char * str)
+/* Appends n values to the list of el's values.  The strings themselves
+ * must already live in the arena. */
+static int add_values(BotParamArena * arena, BotParamElement * el, const char ** vals, int n)
 {
-  int n = el->num_values;
-  el->values = realloc(el->values, (n + 1) * sizeof(char *));
-  el->values[n] = strdup(str);
-  el->num_values = n + 1;
+  char ** values = arena_alloc(arena, (el->num_values + n) * sizeof(char *));
+  if (!values)
+    return -1;
+  if (el->num_values)
+    memcpy(values, el->values, el->num_values * sizeof(char *));
+  memcpy(values + el->num_values, vals, n * sizeof(char *));
+  el->values = values;
+  el->num_values += n;
+  return 0;
+}
+
+/* Queues a value of the assignment currently being parsed. */
+static int push_value(Parser * p, int * n, const char * str, int len)
+{
+  if (*n >= p->vals_size) {
+    int vals_size = MAX(2 * p->vals_size, 16);
+    const char ** vals = realloc(p->vals, vals_size * sizeof(char *));
+    if (!vals)
+      goto nomem;
+    p->vals = vals;
+    p->vals_size = vals_size;
+  }
+  char * val = arena_strndup(p->arena, str, len);
+  if (!val)
+    goto nomem;
+  p->vals[(*n)++] = val;
   return 0;
+
+  nomem: print_msg(p, "Error: out of memory\n");
+  return -1;
 }
 
 /* Parses the interior portion of an array (the part after the leading "["),
- * adding any values to the array's list of values.  Terminates when the
- * trailing "]" is found.
+ * queueing up any values.  Terminates when the trailing "]" is found.
  */
-static int parse_array(Parser * p, BotParamElement * el)
+static int parse_array(Parser * p, int * n)
 {
   BotParamToken tok;
-  char str[256];
+  const char * str;
+  int len;
 
   while (1) {
-    if (get_token(p, &tok, str, sizeof(str)) < 0)
+    if (get_token(p, &tok, &str, &len) < 0)
       goto fail;
 
     if (tok == TokIdentifier || tok == TokString) {
-      add_value(p, el, str);
+      if (push_value(p, n, str, len) < 0)
+        goto fail;
     }
     else if (tok == TokCloseArray) {
       return 0;
     }
     else {
-      print_msg(p, "Error: unexpected token \"%s\", expected value or "
-        "end of array\n", str);
+      print_msg(p, "Error: unexpected token \"%.*s\", expected value or "
+        "end of array\n", len, str);
       goto fail;
     }
 
-    if (get_token(p, &tok, str, sizeof(str)) < 0)
+    if (get_token(p, &tok, &str, &len) < 0)
       goto fail;
 
     if (tok == TokArraySep) {
@@ -457,8 +655,8 @@ static int parse_array(Parser * p, BotParamElement * el)
       return 0;
     }
     else {
-      print_msg(p, "Error: unexpected token \"%s\", expected comma or "
-        "end of array\n", str);
+      print_msg(p, "Error: unexpected token \"%.*s\", expected comma or "
+        "end of array\n", len, str);
       goto fail;
     }
   }
@@ -473,39 +671,46 @@ static int parse_array(Parser * p, BotParamElement * el)
 static int parse_right_side(Parser * p, BotParamElement * el)
 {
   BotParamToken tok;
-  char str[256];
+  const char * str;
+  int len;
+  int n = 0;
 
-  if (get_token(p, &tok, str, sizeof(str)) != 0)
+  if (get_token(p, &tok, &str, &len) != 0)
     goto fail;
 
   /* Allow an optional cast preceeding the right-hand side */
   if (tok == TokCast) {
     /* Cast is currently ignored */
-    if (get_token(p, &tok, str, sizeof(str)) != 0)
+    if (get_token(p, &tok, &str, &len) != 0)
       goto fail;
   }
 
   if (tok == TokIdentifier || tok == TokString) {
-    add_value(p, el, str);
+    if (push_value(p, &n, str, len) < 0)
+      goto fail;
   }
   else if (tok == TokOpenArray) {
-    if (parse_array(p, el) < 0)
+    if (parse_array(p, &n) < 0)
       goto fail;
   }
   else {
-    print_msg(p, "Error: unexpected token \"%s\", expected right-hand "
-      "side\n", str);
+    print_msg(p, "Error: unexpected token \"%.*s\", expected right-hand "
+      "side\n", len, str);
     goto fail;
   }
 
-  if (get_token(p, &tok, str, sizeof(str)) != 0)
+  if (get_token(p, &tok, &str, &len) != 0)
     goto fail;
 
   if (tok != TokEndStatement) {
-    print_msg(p, "Error: unexpected token \"%s\", expected semicolon\n", str);
+    print_msg(p, "Error: unexpected token \"%.*s\", expected semicolon\n", len, str);
     goto fail;
   }
 
+  if (n > 0 && add_values(p->arena, el, p->vals, n) < 0) {
+    print_msg(p, "Error: out of memory\n");
+    goto fail;
+  }
   return 0;
 
   fail: return -1;
@@ -518,16 +723,26 @@ static int parse_right_side(Parser * p, BotParamElement * el)
 static int parse_container(Parser * p, BotParamElement * cont, BotParamToken end_token)
 {
   BotParamToken tok;
-  char str[256];
+  const char * str;
+  int len;
   BotParamElement * child = NULL;
   int child_exists = 0;
 
-  while (get_token(p, &tok, str, sizeof(str)) == 0) {
-    //printf ("t %d: %s\n", tok, str);
+  while (get_token(p, &tok, &str, &len) == 0) {
+    //printf ("t %d: %.*s\n", tok, len, str);
     if (!child && tok == TokIdentifier) {
-      BotParamElement* existing_el = find_key(cont, str, 0);
+      char * name = arena_strndup(p->arena, str, len);
+      if (!name) {
+        print_msg(p, "Error: out of memory\n");
+        goto fail;
+      }
+      BotParamElement* existing_el = find_key(cont, name, 0);
       if (NULL == existing_el) {
-        child = new_element(str);
+        child = new_element(p->arena, name);
+        if (!child) {
+          print_msg(p, "Error: out of memory\n");
+          goto fail;
+        }
         child_exists = 0;
       }
       else {
@@ -540,7 +755,7 @@ static int parse_container(Parser * p, BotParamElement * cont, BotParamToken end
       if (parse_right_side(p, child) < 0)
         goto fail;
       if (!child_exists)
-        add_child(p, cont, child);
+        add_child(cont, child);
       child = NULL;
     }
     else if (child && tok == TokOpenStruct) {
@@ -548,23 +763,39 @@ static int parse_container(Parser * p, BotParamElement * cont, BotParamToken end
       if (parse_container(p, child, TokCloseStruct) < 0)
         goto fail;
       if (!child_exists)
-        add_child(p, cont, child);
+        add_child(cont, child);
       child = NULL;
     }
     else if (!child && tok == end_token)
       return 0;
     else {
-      print_msg(p, "Error: unexpected token \"%s\"\n", str);
+      print_msg(p, "Error: unexpected token \"%.*s\"\n", len, str);
       goto fail;
     }
   }
 
-  fail: if (child) {
-    free_element(child);
-  }
-  return -1;
+  /* elements of a failed parse are reclaimed with the arena */
+  fail: return -1;
+}
+
+/* Parses length bytes of buf into param's (empty) tree.  filename is only
+ * used for error messages. */
+static int parse_buffer(BotParam * param, const char * filename, const char * buf, size_t length)
+{
+  Parser p;
+  memset(&p, 0, sizeof(Parser));
+  p.filename = filename;
+  p.pos = buf;
+  p.end = buf + length;
+  p.arena = param->arena;
+
+  int ret = parse_container(&p, param->root, TokEOF);
+  free(p.scratch);
+  free(p.vals);
+  return ret;
 }
 
+
 static int write_array(BotParamElement * el, int indent, FILE * f)
 {
   if (el->num_values == 1)
@@ -676,10 +907,15 @@ int bot_param_write_to_string(BotParam * param, char ** s)
 /*
  * only used internally
  */
-static BotParam * _bot_param_new(void)
+static BotParam * _bot_param_new(size_t arena_size_hint)
 {
+  BotParamArena * arena = arena_new(arena_size_hint);
   BotParamElement * root;
-  root = new_element(NULL);
+  root = new_element(arena, NULL);
+  if (!root) {
+    arena_destroy(arena);
+    return NULL;
+  }
   root->type = BotParamContainer;
 
   if (!g_thread_supported ())
@@ -689,6 +925,7 @@ static BotParam * _bot_param_new(void)
   BotParam * param;
   param = calloc(1, sizeof(BotParam));
   param->root = root;
+  param->arena = arena;
   param->lock = g_mutex_new();
   param->server_id = -1;
   param->sequence_number = 0;
@@ -704,15 +941,38 @@ static void _update_handler_t_destroy(void * data, void * user)
   g_slice_free(update_handler_t, data);
 }
 
+static void _prefix_handler_t_destroy(void * data, void * user)
+{
+  prefix_handler_t * ph = (prefix_handler_t *) data;
+  g_free(ph->prefix);
+  g_slice_free(prefix_handler_t, ph);
+}
+
+/* Frees the values assigned with bot_param_set_*, which are the only parts
+ * of a tree that don't live in its arena. */
+static void _free_set_values(BotParamElement * el)
+{
+  free(el->set_value);
+  for (BotParamElement * child = el->children; child; child = child->next)
+    _free_set_values(child);
+}
+
 void bot_param_destroy(BotParam * param)
 {
-  free_element(param->root);
+  _free_set_values(param->root);
+  arena_destroy(param->arena);
+  if (param->image)
+    _unmap_file(param->image, param->image_size, param->image_mapped);
   g_mutex_free(param->lock);
 
   if (param->update_callbacks != NULL) {
     g_list_foreach(param->update_callbacks, _update_handler_t_destroy, NULL);
     g_list_free(param->update_callbacks);
   }
+  if (param->prefix_callbacks != NULL) {
+    g_list_foreach(param->prefix_callbacks, _prefix_handler_t_destroy, NULL);
+    g_list_free(param->prefix_callbacks);
+  }
 
   free(param);
 }
@@ -729,6 +989,18 @@ void bot_param_add_update_subscriber(BotParam *param,
 
 }
 
+void bot_param_subscribe_prefix(BotParam * param, const char * prefix,
+    bot_param_prefix_handler_t * callback_func, void * user)
+{
+  prefix_handler_t * ph = g_slice_new0(prefix_handler_t);
+  ph->prefix = g_strdup(prefix ? prefix : "");
+  ph->callback_func = callback_func;
+  ph->user = user;
+  g_mutex_lock(param->lock);
+  param->prefix_callbacks = g_list_append(param->prefix_callbacks, ph);
+  g_mutex_unlock(param->lock);
+}
+
 static void _dispatch_update_callbacks(BotParam * old_param, BotParam * new_param, int64_t utime)
 {
   GList * p = old_param->update_callbacks;
@@ -738,43 +1010,244 @@ static void _dispatch_update_callbacks(BotParam * old_param, BotParam * new_para
   }
 }
 
-static void _on_param_update(const lcm_recv_buf_t *rbuf, const char * channel, const bot_param_update_t * msg,
-    void * user)
+/* Returns 1 if key is prefix itself or lies beneath it. */
+static int _key_has_prefix(const char * key, const char * prefix)
+{
+  size_t len = strlen(prefix);
+  if (len == 0)
+    return 1;
+  return !strncmp(key, prefix, len) && (key[len] == '\0' || key[len] == '.');
+}
+
+static void _dispatch_prefix_callbacks(BotParam * param, GPtrArray * changed, int64_t utime)
+{
+  const char ** keys = malloc(MAX(changed->len, 1) * sizeof(char *));
+  GList * p = param->prefix_callbacks;
+  for ( ; p != NULL; p = g_list_next(p)) {
+    prefix_handler_t * ph = (prefix_handler_t *) p->data;
+    int num_keys = 0;
+    for (guint i = 0; i < changed->len; i++) {
+      const char * key = g_ptr_array_index(changed, i);
+      if (_key_has_prefix(key, ph->prefix))
+        keys[num_keys++] = key;
+    }
+    if (num_keys > 0)
+      ph->callback_func(param, keys, num_keys, utime, ph->user);
+  }
+  free(keys);
+}
+
+/*
+ * Tree diffing
+ */
+
+/* Appends name to the key of its parent, and returns the parent's key
+ * length to truncate back to. */
+static size_t _diff_push_key(GString * key, const char * name)
+{
+  size_t len = key->len;
+  if (len)
+    g_string_append_c(key, '.');
+  g_string_append(key, name);
+  return len;
+}
+
+/* Looks for a child named name, trying hint first since the children of
+ * two versions of a config are usually in the same order. */
+static BotParamElement * _diff_find_child(BotParamElement * el, const char * name, BotParamElement * hint)
+{
+  if (hint && !strcmp(hint->name, name))
+    return hint;
+  BotParamElement * child;
+  for (child = el->children; child; child = child->next)
+    if (!strcmp(child->name, name))
+      return child;
+  return NULL;
+}
+
+/* Adds the keys of all values under el, which was added or removed. */
+static void _diff_add_all(GPtrArray * changed, GString * key, BotParamElement * el)
+{
+  size_t len = _diff_push_key(key, el->name);
+  if (el->type == BotParamArray || el->children == NULL)
+    g_ptr_array_add(changed, g_strdup(key->str));
+  else {
+    BotParamElement * child;
+    for (child = el->children; child; child = child->next)
+      _diff_add_all(changed, key, child);
+  }
+  g_string_truncate(key, len);
+}
+
+static int _diff_values_equal(BotParamElement * a, BotParamElement * b)
+{
+  if (a->num_values != b->num_values)
+    return 0;
+  for (int i = 0; i < a->num_values; i++)
+    if (strcmp(a->values[i], b->values[i]))
+      return 0;
+  return 1;
+}
+
+/* Adds the full keys of all values that differ between the containers a and
+ * b to changed. */
+static void _diff_containers(GPtrArray * changed, GString * key, BotParamElement * a, BotParamElement * b)
+{
+  BotParamElement * ca, *cb;
+  BotParamElement * hint = b->children;
+  for (ca = a->children; ca; ca = ca->next) {
+    cb = _diff_find_child(b, ca->name, hint);
+    hint = cb ? cb->next : NULL;
+    if (cb == NULL)
+      _diff_add_all(changed, key, ca);
+    else if (ca->type != cb->type) {
+      _diff_add_all(changed, key, ca);
+      _diff_add_all(changed, key, cb);
+    }
+    else if (ca->type == BotParamArray) {
+      if (!_diff_values_equal(ca, cb)) {
+        size_t len = _diff_push_key(key, ca->name);
+        g_ptr_array_add(changed, g_strdup(key->str));
+        g_string_truncate(key, len);
+      }
+    }
+    else {
+      size_t len = _diff_push_key(key, ca->name);
+      _diff_containers(changed, key, ca, cb);
+      g_string_truncate(key, len);
+    }
+  }
+
+  hint = a->children;
+  for (cb = b->children; cb; cb = cb->next) {
+    ca = _diff_find_child(a, cb->name, hint);
+    hint = ca ? ca->next : NULL;
+    if (ca == NULL)
+      _diff_add_all(changed, key, cb);
+  }
+}
+
+static void _free_changed_keys(GPtrArray * changed)
+{
+  for (guint i = 0; i < changed->len; i++)
+    g_free(g_ptr_array_index(changed, i));
+  g_ptr_array_free(changed, TRUE);
+}
+
+/* Swaps the trees (and the memory backing them) of two params. */
+static void _swap_tree(BotParam * a, BotParam * b)
+{
+  BotParam tmp = *a;
+  a->root = b->root;
+  a->arena = b->arena;
+  a->image = b->image;
+  a->image_size = b->image_size;
+  a->image_mapped = b->image_mapped;
+  a->image_elements = b->image_elements;
+  b->root = tmp.root;
+  b->arena = tmp.arena;
+  b->image = tmp.image;
+  b->image_size = tmp.image_size;
+  b->image_mapped = tmp.image_mapped;
+  b->image_elements = tmp.image_elements;
+}
+
+/* Returns 1 if an update from the server is newer than the params we
+ * have. */
+static int _is_new_update(BotParam * param, int64_t server_id, int32_t sequence_number)
 {
-  BotParam * param = (BotParam *) user;
   if (param->server_id <= 0) {
-    param->server_id = msg->server_id;
-    param->sequence_number = msg->sequence_number - 1;
+    param->server_id = server_id;
+    param->sequence_number = sequence_number - 1;
   }
-  if (msg->server_id == param->server_id) {
-    if (msg->sequence_number <= param->sequence_number)
-      return;
+  if (server_id == param->server_id) {
+    if (sequence_number <= param->sequence_number)
+      return 0;
     //    else
     //	fprintf(stderr, "received NEW params from server:\n");
   }
   else {
     fprintf(stderr, "WARNING: Got params from a different server! Ignoring them\n");
-    return;
+    return 0;
   }
+  return 1;
+}
 
-  BotParam * new_params = bot_param_new_from_string(msg->params, strlen(msg->params));
-  if (new_params == NULL) {
-    fprintf(stderr, "WARNING: Could not parse params from the server!\n");
+static void _apply_update(BotParam * param, BotParam * new_params, int32_t sequence_number, int64_t utime)
+{
+  GPtrArray * changed = g_ptr_array_new();
+  GString * key = g_string_new(NULL);
+  g_mutex_lock(param->lock);
+  _diff_containers(changed, key, param->root, new_params->root);
+  g_mutex_unlock(param->lock);
+  g_string_free(key, TRUE);
+
+  // nothing to tell anyone about, e.g. a key was set to the value it
+  // already had, which still bumps the server's sequence number
+  if (changed->len == 0) {
+    g_mutex_lock(param->lock);
+    param->sequence_number = sequence_number;
+    g_mutex_unlock(param->lock);
+    bot_param_destroy(new_params);
+    _free_changed_keys(changed);
     return;
   }
 
-  _dispatch_update_callbacks(param,new_params, rbuf->recv_utime);
+  _dispatch_update_callbacks(param,new_params, utime);
 
   //swap the root;
   g_mutex_lock(param->lock);
-  param->sequence_number = msg->sequence_number;
-  BotParamElement * root = new_params->root;
-  new_params->root = param->root;
-  param->root = root;
+  param->sequence_number = sequence_number;
+  _swap_tree(param, new_params);
+  g_atomic_int_inc(&param->version);
   bot_param_destroy(new_params);
   g_mutex_unlock(param->lock);
 
+  _dispatch_prefix_callbacks(param, changed, utime);
+  _free_changed_keys(changed);
+}
+
+static void _on_param_update(const lcm_recv_buf_t *rbuf, const char * channel, const bot_param_update_t * msg,
+    void * user)
+{
+  BotParam * param = (BotParam *) user;
+  if (!_is_new_update(param, msg->server_id, msg->sequence_number))
+    return;
+
+  BotParam * new_params = bot_param_new_from_string(msg->params, strlen(msg->params));
+  if (new_params == NULL) {
+    fprintf(stderr, "WARNING: Could not parse params from the server!\n");
+    return;
+  }
+
+  _apply_update(param, new_params, msg->sequence_number, rbuf->recv_utime);
+}
+
+static void _on_param_update_binary(const lcm_recv_buf_t *rbuf, const char * channel,
+    const bot_param_update_binary_t * msg, void * user)
+{
+  BotParam * param = (BotParam *) user;
+  if (!_is_new_update(param, msg->server_id, msg->sequence_number))
+    return;
 
+  BotParam * new_params = NULL;
+  if (msg->compression == BOT_PARAM_UPDATE_BINARY_T_COMPRESSION_ZLIB) {
+    uLongf len = msg->uncompressed_size;
+    void * image = g_malloc(MAX(len, 1));
+    if (uncompress(image, &len, msg->data, msg->size) == Z_OK && len == (uLongf) msg->uncompressed_size)
+      new_params = _new_from_image(image, len, 0);
+    if (new_params == NULL)
+      g_free(image);
+  }
+  else if (msg->compression == BOT_PARAM_UPDATE_BINARY_T_COMPRESSION_NONE) {
+    new_params = bot_param_new_from_binary_buffer(msg->data, msg->size);
+  }
+  if (new_params == NULL) {
+    fprintf(stderr, "WARNING: Could not load binary params from the server!\n");
+    return;
+  }
+
+  _apply_update(param, new_params, msg->sequence_number, rbuf->recv_utime);
 }
 
 BotParam * bot_param_new_from_server(lcm_t * lcm, int keep_updated)
@@ -785,7 +1258,9 @@ BotParam * bot_param_new_from_server(lcm_t * lcm, int keep_updated)
 
 BotParam * bot_param_new_from_named_server (lcm_t * lcm, const char * server_name, int keep_updated)
 {
-  BotParam * param = _bot_param_new();
+  BotParam * param = _bot_param_new(0);
+  if (!param)
+    return NULL;
 
   const char *param_prefix = server_name; 
   if (!param_prefix) param_prefix = getenv ("BOT_PARAM_SERVER_NAME");
@@ -793,9 +1268,15 @@ BotParam * bot_param_new_from_named_server (lcm_t * lcm, const char * server_nam
           BOT_PARAM_UPDATE_CHANNEL, NULL); 
   gchar *request_channel = request_channel = g_strconcat (param_prefix ? : "", 
           BOT_PARAM_REQUEST_CHANNEL, NULL); 
+  gchar *binary_channel = g_strconcat (param_prefix ? : "",
+          BOT_PARAM_UPDATE_BINARY_CHANNEL, NULL);
 
+  // servers may publish a binary snapshot alongside the text update; which
+  // ever arrives first with a new sequence number is used
   bot_param_update_t_subscription_t * sub = bot_param_update_t_subscribe(lcm, update_channel, _on_param_update,
       (void *) param);
+  bot_param_update_binary_t_subscription_t * binary_sub = bot_param_update_binary_t_subscribe(lcm,
+      binary_channel, _on_param_update_binary, (void *) param);
 
   //TODO: is there a way to be sure nothing else is subscribed???
   int64_t utime_start = _timestamp_now();
@@ -822,6 +1303,7 @@ BotParam * bot_param_new_from_named_server (lcm_t * lcm, const char * server_nam
   }
   g_free (update_channel);
   g_free (request_channel);
+  g_free (binary_channel);
 
   if (last_print_utime > 0) {
     fprintf(stderr, "\n");
@@ -834,28 +1316,63 @@ BotParam * bot_param_new_from_named_server (lcm_t * lcm, const char * server_nam
 
   if (!keep_updated) {
     bot_param_update_t_unsubscribe(lcm, sub);
+    bot_param_update_binary_t_unsubscribe(lcm, binary_sub);
     param->server_id = -1;
   }
   return param;
 }
 
-static BotParam * _new_from_file(const char * filename)
+/* Maps a whole file into memory for parsing.  Falls back to reading it if
+ * the file cannot be mapped.  Release the buffer with _unmap_file. */
+static char * _map_file(const char * filename, size_t * length, int * mapped)
 {
-  ParserFile pf;
-  FILE * f = fopen(filename, "r");
-  if (f == NULL) {
-    err("could not open param file: %s\n",filename);
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
     return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return NULL;
+  }
+  *length = st.st_size;
+  *mapped = 0;
+
+  char * buf = NULL;
+  if (*length > 0) {
+    buf = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf != MAP_FAILED) {
+      *mapped = 1;
+      madvise(buf, *length, MADV_SEQUENTIAL);
+      close(fd);
+      return buf;
+    }
   }
 
-  memset(&pf, 0, sizeof(ParserFile));
-  pf.p.get_ch = get_ch_file;
-  pf.p.type = ParserTypeFile;
-  pf.file = f;
-  pf.filename = filename;
+  /* empty files, pipes and the like */
+  gchar * contents;
+  gsize len;
+  close(fd);
+  if (!g_file_get_contents(filename, &contents, &len, NULL))
+    return NULL;
+  *length = len;
+  return contents;
+}
+
+static void _unmap_file(char * buf, size_t length, int mapped)
+{
+  if (mapped)
+    munmap(buf, length);
+  else
+    g_free(buf);
+}
 
-  BotParam * param = _bot_param_new();
-  if (parse_container(&pf.p, param->root, TokEOF) < 0) {
+static BotParam * _new_from_buffer(const char * filename, const char * buf, size_t length)
+{
+  BotParam * param = _bot_param_new(length);
+  if (!param)
+    return NULL;
+  if (parse_buffer(param, filename, buf, length) < 0) {
     bot_param_destroy(param);
     return NULL;
   }
@@ -866,24 +1383,30 @@ static BotParam * _new_from_file(const char * filename)
 
 BotParam * bot_param_new_from_file (const char *filename)
 {
-    BotParam *param_parent = _new_from_file (filename);
-    if (!param_parent)
+    size_t file_len;
+    int mapped;
+    char *file_buf = _map_file (filename, &file_len, &mapped);
+    if (!file_buf) {
+        err("could not open param file: %s\n",filename);
         return NULL;
+    }
+
+    BotParam *param_parent = _new_from_buffer (filename, file_buf, file_len);
+    if (!param_parent) {
+        _unmap_file (file_buf, file_len, mapped);
+        return NULL;
+    }
 
     char **include = bot_param_get_str_array_alloc (param_parent, BOT_PARAM_INCLUDE_KEYWORD);
-    if (!include)
+    if (!include) {
+        _unmap_file (file_buf, file_len, mapped);
         return param_parent; // nothing to include
-
-    char *contents;  GError *error; gsize len;
-    if (!g_file_get_contents (filename, &contents, &len, &error)) {
-        fprintf (stderr, "%s: [%s]", __func__, error->message);
-        g_error_free (error);
-        bot_param_str_array_free (include);
-        return param_parent;
     }
 
-    char *param_str = contents;
-    gsize param_len = len;
+    char *contents;  GError *error; gsize len;
+    char *param_str = g_strndup (file_buf, file_len);
+    gsize param_len = file_len;
+    _unmap_file (file_buf, file_len, mapped);
     char *param_dir = g_path_get_dirname (filename);
 
     for (char **child=include; *child; child++) {
@@ -930,22 +1453,7 @@ BotParam * bot_param_new_from_file (const char *filename)
 
 BotParam * bot_param_new_from_string(const char * string, int length)
 {
-  ParserString ps;
-
-  memset(&ps, 0, sizeof(ParserString));
-  ps.p.get_ch = get_ch_string;
-  ps.p.type = ParserTypeString;
-  ps.string = string;
-  ps.length = length;
-
-  BotParam * param = _bot_param_new();
-  if (parse_container(&ps.p, param->root, TokEOF) < 0) {
-    bot_param_destroy(param);
-    return NULL;
-  }
-  else {
-    return param;
-  }
+  return _new_from_buffer(NULL, string, length);
 }
 
 static BotParamElement *
@@ -975,11 +1483,36 @@ find_key(BotParamElement * el, const char * key, int inherit)
     return NULL;
 }
 
-static int cast_to_int(const char * key, const char * val, int * out)
+/* The parse_* functions convert a value silently; the cast_* functions
+ * complain about the key when that fails. */
+static int parse_int(const char * val, int * out)
 {
   char * end;
   *out = strtol(val, &end, 0);
-  if (end == val || *end != '\0') {
+  return (end == val || *end != '\0') ? -1 : 0;
+}
+
+static int parse_boolean(const char * val, int * out)
+{
+  if (!strcasecmp(val, "y") || !strcasecmp(val, "yes") || !strcasecmp(val, "true") || !strcmp(val, "1"))
+    *out = 1;
+  else if (!strcasecmp(val, "n") || !strcasecmp(val, "no") || !strcasecmp(val, "false") || !strcmp(val, "0"))
+    *out = 0;
+  else
+    return -1;
+  return 0;
+}
+
+static int parse_double(const char * val, double * out)
+{
+  char * end;
+  *out = strtod(val, &end);
+  return (end == val || *end != '\0') ? -1 : 0;
+}
+
+static int cast_to_int(const char * key, const char * val, int * out)
+{
+  if (parse_int(val, out) < 0) {
     fprintf(stderr, "Error: key \"%s\" (\"%s\") did not cast "
       "properly to int\n", key, val);
     return -1;
@@ -989,11 +1522,7 @@ static int cast_to_int(const char * key, const char * val, int * out)
 
 static int cast_to_boolean(const char * key, const char * val, int * out)
 {
-  if (!strcasecmp(val, "y") || !strcasecmp(val, "yes") || !strcasecmp(val, "true") || !strcmp(val, "1"))
-    *out = 1;
-  else if (!strcasecmp(val, "n") || !strcasecmp(val, "no") || !strcasecmp(val, "false") || !strcmp(val, "0"))
-    *out = 0;
-  else {
+  if (parse_boolean(val, out) < 0) {
     fprintf(stderr, "Error: key \"%s\" (\"%s\") did not cast "
       "properly to boolean\n", key, val);
     return -1;
@@ -1003,9 +1532,7 @@ static int cast_to_boolean(const char * key, const char * val, int * out)
 
 static double cast_to_double(const char * key, const char * val, double * out)
 {
-  char * end;
-  *out = strtod(val, &end);
-  if (end == val || *end != '\0') {
+  if (parse_double(val, out) < 0) {
     fprintf(stderr, "Error: key \"%s\" (\"%s\") did not cast "
       "properly to double\n", key, val);
     return -1;
@@ -1013,13 +1540,372 @@ static double cast_to_double(const char * key, const char * val, double * out)
   return 0;
 }
 
+/* Value getters that use the pre-cast values of a binary snapshot when the
+ * element has them. */
+static int get_int_value(const char * key, BotParamElement * el, int i, int * out)
+{
+  if (el->typed_values && (el->typed_values[i].flags & BOT_PARAM_BINARY_IS_INT)) {
+    *out = el->typed_values[i].int_val;
+    return 0;
+  }
+  return cast_to_int(key, el->values[i], out);
+}
+
+static int get_boolean_value(const char * key, BotParamElement * el, int i, int * out)
+{
+  if (el->typed_values && (el->typed_values[i].flags & BOT_PARAM_BINARY_IS_BOOL)) {
+    *out = el->typed_values[i].bool_val;
+    return 0;
+  }
+  return cast_to_boolean(key, el->values[i], out);
+}
+
+static int get_double_value(const char * key, BotParamElement * el, int i, double * out)
+{
+  if (el->typed_values && (el->typed_values[i].flags & BOT_PARAM_BINARY_IS_DOUBLE)) {
+    *out = el->typed_values[i].double_val;
+    return 0;
+  }
+  return cast_to_double(key, el->values[i], out);
+}
+
+/*
+ * Binary snapshots
+ */
+
+#define BINARY_ALIGN(x) (((x) + 7) & ~((size_t) 7))
+
+typedef struct {
+  GArray * elements; /* BotParamBinaryElement */
+  GArray * values;   /* BotParamBinaryValue */
+  GArray * index;    /* BotParamBinaryIndexEntry */
+  GString * strings;
+} BinaryWriter;
+
+typedef struct {
+  const char * key;
+  BotParamBinaryIndexEntry entry;
+} BinarySortEntry;
+
+static uint32_t binary_add_string(BinaryWriter * w, const char * str, size_t len)
+{
+  uint32_t offset = w->strings->len;
+  g_string_append_len(w->strings, str, len);
+  g_string_append_c(w->strings, '\0');
+  return offset;
+}
+
+/* Appends el and all of its descendants in depth-first order.  key holds the
+ * full key of el's parent. */
+static void binary_add_element(BinaryWriter * w, BotParamElement * el, uint32_t parent, GString * key,
+    int indexed)
+{
+  uint32_t index = w->elements->len;
+  size_t parent_key_len = key->len;
+
+  BotParamBinaryElement bel;
+  memset(&bel, 0, sizeof(bel));
+  bel.type = el->type;
+  bel.parent = parent;
+  bel.name = BOT_PARAM_BINARY_NONE;
+  if (el->name) {
+    if (key->len)
+      g_string_append_c(key, '.');
+    g_string_append(key, el->name);
+
+    /* the name is stored as the tail of the full key */
+    uint32_t key_offset = binary_add_string(w, key->str, key->len);
+    bel.name = key_offset + key->len - strlen(el->name);
+
+    /* find_key can't reach names with a '.' in them, so neither should the
+     * index */
+    if (strchr(el->name, '.'))
+      indexed = 0;
+    if (indexed) {
+      BotParamBinaryIndexEntry entry = { key_offset, index };
+      g_array_append_val(w->index, entry);
+    }
+  }
+
+  bel.num_values = el->num_values;
+  bel.first_value = w->values->len;
+  for (int i = 0; i < el->num_values; i++) {
+    BotParamBinaryValue val;
+    memset(&val, 0, sizeof(val));
+    val.str = binary_add_string(w, el->values[i], strlen(el->values[i]));
+    int ival;
+    if (parse_int(el->values[i], &ival) == 0) {
+      val.int_val = ival;
+      val.flags |= BOT_PARAM_BINARY_IS_INT;
+    }
+    if (parse_boolean(el->values[i], &ival) == 0) {
+      val.bool_val = ival;
+      val.flags |= BOT_PARAM_BINARY_IS_BOOL;
+    }
+    if (parse_double(el->values[i], &val.double_val) == 0)
+      val.flags |= BOT_PARAM_BINARY_IS_DOUBLE;
+    g_array_append_val(w->values, val);
+  }
+  g_array_append_val(w->elements, bel);
+
+  BotParamElement * child;
+  for (child = el->children; child; child = child->next)
+    binary_add_element(w, child, index, key, indexed);
+
+  g_string_truncate(key, parent_key_len);
+}
+
+static int binary_sort_entry_compare(const void * a, const void * b)
+{
+  return strcmp(((const BinarySortEntry *) a)->key, ((const BinarySortEntry *) b)->key);
+}
+
+int bot_param_write_binary_to_buffer(BotParam * param, uint8_t ** buf, int * len)
+{
+  BinaryWriter w;
+  w.elements = g_array_new(FALSE, FALSE, sizeof(BotParamBinaryElement));
+  w.values = g_array_new(FALSE, FALSE, sizeof(BotParamBinaryValue));
+  w.index = g_array_new(FALSE, FALSE, sizeof(BotParamBinaryIndexEntry));
+  w.strings = g_string_new(NULL);
+  GString * key = g_string_new(NULL);
+
+  /* keep the string table non-empty, even for an empty config */
+  binary_add_string(&w, "", 0);
+
+  g_mutex_lock(param->lock);
+  binary_add_element(&w, param->root, BOT_PARAM_BINARY_NONE, key, 1);
+  g_mutex_unlock(param->lock);
+  g_string_free(key, TRUE);
+
+  /* sort the index by key, now that the string table won't move anymore */
+  int num_index = w.index->len;
+  BinarySortEntry * sorted = malloc(MAX(num_index, 1) * sizeof(BinarySortEntry));
+  for (int i = 0; i < num_index; i++) {
+    sorted[i].entry = g_array_index(w.index, BotParamBinaryIndexEntry, i);
+    sorted[i].key = w.strings->str + sorted[i].entry.key;
+  }
+  qsort(sorted, num_index, sizeof(BinarySortEntry), binary_sort_entry_compare);
+
+  BotParamBinaryHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, BOT_PARAM_BINARY_MAGIC, sizeof(hdr.magic));
+  hdr.version = BOT_PARAM_BINARY_VERSION;
+  hdr.endian_check = BOT_PARAM_BINARY_ENDIAN_CHECK;
+  hdr.num_elements = w.elements->len;
+  hdr.num_values = w.values->len;
+  hdr.num_index_entries = num_index;
+  hdr.elements_offset = BINARY_ALIGN(sizeof(hdr));
+  hdr.values_offset = BINARY_ALIGN(hdr.elements_offset + hdr.num_elements * sizeof(BotParamBinaryElement));
+  hdr.index_offset = BINARY_ALIGN(hdr.values_offset + hdr.num_values * sizeof(BotParamBinaryValue));
+  hdr.strings_offset = BINARY_ALIGN(hdr.index_offset + hdr.num_index_entries * sizeof(BotParamBinaryIndexEntry));
+  hdr.strings_size = w.strings->len;
+  hdr.total_size = BINARY_ALIGN(hdr.strings_offset + hdr.strings_size);
+
+  uint8_t * data = calloc(1, hdr.total_size);
+  memcpy(data, &hdr, sizeof(hdr));
+  memcpy(data + hdr.elements_offset, w.elements->data, hdr.num_elements * sizeof(BotParamBinaryElement));
+  if (hdr.num_values)
+    memcpy(data + hdr.values_offset, w.values->data, hdr.num_values * sizeof(BotParamBinaryValue));
+  BotParamBinaryIndexEntry * index = (BotParamBinaryIndexEntry *) (data + hdr.index_offset);
+  for (int i = 0; i < num_index; i++)
+    index[i] = sorted[i].entry;
+  memcpy(data + hdr.strings_offset, w.strings->str, hdr.strings_size);
+
+  free(sorted);
+  g_array_free(w.elements, TRUE);
+  g_array_free(w.values, TRUE);
+  g_array_free(w.index, TRUE);
+  g_string_free(w.strings, TRUE);
+
+  *buf = data;
+  *len = hdr.total_size;
+  return 0;
+}
+
+int bot_param_write_binary(BotParam * param, FILE * f)
+{
+  uint8_t * buf;
+  int len;
+  if (bot_param_write_binary_to_buffer(param, &buf, &len) < 0)
+    return -1;
+  int ret = (fwrite(buf, 1, len, f) == (size_t) len) ? 0 : -1;
+  free(buf);
+  return ret;
+}
+
+/* Checks that a section of count items of the given size lies within the
+ * snapshot. */
+static int binary_section_ok(const BotParamBinaryHeader * hdr, uint32_t offset, uint32_t count, size_t size)
+{
+  if (offset % 8 || offset < sizeof(BotParamBinaryHeader))
+    return 0;
+  return (uint64_t) offset + (uint64_t) count * size <= hdr->total_size;
+}
+
+/* Checks everything that the loader and the getters rely on, so that a
+ * truncated or corrupted snapshot is rejected instead of crashing. */
+static int binary_image_ok(const uint8_t * image, size_t size)
+{
+  const BotParamBinaryHeader * hdr = (const BotParamBinaryHeader *) image;
+  if (size < sizeof(BotParamBinaryHeader) || memcmp(hdr->magic, BOT_PARAM_BINARY_MAGIC, sizeof(hdr->magic))) {
+    err("Error: not a binary param snapshot\n");
+    return 0;
+  }
+  if (hdr->endian_check != BOT_PARAM_BINARY_ENDIAN_CHECK || hdr->version != BOT_PARAM_BINARY_VERSION) {
+    err("Error: binary param snapshot has an unsupported version or byte order\n");
+    return 0;
+  }
+  if (hdr->total_size > size || hdr->num_elements < 1
+      || !binary_section_ok(hdr, hdr->elements_offset, hdr->num_elements, sizeof(BotParamBinaryElement))
+      || !binary_section_ok(hdr, hdr->values_offset, hdr->num_values, sizeof(BotParamBinaryValue))
+      || !binary_section_ok(hdr, hdr->index_offset, hdr->num_index_entries, sizeof(BotParamBinaryIndexEntry))
+      || !binary_section_ok(hdr, hdr->strings_offset, hdr->strings_size, 1) || hdr->strings_size < 1
+      || image[hdr->strings_offset + hdr->strings_size - 1] != '\0')
+    goto corrupt;
+
+  const BotParamBinaryElement * elements = (const BotParamBinaryElement *) (image + hdr->elements_offset);
+  const BotParamBinaryValue * values = (const BotParamBinaryValue *) (image + hdr->values_offset);
+  const BotParamBinaryIndexEntry * index = (const BotParamBinaryIndexEntry *) (image + hdr->index_offset);
+
+  if (elements[0].type != BotParamContainer || elements[0].parent != BOT_PARAM_BINARY_NONE)
+    goto corrupt;
+  for (uint32_t i = 0; i < hdr->num_elements; i++) {
+    const BotParamBinaryElement * bel = &elements[i];
+    if (bel->type != BotParamContainer && bel->type != BotParamArray)
+      goto corrupt;
+    if (i > 0 && (bel->parent >= i || elements[bel->parent].type != BotParamContainer
+        || bel->name >= hdr->strings_size))
+      goto corrupt;
+    if ((uint64_t) bel->first_value + bel->num_values > hdr->num_values)
+      goto corrupt;
+  }
+  for (uint32_t i = 0; i < hdr->num_values; i++)
+    if (values[i].str >= hdr->strings_size)
+      goto corrupt;
+  for (uint32_t i = 0; i < hdr->num_index_entries; i++)
+    if (index[i].key >= hdr->strings_size || index[i].element >= hdr->num_elements)
+      goto corrupt;
+  return 1;
+
+  corrupt: err("Error: binary param snapshot is corrupt\n");
+  return 0;
+}
+
+/* Builds a tree whose names and values point into image.  On success the
+ * BotParam takes ownership of image, and releases it with _unmap_file. */
+static BotParam * _new_from_image(void * image, size_t size, int mapped)
+{
+  if (!binary_image_ok(image, size))
+    return NULL;
+
+  const BotParamBinaryHeader * hdr = image;
+  const BotParamBinaryElement * bin_elements = (const BotParamBinaryElement *) ((uint8_t *) image
+      + hdr->elements_offset);
+  const BotParamBinaryValue * bin_values = (const BotParamBinaryValue *) ((uint8_t *) image + hdr->values_offset);
+  char * strings = (char *) image + hdr->strings_offset;
+
+  /* the whole tree is two allocations */
+  size_t elements_size = hdr->num_elements * sizeof(BotParamElement);
+  size_t values_size = hdr->num_values * sizeof(char *);
+  BotParam * param = _bot_param_new(elements_size + values_size + 16);
+  if (!param)
+    return NULL;
+  BotParamElement * elements = arena_alloc(param->arena, elements_size);
+  char ** values = arena_alloc(param->arena, values_size);
+  if (!elements || !values) {
+    bot_param_destroy(param);
+    return NULL;
+  }
+  memset(elements, 0, elements_size);
+
+  for (uint32_t i = 0; i < hdr->num_values; i++)
+    values[i] = strings + bin_values[i].str;
+
+  for (uint32_t i = 0; i < hdr->num_elements; i++) {
+    const BotParamBinaryElement * bel = &bin_elements[i];
+    BotParamElement * el = &elements[i];
+    el->type = bel->type;
+    el->data_type = BotParamDataString;
+    el->name = (i > 0) ? strings + bel->name : NULL;
+    el->num_values = bel->num_values;
+    if (el->num_values) {
+      el->values = values + bel->first_value;
+      el->typed_values = bin_values + bel->first_value;
+    }
+    /* parents always precede their children */
+    if (i > 0)
+      add_child(&elements[bel->parent], el);
+  }
+
+  param->root = elements;
+  param->image = image;
+  param->image_size = size;
+  param->image_mapped = mapped;
+  param->image_elements = elements;
+  return param;
+}
+
+BotParam * bot_param_new_from_binary(const char * filename)
+{
+  size_t len;
+  int mapped;
+  char * buf = _map_file(filename, &len, &mapped);
+  if (!buf) {
+    err("could not open param snapshot: %s\n", filename);
+    return NULL;
+  }
+  if (mapped)
+    madvise(buf, len, MADV_WILLNEED);
+
+  BotParam * param = _new_from_image(buf, len, mapped);
+  if (!param)
+    _unmap_file(buf, len, mapped);
+  return param;
+}
+
+BotParam * bot_param_new_from_binary_buffer(const void * buf, int length)
+{
+  /* copy, since the caller's buffer may go away or be misaligned */
+  void * image = g_malloc(MAX(length, 1));
+  memcpy(image, buf, length);
+  BotParam * param = _new_from_image(image, length, 0);
+  if (!param)
+    g_free(image);
+  return param;
+}
+
+/* Looks a key up in the index of a binary snapshot, if the tree came from
+ * one, before walking the tree. */
+static BotParamElement *
+lookup_key(BotParam * param, const char * key, int inherit)
+{
+  if (param->image) {
+    const uint8_t * image = param->image;
+    const BotParamBinaryHeader * hdr = param->image;
+    const BotParamBinaryIndexEntry * index = (const BotParamBinaryIndexEntry *) (image + hdr->index_offset);
+    const char * strings = (const char *) image + hdr->strings_offset;
+    int lo = 0, hi = (int) hdr->num_index_entries - 1;
+    while (lo <= hi) {
+      int mid = (lo + hi) / 2;
+      int cmp = strcmp(key, strings + index[mid].key);
+      if (cmp == 0)
+        return &param->image_elements[index[mid].element];
+      else if (cmp < 0)
+        hi = mid - 1;
+      else
+        lo = mid + 1;
+    }
+  }
+  return find_key(param->root, key, inherit);
+}
+
 #define PRINT_KEY_NOT_FOUND(key) \
     err("WARNING: BotParam: could not find key %s!\n", (key));
 
 int bot_param_has_key(BotParam *param, const char *key)
 {
   g_mutex_lock(param->lock);
-  int ret = (find_key(param->root, key, 1) != NULL);
+  int ret = (lookup_key(param, key, 1) != NULL);
   g_mutex_unlock(param->lock);
   return ret;
 }
@@ -1030,7 +1916,7 @@ int bot_param_get_num_subkeys(BotParam * param, const char * containerKey)
 
   BotParamElement* el = param->root;
   if ((NULL != containerKey) && (0 < strlen(containerKey)))
-    el = find_key(param->root, containerKey, 1);
+    el = lookup_key(param, containerKey, 1);
   if (NULL == el) {
     g_mutex_unlock(param->lock);
     return -1;
@@ -1053,7 +1939,7 @@ bot_param_get_subkeys(BotParam * param, const char * containerKey)
 
   BotParamElement* el = param->root;
   if ((NULL != containerKey) && (0 < strlen(containerKey)))
-    el = find_key(param->root, containerKey, 1);
+    el = lookup_key(param, containerKey, 1);
   if (NULL == el) {
     g_mutex_unlock(param->lock);
     return NULL;
@@ -1079,12 +1965,12 @@ int bot_param_get_int(BotParam * param, const char * key, int * val)
 {
   g_mutex_lock(param->lock);
 
-  BotParamElement * el = find_key(param->root, key, 1);
+  BotParamElement * el = lookup_key(param, key, 1);
   if (!el || el->type != BotParamArray || el->num_values < 1) {
     g_mutex_unlock(param->lock);
     return -1;
   }
-  int ret = cast_to_int(key, el->values[0], val);
+  int ret = get_int_value(key, el, 0, val);
 
   g_mutex_unlock(param->lock);
   return ret;
@@ -1093,13 +1979,13 @@ int bot_param_get_int(BotParam * param, const char * key, int * val)
 int bot_param_get_boolean(BotParam * param, const char * key, int * val)
 {
   g_mutex_lock(param->lock);
-  BotParamElement * el = find_key(param->root, key, 1);
+  BotParamElement * el = lookup_key(param, key, 1);
   if (!el || el->type != BotParamArray || el->num_values < 1) {
     g_mutex_unlock(param->lock);
     return -1;
   }
 
-  int ret = cast_to_boolean(key, el->values[0], val);
+  int ret = get_boolean_value(key, el, 0, val);
   g_mutex_unlock(param->lock);
   return ret;
 }
@@ -1108,12 +1994,12 @@ int bot_param_get_double(BotParam * param, const char * key, double * val)
 {
   g_mutex_lock(param->lock);
 
-  BotParamElement * el = find_key(param->root, key, 1);
+  BotParamElement * el = lookup_key(param, key, 1);
   if (!el || el->type != BotParamArray || el->num_values < 1) {
     g_mutex_unlock(param->lock);
     return -1;
   }
-  double ret = cast_to_double(key, el->values[0], val);
+  double ret = get_double_value(key, el, 0, val);
 
   g_mutex_unlock(param->lock);
   return ret;
@@ -1123,7 +2009,7 @@ int bot_param_get_str(BotParam * param, const char * key, char ** val)
 {
   g_mutex_lock(param->lock);
 
-  BotParamElement * el = find_key(param->root, key, 1);
+  BotParamElement * el = lookup_key(param, key, 1);
   if (!el || el->type != BotParamArray || el->num_values < 1) {
     g_mutex_unlock(param->lock);
     return -1;
@@ -1181,7 +2067,7 @@ int bot_param_get_int_array(BotParam * param, const char * key, int * vals, int
 {
   g_mutex_lock(param->lock);
 
-  BotParamElement * el = find_key(param->root, key, 1);
+  BotParamElement * el = lookup_key(param, key, 1);
   if (!el || el->type != BotParamArray) {
     g_mutex_unlock(param->lock);
     return -1;
@@ -1190,7 +2076,7 @@ int bot_param_get_int_array(BotParam * param, const char * key, int * vals, int
   for (i = 0; i < el->num_values; i++) {
     if (len != -1 && i == len)
       break;
-    if (cast_to_int(key, el->values[i], vals + i) < 0) {
+    if (get_int_value(key, el, i, vals + i) < 0) {
       err("WARNING: BotParam: cast error parsing int array %s\n", key);
       g_mutex_unlock(param->lock);
       return -1;
@@ -1221,7 +2107,7 @@ int bot_param_get_boolean_array(BotParam * param, const char * key, int * vals,
 {
   g_mutex_lock(param->lock);
 
-  BotParamElement * el = find_key(param->root, key, 1);
+  BotParamElement * el = lookup_key(param, key, 1);
   if (!el || el->type != BotParamArray) {
     g_mutex_unlock(param->lock);
     return -1;
@@ -1230,7 +2116,7 @@ int bot_param_get_boolean_array(BotParam * param, const char * key, int * vals,
   for (i = 0; i < el->num_values; i++) {
     if (len != -1 && i == len)
       break;
-    if (cast_to_boolean(key, el->values[i], vals + i) < 0) {
+    if (get_boolean_value(key, el, i, vals + i) < 0) {
       err("WARNING: BotParam: cast error parsing boolean array %s\n", key);
       g_mutex_unlock(param->lock);
       return -1;
@@ -1261,7 +2147,7 @@ int bot_param_get_double_array(BotParam * param, const char * key, double * vals
 {
   g_mutex_lock(param->lock);
 
-  BotParamElement * el = find_key(param->root, key, 1);
+  BotParamElement * el = lookup_key(param, key, 1);
   if (!el || el->type != BotParamArray) {
     g_mutex_unlock(param->lock);
     return -1;
@@ -1270,7 +2156,7 @@ int bot_param_get_double_array(BotParam * param, const char * key, double * vals
   for (i = 0; i < el->num_values; i++) {
     if (len != -1 && i == len)
       break;
-    if (cast_to_double(key, el->values[i], vals + i) < 0) {
+    if (get_double_value(key, el, i, vals + i) < 0) {
       err("WARNING: BotParam: cast error parsing double array %s\n", key);
       g_mutex_unlock(param->lock);
       return -1;
@@ -1299,7 +2185,7 @@ void bot_param_get_double_array_or_fail(BotParam * param, const char * key, doub
 int bot_param_get_array_len(BotParam *param, const char * key)
 {
   g_mutex_lock(param->lock);
-  BotParamElement * el = find_key(param->root, key, 1);
+  BotParamElement * el = lookup_key(param, key, 1);
   if (!el || el->type != BotParamArray) {
     g_mutex_unlock(param->lock);
     return -1;
@@ -1315,7 +2201,7 @@ bot_param_get_str_array_alloc(BotParam * param, const char * key)
 {
   g_mutex_lock(param->lock);
 
-  BotParamElement * el = find_key(param->root, key, 1);
+  BotParamElement * el = lookup_key(param, key, 1);
   if (!el || el->type != BotParamArray) {
     g_mutex_unlock(param->lock);
     return NULL;
@@ -1343,8 +2229,95 @@ void bot_param_str_array_free(char **data)
   free(data);
 }
 
+/*
+ * Handles
+ */
+
+/* Looks the handle's key up again and re-casts its value.  If that fails,
+ * the previous value is kept. */
+static int _handle_refresh(BotParamHandle * h)
+{
+  BotParam * param = h->param;
+  g_mutex_lock(param->lock);
+
+  int ret = -1;
+  BotParamElement * el = lookup_key(param, h->key, 1);
+  if (el && el->type == BotParamArray && el->num_values >= 1) {
+    int int_val;
+    double double_val;
+    switch (h->type) {
+    case BOT_PARAM_HANDLE_INT:
+      ret = get_int_value(h->key, el, 0, &int_val);
+      break;
+    case BOT_PARAM_HANDLE_BOOLEAN:
+      ret = get_boolean_value(h->key, el, 0, &int_val);
+      break;
+    case BOT_PARAM_HANDLE_DOUBLE:
+      ret = get_double_value(h->key, el, 0, &double_val);
+      break;
+    }
+    if (ret == 0) {
+      if (h->type == BOT_PARAM_HANDLE_DOUBLE)
+        h->val.double_val = double_val;
+      else
+        h->val.int_val = int_val;
+    }
+  }
+  if (ret < 0 && h->version >= 0)
+    err("WARNING: BotParam: key %s is no longer valid, keeping its previous value\n", h->key);
+
+  h->version = param->version;
+  g_mutex_unlock(param->lock);
+  return ret;
+}
+
+BotParamHandle *
+bot_param_get_handle(BotParam * param, const char * key, BotParamHandleType type)
+{
+  BotParamHandle * h = g_slice_new0(BotParamHandle);
+  h->param = param;
+  h->key = g_strdup(key);
+  h->type = type;
+  h->version = -1;
+  if (_handle_refresh(h) < 0) {
+    bot_param_handle_destroy(h);
+    return NULL;
+  }
+  return h;
+}
+
+void bot_param_handle_destroy(BotParamHandle * h)
+{
+  g_free(h->key);
+  g_slice_free(BotParamHandle, h);
+}
+
+int bot_param_handle_get_int(BotParamHandle * h)
+{
+  assert(h->type == BOT_PARAM_HANDLE_INT);
+  if (G_UNLIKELY(g_atomic_int_get(&h->param->version) != h->version))
+    _handle_refresh(h);
+  return h->val.int_val;
+}
+
+int bot_param_handle_get_boolean(BotParamHandle * h)
+{
+  assert(h->type == BOT_PARAM_HANDLE_BOOLEAN);
+  if (G_UNLIKELY(g_atomic_int_get(&h->param->version) != h->version))
+    _handle_refresh(h);
+  return h->val.int_val;
+}
+
+double bot_param_handle_get_double(BotParamHandle * h)
+{
+  assert(h->type == BOT_PARAM_HANDLE_DOUBLE);
+  if (G_UNLIKELY(g_atomic_int_get(&h->param->version) != h->version))
+    _handle_refresh(h);
+  return h->val.double_val;
+}
+
 static BotParamElement *
-create_key(BotParamElement * el, const char * key)
+create_key(BotParamArena * arena, BotParamElement * el, const char * key)
 {
   size_t len = strcspn(key, ".");
   char str[len + 1];
@@ -1359,17 +2332,20 @@ create_key(BotParamElement * el, const char * key)
   for (child = el->children; child; child = child->next) {
     if (!strcmp(str, child->name)) {
       if (remainder)
-        return create_key(child, remainder);
+        return create_key(arena, child, remainder);
       else
         return child;
     }
   }
 
-  child = new_element(str);
-  add_child(NULL, el, child);
+  char * name = arena_strndup(arena, str, len);
+  child = name ? new_element(arena, name) : NULL;
+  if (!child)
+    return NULL;
+  add_child(el, child);
   if (remainder) {
     child->type = BotParamContainer;
-    return create_key(child, remainder);
+    return create_key(arena, child, remainder);
   }
   else {
     child->type = BotParamArray;
@@ -1387,18 +2363,23 @@ static int set_value(BotParam * param, const char * key, const char * val)
 
   BotParamElement * el = find_key(param->root, key, 0);
   if (el == NULL)
-    el = create_key(param->root, key);
-  else if (el->type != BotParamArray) {
+    el = create_key(param->arena, param->root, key);
+  else if (el->type != BotParamArray)
+    el = NULL;
+
+  /* kept out of the arena, since a server may set the same keys over and
+   * over for as long as it runs */
+  char * new_val = el ? strdup(val) : NULL;
+  if (!new_val || (el->num_values < 1 && add_values(param->arena, el, (const char **) &new_val, 1) < 0)) {
+    free(new_val);
     g_mutex_unlock(param->lock);
     return -1;
   }
-
-  if (el->num_values < 1)
-    add_value(NULL, el, val);
-  else {
-    free(el->values[0]);
-    el->values[0] = strdup(val);
-  }
+  el->values[0] = new_val;
+  free(el->set_value);
+  el->set_value = new_val;
+  el->typed_values = NULL;
+  g_atomic_int_inc(&param->version);
 
   g_mutex_unlock(param->lock);
   return 1;
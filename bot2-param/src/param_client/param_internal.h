@@ -3,8 +3,24 @@
 #define BOT_PARAM_UPDATE_CHANNEL "PARAM_UPDATE"
 #define BOT_PARAM_REQUEST_CHANNEL "PARAM_REQUEST"
 #define BOT_PARAM_SET_CHANNEL "PARAM_SET"
+#define BOT_PARAM_UPDATE_BINARY_CHANNEL "PARAM_UPDATE_BINARY"
 #define BOT_PARAM_INCLUDE_KEYWORD "INCLUDE"
 
+/**
+ * bot_param_write_binary_to_buffer:
+ * @param: The configuration.
+ * @buf: Set to a newly malloc'd binary snapshot, which the caller must free.
+ * @len: Set to the size of the snapshot.
+ *
+ * Writes the same snapshot as bot_param_write_binary(), to memory.
+ *
+ * Returns: 0 on success, -1 on failure.
+ */
+int
+bot_param_write_binary_to_buffer (BotParam * param,
+                               uint8_t ** buf,
+                               int * len);
+
 /**
  * bot_param_set_int:
  * @param: The configuration.
@@ -6,6 +6,7 @@
 #include <sys/select.h>
 #include <sys/time.h>
 #include <glib.h>
+#include <zlib.h>
 
 #include <lcm/lcm.h>
 #include <bot_param/param_client.h>
@@ -25,8 +26,42 @@ typedef struct {
   gchar *update_channel;
   gchar *request_channel;
   gchar *set_channel;
+  gchar *binary_channel; // NULL unless binary updates are enabled
 } param_server_t;
 
+static void publish_binary_params(param_server_t *self, int64_t utime)
+{
+  uint8_t * snapshot;
+  int snapshot_len;
+  if (bot_param_write_binary_to_buffer(self->params, &snapshot, &snapshot_len)) {
+    fprintf(stderr, "ERROR: could not write binary snapshot");
+    exit(1);
+  }
+
+  bot_param_update_binary_t update_msg;
+  update_msg.utime = utime;
+  update_msg.server_id = self->id;
+  update_msg.sequence_number = self->seqNo;
+  update_msg.uncompressed_size = snapshot_len;
+
+  uLongf compressed_len = compressBound(snapshot_len);
+  uint8_t * compressed = malloc(compressed_len);
+  if (compress2(compressed, &compressed_len, snapshot, snapshot_len, Z_BEST_SPEED) == Z_OK) {
+    update_msg.compression = BOT_PARAM_UPDATE_BINARY_T_COMPRESSION_ZLIB;
+    update_msg.size = compressed_len;
+    update_msg.data = compressed;
+  }
+  else {
+    update_msg.compression = BOT_PARAM_UPDATE_BINARY_T_COMPRESSION_NONE;
+    update_msg.size = snapshot_len;
+    update_msg.data = snapshot;
+  }
+
+  bot_param_update_binary_t_publish(self->lcm, self->binary_channel, &update_msg);
+  free(compressed);
+  free(snapshot);
+}
+
 void publish_params(param_server_t *self)
 {
 
@@ -43,6 +78,8 @@ void publish_params(param_server_t *self)
   update_msg->sequence_number = self->seqNo;
 
   bot_param_update_t_publish(self->lcm, self->update_channel, update_msg);
+  if (self->binary_channel)
+    publish_binary_params(self, update_msg->utime);
   bot_param_update_t_destroy(update_msg);
 
   fprintf(stderr, ".");
@@ -98,6 +135,8 @@ static void usage(int argc, char ** argv)
             "   -h, --help          print this help and exit\n"
             "   -s, --server-name   publishes params from named server\n"
             "   -l, --lcm-url       Use this specified LCM URL\n"
+            "   -b, --binary        also publish compressed binary snapshots,\n"
+            "                       which clients load without parsing\n"
             "\n"
             , argv[0]);
 }
@@ -118,16 +157,18 @@ int main(int argc, char ** argv)
   }
 
 
-  char *optstring = "hs:l:";
+  char *optstring = "hs:l:b";
   struct option long_opts[] = {
       { "help", no_argument, NULL, 'h' },
       { "server-name", required_argument, NULL, 's' },
       { "lcm-url", required_argument, NULL, 'l' },
+      { "binary", no_argument, NULL, 'b' },
       { 0, 0, 0, 0 }
   };
   int c=-1;
   char *param_prefix = NULL;
   char *lcm_url = NULL;
+  int binary = 0;
   while ((c = getopt_long (argc, argv, optstring, long_opts, 0)) >= 0)
   {
       switch (c) {
@@ -137,6 +178,9 @@ int main(int argc, char ** argv)
       case 'l':
           lcm_url = optarg;
           break;
+      case 'b':
+          binary = 1;
+          break;
       case 'h':
       default:
           usage (argc, argv);
@@ -166,6 +210,9 @@ int main(int argc, char ** argv)
           BOT_PARAM_REQUEST_CHANNEL, NULL);
   self->set_channel = g_strconcat (param_prefix ? : "", 
           BOT_PARAM_SET_CHANNEL, NULL);
+  if (binary)
+    self->binary_channel = g_strconcat (param_prefix ? : "",
+            BOT_PARAM_UPDATE_BINARY_CHANNEL, NULL);
 
   bot_param_update_t_subscribe(self->lcm, self->update_channel, on_param_update, (void *) self);
   bot_param_request_t_subscribe(self->lcm, self->request_channel, on_param_request, (void *) self);
@@ -0,0 +1,37 @@
+/*
+ * param_snapshot.c
+ *
+ * Converts a config file to a binary snapshot that processes can load with
+ * bot_param_new_from_binary instead of parsing the config.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <bot_param/param_client.h>
+
+int main(int argc, char ** argv)
+{
+  if (argc != 3) {
+    fprintf(stderr, "usage:\n %s <param_file> <snapshot_file>\n", argv[0]);
+    exit(1);
+  }
+
+  BotParam * param = bot_param_new_from_file(argv[1]);
+  if (param == NULL) {
+    fprintf(stderr, "Could not load params from %s\n", argv[1]);
+    exit(1);
+  }
+
+  FILE * f = fopen(argv[2], "wb");
+  if (f == NULL) {
+    perror(argv[2]);
+    exit(1);
+  }
+  if (bot_param_write_binary(param, f) < 0 || fclose(f) != 0) {
+    fprintf(stderr, "Could not write snapshot to %s\n", argv[2]);
+    exit(1);
+  }
+
+  bot_param_destroy(param);
+  return 0;
+}
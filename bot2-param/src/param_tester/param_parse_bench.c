@@ -0,0 +1,180 @@
+/*
+ * param_parse_bench.c
+ *
+ * Measures how long it takes to load a config with bot_param_new_from_file
+ * and bot_param_new_from_string, and to load a binary snapshot of it with
+ * bot_param_new_from_binary.  Without a config file argument, a synthetic
+ * config of roughly the requested size is generated.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include <glib.h>
+
+#include <bot_param/param_client.h>
+
+static inline int64_t _timestamp_now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* writes a config of nested blocks with scalar, array and string values,
+ * until it is at least size bytes long */
+static GString * make_synthetic_config(int size)
+{
+  GString * cfg = g_string_new("# synthetic config for bot-param-parse-bench\n");
+  int block = 0;
+  while (cfg->len < size) {
+    g_string_append_printf(cfg, "sensor%d {\n", block);
+    g_string_append_printf(cfg, "    channel = \"SENSOR_%d\";   # comment\n", block);
+    g_string_append_printf(cfg, "    rate_hz = %d;\n", 10 + block % 90);
+    g_string_append_printf(cfg, "    enabled = true;\n");
+    g_string_append_printf(cfg, "    coord_frame {\n");
+    g_string_append_printf(cfg, "        relative_to = \"body\";\n");
+    g_string_append_printf(cfg, "        translation = [ %f, %f, %f ];\n", block * 0.01, -block * 0.02, 0.5);
+    g_string_append_printf(cfg, "        rpy = [ 0.0, %f, 90.0 ];\n", block * 0.1);
+    g_string_append_printf(cfg, "    }\n");
+    g_string_append_printf(cfg, "    gains {\n");
+    for (int i = 0; i < 8; i++)
+      g_string_append_printf(cfg, "        k%d = (double) %f;\n", i, block * 0.001 + i);
+    g_string_append_printf(cfg, "    }\n");
+    g_string_append_printf(cfg, "}\n");
+    block++;
+  }
+  return cfg;
+}
+
+static void usage(const char * progname)
+{
+  fprintf(stderr, "Usage: %s [options] [param_file]\n"
+      "Times parsing of param_file, or of a generated config\n"
+      "\n"
+      "Options:\n"
+      "   -h, --help          print this help and exit\n"
+      "   -n, --iterations N  number of times to parse (default 100)\n"
+      "   -s, --size KB       size of the generated config (default 300)\n"
+      "\n", progname);
+}
+
+int main(int argc, char ** argv)
+{
+  int iterations = 100;
+  int size_kb = 300;
+
+  const char *optstring = "hn:s:";
+  struct option long_opts[] = {
+      { "help", no_argument, NULL, 'h' },
+      { "iterations", required_argument, NULL, 'n' },
+      { "size", required_argument, NULL, 's' },
+      { 0, 0, 0, 0 }
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, optstring, long_opts, 0)) >= 0) {
+    switch (c) {
+    case 'n':
+      iterations = atoi(optarg);
+      break;
+    case 's':
+      size_kb = atoi(optarg);
+      break;
+    case 'h':
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (iterations <= 0 || size_kb <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  char * filename;
+  char * contents;
+  gsize len;
+  int remove_file = 0;
+  if (optind < argc) {
+    filename = g_strdup(argv[optind]);
+    if (!g_file_get_contents(filename, &contents, &len, NULL)) {
+      fprintf(stderr, "Could not read %s\n", filename);
+      return 1;
+    }
+  }
+  else {
+    GString * cfg = make_synthetic_config(size_kb * 1024);
+    len = cfg->len;
+    contents = g_string_free(cfg, FALSE);
+    filename = g_strdup("/tmp/bot-param-parse-bench-XXXXXX");
+    int fd = mkstemp(filename);
+    if (fd < 0 || write(fd, contents, len) != (ssize_t) len) {
+      perror("writing temporary config");
+      return 1;
+    }
+    close(fd);
+    remove_file = 1;
+  }
+
+  fprintf(stderr, "parsing %d bytes, %d iterations\n", (int) len, iterations);
+
+  int64_t start = _timestamp_now();
+  for (int i = 0; i < iterations; i++) {
+    BotParam * param = bot_param_new_from_file(filename);
+    if (!param) {
+      fprintf(stderr, "Could not parse %s\n", filename);
+      return 1;
+    }
+    bot_param_destroy(param);
+  }
+  double file_ms = (_timestamp_now() - start) * 1e-3 / iterations;
+
+  start = _timestamp_now();
+  for (int i = 0; i < iterations; i++) {
+    BotParam * param = bot_param_new_from_string(contents, len);
+    if (!param) {
+      fprintf(stderr, "Could not parse string\n");
+      return 1;
+    }
+    bot_param_destroy(param);
+  }
+  double string_ms = (_timestamp_now() - start) * 1e-3 / iterations;
+
+  char * snapshot_filename = g_strdup("/tmp/bot-param-parse-bench-bin-XXXXXX");
+  int fd = mkstemp(snapshot_filename);
+  FILE * f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+  BotParam * param = bot_param_new_from_string(contents, len);
+  if (!f || !param || bot_param_write_binary(param, f) < 0) {
+    perror("writing temporary snapshot");
+    return 1;
+  }
+  long snapshot_len = ftell(f);
+  fclose(f);
+  bot_param_destroy(param);
+
+  start = _timestamp_now();
+  for (int i = 0; i < iterations; i++) {
+    BotParam * param = bot_param_new_from_binary(snapshot_filename);
+    if (!param) {
+      fprintf(stderr, "Could not load snapshot\n");
+      return 1;
+    }
+    bot_param_destroy(param);
+  }
+  double binary_ms = (_timestamp_now() - start) * 1e-3 / iterations;
+
+  printf("bot_param_new_from_file:   %8.3f ms (%7.1f MB/s)\n", file_ms, len / (file_ms * 1e3));
+  printf("bot_param_new_from_string: %8.3f ms (%7.1f MB/s)\n", string_ms, len / (string_ms * 1e3));
+  printf("bot_param_new_from_binary: %8.3f ms (%ld byte snapshot)\n", binary_ms, snapshot_len);
+
+  unlink(snapshot_filename);
+  g_free(snapshot_filename);
+  if (remove_file)
+    unlink(filename);
+  g_free(filename);
+  g_free(contents);
+  return 0;
+}
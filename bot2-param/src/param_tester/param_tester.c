@@ -40,10 +40,14 @@ int main()
 
   bot_param_write(param, stderr);
 
+  char * key = "coordinate_frames.body.history";
+  BotParamHandle * history = bot_param_get_handle(param, key, BOT_PARAM_HANDLE_INT);
+
   while (1) {
     lcm_handle(lcm);
-    char * key = "coordinate_frames.body.history";
     fprintf(stderr, "%s = %d\n", key, bot_param_get_int_or_fail(param, key));
+    if (history != NULL)
+      fprintf(stderr, "%s (handle) = %d\n", key, bot_param_handle_get_int(history));
   }
   return 0;
 }